@@ -3,18 +3,43 @@
     {
       "target_name": "edcore",
       "sources": [
-        "src/core/array.h",
+        "src/core/buffer-arena.cc",
+        "src/core/buffer-arena.h",
+        "src/core/simd.cc",
+        "src/core/simd.h",
+        "src/core/mapped-file.cc",
+        "src/core/mapped-file.h",
+        "src/core/lz-codec.cc",
+        "src/core/lz-codec.h",
+        "src/core/leaf-cache.cc",
+        "src/core/leaf-cache.h",
         "src/core/buffer-string.cc",
         "src/core/buffer-string.h",
         "src/core/buffer-piece.cc",
         "src/core/buffer-piece.h",
+        "src/core/buffer-tree.cc",
+        "src/core/buffer-tree.h",
+        "src/core/buffer-regex.cc",
+        "src/core/buffer-regex.h",
+        "src/core/buffer-search.cc",
+        "src/core/buffer-search.h",
         "src/core/buffer.cc",
         "src/core/buffer.h",
+        "src/core/parallel-search.cc",
+        "src/core/parallel-search.h",
+        "src/core/trigram-index.cc",
+        "src/core/trigram-index.h",
+        "src/core/buffer-journal.cc",
+        "src/core/buffer-journal.h",
         "src/core/buffer-builder.cc",
         "src/core/buffer-builder.h",
         "src/node/ed-buffer-string.h",
         "src/node/ed-buffer-builder.cc",
         "src/node/ed-buffer-builder.h",
+        "src/node/ed-buffer-line-iterator.cc",
+        "src/node/ed-buffer-line-iterator.h",
+        "src/node/ed-buffer-snapshot.cc",
+        "src/node/ed-buffer-snapshot.h",
         "src/node/ed-buffer.cc",
         "src/node/ed-buffer.h",
         "node.cpp"
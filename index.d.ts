@@ -9,6 +9,18 @@ export interface IOffsetLenEdit {
     text: string;
 }
 
+export interface IPosition {
+    lineNumber: number;
+    column: number;
+}
+
+export interface ILeafCacheStats {
+    hits: number;
+    misses: number;
+    memUsage: number;
+    budget: number;
+}
+
 export declare class EdBuffer {
     _nativeEdBufferBrand: void;
     constructor();
@@ -16,10 +28,118 @@ export declare class EdBuffer {
     AssertInvariants(): void;
 
     GetLength(): number;
+    /**
+     * Waits for the line starts of a buffer loaded with `EdBufferBuilder.FromFile`, which are scanned in the background.
+     */
     GetLineCount(): number;
+    /**
+     * True while `GetLineCount` would wait. Line content and position queries only wait for the lines they need.
+     */
+    IsLineCountPending(): boolean;
     GetOffsetAt(lineNumber: number, column: number): number;
+    GetPositionAt(offset: number): IPosition;
+    /**
+     * Batch conversions in a single pass over the buffer. `offsets` and `lineNumbers` must be sorted ascending.
+     * Offsets are doubles, as in `FindAll`, so they hold the offsets of buffers larger than 4G. Throws a RangeError
+     * if a line number or column does not fit a Uint32Array.
+     */
+    GetPositionsAt(offsets: Float64Array, outLineNumbers: Uint32Array, outColumns: Uint32Array): void;
+    GetOffsetsAt(lineNumbers: Uint32Array, columns: Uint32Array, outOffsets: Float64Array): void;
     GetLineContent(lineNumber: number): string;
+    /**
+     * The offsets of the matches of `needle`, left to right and not overlapping. With `ignoreCase`, ascii letters
+     * match in either case. With `threadsCount` > 1 ranges of the buffer are searched on that many threads, the
+     * result is the same.
+     */
+    FindAll(needle: string, ignoreCase?: boolean, threadsCount?: number): Float64Array;
+    /**
+     * The first match that starts at or after `offset`, or with `backward` the last match that ends at or before it.
+     * Returns -1 if there is none.
+     */
+    FindNext(needle: string, offset: number, backward?: boolean, ignoreCase?: boolean): number;
+    /**
+     * The start and end offsets of the matches of the regular expression `pattern`, as pairs, left to right and not
+     * overlapping. Matches are leftmost-longest and `^ $` match at line breaks. Captures, lazy quantifiers, back
+     * references, lookarounds and `\b` are not supported. Throws if the pattern is not valid. `threadsCount` is as
+     * for `FindAll`.
+     */
+    FindAllRegex(pattern: string, ignoreCase?: boolean, threadsCount?: number): Float64Array;
     ReplaceOffsetLen(edits: IOffsetLenEdit[]): void;
+    /**
+     * Replaces the matches of `FindAll(needle, ignoreCase)` with `replacement` in one edit, which is recorded for
+     * undo like a ReplaceOffsetLen call. Returns the number of replacements.
+     */
+    ReplaceAll(needle: string, replacement: string, ignoreCase?: boolean): number;
+    /**
+     * Replaces the matches of `FindAllRegex(pattern, ignoreCase)` with `replacement`, like `ReplaceAll`. The
+     * replacement is literal text. Throws if `pattern` is not valid.
+     */
+    ReplaceAllRegex(pattern: string, replacement: string, ignoreCase?: boolean): number;
+
+    /**
+     * Record the inverse of each ReplaceOffsetLen call, using at most `bytes` of memory. 0 disables undo.
+     */
+    SetUndoMemoryCap(bytes: number): void;
+    Undo(): boolean;
+    Redo(): boolean;
+
+    /**
+     * In piece-table mode edits don't copy the text around them, leafs refer to the original text and to an add buffer.
+     */
+    SetPieceTableMode(enabled: boolean): void;
+
+    /**
+     * Keeps an index of the trigrams in each leaf, so `FindAll` only reads the leafs that can hold a match, on
+     * `threadsCount` threads too. Edits update it for the leafs they replace. Off by default, it takes about 6% of the memory of the text.
+     */
+    SetSearchIndex(enabled: boolean): void;
+    /**
+     * The memory of the buffer in bytes, with its search index and leaf cache.
+     */
+    GetMemUsage(): number;
+
+    /**
+     * Compresses the leafs that were not read or edited since the last call, returns how many. Length and line
+     * counts stay available without decompressing, reading a compressed leaf decompresses it into a cache.
+     */
+    CompressColdLeafs(): number;
+    /**
+     * The memory for decompressed leafs, 16 MB by default.
+     */
+    SetLeafCacheBudget(bytes: number): void;
+    GetLeafCacheStats(): ILeafCacheStats;
+
+    /**
+     * O(1), it doesn't wait for pending line starts: its line queries scan the lines they need, like the buffer's.
+     */
+    CreateSnapshot(): EdBufferSnapshot;
+    /**
+     * The iterator reads from a snapshot taken now, later edits are not visible to it. Lines are scanned as the
+     * iterator reaches them.
+     */
+    CreateLineIterator(lineNumber: number): EdBufferLineIterator;
+}
+
+export declare class EdBufferLineIterator {
+    _nativeEdBufferLineIteratorBrand: void;
+
+    GetLineNumber(): number;
+    GetLineLength(): number;
+    Seek(lineNumber: number): boolean;
+    Next(): boolean;
+    Prev(): boolean;
+    /**
+     * Writes the current line to `target` if it fits and returns the line length.
+     */
+    Read(target: Uint16Array): number;
+}
+
+export declare class EdBufferSnapshot {
+    _nativeEdBufferSnapshotBrand: void;
+
+    GetLength(): number;
+    GetLineCount(): number;
+    GetLineContent(lineNumber: number): string;
 }
 
 export declare class EdBufferBuilder {
@@ -28,6 +148,26 @@ export declare class EdBufferBuilder {
     constructor();
 
     AcceptChunk(chunk: string): void;
+    /**
+     * UTF-8 bytes, e.g. a `Buffer` from `fs.read`. A character may be split between chunks.
+     */
+    AcceptUtf8Chunk(chunk: Uint8Array): void;
     Finish(): string;
     Build(): EdBuffer;
+    /**
+     * Whether the buffer scans the line starts of `FromFile` in the background, on by default. Without it they
+     * stay pending until the line queries that need them scan them, so `IsLineCountPending` stays true until then.
+     */
+    SetScanLineStartsInBackground(enabled: boolean): void;
+
+    /**
+     * Returns a finished builder with the UTF-8 content of the file. The file is mapped, not read into strings.
+     * With `threadsCount` > 1 the file is decoded and scanned for lines by that many threads.
+     */
+    static FromFile(path: string, threadsCount?: number): EdBufferBuilder;
+    /**
+     * Like `FromFile`, for files that don't fit in memory: the leafs keep only their length and line count and
+     * are paged in from the file when they are read. `SetLeafCacheBudget` caps the memory for paged in leafs.
+     */
+    static FromFilePaged(path: string, threadsCount?: number): EdBufferBuilder;
 }
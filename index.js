@@ -7,3 +7,5 @@ const native = require('./build/Debug/edcore');
 
 exports.EdBuffer = native.EdBuffer;
 exports.EdBufferBuilder = native.EdBufferBuilder;
+exports.EdBufferSnapshot = native.EdBufferSnapshot;
+exports.EdBufferLineIterator = native.EdBufferLineIterator;
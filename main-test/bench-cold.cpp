@@ -0,0 +1,86 @@
+// Microbenchmark for compressing cold leafs: memory before and after `compressColdLeafs`, then random line reads
+// that decompress leafs into the leaf cache, compared to the same reads before compression.
+// ./bench.sh bench-cold.cpp && ./bench-cold [megabytes] [cache megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+
+#include "bench-util.h"
+
+#define FIXTURE "../test/fixtures/checker.txt"
+#define CHUNK_SIZE 65536
+#define READS 100000
+
+static double readLines(edcore::Buffer *buffer)
+{
+    vector<uint16_t> line;
+    const size_t lineCount = buffer->lineCount();
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t i = 0; i < READS; i++)
+    {
+        edcore::BufferCursor start, end;
+        buffer->findLine(1 + nextRandom() % lineCount, start, end);
+        line.resize(end.offset - start.offset);
+        buffer->extractString(start, line.size(), line.data());
+    }
+    return ms(t) * 1000000 / READS;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 64) * 1024 * 1024;
+
+    FILE *f = fopen(FIXTURE, "rb");
+    if (f == NULL)
+    {
+        printf("CANNOT OPEN FILE\n");
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    const size_t fixtureLength = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    vector<uint8_t> fixture(fixtureLength);
+    if (fread(fixture.data(), 1, fixtureLength, f) != fixtureLength)
+    {
+        printf("CANNOT READ FILE\n");
+        return 1;
+    }
+    fclose(f);
+
+    vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = fixture[i % fixtureLength];
+    }
+
+    edcore::BufferBuilder builder;
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        builder.acceptUtf8Chunk(data.data() + i, min((size_t)CHUNK_SIZE, size - i));
+    }
+    builder.finish();
+    edcore::Buffer *buffer = builder.build();
+    if (argc > 2)
+    {
+        buffer->setLeafCacheBudget(atol(argv[2]) * 1024 * 1024);
+    }
+    printf("loaded: %.1f MB\n", (double)buffer->memUsage() / 1024 / 1024);
+    printf("line read: %.0f ns\n", readLines(buffer));
+
+    // the first call only clears the flags of the leafs that were just read
+    buffer->compressColdLeafs();
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    const size_t compressedCount = buffer->compressColdLeafs();
+    printf("compressColdLeafs: %.1f ms (%zu of %zu leafs, %.1f MB)\n", ms(t), compressedCount, buffer->tree().leafsCount(), (double)buffer->memUsage() / 1024 / 1024);
+
+    const double compressedNs = readLines(buffer);
+    const edcore::LeafCacheStats stats = buffer->leafCacheStats();
+    printf("compressed line read: %.0f ns (%zu hits, %zu misses, %.1f MB cached)\n", compressedNs, stats.hits, stats.misses, (double)stats.memUsage / 1024 / 1024);
+
+    delete buffer;
+    return 0;
+}
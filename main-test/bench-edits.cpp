@@ -0,0 +1,89 @@
+// Microbenchmark for small edits: random single character inserts and deletes on a large buffer,
+// with the number of allocations per edit. A second argument of 1 edits in piece-table mode.
+// ./bench.sh bench-edits.cpp && ./bench-edits [megabytes] [pieceTable]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <new>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+
+#include "bench-util.h"
+
+#define CHUNK_SIZE 65536
+#define ITERATIONS 200000
+
+static size_t newCount = 0;
+
+void *operator new(size_t size)
+{
+    newCount++;
+    void *result = malloc(size);
+    if (result == NULL)
+    {
+        throw bad_alloc();
+    }
+    return result;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 64) * 1024 * 1024;
+    const bool pieceTable = (argc > 2 && atol(argv[2]) != 0);
+
+    // lines of 0..99 characters
+    char *chunk = new char[CHUNK_SIZE];
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+    {
+        chunk[i] = (nextRandom() % 100 == 0 ? '\n' : 'a' + i % 26);
+    }
+
+    edcore::BufferBuilder builder;
+    for (size_t built = 0; built < size; built += CHUNK_SIZE)
+    {
+        SimpleString str(chunk, CHUNK_SIZE);
+        builder.acceptChunk(&str);
+    }
+    builder.finish();
+    edcore::Buffer *buffer = builder.build();
+    buffer->setPieceTableMode(pieceTable);
+    delete[] chunk;
+
+    SimpleString typed("x", 1);
+    vector<edcore::OffsetLenEdit2> edits(1);
+    edits[0].initialIndex = 0;
+
+    size_t arenaAllocations = 0;
+    size_t arenaHeapAllocations = 0;
+    const size_t newCountBefore = newCount;
+
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; i++)
+    {
+        // alternate typing a character and deleting one, so the buffer keeps its size
+        const size_t length = buffer->length();
+        edits[0].offset = nextRandom() % length;
+        edits[0].length = (i % 2 == 0 ? 0 : 1);
+        edits[0].text = (i % 2 == 0 ? static_cast<edcore::BufferString *>(&typed) : edcore::BufferString::empty());
+        buffer->replaceOffsetLen(edits);
+
+        arenaAllocations += buffer->lastEditAllocations().allocations;
+        arenaHeapAllocations += buffer->lastEditAllocations().heapAllocations;
+    }
+    const double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t).count() / ITERATIONS;
+
+    printf("edit: %.1f ns\n", ns);
+    printf("arena allocations per edit: %.2f (%.4f from the heap)\n", (double)arenaAllocations / ITERATIONS, (double)arenaHeapAllocations / ITERATIONS);
+    printf("operator new per edit: %.2f\n", (double)(newCount - newCountBefore) / ITERATIONS);
+    printf("memory: %.1f MB\n", (double)buffer->memUsage() / 1024 / 1024);
+
+    delete buffer;
+    return 0;
+}
@@ -0,0 +1,68 @@
+// Microbenchmark for the tree index: random findOffset / findLine on a large buffer.
+// ./bench.sh bench-index.cpp && ./bench-index [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+
+#include "bench-util.h"
+
+#define CHUNK_SIZE 65536
+#define ITERATIONS 2000000
+
+static double elapsedNs(chrono::steady_clock::time_point start, size_t count)
+{
+    return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / count;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 1024) * 1024 * 1024;
+
+    // lines of 0..99 characters
+    char *chunk = new char[CHUNK_SIZE];
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+    {
+        chunk[i] = (nextRandom() % 100 == 0 ? '\n' : 'a' + i % 26);
+    }
+
+    edcore::BufferBuilder builder;
+    for (size_t built = 0; built < size; built += CHUNK_SIZE)
+    {
+        SimpleString str(chunk, CHUNK_SIZE);
+        builder.acceptChunk(&str);
+    }
+    builder.finish();
+    edcore::Buffer *buffer = builder.build();
+    delete[] chunk;
+
+    const size_t length = buffer->length();
+    const size_t lineCount = buffer->lineCount();
+    printf("length: %zu, lines: %zu, memUsage: %zu\n", length, lineCount, buffer->memUsage());
+
+    size_t checksum = 0;
+    edcore::BufferCursor start, end;
+
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; i++)
+    {
+        buffer->findOffset(nextRandom() % (length + 1), start);
+        checksum += start.leafIndex;
+    }
+    printf("findOffset: %.1f ns\n", elapsedNs(t, ITERATIONS));
+
+    t = chrono::steady_clock::now();
+    for (size_t i = 0; i < ITERATIONS; i++)
+    {
+        buffer->findLine(1 + nextRandom() % lineCount, start, end);
+        checksum += end.offset;
+    }
+    printf("findLine: %.1f ns\n", elapsedNs(t, ITERATIONS));
+
+    printf("checksum: %zu\n", checksum);
+    delete buffer;
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Microbenchmark for the line start scan: createLineStarts compared to memcpy, and loading a buffer.
+// ./bench.sh bench-line-starts.cpp && ./bench-line-starts [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+#include "../src/core/simd.h"
+
+#define FIXTURE "../test/fixtures/checker.txt"
+#define CHUNK_SIZE 65536
+
+static double gbPerSecond(chrono::steady_clock::time_point start, size_t bytes)
+{
+    return bytes / chrono::duration<double>(chrono::steady_clock::now() - start).count() / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 256) * 1024 * 1024;
+
+    FILE *f = fopen(FIXTURE, "rb");
+    if (f == NULL)
+    {
+        printf("CANNOT OPEN FILE\n");
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    const size_t fixtureLength = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *fixture = new uint8_t[fixtureLength];
+    if (fread(fixture, 1, fixtureLength, f) != fixtureLength)
+    {
+        printf("CANNOT READ FILE\n");
+        return 1;
+    }
+    fclose(f);
+
+    // repeat the fixture, in one and two byte form
+    uint8_t *oneByte = new uint8_t[size];
+    uint16_t *twoByte = new uint16_t[size];
+    for (size_t i = 0; i < size; i++)
+    {
+        oneByte[i] = fixture[i % fixtureLength];
+        twoByte[i] = oneByte[i];
+    }
+    delete[] fixture;
+
+    // touch all the memory up front so page faults are not measured
+    vector<uint32_t> lineStarts(size / 16);
+    lineStarts.clear();
+    uint8_t *copy = new uint8_t[size * sizeof(uint16_t)];
+    memset(copy, 0, size * sizeof(uint16_t));
+
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    memcpy(copy, oneByte, size);
+    printf("memcpy, 1 byte: %.2f GB/s\n", gbPerSecond(t, size));
+
+    t = chrono::steady_clock::now();
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        edcore::createLineStarts(oneByte + i, min((size_t)CHUNK_SIZE, size - i), lineStarts);
+    }
+    printf("createLineStarts, 1 byte: %.2f GB/s (%zu lines)\n", gbPerSecond(t, size), lineStarts.size());
+
+    t = chrono::steady_clock::now();
+    memcpy(copy, twoByte, size * sizeof(uint16_t));
+    printf("memcpy, 2 bytes: %.2f GB/s\n", gbPerSecond(t, size * sizeof(uint16_t)));
+
+    lineStarts.clear();
+    t = chrono::steady_clock::now();
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        edcore::createLineStarts(twoByte + i, min((size_t)CHUNK_SIZE, size - i), lineStarts);
+    }
+    printf("createLineStarts, 2 bytes: %.2f GB/s (%zu lines)\n", gbPerSecond(t, size * sizeof(uint16_t)), lineStarts.size());
+
+    delete[] copy;
+    delete[] oneByte;
+
+    t = chrono::steady_clock::now();
+    edcore::BufferBuilder builder;
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        edcore::TwoByteArrayString str(twoByte + i, min((size_t)CHUNK_SIZE, size - i));
+        builder.acceptChunk(&str);
+    }
+    builder.finish();
+    edcore::Buffer *buffer = builder.build();
+    printf("load, 2 bytes: %.2f GB/s (%zu lines)\n", gbPerSecond(t, size * sizeof(uint16_t)), buffer->lineCount());
+
+    delete buffer;
+    delete[] twoByte;
+    return 0;
+}
@@ -0,0 +1,128 @@
+// Microbenchmark for loading a file: BufferBuilder::fromFile compared to the line start scan and to accepting chunks.
+// fromFile leaves the line starts to a background scan, the times after it are since the start of the load.
+// With threads, fromFile decodes and scans the chunks on all of them and the times include the line count.
+// ./bench.sh bench-load.cpp && ./bench-load [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+#include "../src/core/simd.h"
+
+#include "bench-util.h"
+
+#define FIXTURE "../test/fixtures/checker.txt"
+#define FILE_NAME "bench-load.tmp"
+#define CHUNK_SIZE 65536
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 256) * 1024 * 1024;
+
+    FILE *f = fopen(FIXTURE, "rb");
+    if (f == NULL)
+    {
+        printf("CANNOT OPEN FILE\n");
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    const size_t fixtureLength = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *fixture = new uint8_t[fixtureLength];
+    if (fread(fixture, 1, fixtureLength, f) != fixtureLength)
+    {
+        printf("CANNOT READ FILE\n");
+        return 1;
+    }
+    fclose(f);
+
+    // repeat the fixture, the file stays in the page cache for the runs below
+    uint8_t *data = new uint8_t[size];
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = fixture[i % fixtureLength];
+    }
+    delete[] fixture;
+    f = fopen(FILE_NAME, "wb");
+    fwrite(data, 1, size, f);
+    fclose(f);
+
+    vector<uint32_t> lineStarts(size / 16);
+    lineStarts.clear();
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        edcore::createLineStarts(data + i, min((size_t)CHUNK_SIZE, size - i), lineStarts);
+    }
+    printf("createLineStarts: %.1f ms (%zu lines)\n", ms(t), lineStarts.size());
+
+    t = chrono::steady_clock::now();
+    edcore::BufferBuilder builder;
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        SimpleString str(data + i, min((size_t)CHUNK_SIZE, size - i));
+        builder.acceptChunk(&str);
+    }
+    builder.finish();
+    edcore::Buffer *buffer = builder.build();
+    printf("acceptChunk: %.1f ms (%zu lines, %.1f MB)\n", ms(t), buffer->lineCount(), (double)buffer->memUsage() / 1024 / 1024);
+    delete buffer;
+
+    t = chrono::steady_clock::now();
+    edcore::BufferBuilder utf8Builder;
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        utf8Builder.acceptUtf8Chunk(data + i, min((size_t)CHUNK_SIZE, size - i));
+    }
+    utf8Builder.finish();
+    buffer = utf8Builder.build();
+    printf("acceptUtf8Chunk: %.1f ms (%zu lines)\n", ms(t), buffer->lineCount());
+    delete buffer;
+
+    // mostly ascii with a two byte character every 64 bytes, like source code with a few accents
+    for (size_t i = 0; i + 1 < size; i += 64)
+    {
+        data[i] = 0xC3;
+        data[i + 1] = 0xA9;
+    }
+    vector<uint16_t> decoded(CHUNK_SIZE);
+    t = chrono::steady_clock::now();
+    size_t decodedLength = 0;
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        decodedLength += edcore::decodeUtf8(data + i, min((size_t)CHUNK_SIZE, size - i), &decoded[0]);
+    }
+    printf("decodeUtf8: %.1f ms (%zu chars)\n", ms(t), decodedLength);
+    delete[] data;
+
+    t = chrono::steady_clock::now();
+    edcore::BufferBuilder *fileBuilder = edcore::BufferBuilder::fromFile(FILE_NAME);
+    buffer = fileBuilder->build();
+    delete fileBuilder;
+    printf("fromFile: %.1f ms\n", ms(t));
+
+    // the line starts are scanned in the background, the start of the file is usable right away
+    edcore::BufferCursor start, end;
+    buffer->findLine(50, start, end);
+    printf("first 50 lines: %.1f ms (line count pending: %d)\n", ms(t), buffer->isLineCountPending());
+    const size_t lineCount = buffer->lineCount();
+    printf("line count: %.1f ms (%zu lines, %.1f MB)\n", ms(t), lineCount, (double)buffer->memUsage() / 1024 / 1024);
+    delete buffer;
+
+    // the same pieces, decoded and scanned for line starts by a number of threads
+    for (size_t threadsCount = 1; threadsCount <= 16; threadsCount *= 2)
+    {
+        t = chrono::steady_clock::now();
+        fileBuilder = edcore::BufferBuilder::fromFile(FILE_NAME, threadsCount);
+        buffer = fileBuilder->build();
+        delete fileBuilder;
+        const size_t threadsLineCount = buffer->lineCount();
+        printf("fromFile with %zu threads: %.1f ms (%zu lines)\n", threadsCount, ms(t), threadsLineCount);
+        delete buffer;
+    }
+
+    remove(FILE_NAME);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Microbenchmark for the memory of mostly Latin-1 text with a few wide chars: a loaded file with a CJK char every
+// few kilobytes, then emoji typed at random offsets into an ascii buffer and deleted again.
+// ./bench.sh bench-mixed.cpp && ./bench-mixed [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+
+#include "bench-util.h"
+
+#define CHUNK_SIZE 65536
+#define WIDE_CHAR_DISTANCE 4096
+#define EMOJI_COUNT 2000
+
+static edcore::Buffer *buildBuffer(const uint16_t *chunk, size_t size)
+{
+    edcore::BufferBuilder builder;
+    for (size_t built = 0; built < size; built += CHUNK_SIZE)
+    {
+        edcore::TwoByteArrayString str(chunk, CHUNK_SIZE);
+        builder.acceptChunk(&str);
+    }
+    builder.finish();
+    return builder.build();
+}
+
+static double mb(const edcore::Buffer *buffer)
+{
+    return (double)buffer->memUsage() / 1024 / 1024;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 64) * 1024 * 1024;
+
+    // lines of 0..99 characters
+    uint16_t *chunk = new uint16_t[CHUNK_SIZE];
+    for (size_t i = 0; i < CHUNK_SIZE; i++)
+    {
+        chunk[i] = (nextRandom() % 100 == 0 ? '\n' : 'a' + i % 26);
+    }
+    edcore::Buffer *buffer = buildBuffer(chunk, size);
+    printf("ascii: %.1f MB\n", mb(buffer));
+    delete buffer;
+
+    for (size_t i = WIDE_CHAR_DISTANCE / 2; i < CHUNK_SIZE; i += WIDE_CHAR_DISTANCE)
+    {
+        chunk[i] = 0x6F22;
+    }
+    buffer = buildBuffer(chunk, size);
+    printf("a wide char every %d chars: %.1f MB\n", WIDE_CHAR_DISTANCE, mb(buffer));
+    delete buffer;
+
+    for (size_t i = WIDE_CHAR_DISTANCE / 2; i < CHUNK_SIZE; i += WIDE_CHAR_DISTANCE)
+    {
+        chunk[i] = 'x';
+    }
+    buffer = buildBuffer(chunk, size);
+    delete[] chunk;
+
+    const uint16_t emoji[2] = {0xD83D, 0xDE00};
+    edcore::TwoByteArrayString typed(emoji, 2);
+    vector<edcore::OffsetLenEdit2> edits(1);
+    edits[0].initialIndex = 0;
+    edits[0].length = 0;
+    edits[0].text = &typed;
+    vector<size_t> offsets;
+
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t i = 0; i < EMOJI_COUNT; i++)
+    {
+        // between two chars, never inside an emoji typed before
+        const size_t lineNumber = 1 + nextRandom() % (buffer->lineCount() - 1);
+        edcore::BufferCursor start, end;
+        buffer->findLine(lineNumber, start, end);
+        edits[0].offset = start.offset;
+        buffer->replaceOffsetLen(edits);
+        for (size_t j = 0; j < offsets.size(); j++)
+        {
+            offsets[j] += (offsets[j] >= start.offset ? 2 : 0);
+        }
+        offsets.push_back(start.offset);
+    }
+    const double typeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - t).count();
+    printf("%d emoji typed: %.1f MB (%.1f ms)\n", EMOJI_COUNT, mb(buffer), typeMs);
+
+    // delete them again, the leafs they were in are Latin-1 again
+    edits[0].text = edcore::BufferString::empty();
+    edits[0].length = 2;
+    sort(offsets.begin(), offsets.end());
+    for (size_t i = offsets.size(); i > 0; i--)
+    {
+        edits[0].offset = offsets[i - 1];
+        buffer->replaceOffsetLen(edits);
+    }
+    printf("emoji deleted: %.1f MB (%zu chars)\n", mb(buffer), buffer->length());
+
+    delete buffer;
+    return 0;
+}
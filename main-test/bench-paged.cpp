@@ -0,0 +1,106 @@
+// Microbenchmark for paged buffers: BufferBuilder::fromFilePaged compared to fromFile, the memory of the buffer
+// and the resident memory of the process after loading and after random line reads.
+// The resident memory is read from /proc, so it is only printed on Linux.
+// ./bench.sh bench-paged.cpp && ./bench-paged [megabytes] [cache megabytes] [threads]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <chrono>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+
+#include "bench-util.h"
+
+#define FIXTURE "../test/fixtures/checker.txt"
+#define FILE_NAME "bench-paged.tmp"
+#define READS 100000
+
+static double residentMB()
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f == NULL)
+    {
+        return 0;
+    }
+    size_t size = 0, resident = 0;
+    if (fscanf(f, "%zu %zu", &size, &resident) != 2)
+    {
+        resident = 0;
+    }
+    fclose(f);
+    return (double)resident * sysconf(_SC_PAGESIZE) / 1024 / 1024;
+}
+
+static double readLines(edcore::Buffer *buffer)
+{
+    vector<uint16_t> line;
+    const size_t lineCount = buffer->lineCount();
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t i = 0; i < READS; i++)
+    {
+        edcore::BufferCursor start, end;
+        buffer->findLine(1 + nextRandom() % lineCount, start, end);
+        line.resize(end.offset - start.offset);
+        buffer->extractString(start, line.size(), line.data());
+    }
+    return ms(t) * 1000000 / READS;
+}
+
+static void report(const char *name, edcore::BufferBuilder *builder, size_t cacheBudget, chrono::steady_clock::time_point t)
+{
+    edcore::Buffer *buffer = builder->build();
+    delete builder;
+    buffer->setLeafCacheBudget(cacheBudget);
+    const size_t lineCount = buffer->lineCount();
+    printf("%s: %.1f ms (%zu lines, %.1f MB, %.1f MB resident)\n", name, ms(t), lineCount, (double)buffer->memUsage() / 1024 / 1024, residentMB());
+
+    const double readNs = readLines(buffer);
+    const edcore::LeafCacheStats stats = buffer->leafCacheStats();
+    printf("  line read: %.0f ns (%zu misses, %.1f MB, %.1f MB resident)\n", readNs, stats.misses, (double)buffer->memUsage() / 1024 / 1024, residentMB());
+    delete buffer;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 1024) * 1024 * 1024;
+    const size_t cacheBudget = (argc > 2 ? atol(argv[2]) : 16) * 1024 * 1024;
+    const size_t threadsCount = (argc > 3 ? atol(argv[3]) : 4);
+
+    FILE *f = fopen(FIXTURE, "rb");
+    if (f == NULL)
+    {
+        printf("CANNOT OPEN FILE\n");
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    const size_t fixtureLength = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    vector<uint8_t> fixture(fixtureLength);
+    if (fread(fixture.data(), 1, fixtureLength, f) != fixtureLength)
+    {
+        printf("CANNOT READ FILE\n");
+        return 1;
+    }
+    fclose(f);
+
+    // written in pieces, so the process never holds the whole file
+    f = fopen(FILE_NAME, "wb");
+    for (size_t written = 0; written < size; written += fixtureLength)
+    {
+        fwrite(fixture.data(), 1, min(fixtureLength, size - written), f);
+    }
+    fclose(f);
+    printf("start: %.1f MB resident\n", residentMB());
+
+    // paged first, the memory that fromFile gives back is not always returned to the system
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    report("fromFilePaged", edcore::BufferBuilder::fromFilePaged(FILE_NAME, threadsCount), cacheBudget, t);
+
+    t = chrono::steady_clock::now();
+    report("fromFile", edcore::BufferBuilder::fromFile(FILE_NAME, threadsCount), cacheBudget, t);
+
+    remove(FILE_NAME);
+    return 0;
+}
@@ -0,0 +1,240 @@
+// Microbenchmark for searching a buffer built from checker.txt repeated up to the given size: `findAll` for a
+// rare and a frequent needle, with and without ignoring case, `findNext` from random offsets in both directions,
+// `findAllRegex` for a few patterns, one of them anchored at line starts, how both scale on 1 to 16 threads, and
+// `findAll` with the search index for needles that are in every leaf and in a few, and `replaceAll` against
+// `findAll` followed by `replaceOffsetLen` with a text per edit, as a replace of all matches from JavaScript does.
+// ./bench.sh bench-search.cpp && ./bench-search [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "../src/core/buffer.h"
+#include "../src/core/buffer-builder.h"
+
+#include "bench-util.h"
+
+#define FIXTURE "../test/fixtures/checker.txt"
+#define CHUNK_SIZE 65536
+#define FIND_NEXT_COUNT 10000
+
+static void benchFindAll(edcore::Buffer *buffer, const char *needle, bool ignoreCase)
+{
+    SimpleString str(needle);
+    edcore::SearchOptions options;
+    options.ignoreCase = ignoreCase;
+    vector<size_t> result;
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    buffer->findAll(&str, options, result);
+    const double elapsed = ms(t);
+    printf("findAll \"%s\"%s: %.1f ms (%zu matches, %.0f MB/s)\n", needle, (ignoreCase ? " ignoring case" : ""), elapsed, result.size(), (double)buffer->length() / 1024 / 1024 / (elapsed / 1000));
+}
+
+static void benchFindNext(edcore::Buffer *buffer, const char *needle, bool backward)
+{
+    SimpleString str(needle);
+    edcore::SearchOptions options;
+    options.ignoreCase = false;
+    size_t found = 0;
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t i = 0; i < FIND_NEXT_COUNT; i++)
+    {
+        edcore::BufferCursor from;
+        buffer->findOffset(nextRandom() % buffer->length(), from);
+        size_t result;
+        found += buffer->findNext(&str, options, from, backward, result);
+    }
+    printf("findNext \"%s\"%s: %.2f us (%zu found)\n", needle, (backward ? " backward" : ""), ms(t) * 1000 / FIND_NEXT_COUNT, found);
+}
+
+static void benchFindAllRegex(edcore::Buffer *buffer, const char *pattern, bool ignoreCase)
+{
+    SimpleString str(pattern);
+    edcore::SearchOptions options;
+    options.ignoreCase = ignoreCase;
+    vector<size_t> result;
+    string error;
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    if (!buffer->findAllRegex(&str, options, result, error))
+    {
+        printf("findAllRegex /%s/: %s\n", pattern, error.c_str());
+        return;
+    }
+    const double elapsed = ms(t);
+    printf("findAllRegex /%s/%s: %.1f ms (%zu matches, %.0f MB/s)\n", pattern, (ignoreCase ? "i" : ""), elapsed, result.size() / 2, (double)buffer->length() / 1024 / 1024 / (elapsed / 1000));
+}
+
+static void benchThreads(edcore::Buffer *buffer, const char *pattern, bool regex)
+{
+    SimpleString str(pattern);
+    edcore::SearchOptions options;
+    options.ignoreCase = false;
+    double singleThread = 0;
+    for (size_t threadsCount = 1; threadsCount <= 16; threadsCount *= 2)
+    {
+        vector<size_t> result;
+        string error;
+        chrono::steady_clock::time_point t = chrono::steady_clock::now();
+        if (regex)
+        {
+            buffer->findAllRegex(&str, options, result, error, threadsCount);
+        }
+        else
+        {
+            buffer->findAll(&str, options, result, threadsCount);
+        }
+        const double elapsed = ms(t);
+        singleThread = (threadsCount == 1 ? elapsed : singleThread);
+        printf("%s %s%s%s on %zu thread%s: %.1f ms (%.0f MB/s, %.1fx)\n", (regex ? "findAllRegex" : "findAll"), (regex ? "/" : "\""), pattern, (regex ? "/" : "\""), threadsCount, (threadsCount == 1 ? "" : "s"), elapsed, (double)buffer->length() / 1024 / 1024 / (elapsed / 1000), singleThread / elapsed);
+    }
+}
+
+static void benchSearchIndex(edcore::Buffer *buffer)
+{
+    // a needle that is in a few leafs only
+    SimpleString rare("zqxRareNeedlezqx");
+    for (size_t i = 0; i < 8; i++)
+    {
+        vector<edcore::OffsetLenEdit2> edits(1);
+        edits[0].initialIndex = 0;
+        edits[0].offset = nextRandom() % buffer->length();
+        edits[0].length = 0;
+        edits[0].text = &rare;
+        buffer->replaceOffsetLen(edits);
+    }
+
+    const size_t memUsage = buffer->memUsage();
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    buffer->setSearchIndex(true);
+    printf("setSearchIndex: %.1f ms (%.1f MB, %.1f%% of the buffer)\n", ms(t), (double)(buffer->memUsage() - memUsage) / 1024 / 1024, 100.0 * (buffer->memUsage() - memUsage) / memUsage);
+
+    const char *needles[] = {"zqxRareNeedlezqx", "getSymbolOfNode"};
+    for (size_t i = 0; i < 2; i++)
+    {
+        SimpleString str(needles[i]);
+        edcore::SearchOptions options;
+        options.ignoreCase = false;
+        for (size_t indexed = 0; indexed < 2; indexed++)
+        {
+            buffer->setSearchIndex(indexed != 0);
+            vector<size_t> result;
+            t = chrono::steady_clock::now();
+            buffer->findAll(&str, options, result);
+            printf("findAll \"%s\" %s index: %.2f ms (%zu matches)\n", needles[i], (indexed ? "with" : "without"), ms(t), result.size());
+        }
+    }
+
+    // an edit indexes only the leafs it creates
+    vector<edcore::OffsetLenEdit2> edits(1);
+    edits[0].initialIndex = 0;
+    edits[0].offset = nextRandom() % buffer->length();
+    edits[0].length = 0;
+    edits[0].text = &rare;
+    t = chrono::steady_clock::now();
+    buffer->replaceOffsetLen(edits);
+    printf("replaceOffsetLen with index: %.3f ms\n", ms(t));
+    buffer->setSearchIndex(false);
+}
+
+static void benchReplaceAll(edcore::Buffer *buffer, const char *needle, const char *replacement)
+{
+    SimpleString str(needle);
+    SimpleString replacementStr(replacement);
+    edcore::SearchOptions options;
+    options.ignoreCase = false;
+
+    // every edit with its own text, then undone
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    vector<size_t> offsets;
+    buffer->findAll(&str, options, offsets);
+    vector<SimpleString *> texts(offsets.size());
+    vector<edcore::OffsetLenEdit2> edits(offsets.size());
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+        texts[i] = new SimpleString(replacement);
+        edits[i].initialIndex = i;
+        edits[i].offset = offsets[i];
+        edits[i].length = str.length();
+        edits[i].text = texts[i];
+    }
+    edcore::EditBatch *inverse = new edcore::EditBatch();
+    buffer->replaceOffsetLen(edits, inverse);
+    printf("findAll + replaceOffsetLen \"%s\": %.1f ms (%zu edits)\n", needle, ms(t), offsets.size());
+    for (size_t i = 0; i < texts.size(); i++)
+    {
+        delete texts[i];
+    }
+    buffer->replaceOffsetLen(inverse->edits());
+    delete inverse;
+
+    t = chrono::steady_clock::now();
+    inverse = new edcore::EditBatch();
+    const size_t count = buffer->replaceAll(&str, options, &replacementStr, inverse);
+    printf("replaceAll \"%s\": %.1f ms (%zu replacements)\n", needle, ms(t), count);
+    buffer->replaceOffsetLen(inverse->edits());
+    delete inverse;
+
+    t = chrono::steady_clock::now();
+    buffer->replaceAll(&str, options, &replacementStr);
+    printf("replaceAll \"%s\" without inverse: %.1f ms\n", needle, ms(t));
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 256) * 1024 * 1024;
+
+    FILE *f = fopen(FIXTURE, "rb");
+    if (f == NULL)
+    {
+        printf("CANNOT OPEN FILE\n");
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    const size_t fixtureLength = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    vector<uint8_t> fixture(fixtureLength);
+    if (fread(fixture.data(), 1, fixtureLength, f) != fixtureLength)
+    {
+        printf("CANNOT READ FILE\n");
+        return 1;
+    }
+    fclose(f);
+
+    vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = fixture[i % fixtureLength];
+    }
+
+    edcore::BufferBuilder builder;
+    for (size_t i = 0; i < size; i += CHUNK_SIZE)
+    {
+        builder.acceptUtf8Chunk(data.data() + i, min((size_t)CHUNK_SIZE, size - i));
+    }
+    builder.finish();
+    edcore::Buffer *buffer = builder.build();
+    printf("loaded: %.1f MB, %zu leafs\n", (double)buffer->length() / 1024 / 1024, buffer->tree().leafsCount());
+
+    benchFindAll(buffer, "getSymbolOfNode", false);
+    benchFindAll(buffer, "getsymbolofnode", true);
+    benchFindAll(buffer, "node", false);
+    benchFindAll(buffer, "NODE", true);
+    benchFindNext(buffer, "getSymbolOfNode", false);
+    benchFindNext(buffer, "getSymbolOfNode", true);
+    benchFindAllRegex(buffer, "getSymbolOfNode", false);
+    benchFindAllRegex(buffer, "get[A-Z]\\w*Of(Node|Type)\\(", false);
+    benchFindAllRegex(buffer, "getsymbolofnode", true);
+    benchFindAllRegex(buffer, "^\\s*function \\w+", false);
+    benchFindAllRegex(buffer, "\\d+", false);
+    benchThreads(buffer, "getSymbolOfNode", false);
+    benchThreads(buffer, "node", false);
+    benchThreads(buffer, "get[A-Z]\\w*Of(Node|Type)\\(", true);
+    benchThreads(buffer, "^\\s*function \\w+", true);
+    benchSearchIndex(buffer);
+    benchReplaceAll(buffer, "getSymbolOfNode", "getSymbolOfNodeOrType");
+    benchReplaceAll(buffer, "node", "n");
+
+    delete buffer;
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Microbenchmark for the transcoding kernels compared to scalar loops, on ASCII and on mixed text.
+// ./bench.sh bench-transcode.cpp && ./bench-transcode [megabytes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "../src/core/simd.h"
+
+#define REPEAT 10
+
+static double gbPerSecond(chrono::steady_clock::time_point start, size_t bytes)
+{
+    return bytes * REPEAT / chrono::duration<double>(chrono::steady_clock::now() - start).count() / 1e9;
+}
+
+// keep the compiler from vectorizing the scalar loops, so they show what the kernels replaced
+__attribute__((optimize("no-tree-vectorize"))) static void widenScalar(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+__attribute__((optimize("no-tree-vectorize"))) static void narrowScalar(const uint16_t *src, size_t length, uint8_t *dst)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+__attribute__((noinline, optimize("no-tree-vectorize"))) static bool containsOnlyOneByteScalar(const uint16_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (data[i] >= 256)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void run(const char *name, const uint16_t *twoByte, size_t size)
+{
+    uint8_t *oneByte = new uint8_t[size];
+    uint16_t *widened = new uint16_t[size];
+    memset(widened, 0, size * sizeof(uint16_t));
+    edcore::narrowToOneByte(twoByte, size, oneByte);
+
+    chrono::steady_clock::time_point t = chrono::steady_clock::now();
+    for (size_t r = 0; r < REPEAT; r++)
+    {
+        widenScalar(oneByte, size, widened);
+    }
+    printf("%s, widen, scalar: %.2f GB/s\n", name, gbPerSecond(t, size));
+
+    t = chrono::steady_clock::now();
+    for (size_t r = 0; r < REPEAT; r++)
+    {
+        edcore::widenOneByte(oneByte, size, widened);
+    }
+    printf("%s, widen, simd: %.2f GB/s\n", name, gbPerSecond(t, size));
+
+    t = chrono::steady_clock::now();
+    for (size_t r = 0; r < REPEAT; r++)
+    {
+        narrowScalar(twoByte, size, oneByte);
+    }
+    printf("%s, narrow, scalar: %.2f GB/s\n", name, gbPerSecond(t, size * sizeof(uint16_t)));
+
+    t = chrono::steady_clock::now();
+    for (size_t r = 0; r < REPEAT; r++)
+    {
+        edcore::narrowToOneByte(twoByte, size, oneByte);
+    }
+    printf("%s, narrow, simd: %.2f GB/s\n", name, gbPerSecond(t, size * sizeof(uint16_t)));
+
+    bool result = true;
+    t = chrono::steady_clock::now();
+    for (size_t r = 0; r < REPEAT; r++)
+    {
+        asm volatile("" : : : "memory");
+        result &= containsOnlyOneByteScalar(twoByte, size);
+    }
+    printf("%s, containsOnlyOneByte, scalar: %.2f GB/s (%d)\n", name, gbPerSecond(t, size * sizeof(uint16_t)), result);
+
+    result = true;
+    t = chrono::steady_clock::now();
+    for (size_t r = 0; r < REPEAT; r++)
+    {
+        asm volatile("" : : : "memory");
+        result &= edcore::containsOnlyOneByte(twoByte, size);
+    }
+    printf("%s, containsOnlyOneByte, simd: %.2f GB/s (%d)\n", name, gbPerSecond(t, size * sizeof(uint16_t)), result);
+
+    delete[] widened;
+    delete[] oneByte;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t size = (argc > 1 ? atol(argv[1]) : 64) * 1024 * 1024;
+
+    uint16_t *ascii = new uint16_t[size];
+    uint16_t *mixed = new uint16_t[size];
+    for (size_t i = 0; i < size; i++)
+    {
+        ascii[i] = (i % 80 == 79 ? '\n' : 'a' + i % 26);
+        mixed[i] = ascii[i];
+    }
+    // one non Latin-1 character at the very end, so the check has to read everything
+    mixed[size - 1] = 0x20AC;
+
+    run("ascii", ascii, size);
+    run("mixed", mixed, size);
+
+    delete[] mixed;
+    delete[] ascii;
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+// Helpers shared by the microbenchmarks, each benchmark is a single translation unit that includes this once.
+
+#ifndef EDCORE_BENCH_UTIL_H_
+#define EDCORE_BENCH_UTIL_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+
+#include "../src/core/buffer-string.h"
+#include "../src/core/simd.h"
+
+using namespace std;
+
+/**
+ * One-byte chars that the caller keeps alive, `data` is not copied.
+ */
+class SimpleString : public edcore::BufferString
+{
+  public:
+    SimpleString(const char *data, size_t len) { data_ = reinterpret_cast<const uint8_t *>(data); len_ = len; }
+    SimpleString(const uint8_t *data, size_t len) { data_ = data; len_ = len; }
+    explicit SimpleString(const char *str) { data_ = reinterpret_cast<const uint8_t *>(str); len_ = strlen(str); }
+
+    size_t length() const { return len_; }
+    void write(uint16_t *buffer, size_t start, size_t length) const
+    {
+        edcore::widenOneByte(data_ + start, length, buffer);
+    }
+    void writeOneByte(uint8_t *buffer, size_t start, size_t length) const
+    {
+        memcpy(buffer, data_ + start, length);
+    }
+    bool isOneByte() const { return true; }
+    bool containsOnlyOneByte() const { return true; }
+
+  private:
+    const uint8_t *data_;
+    size_t len_;
+};
+
+// xorshift, the same sequence on every run
+static uint64_t rngState = 0x9E3779B97F4A7C15ULL;
+static inline size_t nextRandom()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 7;
+    rngState ^= rngState << 17;
+    return rngState;
+}
+
+static inline double ms(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+#endif
@@ -0,0 +1,18 @@
+# ./bench.sh bench-index.cpp && ./bench-index
+g++ -std=c++11 -O2 -o "${1%.cpp}" "$1" \
+        ../src/core/simd.cc \
+        ../src/core/buffer-arena.cc \
+        ../src/core/mapped-file.cc \
+        ../src/core/lz-codec.cc \
+        ../src/core/leaf-cache.cc \
+        ../src/core/buffer-string.cc \
+        ../src/core/buffer-piece.cc \
+        ../src/core/buffer-tree.cc \
+        ../src/core/buffer-regex.cc \
+        ../src/core/buffer-search.cc \
+        ../src/core/buffer.cc \
+        ../src/core/parallel-search.cc \
+        ../src/core/trigram-index.cc \
+        ../src/core/buffer-journal.cc \
+        ../src/core/buffer-builder.cc \
+        -lpthread
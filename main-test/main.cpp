@@ -101,10 +101,9 @@ int main(void) {
 edcore::Buffer *buildBufferFromFixture(const char *filename) {
 
     edcore::BufferBuilder *builder = new edcore::BufferBuilder();
-    char *buff = new char[CHUNK_SIZE];
-    uint16_t *buff2 = new uint16_t[CHUNK_SIZE];
+    uint8_t *buff = new uint8_t[CHUNK_SIZE];
 
-    FILE *f = fopen(FIXTURE, "rt");
+    FILE *f = fopen(FIXTURE, "rb");
     if (f == NULL)
     {
         printf("CANNOT OPEN FILE\n");
@@ -113,20 +112,15 @@ edcore::Buffer *buildBufferFromFixture(const char *filename) {
     while (!feof(f))
     {
         size_t read = fread(buff, 1, CHUNK_SIZE, f);
-        for (size_t i = 0; i < read; i++)
-        {
-            buff2[i] = buff[i];
-        }
-        builder->AcceptChunk(buff2, read);
+        builder->acceptUtf8Chunk(buff, read);
     }
     fclose(f);
 
     delete []buff;
-    delete []buff2;
 
-    builder->Finish();
+    builder->finish();
 
-    edcore::Buffer *result = builder->Build();
+    edcore::Buffer *result = builder->build();
     delete builder;
     return result;
 
@@ -8,15 +8,21 @@
 
 #include "src/node/ed-buffer-builder.h"
 #include "src/node/ed-buffer.h"
+#include "src/node/ed-buffer-snapshot.h"
+#include "src/node/ed-buffer-line-iterator.h"
 
 v8::Persistent<v8::Function> EdBuffer::constructor;
 v8::Persistent<v8::Function> EdBufferBuilder::constructor;
+v8::Persistent<v8::Function> EdBufferSnapshot::constructor;
+v8::Persistent<v8::Function> EdBufferLineIterator::constructor;
 
 void init(v8::Local<v8::Object> exports)
 {
     // NODE_SET_METHOD(exports, "createBuffer", _createBuffer);
     EdBuffer::Init(exports);
     EdBufferBuilder::Init(exports);
+    EdBufferSnapshot::Init(exports);
+    EdBufferLineIterator::Init(exports);
 }
 
 NODE_MODULE(addon, init);
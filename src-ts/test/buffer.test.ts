@@ -4,8 +4,8 @@
  *--------------------------------------------------------------------------------------------*/
 
 import * as assert from 'assert';
-import { buildBufferFromFixture, readFixture, buildBufferFromString } from './utils/bufferBuilder';
-import { EdBuffer } from '../../index';
+import { buildBufferFromFixture, buildBufferFromFixtureFile, buildPagedBufferFromFixtureFile, readFixture, buildBufferFromString, buildBufferFromUtf8, buildPendingBufferFromFixtureFile } from './utils/bufferBuilder';
+import { EdBuffer, EdBufferSnapshot, EdBufferLineIterator } from '../../index';
 import { IOffsetLengthEdit, getRandomInt, generateEdits, EditType } from './utils';
 
 const GENERATE_TESTS = false;
@@ -46,6 +46,100 @@ suite('Loading', () => {
     test('checker-10.txt', () => {
         assertBuffer('checker-10.txt');
     });
+
+    test('FromFile', () => {
+        for (const fileName of ['checker.txt', 'checker-400.txt', 'checker-400-CRLF.txt', 'checker-10.txt']) {
+            const buff = buildBufferFromFixtureFile(fileName);
+            const text = readFixture(fileName);
+            buff.AssertInvariants();
+            assertAllMethods(buff, text);
+
+            buff.ReplaceOffsetLen([{ offset: 1, length: 2, text: '\u00e9\ud83d\ude00' }]);
+            buff.AssertInvariants();
+            assertAllMethods(buff, text.substring(0, 1) + '\u00e9\ud83d\ude00' + text.substring(3));
+        }
+    });
+
+    test('AcceptUtf8Chunk', () => {
+        const text = 'a\u00e9\r\n\u20ac\ud83d\ude00\rb\n' + readFixture('checker-400.txt');
+        const bytes = Buffer.from(text, 'utf8');
+        // small chunks split the multi-byte characters and \r\n
+        for (const chunkSize of [1, 2, 3, 5, 1 << 16]) {
+            const buff = buildBufferFromUtf8(bytes, chunkSize);
+            buff.AssertInvariants();
+            assertAllMethods(buff, text);
+        }
+        // a truncated sequence at the end decodes like node does
+        const truncated = bytes.subarray(0, 6);
+        assertAllMethods(buildBufferFromUtf8(truncated, 1), truncated.toString());
+    });
+
+    test('FromFile with threads', () => {
+        for (const fileName of ['checker.txt', 'checker-400-CRLF.txt']) {
+            const buff = buildBufferFromFixtureFile(fileName, 4);
+            assert.equal(buff.IsLineCountPending(), false);
+            buff.AssertInvariants();
+            assertAllMethods(buff, readFixture(fileName));
+        }
+    });
+
+    test('FromFile answers line queries before the line count', () => {
+        const buff = buildPendingBufferFromFixtureFile('checker.txt');
+        const lines = constructLines(readFixture('checker.txt'));
+        assert.equal(buff.IsLineCountPending(), true);
+        assert.equal(buff.GetLineContent(1), lines[0]);
+        assert.equal(buff.GetOffsetAt(2, 1), lines[0].length);
+        assert.equal(buff.IsLineCountPending(), true);
+        assert.equal(buff.GetLineCount(), lines.length);
+        assert.equal(buff.IsLineCountPending(), false);
+        buff.AssertInvariants();
+    });
+
+    test('CreateSnapshot and CreateLineIterator do not wait for the line count', () => {
+        const buff = buildPendingBufferFromFixtureFile('checker.txt');
+        const lines = constructLines(readFixture('checker.txt'));
+        const snapshot = buff.CreateSnapshot();
+        const it = buff.CreateLineIterator(1);
+        assert.equal(buff.IsLineCountPending(), true);
+
+        const target = new Uint16Array(1024);
+        for (let i = 0; i < 10; i++) {
+            assert.equal(it.GetLineNumber(), i + 1);
+            const len = it.Read(target);
+            assert.equal(String.fromCharCode.apply(null, target.subarray(0, len)), lines[i]);
+            assert.equal(snapshot.GetLineContent(i + 1), lines[i]);
+            assert.equal(it.Next(), true);
+        }
+        assert.equal(it.Seek(300), true);
+        assert.equal(it.GetLineLength(), lines[299].length);
+        assert.equal(buff.IsLineCountPending(), true);
+
+        assert.equal(snapshot.GetLineCount(), lines.length);
+        assert.equal(buff.GetLineCount(), lines.length);
+        assert.equal(buff.IsLineCountPending(), false);
+    });
+
+    test('FromFilePaged pages leafs in within the cache budget', () => {
+        for (const threadsCount of [1, 4]) {
+            const text = readFixture('checker.txt');
+            const lines = constructLines(text);
+            const buff = buildPagedBufferFromFixtureFile('checker.txt', threadsCount);
+            buff.SetLeafCacheBudget(200000);
+            assert.equal(buff.GetLength(), text.length);
+            assert.equal(buff.GetLineCount(), lines.length);
+            assert.equal(buff.GetLeafCacheStats().misses, 0);
+
+            // a line is in one or two leafs
+            assert.equal(buff.GetLineContent(lines.length - 1), lines[lines.length - 2]);
+            assert.ok(buff.GetLeafCacheStats().misses <= 2);
+            assertAllMethods(buff, text);
+            assert.ok(buff.GetLeafCacheStats().memUsage <= 200000);
+
+            buff.ReplaceOffsetLen([{ offset: 1, length: 2, text: '\u00e9\ud83d\ude00' }]);
+            buff.AssertInvariants();
+            assertAllMethods(buff, text.substring(0, 1) + '\u00e9\ud83d\ude00' + text.substring(3));
+        }
+    });
 });
 
 suite('ReplaceOffsetLen', () => {
@@ -297,6 +391,24 @@ suite('ReplaceOffsetLen', () => {
         });
     });
 
+    test('a pasted emoji does not widen the text around it', () => {
+        const initialContent = readFixture('checker.txt');
+        const buff = buildBufferFromFixture('checker.txt');
+        const oneByteMemUsage = buff.GetMemUsage();
+        const offset = initialContent.length >> 1;
+
+        buff.ReplaceOffsetLen([{ offset: offset, length: 0, text: '\ud83d\ude00' }]);
+        buff.AssertInvariants();
+        assertAllMethods(buff, initialContent.substring(0, offset) + '\ud83d\ude00' + initialContent.substring(offset));
+        // only the emoji is two-byte, a widened leaf would take tens of kilobytes more
+        assert.ok(buff.GetMemUsage() < oneByteMemUsage + 4096);
+
+        buff.ReplaceOffsetLen([{ offset: offset, length: 2, text: '' }]);
+        buff.AssertInvariants();
+        assertAllMethods(buff, initialContent);
+        assert.ok(buff.GetMemUsage() <= oneByteMemUsage + 1024);
+    });
+
     suite('speed', () => {
         test('copy-paste checker.txt', () => {
             const buff = buildBufferFromFixture('checker.txt');
@@ -718,7 +830,392 @@ suite('ReplaceOffsetLen', () => {
     })();
 });
 
-function assertAllMethods(buff: EdBuffer, text: string): void {
+suite('Undo', () => {
+    test('undo and redo restore every state', () => {
+        const initialContent = readFixture('checker-400-CRLF.txt');
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 1000);
+        buff.SetUndoMemoryCap(1 << 24);
+
+        const states = [initialContent];
+        const edits = [
+            [{ offset: 0, length: 10, text: 'x\r' }, { offset: 10, length: 0, text: '\nyy' }, { offset: 2000, length: 5000, text: '' }],
+            [{ offset: 5, length: 12000, text: 'abc\n' }],
+            [{ offset: 0, length: 0, text: '\ud83d\ude00' }, { offset: 100, length: 1, text: '\r\n' }],
+        ];
+        for (let i = 0; i < edits.length; i++) {
+            const prev = states[states.length - 1];
+            let expected = prev;
+            for (let j = edits[i].length - 1; j >= 0; j--) {
+                const edit = edits[i][j];
+                expected = expected.substring(0, edit.offset) + edit.text + expected.substring(edit.offset + edit.length);
+            }
+            buff.ReplaceOffsetLen(edits[i]);
+            states.push(expected);
+        }
+
+        for (let i = states.length - 2; i >= 0; i--) {
+            assert.equal(buff.Undo(), true);
+            buff.AssertInvariants();
+            assertAllMethods(buff, states[i]);
+        }
+        assert.equal(buff.Undo(), false);
+
+        for (let i = 1; i < states.length; i++) {
+            assert.equal(buff.Redo(), true);
+            assertAllMethods(buff, states[i]);
+        }
+        assert.equal(buff.Redo(), false);
+    });
+
+    test('memory cap drops the oldest entries', () => {
+        const buff = buildBufferFromString('abc');
+        buff.SetUndoMemoryCap(1 << 20);
+        buff.ReplaceOffsetLen([{ offset: 0, length: 0, text: 'x' }]);
+        buff.ReplaceOffsetLen([{ offset: 0, length: 0, text: 'y' }]);
+        buff.SetUndoMemoryCap(1);
+        assert.equal(buff.Undo(), false);
+        assertAllMethods(buff, 'yxabc');
+    });
+});
+
+suite('SetPieceTableMode', () => {
+    test('edits, snapshots and undo in piece-table mode', () => {
+        const initialContent = readFixture('checker-400-CRLF.txt');
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 1000);
+        buff.SetUndoMemoryCap(1 << 24);
+        buff.SetPieceTableMode(true);
+
+        const snapshot = buff.CreateSnapshot();
+        const edits = [
+            [{ offset: 0, length: 0, text: 'a\r' }, { offset: 1, length: 1, text: '' }, { offset: 999, length: 2, text: '\ud83d\ude00\n' }],
+            [{ offset: 500, length: 0, text: 'x' }],
+            [{ offset: 501, length: 0, text: 'y' }],
+            [{ offset: 2, length: 3000, text: initialContent.substring(0, 5000) }],
+        ];
+        let expected = initialContent;
+        for (let i = 0; i < edits.length; i++) {
+            for (let j = edits[i].length - 1; j >= 0; j--) {
+                const edit = edits[i][j];
+                expected = expected.substring(0, edit.offset) + edit.text + expected.substring(edit.offset + edit.length);
+            }
+            buff.ReplaceOffsetLen(edits[i]);
+            buff.AssertInvariants();
+            assertAllMethods(buff, expected);
+        }
+
+        buff.SetPieceTableMode(false);
+        buff.ReplaceOffsetLen([{ offset: 3, length: 1, text: '\r\n' }]);
+        expected = expected.substring(0, 3) + '\r\n' + expected.substring(4);
+        buff.AssertInvariants();
+        assertAllMethods(buff, expected);
+
+        while (buff.Undo()) {
+        }
+        buff.AssertInvariants();
+        assertAllMethods(buff, initialContent);
+        assertAllMethods(snapshot, initialContent);
+    });
+});
+
+suite('CompressColdLeafs', () => {
+    test('compressed leafs are read through the cache and edited like others', () => {
+        const initialContent = readFixture('checker-400-CRLF.txt');
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 1000);
+        buff.SetLeafCacheBudget(4096);
+
+        // the first call only finds leafs that were read since the buffer was built
+        buff.CompressColdLeafs();
+        assert.ok(buff.CompressColdLeafs() > 0);
+        assert.equal(buff.GetLength(), initialContent.length);
+        assert.equal(buff.GetLineCount(), constructLines(initialContent).length);
+        assert.equal(buff.GetLeafCacheStats().misses, 0);
+
+        assertAllMethods(buff, initialContent);
+        const stats = buff.GetLeafCacheStats();
+        assert.ok(stats.hits > 0 && stats.misses > 0);
+        assert.ok(stats.memUsage <= stats.budget);
+
+        buff.CompressColdLeafs();
+        buff.CompressColdLeafs();
+        buff.ReplaceOffsetLen([{ offset: 10, length: 5, text: 'x\r' }, { offset: 3000, length: 0, text: '\ud83d\ude00' }]);
+        const expected = initialContent.substring(0, 10) + 'x\r' + initialContent.substring(15, 3000) + '\ud83d\ude00' + initialContent.substring(3000);
+        buff.AssertInvariants();
+        assertAllMethods(buff, expected);
+    });
+});
+
+suite('FindAll', () => {
+    function findAllReference(text: string, needle: string, ignoreCase: boolean): number[] {
+        if (ignoreCase) {
+            // the native search folds ascii letters only
+            const fold = (str: string) => str.replace(/[A-Z]/g, (c) => c.toLowerCase());
+            text = fold(text);
+            needle = fold(needle);
+        }
+        const result: number[] = [];
+        for (let i = text.indexOf(needle); needle.length > 0 && i !== -1; i = text.indexOf(needle, i + needle.length)) {
+            result.push(i);
+        }
+        return result;
+    }
+
+    function assertFindAll(buff: EdBuffer, text: string, needle: string, ignoreCase: boolean): void {
+        const expected = findAllReference(text, needle, ignoreCase);
+        assert.deepEqual(Array.prototype.slice.call(buff.FindAll(needle, ignoreCase)), expected);
+        if (expected.length > 0) {
+            const middle = expected[expected.length >> 1];
+            assert.equal(buff.FindNext(needle, middle, false, ignoreCase), middle);
+            assert.equal(buff.FindNext(needle, middle + needle.length, true, ignoreCase), middle);
+        }
+        assert.equal(buff.FindNext(needle, 0, false, ignoreCase), expected.length > 0 ? expected[0] : -1);
+    }
+
+    test('matches across leafs, in either case', () => {
+        // small chunks, so many matches straddle two leafs
+        const initialContent = readFixture('checker-400-CRLF.txt');
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 37);
+        for (const needle of ['checker', 'Checker', '\r\n', ';\r\n', 'zzz', '']) {
+            assertFindAll(buff, initialContent, needle, false);
+            assertFindAll(buff, initialContent, needle, true);
+        }
+
+        buff.ReplaceOffsetLen([{ offset: 10, length: 0, text: 'CHE\u4e2dCKER' }, { offset: 3000, length: 0, text: 'che\u4e2dcker' }]);
+        const expected = initialContent.substring(0, 10) + 'CHE\u4e2dCKER' + initialContent.substring(10, 3000) + 'che\u4e2dcker' + initialContent.substring(3000);
+        assertFindAll(buff, expected, 'che\u4e2dcker', false);
+        assertFindAll(buff, expected, 'che\u4e2dcker', true);
+
+        buff.CompressColdLeafs();
+        buff.CompressColdLeafs();
+        assertFindAll(buff, expected, 'checker', true);
+    });
+
+    test('threads find the same matches', () => {
+        // self-overlapping needles, so matches reach across the edges of the ranges the threads search
+        const initialContent = 'aaab\r\n'.repeat(300) + 'aaaaaaa'.repeat(100);
+        const buff = buildBufferFromString(initialContent, 37);
+        for (const needle of ['aa', 'aaa', 'aba', '\r\n']) {
+            const expected = findAllReference(initialContent, needle, false);
+            for (const threadsCount of [2, 4, 16]) {
+                assert.deepEqual(Array.prototype.slice.call(buff.FindAll(needle, false, threadsCount)), expected);
+            }
+        }
+    });
+
+    test('threads find the same matches with the search index', () => {
+        const initialContent = 'aaab\r\n'.repeat(300) + 'aaaaaaa'.repeat(100) + 'checker\r\n'.repeat(200);
+        const buff = buildBufferFromString(initialContent, 37);
+        buff.SetSearchIndex(true);
+        for (const needle of ['aa', 'aaa', 'aaaa', 'aab\r', 'checker', 'zzz']) {
+            const expected = findAllReference(initialContent, needle, false);
+            for (const threadsCount of [2, 4, 16]) {
+                assert.deepEqual(Array.prototype.slice.call(buff.FindAll(needle, false, threadsCount)), expected);
+            }
+        }
+    });
+
+    test('the search index finds the same matches across edits', () => {
+        const initialContent = readFixture('checker-400-CRLF.txt');
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 37);
+        buff.SetUndoMemoryCap(1 << 24);
+        const memUsage = buff.GetMemUsage();
+        buff.SetSearchIndex(true);
+        assert.ok(buff.GetMemUsage() > memUsage);
+        const needles = ['checker', 'CHE\u4e2dCKER', ';\r\n', 'zzz', 'ab'];
+        for (const needle of needles) {
+            assertFindAll(buff, initialContent, needle, false);
+            assertFindAll(buff, initialContent, needle, true);
+        }
+
+        buff.ReplaceOffsetLen([{ offset: 10, length: 0, text: 'CHE\u4e2dCKER' }, { offset: 3000, length: 7, text: 'che\u4e2dcker' }]);
+        const expected = initialContent.substring(0, 10) + 'CHE\u4e2dCKER' + initialContent.substring(10, 3000) + 'che\u4e2dcker' + initialContent.substring(3007);
+        buff.CompressColdLeafs();
+        buff.CompressColdLeafs();
+        buff.AssertInvariants();
+        for (const needle of needles) {
+            assertFindAll(buff, expected, needle, true);
+        }
+
+        assert.ok(buff.Undo());
+        buff.AssertInvariants();
+        assertFindAll(buff, initialContent, 'che\u4e2dcker', true);
+        const withIndex = buff.GetMemUsage();
+        buff.SetSearchIndex(false);
+        assert.ok(buff.GetMemUsage() < withIndex);
+    });
+
+    test('find next stops at the nearest match in each direction', () => {
+        const buff = buildBufferFromString('abcabcab', 3);
+        assert.equal(buff.FindNext('ab', 1), 3);
+        assert.equal(buff.FindNext('ab', 7), -1);
+        assert.equal(buff.FindNext('ab', 7, true), 3);
+        assert.equal(buff.FindNext('ab', 8, true), 6);
+        assert.equal(buff.FindNext('AB', 1, true, true), -1);
+        assert.equal(buff.FindNext('AB', 2, true, true), 0);
+    });
+});
+
+suite('FindAllRegex', () => {
+    function findAllRegexReference(text: string, pattern: string, ignoreCase: boolean): number[] {
+        const regex = new RegExp(pattern, ignoreCase ? 'gim' : 'gm');
+        const result: number[] = [];
+        for (let match = regex.exec(text); match !== null; match = regex.exec(text)) {
+            result.push(match.index, match.index + match[0].length);
+            if (match[0].length === 0) {
+                regex.lastIndex++;
+            }
+        }
+        return result;
+    }
+
+    test('matches across leafs like a RegExp', () => {
+        // JavaScript also sees a line break between \r and \n, so LF only; each of these patterns has one longest match
+        const initialContent = readFixture('checker-400.txt');
+        const buff = buildBufferFromFixture('checker-400.txt', 37);
+        for (const pattern of ['checker', 'get[A-Z]\\w+\\(', '^\\s*//.*', '^$', '[;{]$', '\\d{2,}', 'zzz']) {
+            assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex(pattern)), findAllRegexReference(initialContent, pattern, false));
+            assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex(pattern, true)), findAllRegexReference(initialContent, pattern, true));
+        }
+    });
+
+    test('anchors follow the line breaks of the buffer', () => {
+        const buff = buildBufferFromString('ab\r\ncd\n\ref', 3);
+        assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex('^')), [0, 0, 4, 4, 7, 7, 8, 8]);
+        assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex('$')), [2, 2, 6, 6, 7, 7, 10, 10]);
+        assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex('^[a-z]+$')), [0, 2, 4, 6, 8, 10]);
+        assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex('b.*')), [1, 2]);
+    });
+
+    test('matches are leftmost-longest', () => {
+        const buff = buildBufferFromString('abcd abc', 3);
+        assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex('ab|abcd?')), [0, 4, 5, 8]);
+    });
+
+    test('threads find the same matches', () => {
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 37);
+        for (const pattern of ['checker', '^', '$', '^\\s*$', '(?:aa)+|a', '\\w+']) {
+            const expected = Array.prototype.slice.call(buff.FindAllRegex(pattern));
+            for (const threadsCount of [2, 4, 16]) {
+                assert.deepEqual(Array.prototype.slice.call(buff.FindAllRegex(pattern, false, threadsCount)), expected);
+            }
+        }
+    });
+
+    test('invalid patterns throw', () => {
+        const buff = buildBufferFromString('abc');
+        assert.throws(() => buff.FindAllRegex('a(?=b)'), /Lookarounds/);
+        assert.throws(() => buff.FindAllRegex('(ab'), /Unterminated group/);
+        assert.throws(() => buff.FindAllRegex('a*?'), /Lazy/);
+        assert.throws(() => buff.FindAllRegex('*'), /Nothing to repeat/);
+    });
+});
+
+suite('ReplaceAll', () => {
+    test('replaces every match in one undoable edit', () => {
+        // small chunks, so many matches straddle two leafs
+        const initialContent = readFixture('checker-400-CRLF.txt');
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 37);
+        buff.SetUndoMemoryCap(1 << 24);
+        const states = [initialContent];
+        for (const [needle, replacement] of [['checker', 'CHE\u4e2dCKER'], ['\r\n', '\n'], [';', ''], ['zzz', 'z']]) {
+            const prev = states[states.length - 1];
+            const parts = prev.split(needle);
+            assert.equal(buff.ReplaceAll(needle, replacement), parts.length - 1);
+            buff.AssertInvariants();
+            states.push(parts.join(replacement));
+            assertAllMethods(buff, states[states.length - 1]);
+        }
+
+        // nothing is replaced by the last one, so it is not recorded
+        for (let i = states.length - 3; i >= 0; i--) {
+            assert.equal(buff.Undo(), true);
+            assertAllMethods(buff, states[i]);
+        }
+        assert.equal(buff.Undo(), false);
+    });
+
+    test('ignores case and keeps the search index up to date', () => {
+        const initialContent = readFixture('checker-400.txt');
+        const buff = buildBufferFromFixture('checker-400.txt', 37);
+        buff.SetSearchIndex(true);
+        const expected = initialContent.replace(/checker/gi, 'x');
+        assert.equal(buff.ReplaceAll('CHECKER', 'x', true), initialContent.split(/checker/i).length - 1);
+        buff.AssertInvariants();
+        assertAllMethods(buff, expected);
+        assert.equal(buff.FindAll('checker', true).length, 0);
+    });
+
+    test('replaces the matches of a pattern', () => {
+        const buff = buildBufferFromString('ab\r\ncd\n\ref', 3);
+        buff.SetUndoMemoryCap(1 << 20);
+        assert.equal(buff.ReplaceAllRegex('^', '> '), 4);
+        assertAllMethods(buff, '> ab\r\n> cd\n> \r> ef');
+        assert.equal(buff.ReplaceAllRegex('\\r\\n|\\r', '\n'), 2);
+        assertAllMethods(buff, '> ab\n> cd\n> \n> ef');
+        assert.equal(buff.ReplaceAllRegex('$', ';'), 4);
+        assertAllMethods(buff, '> ab;\n> cd;\n> ;\n> ef;');
+        assert.equal(buff.ReplaceAllRegex('[A-Z]', '', true), 6);
+        assertAllMethods(buff, '> ;\n> ;\n> ;\n> ;');
+
+        for (let i = 0; i < 4; i++) {
+            assert.equal(buff.Undo(), true);
+        }
+        assertAllMethods(buff, 'ab\r\ncd\n\ref');
+        assert.throws(() => buff.ReplaceAllRegex('(ab', 'x'), /Unterminated group/);
+        assertAllMethods(buff, 'ab\r\ncd\n\ref');
+    });
+});
+
+suite('CreateSnapshot', () => {
+    test('snapshot is not affected by later edits', () => {
+        const initialContent = readFixture('checker-400-CRLF.txt');
+        const buff = buildBufferFromFixture('checker-400-CRLF.txt', 1000);
+
+        const snapshot = buff.CreateSnapshot();
+        buff.ReplaceOffsetLen([{ offset: 0, length: 0, text: 'a\r\nb' }, { offset: 5000, length: 3000, text: '' }]);
+        const snapshot2 = buff.CreateSnapshot();
+        buff.ReplaceOffsetLen([{ offset: 0, length: buff.GetLength(), text: 'x' }]);
+
+        assertAllMethods(snapshot, initialContent);
+        assertAllMethods(snapshot2, 'a\r\nb' + initialContent.substring(0, 5000) + initialContent.substring(8000));
+        assertAllMethods(buff, 'x');
+        buff.AssertInvariants();
+    });
+});
+
+suite('CreateLineIterator', () => {
+    function readLine(it: EdBufferLineIterator, target: Uint16Array): string {
+        const len = it.Read(target);
+        assert.ok(len <= target.length);
+        return String.fromCharCode.apply(null, target.subarray(0, len));
+    }
+
+    test('forward, backward and seek', () => {
+        const text = 'a\r\nbc\rd\n\n' + readFixture('checker-400-CRLF.txt') + '\r';
+        const lines = constructLines(text);
+        const buff = buildBufferFromString(text);
+        const target = new Uint16Array(1024);
+
+        const it = buff.CreateLineIterator(1);
+        buff.ReplaceOffsetLen([{ offset: 0, length: 10, text: '' }]);
+        for (let i = 0; i < lines.length; i++) {
+            assert.equal(it.GetLineNumber(), i + 1);
+            assert.equal(it.GetLineLength(), lines[i].length);
+            assert.equal(readLine(it, target), lines[i], '@ line number ' + (i + 1));
+            assert.equal(it.Next(), i + 1 < lines.length);
+        }
+        for (let i = lines.length - 1; i >= 0; i--) {
+            assert.equal(readLine(it, target), lines[i], '@ line number ' + (i + 1));
+            assert.equal(it.Prev(), i > 0);
+        }
+
+        assert.equal(it.Seek(lines.length + 1), false);
+        assert.equal(it.Seek(100), true);
+        assert.equal(readLine(it, target), lines[99]);
+        assert.equal(it.Read(new Uint16Array(0)), lines[99].length);
+    });
+});
+
+function assertAllMethods(buff: EdBuffer | EdBufferSnapshot, text: string): void {
     assert.equal(buff.GetLength(), text.length, 'length');
 
     const lines = constructLines(text);
@@ -729,6 +1226,43 @@ function assertAllMethods(buff: EdBuffer, text: string): void {
         let expected = lines[i];
         assert.equal(actual, expected, '@ line number ' + (i + 1));
     }
+
+    if (buff instanceof EdBuffer) {
+        assertPositions(buff, lines);
+    }
+}
+
+function assertPositions(buff: EdBuffer, lines: string[]): void {
+    let offset = 0;
+    for (let i = 0; i < lines.length; i++) {
+        const step = Math.max(1, Math.floor(lines[i].length / 4));
+        for (let column = 1; column <= lines[i].length; column += step) {
+            const position = buff.GetPositionAt(offset + column - 1);
+            assert.equal(position.lineNumber, i + 1, '@ offset ' + (offset + column - 1));
+            assert.equal(position.column, column, '@ offset ' + (offset + column - 1));
+            assert.equal(buff.GetOffsetAt(i + 1, column), offset + column - 1);
+        }
+        offset += lines[i].length;
+    }
+    const end = buff.GetPositionAt(offset);
+    assert.equal(end.lineNumber, lines.length);
+    assert.equal(end.column, lines[lines.length - 1].length + 1);
+
+    const offsets = new Float64Array(Math.min(offset + 1, 1000));
+    for (let i = 0; i < offsets.length; i++) {
+        offsets[i] = Math.floor(i * offset / Math.max(1, offsets.length - 1));
+    }
+    const lineNumbers = new Uint32Array(offsets.length);
+    const columns = new Uint32Array(offsets.length);
+    buff.GetPositionsAt(offsets, lineNumbers, columns);
+    const actualOffsets = new Float64Array(offsets.length);
+    buff.GetOffsetsAt(lineNumbers, columns, actualOffsets);
+    for (let i = 0; i < offsets.length; i++) {
+        const position = buff.GetPositionAt(offsets[i]);
+        assert.equal(lineNumbers[i], position.lineNumber, '@ offset ' + offsets[i]);
+        assert.equal(columns[i], position.column, '@ offset ' + offsets[i]);
+        assert.equal(actualOffsets[i], offsets[i]);
+    }
 }
 
 /**
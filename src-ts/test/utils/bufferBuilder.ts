@@ -26,6 +26,33 @@ export function buildBufferFromString(fileContents: string, chunkSize: number =
     return builder.Build();
 }
 
+export function buildBufferFromUtf8(bytes: Uint8Array, chunkSize: number = 1 << 16): EdBuffer {
+    const builder = new EdBufferBuilder();
+    for (let offset = 0; offset < bytes.length; offset += chunkSize) {
+        builder.AcceptUtf8Chunk(bytes.subarray(offset, Math.min(offset + chunkSize, bytes.length)));
+    }
+    builder.Finish();
+    return builder.Build();
+}
+
+export function buildBufferFromFixtureFile(fileName: string, threadsCount: number = 1): EdBuffer {
+    return EdBufferBuilder.FromFile(path.join(FIXTURES_FOLDER, fileName), threadsCount).Build();
+}
+
+export function buildPagedBufferFromFixtureFile(fileName: string, threadsCount: number = 1): EdBuffer {
+    return EdBufferBuilder.FromFilePaged(path.join(FIXTURES_FOLDER, fileName), threadsCount).Build();
+}
+
+/**
+ * Like `buildBufferFromFixtureFile`, with the line starts left pending until the line queries that need them
+ * scan them.
+ */
+export function buildPendingBufferFromFixtureFile(fileName: string): EdBuffer {
+    const builder = EdBufferBuilder.FromFile(path.join(FIXTURES_FOLDER, fileName), 1);
+    builder.SetScanLineStartsInBackground(false);
+    return builder.Build();
+}
+
 const FIXTURE_CACHE: { [fileName:string]: string; } = {};
 
 export function readFixture(fileName: string): string {
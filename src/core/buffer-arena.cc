@@ -0,0 +1,128 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "buffer-arena.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <stdlib.h>
+#include <cstring>
+
+namespace edcore
+{
+
+static inline size_t floorLog2(size_t v)
+{
+    size_t result = 0;
+    while (v >>= 1)
+    {
+        result++;
+    }
+    return result;
+}
+
+static inline size_t sizeClass(size_t size)
+{
+    if (size <= 16 * BUFFER_ARENA_SMALL_CLASSES)
+    {
+        return (size == 0 ? 0 : (size - 1) >> 4);
+    }
+    // size is in (2^p, 2^(p+1)], which is split in 4 classes of 2^(p-2) bytes
+    const size_t p = floorLog2(size - 1);
+    const size_t k = ((size - 1) - ((size_t)1 << p)) >> (p - 2);
+    return BUFFER_ARENA_SMALL_CLASSES + (p - 6) * 4 + k;
+}
+
+static inline size_t classSize(size_t index)
+{
+    if (index < BUFFER_ARENA_SMALL_CLASSES)
+    {
+        return (index + 1) * 16;
+    }
+    const size_t p = 6 + (index - BUFFER_ARENA_SMALL_CLASSES) / 4;
+    const size_t k = (index - BUFFER_ARENA_SMALL_CLASSES) % 4;
+    return ((size_t)1 << p) + ((k + 1) << (p - 2));
+}
+
+BufferArena::BufferArena() : refCount_(1)
+{
+    assert(sizeClass(BUFFER_ARENA_MAX_BLOCK_SIZE) == BUFFER_ARENA_CLASS_COUNT - 1);
+    memset(freeLists_, 0, sizeof(freeLists_));
+    slabNext_ = NULL;
+    slabEnd_ = NULL;
+    nextSlabSize_ = BUFFER_ARENA_MIN_SLAB_SIZE;
+    stats_.allocations = 0;
+    stats_.heapAllocations = 0;
+}
+
+BufferArena::~BufferArena()
+{
+    for (size_t i = 0, len = slabs_.size(); i < len; i++)
+    {
+        ::free(slabs_[i]);
+    }
+}
+
+uint8_t *BufferArena::allocFromSlab(size_t size)
+{
+    if (slabNext_ == NULL || (size_t)(slabEnd_ - slabNext_) < size)
+    {
+        // the rest of the current slab is given up, slabs grow so this stays a small fraction
+        const size_t slabSize = max(nextSlabSize_, size);
+        nextSlabSize_ = min(2 * nextSlabSize_, (size_t)BUFFER_ARENA_MAX_SLAB_SIZE);
+
+        slabNext_ = static_cast<uint8_t *>(malloc(slabSize));
+        slabEnd_ = slabNext_ + slabSize;
+        slabs_.push_back(slabNext_);
+        stats_.heapAllocations++;
+    }
+
+    uint8_t *result = slabNext_;
+    slabNext_ += size;
+    return result;
+}
+
+void *BufferArena::alloc(size_t size)
+{
+    lock_guard<mutex> lock(mutex_);
+    stats_.allocations++;
+
+    if (size > BUFFER_ARENA_MAX_BLOCK_SIZE)
+    {
+        stats_.heapAllocations++;
+        return malloc(size);
+    }
+
+    const size_t index = sizeClass(size);
+    void *result = freeLists_[index];
+    if (result != NULL)
+    {
+        freeLists_[index] = *static_cast<void **>(result);
+        return result;
+    }
+    return allocFromSlab(classSize(index));
+}
+
+void BufferArena::free(void *ptr, size_t size)
+{
+    lock_guard<mutex> lock(mutex_);
+
+    if (size > BUFFER_ARENA_MAX_BLOCK_SIZE)
+    {
+        ::free(ptr);
+        return;
+    }
+
+    const size_t index = sizeClass(size);
+    *static_cast<void **>(ptr) = freeLists_[index];
+    freeLists_[index] = ptr;
+}
+
+BufferArenaStats BufferArena::stats()
+{
+    lock_guard<mutex> lock(mutex_);
+    return stats_;
+}
+}
@@ -0,0 +1,90 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_BUFFER_ARENA_H_
+#define EDCORE_BUFFER_ARENA_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+// blocks up to 64 bytes come in steps of 16 bytes, larger ones in 4 steps per power of two
+#define BUFFER_ARENA_SMALL_CLASSES 4
+#define BUFFER_ARENA_MAX_BLOCK_SIZE (256 * 1024)
+#define BUFFER_ARENA_CLASS_COUNT 52
+#define BUFFER_ARENA_MIN_SLAB_SIZE (64 * 1024)
+#define BUFFER_ARENA_MAX_SLAB_SIZE (4 * 1024 * 1024)
+
+namespace edcore
+{
+
+struct BufferArenaStats
+{
+    // blocks handed out by the arena
+    size_t allocations;
+    // blocks (or slabs) that had to come from the system allocator
+    size_t heapAllocations;
+};
+typedef struct BufferArenaStats BufferArenaStats;
+
+/**
+ * A size-class allocator for the pieces of one buffer and their chars and line starts.
+ * Blocks are carved out of large slabs and freed blocks are kept on a free list per size class,
+ * so the steady state of editing does not go to the system allocator. Blocks larger than
+ * `BUFFER_ARENA_MAX_BLOCK_SIZE` are allocated and freed directly.
+ *
+ * Every piece holds a reference to its arena, so the arena outlives the buffer while snapshots
+ * or undo entries still use its pieces. The slabs are freed all at once with the last reference.
+ * Pieces can be released from other threads (snapshots), so allocation is guarded by a mutex.
+ */
+class BufferArena
+{
+  public:
+    BufferArena();
+
+    void retain() { refCount_++; }
+    void release()
+    {
+        if (--refCount_ == 0)
+        {
+            delete this;
+        }
+    }
+
+    void *alloc(size_t size);
+    void free(void *ptr, size_t size);
+
+    template <typename T>
+    T *allocArray(size_t length) { return static_cast<T *>(alloc(length * sizeof(T))); }
+    template <typename T>
+    void freeArray(T *ptr, size_t length) { free(ptr, length * sizeof(T)); }
+
+    BufferArenaStats stats();
+
+  private:
+    atomic<size_t> refCount_;
+    mutex mutex_;
+
+    void *freeLists_[BUFFER_ARENA_CLASS_COUNT];
+    vector<void *> slabs_;
+    uint8_t *slabNext_;
+    uint8_t *slabEnd_;
+    size_t nextSlabSize_;
+
+    BufferArenaStats stats_;
+
+    ~BufferArena();
+    BufferArena(const BufferArena &other);
+    BufferArena &operator=(const BufferArena &other);
+
+    uint8_t *allocFromSlab(size_t size);
+};
+}
+
+#endif
@@ -4,17 +4,31 @@
  *--------------------------------------------------------------------------------------------*/
 
 #include "buffer-builder.h"
+#include "simd.h"
 
+#include <atomic>
 #include <cstring>
+#include <thread>
 
 namespace edcore
 {
 
 BufferBuilder::BufferBuilder()
 {
+    arena_ = new BufferArena();
+    leafCache_ = new LeafCache(LEAF_CACHE_DEFAULT_BUDGET);
     hasPreviousChar_ = false;
     averageChunkSize_ = 0;
+    chunksCount_ = 0;
     previousChar_ = 0;
+    utf8PendingLength_ = 0;
+    scanLineStartsInBackground_ = true;
+}
+
+BufferBuilder::~BufferBuilder()
+{
+    leafCache_->release();
+    arena_->release();
 }
 
 uint16_t getLastCharacter(const BufferString *str)
@@ -33,9 +47,9 @@ void BufferBuilder::acceptChunk(const BufferString *str)
         return;
     }
 
-    // Current pieces
-    const size_t rawPiecesCount = rawPieces_.size();
-    averageChunkSize_ = (averageChunkSize_ * rawPiecesCount + strLength) / (rawPiecesCount + 1);
+    // a chunk may become several pieces, the leaf lengths are based on the chunks
+    averageChunkSize_ = (averageChunkSize_ * chunksCount_ + strLength) / (chunksCount_ + 1);
+    chunksCount_++;
 
     uint16_t lastChar = getLastCharacter(str);
     if (lastChar == 13 || (lastChar >= 0xd800 && lastChar <= 0xdbff))
@@ -58,9 +72,9 @@ void BufferBuilder::acceptChunk(const BufferString *str)
 void BufferBuilder::acceptChunk1(const BufferString *str, bool allowEmptyStrings)
 {
     const size_t strLength = str->length();
-    if (!allowEmptyStrings && strLength == 0)
+    if (!allowEmptyStrings && strLength == 0 && !hasPreviousChar_)
     {
-        // Nothing to do
+        // Nothing to do, a kept back char must not be dropped when a one char chunk is kept back too
         return;
     }
 
@@ -80,11 +94,257 @@ void BufferBuilder::acceptChunk1(const BufferString *str, bool allowEmptyStrings
 
 void BufferBuilder::acceptChunk2(const BufferString *str)
 {
-    rawPieces_.push_back(BufferPiece::createFromString(str));
+    if (str->containsOnlyOneByte())
+    {
+        rawPieces_.push_back(BufferPiece::createFromString(arena_, str));
+        return;
+    }
+
+    // the runs of wide chars get pieces of their own, so a few of them don't widen the whole chunk
+    const size_t strLength = str->length();
+    vector<uint16_t> chars(strLength);
+    str->write(chars.data(), 0, strLength);
+    BufferPiece::createLeafs(arena_, chars.data(), strLength, strLength, strLength, false, rawPieces_);
+}
+
+/**
+ * Returns the length of the UTF-8 sequence cut by the end of `data`, 0 if the last sequence is complete.
+ */
+static size_t incompleteUtf8Length(const uint8_t *data, size_t length)
+{
+    for (size_t k = 1; k <= 3 && k <= length; k++)
+    {
+        const uint8_t byte = data[length - k];
+        if ((byte & 0xC0) == 0x80)
+        {
+            // continuation byte, look further back for the lead byte
+            continue;
+        }
+        const size_t sequenceLength = (byte >= 0xC2 && byte <= 0xDF ? 2 : byte >= 0xE0 && byte <= 0xEF ? 3 : byte >= 0xF0 && byte <= 0xF4 ? 4 : 0);
+        return (sequenceLength > k ? k : 0);
+    }
+    return 0;
+}
+
+void BufferBuilder::acceptUtf8Chunk(const uint8_t *data, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    if (utf8PendingLength_ > 0)
+    {
+        // decode the kept back bytes together with this chunk
+        static thread_local vector<uint8_t> joined;
+        joined.assign(utf8Pending_, utf8Pending_ + utf8PendingLength_);
+        joined.insert(joined.end(), data, data + length);
+        utf8PendingLength_ = 0;
+        acceptUtf8Chunk(&joined[0], joined.size());
+        return;
+    }
+
+    const size_t pendingLength = incompleteUtf8Length(data, length);
+    memcpy(utf8Pending_, data + length - pendingLength, pendingLength);
+    utf8PendingLength_ = pendingLength;
+    acceptUtf8(data, length - pendingLength);
+}
+
+void BufferBuilder::acceptUtf8(const uint8_t *data, size_t length)
+{
+    if (length == 0)
+    {
+        return;
+    }
+
+    if (containsOnlyAscii(data, length))
+    {
+        OneByteArrayString str(data, length);
+        acceptChunk(&str);
+        return;
+    }
+
+    // Latin-1 text is narrowed again when the piece is created
+    static thread_local vector<uint16_t> decoded;
+    decoded.resize(length);
+    TwoByteArrayString str(&decoded[0], decodeUtf8(data, length, &decoded[0]));
+    acceptChunk(&str);
+}
+
+void BufferBuilder::acceptPieces(const vector<BufferPiece *> &pieces)
+{
+    size_t length = 0;
+    for (size_t i = 0, len = pieces.size(); i < len; i++)
+    {
+        length += pieces[i]->length();
+        rawPieces_.push_back(pieces[i]);
+    }
+    averageChunkSize_ = (averageChunkSize_ * chunksCount_ + length) / (chunksCount_ + 1);
+    chunksCount_++;
+}
+
+/**
+ * Cut `file` into chunks of about `BUFFER_BUILDER_FILE_CHUNK_LENGTH` bytes that can be decoded on their own.
+ */
+static void splitFile(const MappedFile *file, vector<size_t> &chunkEnds)
+{
+    const uint8_t *data = file->data();
+    const size_t length = file->length();
+
+    size_t offset = 0;
+    while (offset < length)
+    {
+        size_t end = min(offset + BUFFER_BUILDER_FILE_CHUNK_LENGTH, length);
+        if (end < length)
+        {
+            // Don't cut a UTF-8 sequence: go back to its lead byte, which is at most 3 bytes before.
+            // Without a lead byte that close, `end` is not inside a valid sequence.
+            size_t cut = end;
+            for (size_t i = 0; i < 3 && cut > offset + 1 && (data[cut] & 0xC0) == 0x80; i++)
+            {
+                cut--;
+            }
+            if ((data[cut] & 0xC0) != 0x80)
+            {
+                end = cut;
+            }
+            // don't cut \r\n
+            if (end > offset + 1 && data[end - 1] == '\r' && data[end] == '\n')
+            {
+                end--;
+            }
+        }
+        chunkEnds.push_back(end);
+        offset = end;
+    }
+}
+
+/**
+ * With a `cache` the chunk becomes a paged piece, otherwise its line starts are scanned when first needed,
+ * or by the buffer in the background.
+ */
+static void createFilePieces(BufferArena *arena, LeafCache *cache, MappedFile *file, size_t start, size_t length, vector<BufferPiece *> &result)
+{
+    if (cache != NULL)
+    {
+        result.push_back(PagedBufferPiece::create(arena, cache, file, start, length));
+        return;
+    }
+
+    const uint8_t *data = file->data();
+    if (containsOnlyAscii(data + start, length))
+    {
+        result.push_back(OneByteBufferPiece::createLazy(arena, file, start, length));
+        return;
+    }
+
+    // decode into per-thread scratch, so the pieces get arrays of their exact length
+    static thread_local vector<uint16_t> decoded;
+    decoded.resize(length);
+    const size_t decodedLength = decodeUtf8(data + start, length, &decoded[0]);
+
+    if (containsOnlyOneByte(&decoded[0], decodedLength))
+    {
+        uint8_t *oneByteData = arena->allocArray<uint8_t>(decodedLength);
+        narrowToOneByte(&decoded[0], decodedLength, oneByteData);
+        result.push_back(OneByteBufferPiece::createLazy(arena, oneByteData, decodedLength));
+        return;
+    }
+    BufferPiece::createLeafs(arena, &decoded[0], decodedLength, decodedLength, decodedLength, true, result);
+}
+
+/**
+ * Runs on each loader thread: takes the next chunk until there are none left, so a thread that gets
+ * chunks which are fast to decode takes more of them.
+ */
+static void loadFileChunks(BufferArena *arena, LeafCache *cache, MappedFile *file, const vector<size_t> *chunkEnds, atomic<size_t> *nextChunk, vector<vector<BufferPiece *>> *pieces)
+{
+    const size_t chunksCount = chunkEnds->size();
+    for (size_t i = (*nextChunk)++; i < chunksCount; i = (*nextChunk)++)
+    {
+        const size_t start = (i == 0 ? 0 : (*chunkEnds)[i - 1]);
+        vector<BufferPiece *> &chunkPieces = (*pieces)[i];
+        createFilePieces(arena, cache, file, start, (*chunkEnds)[i] - start, chunkPieces);
+        for (size_t j = 0, len = chunkPieces.size(); j < len; j++)
+        {
+            chunkPieces[j]->ensureLineStarts();
+        }
+    }
+}
+
+void BufferBuilder::acceptFile(MappedFile *file, size_t threadsCount, bool paged)
+{
+    LeafCache *cache = (paged ? leafCache_ : NULL);
+    vector<size_t> chunkEnds;
+    splitFile(file, chunkEnds);
+    const size_t chunksCount = chunkEnds.size();
+
+    if (threadsCount <= 1 || chunksCount <= 1)
+    {
+        vector<BufferPiece *> chunkPieces;
+        for (size_t i = 0; i < chunksCount; i++)
+        {
+            const size_t start = (i == 0 ? 0 : chunkEnds[i - 1]);
+            chunkPieces.clear();
+            createFilePieces(arena_, cache, file, start, chunkEnds[i] - start, chunkPieces);
+            acceptPieces(chunkPieces);
+        }
+        return;
+    }
+
+    // the chunks don't depend on each other, so they are accepted in order once all of them are done
+    vector<vector<BufferPiece *>> pieces(chunksCount);
+    atomic<size_t> nextChunk(0);
+    vector<thread> threads;
+    for (size_t i = 0, len = min(threadsCount, chunksCount); i < len; i++)
+    {
+        threads.push_back(thread(loadFileChunks, arena_, cache, file, &chunkEnds, &nextChunk, &pieces));
+    }
+    for (size_t i = 0, len = threads.size(); i < len; i++)
+    {
+        threads[i].join();
+    }
+    for (size_t i = 0; i < chunksCount; i++)
+    {
+        acceptPieces(pieces[i]);
+    }
+}
+
+BufferBuilder *BufferBuilder::fromFile(const char *path, size_t threadsCount)
+{
+    return fromFile(path, threadsCount, false);
+}
+
+BufferBuilder *BufferBuilder::fromFilePaged(const char *path, size_t threadsCount)
+{
+    return fromFile(path, threadsCount, true);
+}
+
+BufferBuilder *BufferBuilder::fromFile(const char *path, size_t threadsCount, bool paged)
+{
+    MappedFile *file = MappedFile::open(path, paged);
+    if (file == NULL)
+    {
+        return NULL;
+    }
+
+    BufferBuilder *result = new BufferBuilder();
+    result->acceptFile(file, threadsCount, paged);
+    // the pieces hold on to the mapping
+    file->release();
+    result->finish();
+    return result;
 }
 
 void BufferBuilder::finish()
 {
+    if (utf8PendingLength_ > 0)
+    {
+        // the file ends in the middle of a sequence
+        acceptUtf8(utf8Pending_, utf8PendingLength_);
+        utf8PendingLength_ = 0;
+    }
+
     if (rawPieces_.size() == 0)
     {
         // no chunks => forcefully go through accept chunk
@@ -100,12 +360,12 @@ void BufferBuilder::finish()
         BufferPiece *lastPiece = rawPieces_[rawPieces_.size() - 1];
 
         BufferString *tmp1 = BufferString::createFromSingle(previousChar_);
-        BufferPiece *tmp2 = BufferPiece::createFromString(tmp1);
+        BufferPiece *tmp2 = BufferPiece::createFromString(arena_, tmp1);
         delete tmp1;
 
         BufferPiece *newLastPiece = BufferPiece::join2(lastPiece, tmp2);
-        delete lastPiece;
-        delete tmp2;
+        lastPiece->release();
+        tmp2->release();
 
         rawPieces_[rawPieces_.size() - 1] = newLastPiece;
     }
@@ -120,6 +380,6 @@ Buffer *BufferBuilder::build()
 
     // printf("%lf ==> %lu, %lu\n", averageChunkSize_, min_, max_);
 
-    return new Buffer(rawPieces_, min_, max_);
+    return new Buffer(arena_, leafCache_, rawPieces_, min_, max_, scanLineStartsInBackground_);
 }
 }
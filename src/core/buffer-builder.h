@@ -14,6 +14,9 @@
 
 using namespace std;
 
+// the chunks a file is split into when it is loaded
+#define BUFFER_BUILDER_FILE_CHUNK_LENGTH 65536
+
 namespace edcore
 {
 
@@ -21,18 +24,60 @@ class BufferBuilder
 {
   public:
     BufferBuilder();
+    ~BufferBuilder();
     void acceptChunk(const BufferString *str);
+    /**
+     * Accept the next `length` bytes of UTF-8 text, decoded like `fromFile` does. A sequence that is cut by the
+     * end of the chunk is kept back until the next chunk completes it, or until `finish`.
+     * Ascii and Latin-1 chunks become one byte pieces.
+     */
+    void acceptUtf8Chunk(const uint8_t *data, size_t length);
     void finish();
     Buffer *build();
+    /**
+     * Whether the buffer scans the pending line starts of `fromFile` on a background thread, on by default.
+     * Without it they stay pending until the line queries that need them scan them, so tests can see the
+     * pending state.
+     */
+    void setScanLineStartsInBackground(bool enabled) { scanLineStartsInBackground_ = enabled; }
+
+    /**
+     * Returns a finished builder with the UTF-8 content of the file at `path`, or NULL if it cannot be read.
+     * The file is mapped and its ascii chunks become pieces that point into the mapping, other chunks are decoded.
+     * Edits copy the text of the pieces they touch, the other pieces keep using the mapping.
+     * The line starts of the pieces are pending, the buffer scans them in the background.
+     * With more than one thread, the chunks are decoded and scanned for line starts by `threadsCount` threads
+     * and the buffer starts with all of its line starts. The text and the pieces are the same either way.
+     */
+    static BufferBuilder *fromFile(const char *path, size_t threadsCount = 1);
+    /**
+     * Like `fromFile`, for files that don't fit in memory: each chunk becomes a `PagedBufferPiece` that keeps
+     * only its length and line count, found by one scan of the file on `threadsCount` threads. Reading a leaf
+     * pages it in from the mapping, the leaf cache budget of the buffer caps the memory for paged in leafs.
+     * Leafs that are edited stay in memory, `Buffer::compressColdLeafs` can compress them.
+     */
+    static BufferBuilder *fromFilePaged(const char *path, size_t threadsCount = 1);
 
   private:
+    BufferArena *arena_;
+    // the cache of the buffer, paged pieces need it before the buffer exists
+    LeafCache *leafCache_;
     vector<BufferPiece *> rawPieces_;
     bool hasPreviousChar_;
     uint16_t previousChar_;
     double averageChunkSize_;
+    size_t chunksCount_;
+    // the start of a UTF-8 sequence at the end of the last chunk
+    uint8_t utf8Pending_[3];
+    size_t utf8PendingLength_;
+    bool scanLineStartsInBackground_;
 
     void acceptChunk1(const BufferString *str, bool allowEmptyStrings);
     void acceptChunk2(const BufferString *str);
+    void acceptUtf8(const uint8_t *data, size_t length);
+    void acceptPieces(const vector<BufferPiece *> &pieces);
+    void acceptFile(MappedFile *file, size_t threadsCount, bool paged);
+    static BufferBuilder *fromFile(const char *path, size_t threadsCount, bool paged);
 };
 }
 
@@ -0,0 +1,146 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "buffer-journal.h"
+
+namespace edcore
+{
+
+BufferJournal::BufferJournal(Buffer *buffer, size_t memoryCap)
+{
+    buffer_ = buffer;
+    memUsage_ = 0;
+    memoryCap_ = memoryCap;
+}
+
+BufferJournal::~BufferJournal()
+{
+    clear();
+}
+
+void BufferJournal::setMemoryCap(size_t memoryCap)
+{
+    memoryCap_ = memoryCap;
+    enforceMemoryCap();
+}
+
+void BufferJournal::replaceOffsetLen(vector<OffsetLenEdit2> &edits)
+{
+    if (memoryCap_ == 0)
+    {
+        buffer_->replaceOffsetLen(edits);
+        return;
+    }
+
+    EditBatch *inverse = new EditBatch();
+    buffer_->replaceOffsetLen(edits, inverse);
+
+    clearStack(redo_);
+    push(undo_, inverse);
+}
+
+size_t BufferJournal::replaceAll(const BufferString *needle, const SearchOptions &options, const BufferString *replacement)
+{
+    EditBatch *inverse = (memoryCap_ > 0 ? new EditBatch() : NULL);
+    const size_t count = buffer_->replaceAll(needle, options, replacement, inverse);
+    record(inverse, count > 0);
+    return count;
+}
+
+bool BufferJournal::replaceAllRegex(const BufferString *pattern, const SearchOptions &options, const BufferString *replacement, size_t &count, string &error)
+{
+    EditBatch *inverse = (memoryCap_ > 0 ? new EditBatch() : NULL);
+    const bool valid = buffer_->replaceAllRegex(pattern, options, replacement, count, error, inverse);
+    record(inverse, valid && count > 0);
+    return valid;
+}
+
+/**
+ * Pushes the inverse of an applied call, or drops it if the call changed nothing.
+ */
+void BufferJournal::record(EditBatch *inverse, bool applied)
+{
+    if (inverse == NULL)
+    {
+        return;
+    }
+    if (!applied)
+    {
+        delete inverse;
+        return;
+    }
+    clearStack(redo_);
+    push(undo_, inverse);
+}
+
+bool BufferJournal::undo()
+{
+    return apply(undo_, redo_);
+}
+
+bool BufferJournal::redo()
+{
+    return apply(redo_, undo_);
+}
+
+void BufferJournal::clear()
+{
+    clearStack(undo_);
+    clearStack(redo_);
+}
+
+void BufferJournal::push(deque<EditBatch *> &stack, EditBatch *entry)
+{
+    stack.push_back(entry);
+    memUsage_ += entry->memUsage();
+    enforceMemoryCap();
+}
+
+bool BufferJournal::apply(deque<EditBatch *> &from, deque<EditBatch *> &to)
+{
+    if (from.empty())
+    {
+        return false;
+    }
+
+    EditBatch *entry = from.back();
+    from.pop_back();
+    memUsage_ -= entry->memUsage();
+
+    // applying an entry yields the entry that reverts it
+    EditBatch *inverse = new EditBatch();
+    buffer_->replaceOffsetLen(entry->edits(), inverse);
+    delete entry;
+
+    push(to, inverse);
+    return true;
+}
+
+void BufferJournal::clearStack(deque<EditBatch *> &stack)
+{
+    for (size_t i = 0, len = stack.size(); i < len; i++)
+    {
+        memUsage_ -= stack[i]->memUsage();
+        delete stack[i];
+    }
+    stack.clear();
+}
+
+void BufferJournal::enforceMemoryCap()
+{
+    while (memUsage_ > memoryCap_ && !undo_.empty())
+    {
+        memUsage_ -= undo_.front()->memUsage();
+        delete undo_.front();
+        undo_.pop_front();
+    }
+    while (memUsage_ > memoryCap_ && !redo_.empty())
+    {
+        memUsage_ -= redo_.front()->memUsage();
+        delete redo_.front();
+        redo_.pop_front();
+    }
+}
+}
@@ -0,0 +1,69 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_BUFFER_JOURNAL_H_
+#define EDCORE_BUFFER_JOURNAL_H_
+
+#include <deque>
+#include <vector>
+
+#include "buffer.h"
+
+using namespace std;
+
+namespace edcore
+{
+
+/**
+ * Undo/redo stacks for a buffer.
+ * Each entry is the inverse of an applied batch of edits. When the entries take more than `memoryCap` bytes,
+ * the oldest undo entries (and then the farthest redo entries) are dropped.
+ * A `memoryCap` of 0 disables recording.
+ */
+class BufferJournal
+{
+  public:
+    BufferJournal(Buffer *buffer, size_t memoryCap);
+    ~BufferJournal();
+
+    size_t memUsage() const { return memUsage_; }
+    size_t memoryCap() const { return memoryCap_; }
+    void setMemoryCap(size_t memoryCap);
+
+    size_t undoCount() const { return undo_.size(); }
+    size_t redoCount() const { return redo_.size(); }
+
+    /**
+     * Apply `edits` to the buffer and record their inverse. Clears the redo stack.
+     */
+    void replaceOffsetLen(vector<OffsetLenEdit2> &edits);
+    /**
+     * `Buffer::replaceAll` and `Buffer::replaceAllRegex`, recording their inverse. Nothing is recorded when
+     * there is no match.
+     */
+    size_t replaceAll(const BufferString *needle, const SearchOptions &options, const BufferString *replacement);
+    bool replaceAllRegex(const BufferString *pattern, const SearchOptions &options, const BufferString *replacement, size_t &count, string &error);
+
+    bool undo();
+    bool redo();
+
+    void clear();
+
+  private:
+    Buffer *buffer_;
+    deque<EditBatch *> undo_;
+    deque<EditBatch *> redo_;
+    size_t memUsage_;
+    size_t memoryCap_;
+
+    void push(deque<EditBatch *> &stack, EditBatch *entry);
+    void record(EditBatch *inverse, bool applied);
+    bool apply(deque<EditBatch *> &from, deque<EditBatch *> &to);
+    void clearStack(deque<EditBatch *> &stack);
+    void enforceMemoryCap();
+};
+}
+
+#endif
@@ -6,38 +6,106 @@
 #include <iostream>
 #include <assert.h>
 #include <cstring>
+#include <new>
+#include <thread>
 
 #include "buffer-piece.h"
+#include "lz-codec.h"
+#include "simd.h"
 
 namespace edcore
 {
 
-BufferPiece *BufferPiece::createFromString(const BufferString *str)
+BufferPiece::BufferPiece(BufferArena *arena, LINE_START_T *lineStarts, size_t lineStartsLength, LINE_START_T lineStartsOffset, bool ownsLineStarts) : refCount_(1), lineStartsState_(lineStarts != NULL ? LINE_STARTS_READY : LINE_STARTS_PENDING), accessed_(true)
+{
+    assert(arena != NULL);
+    assert(lineStarts != NULL || (lineStartsLength == 0 && ownsLineStarts));
+    arena->retain();
+    arena_ = arena;
+    lineStarts_ = lineStarts;
+    lineStartsLength_ = lineStartsLength;
+    lineStartsOffset_ = lineStartsOffset;
+    lineStartsCapacity_ = lineStartsLength;
+    ownsLineStarts_ = ownsLineStarts;
+}
+
+BufferPiece::BufferPiece(BufferArena *arena, size_t newLineCount) : refCount_(1), lineStartsState_(LINE_STARTS_READY), accessed_(true)
+{
+    assert(arena != NULL);
+    arena->retain();
+    arena_ = arena;
+    lineStarts_ = NULL;
+    lineStartsLength_ = newLineCount;
+    lineStartsOffset_ = 0;
+    lineStartsCapacity_ = 0;
+    ownsLineStarts_ = false;
+}
+
+BufferPiece::~BufferPiece()
+{
+    if (ownsLineStarts_ && lineStarts_ != NULL)
+    {
+        arena_->freeArray(lineStarts_, lineStartsCapacity_);
+    }
+}
+
+void BufferPiece::destroy() const
+{
+    // the arena goes away with the last piece, so it is released after the piece is given back
+    BufferArena *arena = arena_;
+    const size_t size = objectSize();
+    this->~BufferPiece();
+    arena->free(const_cast<BufferPiece *>(this), size);
+    arena->release();
+}
+
+void BufferPiece::scanLineStarts() const
+{
+    uint8_t expected = LINE_STARTS_PENDING;
+    if (!lineStartsState_.compare_exchange_strong(expected, LINE_STARTS_SCANNING, memory_order_acquire))
+    {
+        // another thread is scanning, a leaf takes microseconds
+        while (!hasLineStarts())
+        {
+            this_thread::yield();
+        }
+        return;
+    }
+
+    // the fields are written once, before the state is published
+    BufferPiece *self = const_cast<BufferPiece *>(this);
+    self->lineStarts_ = computeLineStarts(self->lineStartsLength_);
+    self->lineStartsCapacity_ = lineStartsLength_;
+    self->lineStartsOffset_ = 0;
+    lineStartsState_.store(LINE_STARTS_READY, memory_order_release);
+}
+
+BufferPiece *BufferPiece::createFromString(BufferArena *arena, const BufferString *str)
 {
     const size_t strLength = str->length();
 
     if (str->containsOnlyOneByte())
     {
-        uint8_t *oneByteData = new uint8_t[strLength];
+        uint8_t *oneByteData = arena->allocArray<uint8_t>(strLength);
         str->writeOneByte(oneByteData, 0, strLength);
-        return new OneByteBufferPiece(oneByteData, strLength);
+        return OneByteBufferPiece::create(arena, oneByteData, strLength);
     }
     else
     {
-        uint16_t *twoByteData = new uint16_t[strLength];
+        uint16_t *twoByteData = arena->allocArray<uint16_t>(strLength);
         str->write(twoByteData, 0, strLength);
-        return new TwoByteBufferPiece(twoByteData, strLength);
+        return TwoByteBufferPiece::create(arena, twoByteData, strLength);
     }
 }
 
 BufferPiece *BufferPiece::deleteLastChar2(const BufferPiece *target)
 {
+    BufferArena *arena = target->arena();
     const size_t targetCharsLength = target->length();
     const size_t targetLineStartsLength = target->newLineCount();
-    const LINE_START_T *targetLineStarts = target->lineStarts();
 
     size_t newLineStartsLength;
-    if (targetLineStartsLength > 0 && targetLineStarts[targetLineStartsLength - 1] == targetCharsLength)
+    if (targetLineStartsLength > 0 && target->lineStartFor(targetLineStartsLength - 1) == targetCharsLength)
     {
         newLineStartsLength = targetLineStartsLength - 1;
     }
@@ -46,296 +114,438 @@ BufferPiece *BufferPiece::deleteLastChar2(const BufferPiece *target)
         newLineStartsLength = targetLineStartsLength;
     }
 
-    LINE_START_T *newLineStarts = new LINE_START_T[newLineStartsLength];
-    memcpy(newLineStarts, targetLineStarts, sizeof(*newLineStarts) * newLineStartsLength);
+    LINE_START_T *newLineStarts = arena->allocArray<LINE_START_T>(newLineStartsLength);
+    for (size_t i = 0; i < newLineStartsLength; i++)
+    {
+        newLineStarts[i] = target->lineStartFor(i);
+    }
 
     const size_t newCharsLength = targetCharsLength - 1;
     if (target->isOneByte())
     {
-        uint8_t *newData = new uint8_t[newCharsLength];
+        uint8_t *newData = arena->allocArray<uint8_t>(newCharsLength);
         target->writeOneByte(newData, 0, newCharsLength);
-        return new OneByteBufferPiece(newData, newCharsLength, newLineStarts, newLineStartsLength);
+        return OneByteBufferPiece::create(arena, newData, newCharsLength, newLineStarts, newLineStartsLength);
     }
     else
     {
-        uint16_t *newData = new uint16_t[newCharsLength];
+        uint16_t *newData = arena->allocArray<uint16_t>(newCharsLength);
         target->write(newData, 0, newCharsLength);
-        return new TwoByteBufferPiece(newData, newCharsLength, newLineStarts, newLineStartsLength);
+        return TwoByteBufferPiece::create(arena, newData, newCharsLength, newLineStarts, newLineStartsLength);
     }
 }
 
 BufferPiece *BufferPiece::insertFirstChar2(const BufferPiece *target, uint16_t character)
 {
+    BufferArena *arena = target->arena();
     const size_t targetCharsLength = target->length();
     const size_t targetLineStartsLength = target->newLineCount();
-    const LINE_START_T *targetLineStarts = target->lineStarts();
-    const bool insertLineStart = ((character == '\r' && (targetLineStartsLength == 0 || targetLineStarts[0] != 1 || target->charAt(0) != '\n')) || (character == '\n'));
+    const bool insertLineStart = ((character == '\r' && (targetLineStartsLength == 0 || target->lineStartFor(0) != 1 || target->charAt(0) != '\n')) || (character == '\n'));
 
 
     const size_t newLineStartsLength = (insertLineStart ? targetLineStartsLength + 1 : targetLineStartsLength);
-    LINE_START_T *newLineStarts = new LINE_START_T[newLineStartsLength];
+    LINE_START_T *newLineStarts = arena->allocArray<LINE_START_T>(newLineStartsLength);
 
     if (insertLineStart)
     {
         newLineStarts[0] = 1;
         for (size_t i = 0; i < targetLineStartsLength; i++)
         {
-            newLineStarts[i + 1] = targetLineStarts[i] + 1;
+            newLineStarts[i + 1] = target->lineStartFor(i) + 1;
         }
     }
     else
     {
         for (size_t i = 0; i < targetLineStartsLength; i++)
         {
-            newLineStarts[i] = targetLineStarts[i] + 1;
+            newLineStarts[i] = target->lineStartFor(i) + 1;
         }
     }
 
     const size_t newCharsLength = targetCharsLength + 1;
     if (target->isOneByte() && character < 256)
     {
-        uint8_t *newData = new uint8_t[newCharsLength];
+        uint8_t *newData = arena->allocArray<uint8_t>(newCharsLength);
         target->writeOneByte(newData + 1, 0, targetCharsLength);
         newData[0] = character;
-        return new OneByteBufferPiece(newData, newCharsLength, newLineStarts, newLineStartsLength);
+        return OneByteBufferPiece::create(arena, newData, newCharsLength, newLineStarts, newLineStartsLength);
     }
     else
     {
-        uint16_t *newData = new uint16_t[newCharsLength];
+        uint16_t *newData = arena->allocArray<uint16_t>(newCharsLength);
         target->write(newData + 1, 0, targetCharsLength);
         newData[0] = character;
-        return new TwoByteBufferPiece(newData, newCharsLength, newLineStarts, newLineStartsLength);
+        return TwoByteBufferPiece::create(arena, newData, newCharsLength, newLineStarts, newLineStartsLength);
     }
 }
 
 BufferPiece *BufferPiece::join2(const BufferPiece *first, const BufferPiece *second)
 {
+    assert(first->arena() == second->arena());
+    BufferArena *arena = first->arena();
     const size_t firstCharsLength = first->length();
     const size_t secondCharsLength = second->length();
 
-    const size_t firstLineStartsLength = first->newLineCount();
+    size_t firstLineStartsLength = first->newLineCount();
     const size_t secondLineStartsLength = second->newLineCount();
 
-    const LINE_START_T *firstLineStarts = first->lineStarts();
-    const LINE_START_T *secondLineStarts = second->lineStarts();
+    if (firstCharsLength > 0 && secondCharsLength > 0 && first->charAt(firstCharsLength - 1) == '\r' && second->charAt(0) == '\n')
+    {
+        // \r\n across the join => the line start after \r is no longer valid
+        firstLineStartsLength--;
+    }
 
     const size_t newLineStartsLength = firstLineStartsLength + secondLineStartsLength;
-    LINE_START_T *newLineStarts = new LINE_START_T[newLineStartsLength];
-    memcpy(newLineStarts, firstLineStarts, sizeof(*newLineStarts) * firstLineStartsLength);
+    LINE_START_T *newLineStarts = arena->allocArray<LINE_START_T>(newLineStartsLength);
+    for (size_t i = 0; i < firstLineStartsLength; i++)
+    {
+        newLineStarts[i] = first->lineStartFor(i);
+    }
     for (size_t i = 0; i < secondLineStartsLength; i++)
     {
-        newLineStarts[i + firstLineStartsLength] = secondLineStarts[i] + firstCharsLength;
+        newLineStarts[i + firstLineStartsLength] = second->lineStartFor(i) + firstCharsLength;
     }
 
     const size_t newCharsLength = firstCharsLength + secondCharsLength;
     if (first->isOneByte() && second->isOneByte())
     {
-        uint8_t *newData = new uint8_t[newCharsLength];
+        uint8_t *newData = arena->allocArray<uint8_t>(newCharsLength);
         first->writeOneByte(newData, 0, firstCharsLength);
         second->writeOneByte(newData + firstCharsLength, 0, secondCharsLength);
-        return new OneByteBufferPiece(newData, newCharsLength, newLineStarts, newLineStartsLength);
+        return OneByteBufferPiece::create(arena, newData, newCharsLength, newLineStarts, newLineStartsLength);
     }
     else
     {
-        uint16_t *newData = new uint16_t[newCharsLength];
+        uint16_t *newData = arena->allocArray<uint16_t>(newCharsLength);
         first->write(newData, 0, firstCharsLength);
         second->write(newData + firstCharsLength, 0, secondCharsLength);
-        return new TwoByteBufferPiece(newData, newCharsLength, newLineStarts, newLineStartsLength);
+        return TwoByteBufferPiece::create(arena, newData, newCharsLength, newLineStarts, newLineStartsLength);
     }
 }
 
-BufferString *recordString(BufferString *str, size_t index, vector<BufferString *> &toDelete)
-{
-    toDelete[index] = str;
-    return str;
-}
-
-void BufferPiece::replaceOffsetLen(const BufferPiece *target, vector<LeafOffsetLenEdit2> &edits, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> *result)
+BufferPiece *BufferPiece::slice(const BufferPiece *target, size_t start, size_t length)
 {
-    const size_t editsSize = edits.size();
-    assert(editsSize > 0);
-
-    const size_t originalCharsLength = target->length();
-    if (editsSize == 1 && edits[0].text->length() == 0 && edits[0].start == 0 && edits[0].length == originalCharsLength)
+    assert(length > 0 && start + length <= target->length());
+    if (start == 0 && length == target->length())
     {
-        // special case => deleting everything
-        return;
+        target->retain();
+        return const_cast<BufferPiece *>(target);
     }
-
-    vector<BufferString *> toDelete(editsSize + 1);
-
-    vector<const BufferString *> pieces(2 * editsSize + 1);
-    size_t originalFromIndex = 0;
-    size_t piecesTextLength = 0;
-    bool resultIsOneByte = target->isOneByte();
-    for (size_t i = 0; i < editsSize; i++)
+    if (target->isCached())
     {
-        LeafOffsetLenEdit2 &edit = edits[i];
-
-        resultIsOneByte = resultIsOneByte && edit.text->containsOnlyOneByte();
-        // printf("~~~~leaf edit: %lu,%lu -> [%lu ~ ", edit.start, edit.length, edit.text->length());
-        // edit.text->print();
-        // printf("]\n");
-
-        // maintain the chars that survive to the left of this edit
-        BufferString *originalText = recordString(BufferString::substr(target, originalFromIndex, edit.start - originalFromIndex), i, toDelete);
-        pieces[2 * i] = originalText;
-        piecesTextLength += originalText->length();
-
-        originalFromIndex = edit.start + edit.length;
-        pieces[2 * i + 1] = edit.text;
-        piecesTextLength += edit.text->length();
+        // spans need the chars of their block, the slice gets a copy of them instead
+        vector<uint16_t> chars(length);
+        target->write(chars.data(), start, length);
+        TwoByteArrayString str(chars.data(), length);
+        return createFromString(target->arena(), &str);
     }
+    return SpanBufferPiece::create(target->block(), target->blockStart() + start, length);
+}
 
-    // maintain the chars that survive to the right of the last edit
-    BufferString *text = recordString(BufferString::substr(target, originalFromIndex, originalCharsLength - originalFromIndex), editsSize, toDelete);
-    pieces[2 * editsSize] = text;
-    piecesTextLength += text->length();
-
-    size_t targetDataLength = piecesTextLength > maxLeafLength ? idealLeafLength : piecesTextLength;
-    size_t targetDataOffset = 0;
-
-    uint8_t *oneByteData = NULL;
-    uint16_t *twoByteData = NULL;
-    if (resultIsOneByte)
-    {
-        oneByteData = new uint8_t[targetDataLength];
-    }
-    else
+/**
+ * Copies spans of text into new leafs of `idealLeafLength`, or a single leaf if everything fits in `maxLeafLength`.
+ * A leaf never ends in \r or a high surrogate while more text follows, those move over to the next leaf.
+ */
+class LeafWriter
+{
+  public:
+    LeafWriter(BufferArena *arena, bool isOneByte, size_t textLength, size_t idealLeafLength, size_t maxLeafLength, bool lazy, vector<BufferPiece *> &result)
+        : arena_(arena), isOneByte_(isOneByte), textLength_(textLength), idealLeafLength_(idealLeafLength), maxLeafLength_(maxLeafLength), lazy_(lazy), result_(result)
     {
-        twoByteData = new uint16_t[targetDataLength];
+        startLeaf();
     }
 
-    for (size_t pieceIndex = 0, pieceCount = pieces.size(); pieceIndex < pieceCount; pieceIndex++)
+    void append(const BufferString *source, size_t start, size_t length)
     {
-        const BufferString *pieceText = pieces[pieceIndex];
-        const size_t pieceLength = pieceText->length();
-        if (pieceLength == 0)
-        {
-            continue;
-        }
-
-        size_t pieceOffset = 0;
-        while (pieceOffset < pieceLength)
+        size_t offset = 0;
+        while (offset < length)
         {
-            if (targetDataOffset >= targetDataLength)
+            if (leafOffset_ >= leafLength_)
             {
-                if (resultIsOneByte)
-                {
-                    result->push_back(new OneByteBufferPiece(oneByteData, targetDataLength));
-                }
-                else
-                {
-                    result->push_back(new TwoByteBufferPiece(twoByteData, targetDataLength));
-                }
-
-                targetDataLength = piecesTextLength > maxLeafLength ? idealLeafLength : piecesTextLength;
-                targetDataOffset = 0;
-                if (resultIsOneByte)
-                {
-                    oneByteData = new uint8_t[targetDataLength];
-                }
-                else
-                {
-                    twoByteData = new uint16_t[targetDataLength];
-                }
+                finishLeaf();
+                startLeaf();
             }
-            size_t writingCnt = min(pieceLength - pieceOffset, targetDataLength - targetDataOffset);
-            if (resultIsOneByte)
+            const size_t writingCnt = min(length - offset, leafLength_ - leafOffset_);
+            if (isOneByte_)
             {
-                pieceText->writeOneByte(oneByteData + targetDataOffset, pieceOffset, writingCnt);
+                source->writeOneByte(oneByteData_ + leafOffset_, start + offset, writingCnt);
             }
             else
             {
-                pieceText->write(twoByteData + targetDataOffset, pieceOffset, writingCnt);
+                source->write(twoByteData_ + leafOffset_, start + offset, writingCnt);
             }
 
-            pieceOffset += writingCnt;
-            targetDataOffset += writingCnt;
-            piecesTextLength -= writingCnt;
+            offset += writingCnt;
+            leafOffset_ += writingCnt;
+            textLength_ -= writingCnt;
 
             // check that the buffer piece does not end in a \r or high surrogate
-            if (targetDataOffset == targetDataLength && piecesTextLength > 0)
+            if (leafOffset_ == leafLength_ && textLength_ > 0)
             {
-                uint16_t lastChar;
-                if (resultIsOneByte)
-                {
-                    lastChar = oneByteData[targetDataLength - 1];
-                }
-                else
-                {
-                    lastChar = twoByteData[targetDataLength - 1];
-                }
+                const uint16_t lastChar = (isOneByte_ ? oneByteData_[leafLength_ - 1] : twoByteData_[leafLength_ - 1]);
                 if (lastChar == '\r' || (0xD800 <= lastChar && lastChar <= 0xDBFF))
                 {
                     // move lastChar over to next buffer piece
-                    targetDataLength -= 1;
-                    pieceOffset -= 1;
-                    targetDataOffset -= 1;
-                    piecesTextLength += 1;
+                    leafLength_ -= 1;
+                    offset -= 1;
+                    leafOffset_ -= 1;
+                    textLength_ += 1;
                 }
             }
         }
     }
 
-    if (resultIsOneByte)
+    void finishLeaf()
     {
-        result->push_back(new OneByteBufferPiece(oneByteData, targetDataLength));
+        if (leafLength_ != leafCapacity_)
+        {
+            // arena blocks must be given back with the size they were allocated with
+            shrinkLeaf();
+        }
+        if (isOneByte_)
+        {
+            result_.push_back(lazy_ ? OneByteBufferPiece::createLazy(arena_, oneByteData_, leafLength_) : OneByteBufferPiece::create(arena_, oneByteData_, leafLength_));
+        }
+        else
+        {
+            result_.push_back(lazy_ ? TwoByteBufferPiece::createLazy(arena_, twoByteData_, leafLength_) : TwoByteBufferPiece::create(arena_, twoByteData_, leafLength_));
+        }
     }
-    else
+
+  private:
+    BufferArena *arena_;
+    const bool isOneByte_;
+    // the text still to be written
+    size_t textLength_;
+    const size_t idealLeafLength_;
+    const size_t maxLeafLength_;
+    const bool lazy_;
+    vector<BufferPiece *> &result_;
+
+    uint8_t *oneByteData_;
+    uint16_t *twoByteData_;
+    size_t leafLength_;
+    size_t leafCapacity_;
+    size_t leafOffset_;
+
+    void startLeaf()
+    {
+        leafLength_ = (textLength_ > maxLeafLength_ ? idealLeafLength_ : textLength_);
+        leafCapacity_ = leafLength_;
+        leafOffset_ = 0;
+        oneByteData_ = (isOneByte_ ? arena_->allocArray<uint8_t>(leafLength_) : NULL);
+        twoByteData_ = (isOneByte_ ? NULL : arena_->allocArray<uint16_t>(leafLength_));
+    }
+
+    void shrinkLeaf()
+    {
+        if (isOneByte_)
+        {
+            uint8_t *data = arena_->allocArray<uint8_t>(leafLength_);
+            memcpy(data, oneByteData_, sizeof(*data) * leafLength_);
+            arena_->freeArray(oneByteData_, leafCapacity_);
+            oneByteData_ = data;
+        }
+        else
+        {
+            uint16_t *data = arena_->allocArray<uint16_t>(leafLength_);
+            memcpy(data, twoByteData_, sizeof(*data) * leafLength_);
+            arena_->freeArray(twoByteData_, leafCapacity_);
+            twoByteData_ = data;
+        }
+        leafCapacity_ = leafLength_;
+    }
+};
+
+/**
+ * Writes spans of text one after the other into an array of two byte chars.
+ */
+class ArrayWriter
+{
+  public:
+    ArrayWriter(uint16_t *chars) : chars_(chars) {}
+
+    void append(const BufferString *source, size_t start, size_t length)
+    {
+        source->write(chars_, start, length);
+        chars_ += length;
+    }
+
+  private:
+    uint16_t *chars_;
+};
+
+/**
+ * Appends the text of `target` with `edits` applied to `writer`.
+ */
+template <typename W>
+static void writeEditedText(const BufferPiece *target, const vector<LeafOffsetLenEdit2> &edits, const vector<TextSpan> &spans, W &writer)
+{
+    size_t originalFromIndex = 0;
+    for (size_t i = 0, editsSize = edits.size(); i < editsSize; i++)
     {
-        result->push_back(new TwoByteBufferPiece(twoByteData, targetDataLength));
+        const LeafOffsetLenEdit2 &edit = edits[i];
+
+        // the chars that survive to the left of this edit
+        writer.append(target, originalFromIndex, edit.start - originalFromIndex);
+        for (size_t j = edit.spansStart, end = edit.spansStart + edit.spansCount; j < end; j++)
+        {
+            writer.append(spans[j].source, spans[j].start, spans[j].length);
+        }
+        originalFromIndex = edit.start + edit.length;
     }
+    // the chars that survive to the right of the last edit
+    writer.append(target, originalFromIndex, target->length() - originalFromIndex);
+}
 
-    for (size_t i = 0, len = toDelete.size(); i < len; i++)
+static void appendRun(BufferArena *arena, const TwoByteArrayString &text, size_t start, size_t length, bool isOneByte, size_t idealLeafLength, size_t maxLeafLength, bool lazy, vector<BufferPiece *> &result)
+{
+    if (length == 0)
     {
-        delete toDelete[i];
+        return;
     }
+    LeafWriter writer(arena, isOneByte, length, idealLeafLength, maxLeafLength, lazy, result);
+    writer.append(&text, start, length);
+    writer.finishLeaf();
 }
 
-template <typename T>
-void createLineStarts(const T *data, size_t length, vector<LINE_START_T> &lineStarts)
+void BufferPiece::createLeafs(BufferArena *arena, const uint16_t *chars, size_t length, size_t idealLeafLength, size_t maxLeafLength, bool lazy, vector<BufferPiece *> &result)
 {
-    for (size_t i = 0; i < length; i++)
+    const TwoByteArrayString text(chars, length);
+
+    size_t runStart = 0;
+    size_t wideStart = 0;
+    while (true)
     {
-        uint16_t chr = data[i];
+        while (wideStart < length && chars[wideStart] < 256)
+        {
+            wideStart++;
+        }
+        if (wideStart == length)
+        {
+            break;
+        }
 
-        if (chr == '\r')
+        // the wide run goes on until the one byte text after its last wide char gets long
+        size_t wideEnd = wideStart + 1;
+        for (size_t i = wideEnd; i < length && i - wideEnd < WIDE_RUN_MAX_GAP; i++)
         {
-            if (i + 1 < length && data[i + 1] == '\n')
+            if (chars[i] >= 256)
             {
-                // \r\n... case
-                lineStarts.push_back(i + 2);
-                i++; // skip \n
-            }
-            else
-            {
-                // \r... case
-                lineStarts.push_back(i + 1);
+                wideEnd = i + 1;
             }
         }
-        else if (chr == '\n')
+        while (wideEnd < length && ((0xD800 <= chars[wideEnd - 1] && chars[wideEnd - 1] <= 0xDBFF) || (chars[wideEnd - 1] == '\r' && chars[wideEnd] == '\n')))
+        {
+            // a lone high surrogate would be moved over to the one byte leaf after it, and \r\n must stay together
+            wideEnd++;
+        }
+        if (length - wideEnd <= WIDE_RUN_MAX_GAP)
+        {
+            wideEnd = length;
+        }
+        if (wideStart - runStart <= WIDE_RUN_MAX_GAP)
+        {
+            wideStart = runStart;
+        }
+
+        // a run starts before a wide char, so \r\n and surrogate pairs are never cut there
+        appendRun(arena, text, runStart, wideStart - runStart, true, idealLeafLength, maxLeafLength, lazy, result);
+        appendRun(arena, text, wideStart, wideEnd - wideStart, false, idealLeafLength, maxLeafLength, lazy, result);
+        runStart = wideStart = wideEnd;
+    }
+    appendRun(arena, text, runStart, length - runStart, true, idealLeafLength, maxLeafLength, lazy, result);
+}
+
+void BufferPiece::replaceOffsetLen(const BufferPiece *target, const vector<LeafOffsetLenEdit2> &edits, const vector<TextSpan> &spans, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> &result)
+{
+    const size_t editsSize = edits.size();
+    assert(editsSize > 0);
+
+    const size_t originalCharsLength = target->length();
+    if (editsSize == 1 && edits[0].spansCount == 0 && edits[0].start == 0 && edits[0].length == originalCharsLength)
+    {
+        // special case => deleting everything
+        return;
+    }
+
+    size_t textLength = originalCharsLength;
+    bool resultIsOneByte = target->isOneByte();
+    for (size_t i = 0; i < editsSize; i++)
+    {
+        const LeafOffsetLenEdit2 &edit = edits[i];
+        textLength -= edit.length;
+        for (size_t j = edit.spansStart, end = edit.spansStart + edit.spansCount; j < end; j++)
+        {
+            resultIsOneByte = resultIsOneByte && spans[j].source->containsOnlyOneByte();
+            textLength += spans[j].length;
+        }
+    }
+
+    if (resultIsOneByte)
+    {
+        LeafWriter writer(target->arena(), true, textLength, idealLeafLength, maxLeafLength, false, result);
+        writeEditedText(target, edits, spans, writer);
+        writer.finishLeaf();
+        return;
+    }
+
+    if (textLength == 0)
+    {
+        return;
+    }
+
+    // the wide chars may be few or gone, the runs between them get one byte leafs
+    vector<uint16_t> text(textLength);
+    ArrayWriter writer(text.data());
+    writeEditedText(target, edits, spans, writer);
+    createLeafs(target->arena(), text.data(), textLength, idealLeafLength, maxLeafLength, false, result);
+}
+
+void BufferPiece::replaceSpans(const BufferPiece *target, const vector<LeafOffsetLenEdit2> &edits, const vector<TextSpan> &spans, AddBuffer &addBuffer, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> &result)
+{
+    const size_t editsSize = edits.size();
+    assert(editsSize > 0);
+
+    const size_t originalCharsLength = target->length();
+    size_t originalFromIndex = 0;
+    for (size_t i = 0; i < editsSize; i++)
+    {
+        const LeafOffsetLenEdit2 &edit = edits[i];
+
+        // the chars that survive to the left of this edit
+        if (edit.start > originalFromIndex)
+        {
+            result.push_back(slice(target, originalFromIndex, edit.start - originalFromIndex));
+        }
+        if (edit.spansCount > 0)
         {
-            lineStarts.push_back(i + 1);
+            addBuffer.append(&spans[edit.spansStart], edit.spansCount, idealLeafLength, maxLeafLength, result);
         }
+        originalFromIndex = edit.start + edit.length;
+    }
+    // the chars that survive to the right of the last edit
+    if (originalCharsLength > originalFromIndex)
+    {
+        result.push_back(slice(target, originalFromIndex, originalCharsLength - originalFromIndex));
     }
 }
 
 template <typename T>
-void doAssertInvariants(const T *chars, size_t charsLength, const LINE_START_T *lineStarts, size_t lineStartsLength)
+void doAssertInvariants(const T *chars, size_t charsLength, const LINE_START_T *lineStarts, size_t lineStartsLength, LINE_START_T lineStartsOffset)
 {
     assert(chars != NULL);
     assert(lineStarts != NULL);
 
     for (size_t i = 0; i < lineStartsLength; i++)
     {
-        LINE_START_T lineStart = lineStarts[i];
+        LINE_START_T lineStart = lineStarts[i] - lineStartsOffset;
 
         assert(lineStart > 0 && lineStart <= charsLength);
 
         if (i > 0)
         {
-            LINE_START_T prevLineStart = lineStarts[i - 1];
+            LINE_START_T prevLineStart = lineStarts[i - 1] - lineStartsOffset;
             assert(lineStart > prevLineStart);
         }
 
@@ -350,49 +560,96 @@ void doAssertInvariants(const T *chars, size_t charsLength, const LINE_START_T *
     }
 }
 
+template <typename T>
+LINE_START_T *allocLineStarts(BufferArena *arena, const T *data, size_t length, size_t &lineStartsLength)
+{
+    // the scan result is collected in a per-thread scratch vector, so only the final array is allocated
+    static thread_local vector<LINE_START_T> lineStarts;
+    lineStarts.clear();
+    createLineStarts(data, length, lineStarts);
+
+    lineStartsLength = lineStarts.size();
+    LINE_START_T *result = arena->allocArray<LINE_START_T>(lineStartsLength);
+    if (lineStartsLength > 0)
+    {
+        memcpy(result, lineStarts.data(), sizeof(*result) * lineStartsLength);
+    }
+    return result;
+}
+
 // ---- OneByteBufferPiece
 
-OneByteBufferPiece::OneByteBufferPiece(uint8_t *data, size_t length)
+OneByteBufferPiece *OneByteBufferPiece::create(BufferArena *arena, uint8_t *data, size_t dataLength)
 {
-    assert(data != NULL);
-    chars_ = data;
-    charsLength_ = length;
+    size_t lineStartsLength;
+    LINE_START_T *lineStarts = allocLineStarts(arena, data, dataLength, lineStartsLength);
+    return create(arena, data, dataLength, lineStarts, lineStartsLength);
+}
 
-    vector<LINE_START_T> lineStarts;
-    createLineStarts(data, length, lineStarts);
-    lineStarts_.assign(lineStarts);
+OneByteBufferPiece *OneByteBufferPiece::create(BufferArena *arena, uint8_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength)
+{
+    return new (arena->alloc(sizeof(OneByteBufferPiece))) OneByteBufferPiece(arena, data, dataLength, lineStarts, lineStartsLength);
+}
+
+OneByteBufferPiece *OneByteBufferPiece::createLazy(BufferArena *arena, uint8_t *data, size_t dataLength)
+{
+    return create(arena, data, dataLength, NULL, 0);
 }
 
-OneByteBufferPiece::OneByteBufferPiece(uint8_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength)
+OneByteBufferPiece *OneByteBufferPiece::createLazy(BufferArena *arena, MappedFile *file, size_t start, size_t length)
 {
-    assert(data != NULL && lineStarts != NULL);
+    assert(start + length <= file->length());
+    // the mapping is read-only, only add buffer blocks are ever written to
+    uint8_t *data = const_cast<uint8_t *>(file->data() + start);
+    OneByteBufferPiece *result = createLazy(arena, data, length);
+    file->retain();
+    result->file_ = file;
+    return result;
+}
+
+OneByteBufferPiece::OneByteBufferPiece(BufferArena *arena, uint8_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength) : BufferPiece(arena, lineStarts, lineStartsLength)
+{
+    assert(data != NULL);
     chars_ = data;
     charsLength_ = dataLength;
-    lineStarts_.assign(lineStarts, lineStartsLength);
+    charsCapacity_ = dataLength;
+    file_ = NULL;
 }
 
 OneByteBufferPiece::~OneByteBufferPiece()
 {
-    delete[] chars_;
+    if (file_ != NULL)
+    {
+        file_->release();
+    }
+    else
+    {
+        arena_->freeArray(chars_, charsCapacity_);
+    }
+}
+
+LINE_START_T *OneByteBufferPiece::computeLineStarts(size_t &lineStartsLength) const
+{
+    return allocLineStarts(arena_, chars_, charsLength_, lineStartsLength);
 }
 
 void OneByteBufferPiece::assertInvariants() const
 {
-    doAssertInvariants(chars_, charsLength_, lineStarts_.data(), lineStarts_.length());
+    ensureLineStarts();
+    doAssertInvariants(chars_, charsLength_, lineStarts_, lineStartsLength_, lineStartsOffset_);
 }
 
 void OneByteBufferPiece::write(uint16_t *buffer, size_t start, size_t length) const
 {
     assert(start + length <= charsLength_);
-    for (size_t i = 0; i < length; i++)
-    {
-        buffer[i] = chars_[start + i];
-    }
+    markAccessed();
+    widenOneByte(chars_ + start, length, buffer);
 }
 
 void OneByteBufferPiece::writeOneByte(uint8_t *buffer, size_t start, size_t length) const
 {
     assert(start + length <= charsLength_);
+    markAccessed();
     memcpy(buffer, chars_ + start, sizeof(*buffer) * length);
 }
 
@@ -402,55 +659,723 @@ bool OneByteBufferPiece::containsOnlyOneByte() const {
 
 // ---- TwoByteBufferPiece
 
-TwoByteBufferPiece::TwoByteBufferPiece(uint16_t *data, size_t length)
+TwoByteBufferPiece *TwoByteBufferPiece::create(BufferArena *arena, uint16_t *data, size_t dataLength)
 {
-    assert(data != NULL);
-    chars_ = data;
-    charsLength_ = length;
+    size_t lineStartsLength;
+    LINE_START_T *lineStarts = allocLineStarts(arena, data, dataLength, lineStartsLength);
+    return create(arena, data, dataLength, lineStarts, lineStartsLength);
+}
 
-    vector<LINE_START_T> lineStarts;
-    createLineStarts(data, length, lineStarts);
-    lineStarts_.assign(lineStarts);
+TwoByteBufferPiece *TwoByteBufferPiece::create(BufferArena *arena, uint16_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength)
+{
+    return new (arena->alloc(sizeof(TwoByteBufferPiece))) TwoByteBufferPiece(arena, data, dataLength, lineStarts, lineStartsLength);
 }
 
-TwoByteBufferPiece::TwoByteBufferPiece(uint16_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength)
+TwoByteBufferPiece *TwoByteBufferPiece::createLazy(BufferArena *arena, uint16_t *data, size_t dataLength)
 {
-    assert(data != NULL && lineStarts != NULL);
+    return create(arena, data, dataLength, NULL, 0);
+}
+
+TwoByteBufferPiece::TwoByteBufferPiece(BufferArena *arena, uint16_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength) : BufferPiece(arena, lineStarts, lineStartsLength)
+{
+    assert(data != NULL);
     chars_ = data;
     charsLength_ = dataLength;
-    lineStarts_.assign(lineStarts, lineStartsLength);
+    charsCapacity_ = dataLength;
 }
 
 TwoByteBufferPiece::~TwoByteBufferPiece()
 {
-    delete[] chars_;
+    arena_->freeArray(chars_, charsCapacity_);
+}
+
+LINE_START_T *TwoByteBufferPiece::computeLineStarts(size_t &lineStartsLength) const
+{
+    return allocLineStarts(arena_, chars_, charsLength_, lineStartsLength);
 }
 
 void TwoByteBufferPiece::assertInvariants() const
 {
-    doAssertInvariants(chars_, charsLength_, lineStarts_.data(), lineStarts_.length());
+    ensureLineStarts();
+    doAssertInvariants(chars_, charsLength_, lineStarts_, lineStartsLength_, lineStartsOffset_);
 }
 
 void TwoByteBufferPiece::write(uint16_t *buffer, size_t start, size_t length) const
 {
     assert(start + length <= charsLength_);
+    markAccessed();
     memcpy(buffer, chars_ + start, sizeof(*buffer) * length);
 }
 
 void TwoByteBufferPiece::writeOneByte(uint8_t *buffer, size_t start, size_t length) const
 {
     assert(start + length <= charsLength_);
-    for (size_t i = 0; i < length; i++)
+    markAccessed();
+    narrowToOneByte(chars_ + start, length, buffer);
+}
+
+bool TwoByteBufferPiece::containsOnlyOneByte() const
+{
+    return edcore::containsOnlyOneByte(chars_, charsLength_);
+}
+
+bool TwoByteBufferPiece::sliceContainsOnlyOneByte(size_t start, size_t length) const
+{
+    assert(start + length <= charsLength_);
+    return edcore::containsOnlyOneByte(chars_ + start, length);
+}
+
+// ---- SpanBufferPiece
+
+SpanBufferPiece *SpanBufferPiece::create(const BufferPiece *block, size_t blockStart, size_t length)
+{
+    assert(block->block() == block);
+    assert(length > 0 && blockStart + length <= block->length());
+    BufferArena *arena = block->arena();
+    const size_t blockEnd = blockStart + length;
+
+    if (!block->hasLineStarts())
     {
-        buffer[i] = chars_[start + i];
+        // don't make a leaf of the file wait for the scan of the whole block
+        return new (arena->alloc(sizeof(SpanBufferPiece))) SpanBufferPiece(block, blockStart, length, NULL, 0, true);
     }
+
+    // the block's line starts inside the span, a line start at `blockStart` belongs to the char before the span
+    const LINE_START_T *blockLineStarts = block->lineStarts_;
+    const size_t blockLineStartsLength = block->lineStartsLength_;
+    const size_t first = upper_bound(blockLineStarts, blockLineStarts + blockLineStartsLength, blockStart) - blockLineStarts;
+    const size_t last = upper_bound(blockLineStarts, blockLineStarts + blockLineStartsLength, blockEnd) - blockLineStarts;
+
+    if (block->charAt(blockEnd - 1) == '\r' && blockEnd < block->length() && block->charAt(blockEnd) == '\n')
+    {
+        // the block has its line start after the \n, which is not part of the span
+        const size_t lineStartsLength = last - first + 1;
+        LINE_START_T *lineStarts = arena->allocArray<LINE_START_T>(lineStartsLength);
+        memcpy(lineStarts, blockLineStarts + first, sizeof(*lineStarts) * (last - first));
+        lineStarts[lineStartsLength - 1] = blockEnd;
+        return new (arena->alloc(sizeof(SpanBufferPiece))) SpanBufferPiece(block, blockStart, length, lineStarts, lineStartsLength, true);
+    }
+
+    LINE_START_T *lineStarts = const_cast<LINE_START_T *>(blockLineStarts + first);
+    return new (arena->alloc(sizeof(SpanBufferPiece))) SpanBufferPiece(block, blockStart, length, lineStarts, last - first, false);
 }
 
-bool TwoByteBufferPiece::containsOnlyOneByte() const
+SpanBufferPiece::SpanBufferPiece(const BufferPiece *block, size_t blockStart, size_t length, LINE_START_T *lineStarts, size_t lineStartsLength, bool ownsLineStarts) : BufferPiece(block->arena(), lineStarts, lineStartsLength, blockStart, ownsLineStarts)
+{
+    block->retain();
+    block_ = block;
+    blockStart_ = blockStart;
+    charsLength_ = length;
+    if (block->isOneByte())
+    {
+        oneByteChars_ = static_cast<const OneByteBufferPiece *>(block)->data() + blockStart;
+        twoByteChars_ = NULL;
+    }
+    else
+    {
+        oneByteChars_ = NULL;
+        twoByteChars_ = static_cast<const TwoByteBufferPiece *>(block)->data() + blockStart;
+    }
+}
+
+SpanBufferPiece::~SpanBufferPiece()
+{
+    block_->release();
+}
+
+LINE_START_T *SpanBufferPiece::computeLineStarts(size_t &lineStartsLength) const
+{
+    if (oneByteChars_ != NULL)
+    {
+        return allocLineStarts(arena_, oneByteChars_, charsLength_, lineStartsLength);
+    }
+    return allocLineStarts(arena_, twoByteChars_, charsLength_, lineStartsLength);
+}
+
+void SpanBufferPiece::assertInvariants() const
+{
+    ensureLineStarts();
+    if (oneByteChars_ != NULL)
+    {
+        doAssertInvariants(oneByteChars_, charsLength_, lineStarts_, lineStartsLength_, lineStartsOffset_);
+    }
+    else
+    {
+        doAssertInvariants(twoByteChars_, charsLength_, lineStarts_, lineStartsLength_, lineStartsOffset_);
+    }
+}
+
+void SpanBufferPiece::write(uint16_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= charsLength_);
+    if (oneByteChars_ != NULL)
+    {
+        widenOneByte(oneByteChars_ + start, length, buffer);
+    }
+    else
+    {
+        memcpy(buffer, twoByteChars_ + start, sizeof(*buffer) * length);
+    }
+}
+
+void SpanBufferPiece::writeOneByte(uint8_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= charsLength_);
+    if (oneByteChars_ != NULL)
+    {
+        memcpy(buffer, oneByteChars_ + start, sizeof(*buffer) * length);
+    }
+    else
+    {
+        narrowToOneByte(twoByteChars_ + start, length, buffer);
+    }
+}
+
+bool SpanBufferPiece::containsOnlyOneByte() const
+{
+    return sliceContainsOnlyOneByte(0, charsLength_);
+}
+
+bool SpanBufferPiece::sliceContainsOnlyOneByte(size_t start, size_t length) const
+{
+    assert(start + length <= charsLength_);
+    return (oneByteChars_ != NULL || edcore::containsOnlyOneByte(twoByteChars_ + start, length));
+}
+
+// ---- CachedBufferPiece
+
+CachedBufferPiece::CachedBufferPiece(BufferArena *arena, LeafCache *cache, size_t charsLength, bool isOneByte, bool containsOnlyOneByte, LINE_START_T *lineStarts, size_t lineStartsLength) : BufferPiece(arena, lineStarts, lineStartsLength)
+{
+    cache->retain();
+    cache_ = cache;
+    charsLength_ = charsLength;
+    isOneByte_ = isOneByte;
+    containsOnlyOneByte_ = containsOnlyOneByte;
+}
+
+CachedBufferPiece::CachedBufferPiece(BufferArena *arena, LeafCache *cache, size_t charsLength, bool isOneByte, bool containsOnlyOneByte, size_t newLineCount) : BufferPiece(arena, newLineCount)
+{
+    cache->retain();
+    cache_ = cache;
+    charsLength_ = charsLength;
+    isOneByte_ = isOneByte;
+    containsOnlyOneByte_ = containsOnlyOneByte;
+}
+
+CachedBufferPiece::~CachedBufferPiece()
+{
+    cache_->remove(this);
+    cache_->release();
+}
+
+LINE_START_T *CachedBufferPiece::computeLineStarts(size_t &lineStartsLength) const
+{
+    // the line starts are known when the piece is created, this is only here for completeness
+    const uint8_t *chars = cache_->lock(this);
+    LINE_START_T *result = (isOneByte_ ? allocLineStarts(arena_, chars, charsLength_, lineStartsLength) : allocLineStarts(arena_, reinterpret_cast<const uint16_t *>(chars), charsLength_, lineStartsLength));
+    cache_->unlock();
+    return result;
+}
+
+void CachedBufferPiece::assertInvariants() const
+{
+    const uint8_t *chars = cache_->lock(this);
+    const LINE_START_T *lineStarts = (lineStarts_ != NULL ? lineStarts_ : reinterpret_cast<const LINE_START_T *>(chars + pagedLineStartsAt()));
+    if (isOneByte_)
+    {
+        doAssertInvariants(chars, charsLength_, lineStarts, lineStartsLength_, lineStartsOffset_);
+    }
+    else
+    {
+        doAssertInvariants(reinterpret_cast<const uint16_t *>(chars), charsLength_, lineStarts, lineStartsLength_, lineStartsOffset_);
+    }
+    cache_->unlock();
+}
+
+uint16_t CachedBufferPiece::charAt(size_t index) const
+{
+    assert(index < charsLength_);
+    const uint8_t *chars = cache_->lock(this);
+    const uint16_t result = (isOneByte_ ? chars[index] : reinterpret_cast<const uint16_t *>(chars)[index]);
+    cache_->unlock();
+    return result;
+}
+
+void CachedBufferPiece::write(uint16_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= charsLength_);
+    const uint8_t *chars = cache_->lock(this);
+    if (isOneByte_)
+    {
+        widenOneByte(chars + start, length, buffer);
+    }
+    else
+    {
+        memcpy(buffer, reinterpret_cast<const uint16_t *>(chars) + start, sizeof(*buffer) * length);
+    }
+    cache_->unlock();
+}
+
+void CachedBufferPiece::writeOneByte(uint8_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= charsLength_);
+    const uint8_t *chars = cache_->lock(this);
+    if (isOneByte_)
+    {
+        memcpy(buffer, chars + start, sizeof(*buffer) * length);
+    }
+    else
+    {
+        narrowToOneByte(reinterpret_cast<const uint16_t *>(chars) + start, length, buffer);
+    }
+    cache_->unlock();
+}
+
+bool CachedBufferPiece::sliceContainsOnlyOneByte(size_t start, size_t length) const
+{
+    if (containsOnlyOneByte_)
+    {
+        return true;
+    }
+    const uint8_t *chars = cache_->lock(this);
+    const bool result = edcore::containsOnlyOneByte(reinterpret_cast<const uint16_t *>(chars) + start, length);
+    cache_->unlock();
+    return result;
+}
+
+// ---- CompressedBufferPiece
+
+CompressedBufferPiece *CompressedBufferPiece::create(const BufferPiece *source, LeafCache *cache)
+{
+    if (!source->isCompressible() || !source->hasLineStarts() || source->length() == 0)
+    {
+        return NULL;
+    }
+
+    const bool isOneByte = source->isOneByte();
+    const uint8_t *chars = (isOneByte ? static_cast<const OneByteBufferPiece *>(source)->data() : reinterpret_cast<const uint8_t *>(static_cast<const TwoByteBufferPiece *>(source)->data()));
+    const size_t size = source->length() * (isOneByte ? sizeof(uint8_t) : sizeof(uint16_t));
+
+    // compress into per-thread scratch, so the piece gets an array of its exact length
+    static thread_local vector<uint8_t> scratch;
+    scratch.resize(lzCompressBound(size));
+    const size_t compressedLength = lzCompress(chars, size, scratch.data());
+    if (compressedLength * 100 > size * (100 - COMPRESSED_PIECE_MIN_SAVING))
+    {
+        return NULL;
+    }
+
+    BufferArena *arena = source->arena();
+    uint8_t *compressed = arena->allocArray<uint8_t>(compressedLength);
+    memcpy(compressed, scratch.data(), compressedLength);
+
+    const size_t lineStartsLength = source->newLineCount();
+    LINE_START_T *lineStarts = arena->allocArray<LINE_START_T>(lineStartsLength);
+    for (size_t i = 0; i < lineStartsLength; i++)
+    {
+        lineStarts[i] = source->lineStartFor(i);
+    }
+
+    return new (arena->alloc(sizeof(CompressedBufferPiece))) CompressedBufferPiece(source, cache, compressed, compressedLength, lineStarts);
+}
+
+CompressedBufferPiece::CompressedBufferPiece(const BufferPiece *source, LeafCache *cache, uint8_t *compressed, size_t compressedLength, LINE_START_T *lineStarts) : CachedBufferPiece(source->arena(), cache, source->length(), source->isOneByte(), source->containsOnlyOneByte(), lineStarts, source->newLineCount())
+{
+    compressed_ = compressed;
+    compressedLength_ = compressedLength;
+}
+
+CompressedBufferPiece::~CompressedBufferPiece()
+{
+    arena_->freeArray(compressed_, compressedLength_);
+}
+
+void CompressedBufferPiece::load(uint8_t *dest) const
+{
+    lzDecompress(compressed_, compressedLength_, dest, charsSize());
+}
+
+// ---- PagedBufferPiece
+
+/**
+ * Decodes UTF-8 `data` into `chars`, which is left empty for ascii: those bytes are the chars.
+ */
+static void decodePagedChars(const uint8_t *data, size_t length, vector<uint16_t> &chars)
+{
+    if (containsOnlyAscii(data, length))
+    {
+        chars.clear();
+        return;
+    }
+    chars.resize(length);
+    chars.resize(decodeUtf8(data, length, chars.data()));
+}
+
+PagedBufferPiece *PagedBufferPiece::create(BufferArena *arena, LeafCache *cache, MappedFile *file, size_t start, size_t length)
+{
+    // decode and scan into per-thread scratch, only the counts are kept
+    static thread_local vector<uint16_t> decoded;
+    static thread_local vector<LINE_START_T> lineStarts;
+    const uint8_t *data = file->data() + start;
+    decodePagedChars(data, length, decoded);
+    lineStarts.clear();
+
+    size_t charsLength = length;
+    bool isOneByte = true;
+    if (decoded.empty())
+    {
+        createLineStarts(data, length, lineStarts);
+    }
+    else
+    {
+        charsLength = decoded.size();
+        isOneByte = edcore::containsOnlyOneByte(decoded.data(), charsLength);
+        createLineStarts(decoded.data(), charsLength, lineStarts);
+    }
+    // the file is scanned through the mapping, only the chunks being scanned stay resident
+    file->dropPages(start, length);
+
+    return new (arena->alloc(sizeof(PagedBufferPiece))) PagedBufferPiece(arena, cache, file, start, length, charsLength, isOneByte, isOneByte, lineStarts.size());
+}
+
+PagedBufferPiece::PagedBufferPiece(BufferArena *arena, LeafCache *cache, MappedFile *file, size_t start, size_t length, size_t charsLength, bool isOneByte, bool containsOnlyOneByte, size_t newLineCount) : CachedBufferPiece(arena, cache, charsLength, isOneByte, containsOnlyOneByte, newLineCount)
+{
+    file->retain();
+    file_ = file;
+    fileStart_ = start;
+    fileLength_ = length;
+}
+
+PagedBufferPiece::~PagedBufferPiece()
+{
+    file_->release();
+}
+
+void PagedBufferPiece::load(uint8_t *dest) const
+{
+    // read rather than mapped: pages faulted in through the mapping would stay resident
+    static thread_local vector<uint8_t> bytes;
+    static thread_local vector<uint16_t> decoded;
+    static thread_local vector<LINE_START_T> lineStarts;
+    bytes.resize(fileLength_);
+    file_->read(fileStart_, fileLength_, bytes.data());
+    decodePagedChars(bytes.data(), fileLength_, decoded);
+    lineStarts.clear();
+
+    if (decoded.empty())
+    {
+        memcpy(dest, bytes.data(), fileLength_);
+    }
+    else if (isOneByte_)
+    {
+        narrowToOneByte(decoded.data(), charsLength_, dest);
+    }
+    else
+    {
+        memcpy(dest, decoded.data(), charsSize());
+    }
+
+    if (isOneByte_)
+    {
+        createLineStarts(dest, charsLength_, lineStarts);
+    }
+    else
+    {
+        createLineStarts(reinterpret_cast<const uint16_t *>(dest), charsLength_, lineStarts);
+    }
+    assert(lineStarts.size() == lineStartsLength_);
+    if (lineStartsLength_ > 0)
+    {
+        memcpy(dest + pagedLineStartsAt(), lineStarts.data(), sizeof(LINE_START_T) * lineStartsLength_);
+    }
+}
+
+LINE_START_T PagedBufferPiece::pagedLineStartFor(size_t relativeLineIndex) const
+{
+    assert(relativeLineIndex < lineStartsLength_);
+    const uint8_t *loaded = cache_->lock(this);
+    const LINE_START_T result = reinterpret_cast<const LINE_START_T *>(loaded + pagedLineStartsAt())[relativeLineIndex];
+    cache_->unlock();
+    return result;
+}
+
+size_t PagedBufferPiece::pagedLineStartsUpTo(size_t innerOffset) const
+{
+    const uint8_t *loaded = cache_->lock(this);
+    const LINE_START_T *lineStarts = reinterpret_cast<const LINE_START_T *>(loaded + pagedLineStartsAt());
+    const size_t result = upper_bound(lineStarts, lineStarts + lineStartsLength_, innerOffset) - lineStarts;
+    cache_->unlock();
+    return result;
+}
+
+// ---- AddBuffer
+
+AddBuffer::AddBuffer(BufferArena *arena)
+{
+    arena->retain();
+    arena_ = arena;
+    block_ = NULL;
+    oneByteChars_ = NULL;
+    twoByteChars_ = NULL;
+    charsCapacity_ = 0;
+}
+
+AddBuffer::~AddBuffer()
+{
+    releaseBlock();
+    arena_->release();
+}
+
+void AddBuffer::releaseBlock()
+{
+    if (block_ != NULL)
+    {
+        // the spans over the block keep it alive
+        block_->release();
+        block_ = NULL;
+    }
+}
+
+void AddBuffer::startBlock(bool isOneByte, size_t charsCapacity)
+{
+    releaseBlock();
+
+    const size_t lineStartsCapacity = charsCapacity / 16;
+    LINE_START_T *lineStarts = arena_->allocArray<LINE_START_T>(lineStartsCapacity);
+    if (isOneByte)
+    {
+        oneByteChars_ = arena_->allocArray<uint8_t>(charsCapacity);
+        twoByteChars_ = NULL;
+        OneByteBufferPiece *block = OneByteBufferPiece::create(arena_, oneByteChars_, 0, lineStarts, 0);
+        block->charsCapacity_ = charsCapacity;
+        block_ = block;
+    }
+    else
+    {
+        oneByteChars_ = NULL;
+        twoByteChars_ = arena_->allocArray<uint16_t>(charsCapacity);
+        TwoByteBufferPiece *block = TwoByteBufferPiece::create(arena_, twoByteChars_, 0, lineStarts, 0);
+        block->charsCapacity_ = charsCapacity;
+        block_ = block;
+    }
+    block_->lineStartsCapacity_ = lineStartsCapacity;
+    charsCapacity_ = charsCapacity;
+}
+
+void AddBuffer::writeAt(const TextSpan *spans, size_t spansCount, size_t blockStart)
+{
+    for (size_t i = 0; i < spansCount; i++)
+    {
+        const TextSpan &span = spans[i];
+        if (oneByteChars_ != NULL)
+        {
+            span.source->writeOneByte(oneByteChars_ + blockStart, span.start, span.length);
+        }
+        else
+        {
+            span.source->write(twoByteChars_ + blockStart, span.start, span.length);
+        }
+        blockStart += span.length;
+    }
+}
+
+size_t AddBuffer::write(const TextSpan *spans, size_t spansCount, size_t &length)
+{
+    length = 0;
+    bool isOneByte = true;
+    for (size_t i = 0; i < spansCount; i++)
+    {
+        length += spans[i].length;
+        isOneByte = isOneByte && spans[i].source->containsOnlyOneByte();
+    }
+    assert(length > 0);
+
+    size_t blockStart = (block_ != NULL ? block_->length() : 0);
+    bool fits = (block_ != NULL && (isOneByte || twoByteChars_ != NULL) && blockStart + length <= charsCapacity_);
+    if (fits && blockStart > 0 && block_->charAt(blockStart - 1) == '\r')
+    {
+        // a \n would change the line start after the \r, which spans may already use
+        uint16_t firstChar;
+        spans[0].source->write(&firstChar, spans[0].start, 1);
+        fits = (firstChar != '\n');
+    }
+    if (!fits)
+    {
+        startBlock(isOneByte, max((size_t)ADD_BUFFER_BLOCK_LENGTH, length));
+        blockStart = 0;
+    }
+    writeAt(spans, spansCount, blockStart);
+
+    lineStarts_.clear();
+    if (oneByteChars_ != NULL)
+    {
+        createLineStarts(oneByteChars_ + blockStart, length, lineStarts_);
+    }
+    else
+    {
+        createLineStarts(twoByteChars_ + blockStart, length, lineStarts_);
+    }
+
+    if (block_->lineStartsLength_ + lineStarts_.size() > block_->lineStartsCapacity_)
+    {
+        if (blockStart > 0)
+        {
+            startBlock(isOneByte, max((size_t)ADD_BUFFER_BLOCK_LENGTH, length));
+            writeAt(spans, spansCount, 0);
+            blockStart = 0;
+        }
+        if (lineStarts_.size() > block_->lineStartsCapacity_)
+        {
+            // no span uses the line starts of a new block yet, so they can still move
+            arena_->freeArray(block_->lineStarts_, block_->lineStartsCapacity_);
+            block_->lineStartsCapacity_ = lineStarts_.size();
+            block_->lineStarts_ = arena_->allocArray<LINE_START_T>(block_->lineStartsCapacity_);
+        }
+    }
+
+    LINE_START_T *blockLineStarts = block_->lineStarts_ + block_->lineStartsLength_;
+    for (size_t i = 0, len = lineStarts_.size(); i < len; i++)
+    {
+        blockLineStarts[i] = lineStarts_[i] + blockStart;
+    }
+    block_->lineStartsLength_ += lineStarts_.size();
+    if (oneByteChars_ != NULL)
+    {
+        static_cast<OneByteBufferPiece *>(block_)->charsLength_ += length;
+    }
+    else
+    {
+        static_cast<TwoByteBufferPiece *>(block_)->charsLength_ += length;
+    }
+    return blockStart;
+}
+
+BufferPiece *AddBuffer::append(const TextSpan *spans, size_t spansCount)
+{
+    size_t length;
+    const size_t blockStart = write(spans, spansCount, length);
+    return SpanBufferPiece::create(block_, blockStart, length);
+}
+
+void AddBuffer::append(const TextSpan *spans, size_t spansCount, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> &result)
+{
+    size_t length;
+    const size_t blockStart = write(spans, spansCount, length);
+    if (length <= maxLeafLength)
+    {
+        result.push_back(SpanBufferPiece::create(block_, blockStart, length));
+        return;
+    }
+
+    const size_t blockEnd = blockStart + length;
+    size_t start = blockStart;
+    while (start < blockEnd)
+    {
+        size_t end = min(start + idealLeafLength, blockEnd);
+        if (end < blockEnd)
+        {
+            // the last char moves over to the next span, like in `LeafWriter`
+            const uint16_t lastChar = block_->charAt(end - 1);
+            if (lastChar == '\r' || (0xD800 <= lastChar && lastChar <= 0xDBFF))
+            {
+                end--;
+            }
+        }
+        result.push_back(SpanBufferPiece::create(block_, start, end - start));
+        start = end;
+    }
+}
+
+PieceSliceString::PieceSliceString(vector<PieceSlice> &slices)
+{
+    slices_.swap(slices);
+    length_ = 0;
+    for (size_t i = 0, len = slices_.size(); i < len; i++)
+    {
+        slices_[i].piece->retain();
+        length_ += slices_[i].length;
+    }
+}
+
+PieceSliceString::~PieceSliceString()
+{
+    for (size_t i = 0, len = slices_.size(); i < len; i++)
+    {
+        slices_[i].piece->release();
+    }
+}
+
+size_t PieceSliceString::memUsage() const
+{
+    // count only the sliced text, the rest of the pieces is usually shared with the buffer.
+    size_t result = sizeof(PieceSliceString) + slices_.capacity() * sizeof(PieceSlice);
+    for (size_t i = 0, len = slices_.size(); i < len; i++)
+    {
+        result += slices_[i].length * (slices_[i].piece->isOneByte() ? sizeof(uint8_t) : sizeof(uint16_t));
+    }
+    return result;
+}
+
+void PieceSliceString::write(uint16_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= length_);
+
+    for (size_t i = 0, len = slices_.size(); i < len && length > 0; i++)
+    {
+        const PieceSlice &slice = slices_[i];
+        if (start >= slice.length)
+        {
+            start -= slice.length;
+            continue;
+        }
+
+        const size_t cnt = min(slice.length - start, length);
+        slice.piece->write(buffer, slice.start + start, cnt);
+        buffer += cnt;
+        length -= cnt;
+        start = 0;
+    }
+}
+
+void PieceSliceString::writeOneByte(uint8_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= length_);
+
+    for (size_t i = 0, len = slices_.size(); i < len && length > 0; i++)
+    {
+        const PieceSlice &slice = slices_[i];
+        if (start >= slice.length)
+        {
+            start -= slice.length;
+            continue;
+        }
+
+        const size_t cnt = min(slice.length - start, length);
+        slice.piece->writeOneByte(buffer, slice.start + start, cnt);
+        buffer += cnt;
+        length -= cnt;
+        start = 0;
+    }
+}
+
+bool PieceSliceString::isOneByte() const
+{
+    for (size_t i = 0, len = slices_.size(); i < len; i++)
+    {
+        if (!slices_[i].piece->isOneByte())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PieceSliceString::containsOnlyOneByte() const
 {
-    for (size_t i = 0; i < charsLength_; i++)
+    for (size_t i = 0, len = slices_.size(); i < len; i++)
     {
-        if (chars_[i] >= 256)
+        const PieceSlice &slice = slices_[i];
+        if (!slice.piece->sliceContainsOnlyOneByte(slice.start, slice.length))
         {
             return false;
         }
@@ -6,100 +6,541 @@
 #ifndef EDCORE_BUFFER_PIECE_H_
 #define EDCORE_BUFFER_PIECE_H_
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <cstring>
 #include <time.h>
 #include <assert.h>
 
-#include "array.h"
+#include "buffer-arena.h"
 #include "buffer-string.h"
+#include "leaf-cache.h"
+#include "mapped-file.h"
 
 using namespace std;
 
 #define LINE_START_T uint32_t
 
+// the chars of a new add buffer block
+#define ADD_BUFFER_BLOCK_LENGTH 16384
+
+// states of the line starts of a piece
+#define LINE_STARTS_PENDING 0
+#define LINE_STARTS_SCANNING 1
+#define LINE_STARTS_READY 2
+
+// one byte text of up to this length next to wide chars stays in their two byte leaf, longer runs get one byte leafs
+#define WIDE_RUN_MAX_GAP 256
+
+// a leaf is only compressed if that saves at least this share of the memory of its chars, in percent
+#define COMPRESSED_PIECE_MIN_SAVING 25
+
 namespace edcore
 {
 
+/**
+ * A range of a string. Edits are resolved into flat lists of spans instead of temporary concatenated strings.
+ */
+struct TextSpan
+{
+    const BufferString *source;
+    size_t start;
+    size_t length;
+};
+typedef struct TextSpan TextSpan;
+
+/**
+ * Replaces `[start, start + length)` of a leaf with the text of `spansCount` spans starting at `spansStart`.
+ */
 struct LeafOffsetLenEdit2
 {
     size_t start;
     size_t length;
-    const BufferString *text;
+    size_t spansStart;
+    size_t spansCount;
 };
 typedef struct LeafOffsetLenEdit2 LeafOffsetLenEdit2;
 
+class AddBuffer;
+
 class BufferPiece : public BufferString
 {
   public:
-    virtual ~BufferPiece(){};
+    /**
+     * The piece frees `lineStarts` unless `ownsLineStarts` is false.
+     * `lineStarts` are relative to `lineStartsOffset`, so a span can use the line starts of its block.
+     * If `lineStarts` is NULL they are pending: the chars are scanned the first time the line starts are used.
+     */
+    BufferPiece(BufferArena *arena, LINE_START_T *lineStarts, size_t lineStartsLength, LINE_START_T lineStartsOffset = 0, bool ownsLineStarts = true);
+    virtual ~BufferPiece();
+
+    /**
+     * Pieces are immutable and can be shared between a buffer and its snapshots.
+     * A new piece has one reference, `release` destroys the piece once the last reference is gone.
+     * Pieces live in their buffer's arena and must not be deleted directly.
+     */
+    void retain() const { refCount_++; }
+    void release() const
+    {
+        if (--refCount_ == 0)
+        {
+            destroy();
+        }
+    }
+
+    BufferArena *arena() const { return arena_; }
+    size_t newLineCount() const { ensureLineStarts(); return lineStartsLength_; }
+    LINE_START_T lineStartFor(size_t relativeLineIndex) const;
+    /**
+     * Returns the number of line starts at or before `innerOffset`.
+     */
+    size_t lineStartsUpTo(size_t innerOffset) const;
 
-    size_t newLineCount() const { return lineStarts_.length(); }
-    LINE_START_T lineStartFor(size_t relativeLineIndex) const { return lineStarts_[relativeLineIndex]; }
-    const LINE_START_T *lineStarts() const { return lineStarts_.data(); }
+    /**
+     * Returns false while the line starts are pending. Never blocks.
+     */
+    bool hasLineStarts() const { return (lineStartsState_.load(memory_order_acquire) == LINE_STARTS_READY); }
+    /**
+     * Scans the chars for line starts if that has not happened yet. Any thread can call this, if another
+     * thread is already scanning it waits for that thread to finish.
+     */
+    void ensureLineStarts() const
+    {
+        if (!hasLineStarts())
+        {
+            scanLineStarts();
+        }
+    }
+
+    /**
+     * Returns whether the chars were read since the last call, see `Buffer::compressColdLeafs`.
+     * A new piece counts as read.
+     */
+    bool takeAccessed() const { return accessed_.exchange(false, memory_order_relaxed); }
+    /**
+     * Whether anything else than its node holds the piece: a snapshot, the undo history or a span.
+     */
+    bool isShared() const { return (refCount_.load() > 1); }
+    /**
+     * Only one and two byte pieces that own all of their chars can be compressed.
+     */
+    virtual bool isCompressible() const { return false; }
+    /**
+     * Whether the chars are loaded into a `LeafCache` when they are read, see `CachedBufferPiece`.
+     */
+    virtual bool isCached() const { return false; }
+
+    /**
+     * The piece holding the chars of this piece, starting at `blockStart`. Only spans are not their own block.
+     */
+    virtual const BufferPiece *block() const { return this; }
+    virtual size_t blockStart() const { return 0; }
 
     virtual size_t length() const = 0;
     virtual uint16_t charAt(size_t index) const = 0;
     virtual size_t memUsage() const = 0;
 
+    /**
+     * Returns whether `[start, start + length)` contains only one byte data.
+     */
+    virtual bool sliceContainsOnlyOneByte(size_t start, size_t length) const = 0;
+
     virtual void assertInvariants() const = 0;
     // virtual void write(uint16_t *buffer, size_t start, size_t length) const = 0;
 
-    static BufferPiece *createFromString(const BufferString *str);
+    static BufferPiece *createFromString(BufferArena *arena, const BufferString *str);
     static BufferPiece *deleteLastChar2(const BufferPiece *target);
     static BufferPiece *insertFirstChar2(const BufferPiece *target, uint16_t character);
     static BufferPiece *join2(const BufferPiece *first, const BufferPiece *second);
-    static void replaceOffsetLen(const BufferPiece *target, vector<LeafOffsetLenEdit2> &edits, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> *result);
+    /**
+     * Append leafs with `chars` to `result`, cut like `replaceOffsetLen` cuts them. Only the runs of chars that
+     * don't fit in one byte get two byte leafs, so a few wide chars don't double the memory of the text around them.
+     * With `lazy`, the line starts of the leafs are left pending.
+     */
+    static void createLeafs(BufferArena *arena, const uint16_t *chars, size_t length, size_t idealLeafLength, size_t maxLeafLength, bool lazy, vector<BufferPiece *> &result);
+    /**
+     * A span over `[start, start + length)` of `target`, or `target` itself if that is all of it. Does not copy chars.
+     */
+    static BufferPiece *slice(const BufferPiece *target, size_t start, size_t length);
+    /**
+     * Apply `edits` (sorted, with texts in `spans`) to `target` and append the resulting leafs to `result`.
+     * A result with wide chars is split like `createLeafs` splits it, Latin-1 text becomes one byte again.
+     */
+    static void replaceOffsetLen(const BufferPiece *target, const vector<LeafOffsetLenEdit2> &edits, const vector<TextSpan> &spans, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> &result);
+    /**
+     * Like `replaceOffsetLen`, but the result is made of spans: the surviving parts of `target` are sliced
+     * and the inserted texts are appended to `addBuffer`.
+     */
+    static void replaceSpans(const BufferPiece *target, const vector<LeafOffsetLenEdit2> &edits, const vector<TextSpan> &spans, AddBuffer &addBuffer, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> &result);
 
   protected:
-    MyArray<LINE_START_T> lineStarts_;
+    BufferArena *arena_;
+    // set once by `scanLineStarts` if the piece was created without them, NULL for paged line starts
+    LINE_START_T *lineStarts_;
+    size_t lineStartsLength_;
+    LINE_START_T lineStartsOffset_;
+    size_t lineStartsCapacity_;
+    bool ownsLineStarts_;
+
+    /**
+     * A piece with paged line starts: only their count is kept, the accessors read them from the cache.
+     * Only for `PagedBufferPiece`.
+     */
+    BufferPiece(BufferArena *arena, size_t newLineCount);
+
+    // the size of the most derived object, to give its block back to the arena
+    virtual size_t objectSize() const = 0;
+    // the line starts of the chars of this piece, allocated from the arena
+    virtual LINE_START_T *computeLineStarts(size_t &lineStartsLength) const = 0;
+    // the line start accessors only look at the line starts once this is `LINE_STARTS_READY`
+    size_t lineStartsMemUsage() const { return (hasLineStarts() && ownsLineStarts_ ? lineStartsLength_ * sizeof(LINE_START_T) : 0); }
+    void markAccessed() const { accessed_.store(true, memory_order_relaxed); }
+
+  private:
+    mutable atomic<size_t> refCount_;
+    mutable atomic<uint8_t> lineStartsState_;
+    mutable atomic<bool> accessed_;
+
+    void destroy() const;
+    void scanLineStarts() const;
+
+    friend class SpanBufferPiece;
+    friend class AddBuffer;
 };
 
 class OneByteBufferPiece : public BufferPiece
 {
   public:
-    OneByteBufferPiece(uint8_t *data, size_t len);
-    OneByteBufferPiece(uint8_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength);
+    /**
+     * `data` and `lineStarts` must be allocated from `arena`, the piece takes them over.
+     */
+    static OneByteBufferPiece *create(BufferArena *arena, uint8_t *data, size_t dataLength);
+    static OneByteBufferPiece *create(BufferArena *arena, uint8_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength);
+    /**
+     * Like `create`, but the line starts are pending until they are first used.
+     */
+    static OneByteBufferPiece *createLazy(BufferArena *arena, uint8_t *data, size_t dataLength);
+    /**
+     * A piece whose chars are `[start, start + length)` of `file`, which must be ascii. The chars are not copied
+     * and the line starts are pending.
+     */
+    static OneByteBufferPiece *createLazy(BufferArena *arena, MappedFile *file, size_t start, size_t length);
     ~OneByteBufferPiece();
 
     void assertInvariants() const;
 
-    size_t memUsage() const { return (sizeof(OneByteBufferPiece) + (charsLength_ * sizeof(*chars_)) + lineStarts_.memUsage()); }
+    // mapped chars are backed by the file, not by memory of the buffer
+    size_t memUsage() const { return (sizeof(OneByteBufferPiece) + (file_ != NULL ? 0 : charsLength_ * sizeof(*chars_)) + lineStartsMemUsage()); }
     size_t length() const { return charsLength_; }
     uint16_t charAt(size_t index) const { return chars_[index]; }
+    const uint8_t *data() const { return chars_; }
     bool isOneByte() const { return true; }
 
     void write(uint16_t *buffer, size_t start, size_t length) const;
     void writeOneByte(uint8_t *buffer, size_t start, size_t length) const;
     bool containsOnlyOneByte() const;
+    bool sliceContainsOnlyOneByte(size_t, size_t) const { return true; }
+    // mapped chars take no memory to begin with
+    bool isCompressible() const { return (file_ == NULL && charsCapacity_ == charsLength_); }
+
+  protected:
+    size_t objectSize() const { return sizeof(OneByteBufferPiece); }
+    LINE_START_T *computeLineStarts(size_t &lineStartsLength) const;
 
   private:
     uint8_t *chars_;
     size_t charsLength_;
+    // more than `charsLength_` only for add buffer blocks
+    size_t charsCapacity_;
+    // the file the chars are mapped from, NULL if they are allocated from the arena
+    MappedFile *file_;
+
+    OneByteBufferPiece(BufferArena *arena, uint8_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength);
+
+    friend class AddBuffer;
 };
 
 class TwoByteBufferPiece : public BufferPiece
 {
   public:
-    TwoByteBufferPiece(uint16_t *data, size_t len);
-    TwoByteBufferPiece(uint16_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength);
+    /**
+     * `data` and `lineStarts` must be allocated from `arena`, the piece takes them over.
+     */
+    static TwoByteBufferPiece *create(BufferArena *arena, uint16_t *data, size_t dataLength);
+    static TwoByteBufferPiece *create(BufferArena *arena, uint16_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength);
+    /**
+     * Like `create`, but the line starts are pending until they are first used.
+     */
+    static TwoByteBufferPiece *createLazy(BufferArena *arena, uint16_t *data, size_t dataLength);
     ~TwoByteBufferPiece();
 
     void assertInvariants() const;
 
-    size_t memUsage() const { return (sizeof(TwoByteBufferPiece) + (charsLength_ * sizeof(*chars_)) + lineStarts_.memUsage()); }
+    size_t memUsage() const { return (sizeof(TwoByteBufferPiece) + (charsLength_ * sizeof(*chars_)) + lineStartsMemUsage()); }
     size_t length() const { return charsLength_; }
     uint16_t charAt(size_t index) const { return chars_[index]; }
+    const uint16_t *data() const { return chars_; }
     bool isOneByte() const { return false; }
 
     void write(uint16_t *buffer, size_t start, size_t length) const;
     void writeOneByte(uint8_t *buffer, size_t start, size_t length) const;
     bool containsOnlyOneByte() const;
+    bool sliceContainsOnlyOneByte(size_t start, size_t length) const;
+    bool isCompressible() const { return (charsCapacity_ == charsLength_); }
+
+  protected:
+    size_t objectSize() const { return sizeof(TwoByteBufferPiece); }
+    LINE_START_T *computeLineStarts(size_t &lineStartsLength) const;
 
   private:
     uint16_t *chars_;
     size_t charsLength_;
+    // more than `charsLength_` only for add buffer blocks
+    size_t charsCapacity_;
+
+    TwoByteBufferPiece(BufferArena *arena, uint16_t *data, size_t dataLength, LINE_START_T *lineStarts, size_t lineStartsLength);
+
+    friend class AddBuffer;
+};
+
+/**
+ * A piece that refers to `[blockStart, blockStart + length)` of a one or two byte piece, its block.
+ * The chars are the block's and so are the line starts, unless the span ends between \r and \n.
+ * A span over a block with pending line starts has pending line starts of its own, which it scans itself.
+ * The span keeps its block alive.
+ */
+class SpanBufferPiece : public BufferPiece
+{
+  public:
+    static SpanBufferPiece *create(const BufferPiece *block, size_t blockStart, size_t length);
+    ~SpanBufferPiece();
+
+    void assertInvariants() const;
+
+    // the chars are shared with the block and other spans, only the ones this span shows are counted
+    size_t memUsage() const { return (sizeof(SpanBufferPiece) + (charsLength_ * (isOneByte() ? sizeof(uint8_t) : sizeof(uint16_t))) + lineStartsMemUsage()); }
+    size_t length() const { return charsLength_; }
+    uint16_t charAt(size_t index) const { return (oneByteChars_ != NULL ? oneByteChars_[index] : twoByteChars_[index]); }
+    bool isOneByte() const { return (oneByteChars_ != NULL); }
+
+    const BufferPiece *block() const { return block_; }
+    size_t blockStart() const { return blockStart_; }
+
+    void write(uint16_t *buffer, size_t start, size_t length) const;
+    void writeOneByte(uint8_t *buffer, size_t start, size_t length) const;
+    bool containsOnlyOneByte() const;
+    bool sliceContainsOnlyOneByte(size_t start, size_t length) const;
+
+  protected:
+    size_t objectSize() const { return sizeof(SpanBufferPiece); }
+    LINE_START_T *computeLineStarts(size_t &lineStartsLength) const;
+
+  private:
+    const BufferPiece *block_;
+    size_t blockStart_;
+    const uint8_t *oneByteChars_;
+    const uint16_t *twoByteChars_;
+    size_t charsLength_;
+
+    SpanBufferPiece(const BufferPiece *block, size_t blockStart, size_t length, LINE_START_T *lineStarts, size_t lineStartsLength, bool ownsLineStarts);
+};
+
+/**
+ * A leaf whose chars are not kept in memory of the buffer: reading them loads them into `cache`, where they
+ * stay until the cache drops them. The length is known without loading, and so are the line starts unless
+ * they are paged: then they are loaded along with the chars. Edits replace the leaf with resident ones,
+ * like any other leaf.
+ */
+class CachedBufferPiece : public BufferPiece
+{
+  public:
+    ~CachedBufferPiece();
+
+    void assertInvariants() const;
+
+    size_t length() const { return charsLength_; }
+    uint16_t charAt(size_t index) const;
+    bool isOneByte() const { return isOneByte_; }
+    bool isCached() const { return true; }
+
+    void write(uint16_t *buffer, size_t start, size_t length) const;
+    void writeOneByte(uint8_t *buffer, size_t start, size_t length) const;
+    bool containsOnlyOneByte() const { return containsOnlyOneByte_; }
+    bool sliceContainsOnlyOneByte(size_t start, size_t length) const;
+
+    /**
+     * For `LeafCache`: the size of what `load` writes, the chars followed by the paged line starts.
+     */
+    size_t loadedSize() const { return pagedLineStartsAt() + (lineStarts_ == NULL ? lineStartsLength_ * sizeof(LINE_START_T) : 0); }
+    virtual void load(uint8_t *dest) const = 0;
+
+  protected:
+    LeafCache *cache_;
+    size_t charsLength_;
+    bool isOneByte_;
+    bool containsOnlyOneByte_;
+
+    CachedBufferPiece(BufferArena *arena, LeafCache *cache, size_t charsLength, bool isOneByte, bool containsOnlyOneByte, LINE_START_T *lineStarts, size_t lineStartsLength);
+    // with paged line starts
+    CachedBufferPiece(BufferArena *arena, LeafCache *cache, size_t charsLength, bool isOneByte, bool containsOnlyOneByte, size_t newLineCount);
+
+    size_t charsSize() const { return charsLength_ * (isOneByte_ ? sizeof(uint8_t) : sizeof(uint16_t)); }
+    // the line starts follow the chars at the next aligned offset
+    size_t pagedLineStartsAt() const { return (charsSize() + sizeof(LINE_START_T) - 1) & ~(sizeof(LINE_START_T) - 1); }
+
+    LINE_START_T *computeLineStarts(size_t &lineStartsLength) const;
+};
+
+/**
+ * A leaf whose chars are compressed with `lzCompress`, see `Buffer::compressColdLeafs`. The line starts are
+ * kept as they are, so offset and line queries never decompress.
+ */
+class CompressedBufferPiece : public CachedBufferPiece
+{
+  public:
+    /**
+     * Returns NULL unless `source` is compressible, has its line starts and its chars compress well enough.
+     */
+    static CompressedBufferPiece *create(const BufferPiece *source, LeafCache *cache);
+    ~CompressedBufferPiece();
+
+    size_t memUsage() const { return (sizeof(CompressedBufferPiece) + compressedLength_ + lineStartsMemUsage()); }
+    void load(uint8_t *dest) const;
+
+  protected:
+    size_t objectSize() const { return sizeof(CompressedBufferPiece); }
+
+  private:
+    uint8_t *compressed_;
+    size_t compressedLength_;
+
+    CompressedBufferPiece(const BufferPiece *source, LeafCache *cache, uint8_t *compressed, size_t compressedLength, LINE_START_T *lineStarts);
+};
+
+/**
+ * A leaf that is the UTF-8 text of `[start, start + length)` of a file, see `BufferBuilder::fromFilePaged`.
+ * Only the length and the number of line starts stay in memory: the chars and the line starts are decoded
+ * from the mapping into the cache when the leaf is read, and the pages of the mapping are dropped again.
+ */
+class PagedBufferPiece : public CachedBufferPiece
+{
+  public:
+    /**
+     * Scans the bytes once for the length and the line count. The range must not cut a UTF-8 sequence or \r\n.
+     */
+    static PagedBufferPiece *create(BufferArena *arena, LeafCache *cache, MappedFile *file, size_t start, size_t length);
+    ~PagedBufferPiece();
+
+    // neither the chars nor the line starts take memory of the buffer
+    size_t memUsage() const { return sizeof(PagedBufferPiece); }
+    void load(uint8_t *dest) const;
+
+    /**
+     * For `BufferPiece::lineStartFor` and `BufferPiece::lineStartsUpTo`, the line starts are read from the cache.
+     */
+    LINE_START_T pagedLineStartFor(size_t relativeLineIndex) const;
+    size_t pagedLineStartsUpTo(size_t innerOffset) const;
+
+  protected:
+    size_t objectSize() const { return sizeof(PagedBufferPiece); }
+
+  private:
+    MappedFile *file_;
+    size_t fileStart_;
+    size_t fileLength_;
+
+    PagedBufferPiece(BufferArena *arena, LeafCache *cache, MappedFile *file, size_t start, size_t length, size_t charsLength, bool isOneByte, bool containsOnlyOneByte, size_t newLineCount);
+};
+
+// only a `PagedBufferPiece` has no line starts once they are ensured
+inline LINE_START_T BufferPiece::lineStartFor(size_t relativeLineIndex) const
+{
+    ensureLineStarts();
+    if (lineStarts_ == NULL)
+    {
+        return static_cast<const PagedBufferPiece *>(this)->pagedLineStartFor(relativeLineIndex);
+    }
+    return lineStarts_[relativeLineIndex] - lineStartsOffset_;
+}
+
+inline size_t BufferPiece::lineStartsUpTo(size_t innerOffset) const
+{
+    ensureLineStarts();
+    if (lineStarts_ == NULL)
+    {
+        return static_cast<const PagedBufferPiece *>(this)->pagedLineStartsUpTo(innerOffset);
+    }
+    return upper_bound(lineStarts_, lineStarts_ + lineStartsLength_, innerOffset + lineStartsOffset_) - lineStarts_;
+}
+
+/**
+ * The append-only text of piece-table mode. Inserted text is copied once to the end of the current block
+ * and the buffer refers to it with spans. The written part of a block never changes, so spans can be shared
+ * with snapshots and can use the line starts of the block.
+ * A new block is started when the text does not fit, needs two bytes per char, or starts with \n after a \r.
+ */
+class AddBuffer
+{
+  public:
+    AddBuffer(BufferArena *arena);
+    ~AddBuffer();
+
+    /**
+     * Appends the text of `spansCount` spans and returns a span over it.
+     */
+    BufferPiece *append(const TextSpan *spans, size_t spansCount);
+    /**
+     * Appends the text of `spansCount` spans and pushes spans over it to `result`: a single one if the text fits
+     * in `maxLeafLength`, otherwise spans of `idealLeafLength` that don't end in \r or a high surrogate.
+     */
+    void append(const TextSpan *spans, size_t spansCount, size_t idealLeafLength, size_t maxLeafLength, vector<BufferPiece *> &result);
+
+  private:
+    BufferArena *arena_;
+    BufferPiece *block_;
+    uint8_t *oneByteChars_;
+    uint16_t *twoByteChars_;
+    size_t charsCapacity_;
+    vector<LINE_START_T> lineStarts_;
+
+    AddBuffer(const AddBuffer &other);
+    AddBuffer &operator=(const AddBuffer &other);
+
+    size_t write(const TextSpan *spans, size_t spansCount, size_t &length);
+    void writeAt(const TextSpan *spans, size_t spansCount, size_t blockStart);
+    void startBlock(bool isOneByte, size_t charsCapacity);
+    void releaseBlock();
+};
+
+struct PieceSlice
+{
+    const BufferPiece *piece;
+    size_t start;
+    size_t length;
+};
+typedef struct PieceSlice PieceSlice;
+
+/**
+ * A string made of ranges of pieces. The pieces are retained, so the text is not copied.
+ */
+class PieceSliceString : public BufferString
+{
+  public:
+    PieceSliceString(vector<PieceSlice> &slices);
+    ~PieceSliceString();
+
+    size_t memUsage() const;
+    size_t length() const { return length_; }
+    void write(uint16_t *buffer, size_t start, size_t length) const;
+    void writeOneByte(uint8_t *buffer, size_t start, size_t length) const;
+    bool isOneByte() const;
+    bool containsOnlyOneByte() const;
+
+  private:
+    vector<PieceSlice> slices_;
+    size_t length_;
 };
 
 struct timespec time_diff(struct timespec start, struct timespec end);
@@ -0,0 +1,1493 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "buffer-regex.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <assert.h>
+
+#define REGEX_OP_SET 0
+#define REGEX_OP_SPLIT 1
+#define REGEX_OP_LINE_START 2
+#define REGEX_OP_LINE_END 3
+#define REGEX_OP_MATCH 4
+
+// the kind of the char before a position, the start of the text counts as a line feed
+#define REGEX_KIND_OTHER 0
+#define REGEX_KIND_LF 1
+#define REGEX_KIND_CR 2
+
+#define REGEX_NODE_EMPTY 0
+#define REGEX_NODE_SET 1
+#define REGEX_NODE_LINE_START 2
+#define REGEX_NODE_LINE_END 3
+#define REGEX_NODE_CONCAT 4
+#define REGEX_NODE_ALTERNATE 5
+#define REGEX_NODE_REPEAT 6
+
+#define REGEX_UNBOUNDED ((size_t)-1)
+#define REGEX_MAX_REPEAT 1000
+// the size of the class membership table of all char sets
+#define REGEX_MAX_SET_MEMBERS (64 * 1024 * 1024)
+
+namespace edcore
+{
+
+// an inclusive range of chars
+typedef pair<uint16_t, uint16_t> CharRange;
+
+struct RegexNode
+{
+    uint8_t type;
+    vector<size_t> children;
+    size_t set;
+    size_t min;
+    size_t max;
+};
+
+static void normalizeRanges(vector<CharRange> &ranges)
+{
+    sort(ranges.begin(), ranges.end());
+    size_t count = 0;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        if (count > 0 && (uint32_t)ranges[i].first <= (uint32_t)ranges[count - 1].second + 1)
+        {
+            ranges[count - 1].second = max(ranges[count - 1].second, ranges[i].second);
+        }
+        else
+        {
+            ranges[count++] = ranges[i];
+        }
+    }
+    ranges.resize(count);
+}
+
+static void complementRanges(vector<CharRange> &ranges)
+{
+    normalizeRanges(ranges);
+    vector<CharRange> result;
+    uint32_t next = 0;
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        if (ranges[i].first > next)
+        {
+            result.push_back(CharRange(next, ranges[i].first - 1));
+        }
+        next = (uint32_t)ranges[i].second + 1;
+    }
+    if (next <= 0xFFFF)
+    {
+        result.push_back(CharRange(next, 0xFFFF));
+    }
+    ranges.swap(result);
+}
+
+static bool containsChar(const vector<CharRange> &ranges, uint16_t c)
+{
+    vector<CharRange>::const_iterator it = upper_bound(ranges.begin(), ranges.end(), CharRange(c, 0xFFFF));
+    return (it != ranges.begin() && (it - 1)->second >= c);
+}
+
+/**
+ * Parses a pattern into a tree of nodes and compiles it into the program and char classes of a `RegexSearch`.
+ */
+class RegexCompiler
+{
+  public:
+    RegexCompiler(const vector<uint16_t> &pattern, bool ignoreCase) : pattern_(pattern), pos_(0), ignoreCase_(ignoreCase), depth_(0) {}
+
+    bool compile(RegexSearch *search, string &error);
+
+  private:
+    const vector<uint16_t> &pattern_;
+    size_t pos_;
+    bool ignoreCase_;
+    size_t depth_;
+    vector<RegexNode> nodes_;
+    vector<vector<CharRange>> sets_;
+    map<vector<CharRange>, size_t> setIndex_;
+    string error_;
+    RegexSearch *search_;
+
+    bool atEnd() const { return pos_ >= pattern_.size(); }
+    uint16_t peek() const { return pattern_[pos_]; }
+    bool fail(const char *message)
+    {
+        if (error_.empty())
+        {
+            error_ = message;
+        }
+        return false;
+    }
+
+    size_t addNode(uint8_t type);
+    size_t addSet(vector<CharRange> &ranges, bool negate);
+    bool parseAlternate(size_t &node);
+    bool parseConcat(size_t &node);
+    bool parseRepeat(size_t &node);
+    bool parseQuantifier(size_t &min, size_t &max);
+    bool parseNumber(size_t &value);
+    bool parseAtom(size_t &node);
+    bool parseClass(size_t &node);
+    bool parseClassAtom(vector<CharRange> &ranges, int32_t &single);
+    bool parseEscape(bool inClass, vector<CharRange> &ranges, int32_t &single);
+    bool parseHex(size_t digits, int32_t &value);
+
+    bool addInst(uint8_t op, uint32_t out, uint32_t out1, uint32_t set, uint32_t &pc);
+    bool emit(size_t node, uint32_t next, uint32_t &entry);
+    bool buildClasses();
+    bool isLineAnchored() const;
+    void buildStartClasses();
+};
+
+static void addDigits(vector<CharRange> &ranges)
+{
+    ranges.push_back(CharRange('0', '9'));
+}
+
+static void addWordChars(vector<CharRange> &ranges)
+{
+    ranges.push_back(CharRange('0', '9'));
+    ranges.push_back(CharRange('A', 'Z'));
+    ranges.push_back(CharRange('_', '_'));
+    ranges.push_back(CharRange('a', 'z'));
+}
+
+static void addSpaces(vector<CharRange> &ranges)
+{
+    ranges.push_back(CharRange('\t', '\r'));
+    ranges.push_back(CharRange(' ', ' '));
+    ranges.push_back(CharRange(0xA0, 0xA0));
+    ranges.push_back(CharRange(0x1680, 0x1680));
+    ranges.push_back(CharRange(0x2000, 0x200A));
+    ranges.push_back(CharRange(0x2028, 0x2029));
+    ranges.push_back(CharRange(0x202F, 0x202F));
+    ranges.push_back(CharRange(0x205F, 0x205F));
+    ranges.push_back(CharRange(0x3000, 0x3000));
+    ranges.push_back(CharRange(0xFEFF, 0xFEFF));
+}
+
+size_t RegexCompiler::addNode(uint8_t type)
+{
+    RegexNode node;
+    node.type = type;
+    node.set = 0;
+    node.min = 0;
+    node.max = 0;
+    nodes_.push_back(node);
+    return nodes_.size() - 1;
+}
+
+/**
+ * Adds the other case of the ascii letters in `ranges` when ignoring case, and shares equal sets.
+ */
+size_t RegexCompiler::addSet(vector<CharRange> &ranges, bool negate)
+{
+    if (ignoreCase_)
+    {
+        const size_t count = ranges.size();
+        for (size_t i = 0; i < count; i++)
+        {
+            const uint16_t lower = max(ranges[i].first, (uint16_t)'a');
+            const uint16_t upper = min(ranges[i].second, (uint16_t)'z');
+            if (lower <= upper)
+            {
+                ranges.push_back(CharRange(lower - ('a' - 'A'), upper - ('a' - 'A')));
+            }
+            const uint16_t lowerUpper = max(ranges[i].first, (uint16_t)'A');
+            const uint16_t upperUpper = min(ranges[i].second, (uint16_t)'Z');
+            if (lowerUpper <= upperUpper)
+            {
+                ranges.push_back(CharRange(lowerUpper + ('a' - 'A'), upperUpper + ('a' - 'A')));
+            }
+        }
+    }
+    if (negate)
+    {
+        complementRanges(ranges);
+    }
+    else
+    {
+        normalizeRanges(ranges);
+    }
+
+    map<vector<CharRange>, size_t>::iterator found = setIndex_.find(ranges);
+    if (found != setIndex_.end())
+    {
+        return found->second;
+    }
+    sets_.push_back(ranges);
+    setIndex_[ranges] = sets_.size() - 1;
+    return sets_.size() - 1;
+}
+
+bool RegexCompiler::parseAlternate(size_t &node)
+{
+    size_t first;
+    if (!parseConcat(first))
+    {
+        return false;
+    }
+    if (atEnd() || peek() != '|')
+    {
+        node = first;
+        return true;
+    }
+
+    node = addNode(REGEX_NODE_ALTERNATE);
+    nodes_[node].children.push_back(first);
+    while (!atEnd() && peek() == '|')
+    {
+        pos_++;
+        size_t next;
+        if (!parseConcat(next))
+        {
+            return false;
+        }
+        nodes_[node].children.push_back(next);
+    }
+    return true;
+}
+
+bool RegexCompiler::parseConcat(size_t &node)
+{
+    vector<size_t> children;
+    while (!atEnd() && peek() != '|' && peek() != ')')
+    {
+        size_t child;
+        if (!parseRepeat(child))
+        {
+            return false;
+        }
+        children.push_back(child);
+    }
+
+    if (children.size() == 1)
+    {
+        node = children[0];
+        return true;
+    }
+    node = addNode(children.empty() ? REGEX_NODE_EMPTY : REGEX_NODE_CONCAT);
+    nodes_[node].children.swap(children);
+    return true;
+}
+
+bool RegexCompiler::parseNumber(size_t &value)
+{
+    if (atEnd() || peek() < '0' || peek() > '9')
+    {
+        return false;
+    }
+    value = 0;
+    while (!atEnd() && peek() >= '0' && peek() <= '9')
+    {
+        value = min(value * 10 + (peek() - '0'), (size_t)REGEX_MAX_REPEAT + 1);
+        pos_++;
+    }
+    return true;
+}
+
+/**
+ * Parses a quantifier at the current position. A `{` that does not start `{n}`, `{n,}` or `{n,m}` is left
+ * alone, it is a literal like in JavaScript.
+ */
+bool RegexCompiler::parseQuantifier(size_t &min, size_t &max)
+{
+    if (atEnd())
+    {
+        return false;
+    }
+    switch (peek())
+    {
+    case '*':
+        pos_++;
+        min = 0;
+        max = REGEX_UNBOUNDED;
+        return true;
+    case '+':
+        pos_++;
+        min = 1;
+        max = REGEX_UNBOUNDED;
+        return true;
+    case '?':
+        pos_++;
+        min = 0;
+        max = 1;
+        return true;
+    case '{':
+    {
+        const size_t start = pos_++;
+        if (!parseNumber(min))
+        {
+            pos_ = start;
+            return false;
+        }
+        max = min;
+        if (!atEnd() && peek() == ',')
+        {
+            pos_++;
+            if (!parseNumber(max))
+            {
+                max = REGEX_UNBOUNDED;
+            }
+        }
+        if (atEnd() || peek() != '}')
+        {
+            pos_ = start;
+            return false;
+        }
+        pos_++;
+        return true;
+    }
+    }
+    return false;
+}
+
+bool RegexCompiler::parseRepeat(size_t &node)
+{
+    size_t min, max;
+    const size_t start = pos_;
+    if (parseQuantifier(min, max))
+    {
+        pos_ = start;
+        return fail("Nothing to repeat");
+    }
+    if (!parseAtom(node))
+    {
+        return false;
+    }
+    if (!parseQuantifier(min, max))
+    {
+        return true;
+    }
+
+    if (max != REGEX_UNBOUNDED && max < min)
+    {
+        return fail("Numbers out of order in {} quantifier");
+    }
+    if (min > REGEX_MAX_REPEAT || (max != REGEX_UNBOUNDED && max > REGEX_MAX_REPEAT))
+    {
+        return fail("Repeat count too large");
+    }
+    if (!atEnd() && peek() == '?')
+    {
+        return fail("Lazy quantifiers are not supported");
+    }
+    size_t other;
+    if (parseQuantifier(other, other))
+    {
+        return fail("Nothing to repeat");
+    }
+
+    const size_t child = node;
+    node = addNode(REGEX_NODE_REPEAT);
+    nodes_[node].children.push_back(child);
+    nodes_[node].min = min;
+    nodes_[node].max = max;
+    return true;
+}
+
+bool RegexCompiler::parseAtom(size_t &node)
+{
+    const uint16_t c = pattern_[pos_++];
+    vector<CharRange> ranges;
+    switch (c)
+    {
+    case '(':
+    {
+        if (!atEnd() && peek() == '?')
+        {
+            if (pos_ + 1 < pattern_.size() && pattern_[pos_ + 1] == ':')
+            {
+                pos_ += 2;
+            }
+            else
+            {
+                return fail("Lookarounds and named groups are not supported");
+            }
+        }
+        if (++depth_ > REGEX_MAX_DEPTH)
+        {
+            return fail("Too many nested groups");
+        }
+        if (!parseAlternate(node))
+        {
+            return false;
+        }
+        depth_--;
+        if (atEnd())
+        {
+            return fail("Unterminated group");
+        }
+        pos_++;
+        return true;
+    }
+    case ')':
+        return fail("Unmatched ')'");
+    case '[':
+        return parseClass(node);
+    case '^':
+        node = addNode(REGEX_NODE_LINE_START);
+        return true;
+    case '$':
+        node = addNode(REGEX_NODE_LINE_END);
+        return true;
+    case '.':
+        // like JavaScript without the s flag, but only \r and \n end lines, as they do in the buffer
+        ranges.push_back(CharRange('\n', '\n'));
+        ranges.push_back(CharRange('\r', '\r'));
+        node = addNode(REGEX_NODE_SET);
+        nodes_[node].set = addSet(ranges, true);
+        return true;
+    case '\\':
+    {
+        int32_t single;
+        if (!parseEscape(false, ranges, single))
+        {
+            return false;
+        }
+        node = addNode(REGEX_NODE_SET);
+        nodes_[node].set = addSet(ranges, false);
+        return true;
+    }
+    }
+
+    ranges.push_back(CharRange(c, c));
+    node = addNode(REGEX_NODE_SET);
+    nodes_[node].set = addSet(ranges, false);
+    return true;
+}
+
+bool RegexCompiler::parseClass(size_t &node)
+{
+    bool negate = false;
+    if (!atEnd() && peek() == '^')
+    {
+        negate = true;
+        pos_++;
+    }
+
+    vector<CharRange> ranges;
+    while (!atEnd() && peek() != ']')
+    {
+        int32_t first;
+        vector<CharRange> firstRanges;
+        if (!parseClassAtom(firstRanges, first))
+        {
+            return false;
+        }
+        if (first < 0 || atEnd() || peek() != '-' || pos_ + 1 >= pattern_.size() || pattern_[pos_ + 1] == ']')
+        {
+            ranges.insert(ranges.end(), firstRanges.begin(), firstRanges.end());
+            continue;
+        }
+
+        pos_++;
+        int32_t last;
+        vector<CharRange> lastRanges;
+        if (!parseClassAtom(lastRanges, last))
+        {
+            return false;
+        }
+        if (last < 0 || last < first)
+        {
+            return fail("Invalid character class range");
+        }
+        ranges.push_back(CharRange(first, last));
+    }
+    if (atEnd())
+    {
+        return fail("Unterminated character class");
+    }
+    pos_++;
+
+    node = addNode(REGEX_NODE_SET);
+    nodes_[node].set = addSet(ranges, negate);
+    return true;
+}
+
+/**
+ * A char or an escape in a class, see `parseEscape`.
+ */
+bool RegexCompiler::parseClassAtom(vector<CharRange> &ranges, int32_t &single)
+{
+    const uint16_t c = pattern_[pos_++];
+    if (c == '\\')
+    {
+        return parseEscape(true, ranges, single);
+    }
+    single = c;
+    ranges.push_back(CharRange(c, c));
+    return true;
+}
+
+bool RegexCompiler::parseHex(size_t digits, int32_t &value)
+{
+    value = 0;
+    for (size_t i = 0; i < digits; i++, pos_++)
+    {
+        if (atEnd())
+        {
+            return fail("Invalid escape");
+        }
+        const uint16_t c = peek();
+        if (c >= '0' && c <= '9')
+        {
+            value = value * 16 + (c - '0');
+        }
+        else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        {
+            value = value * 16 + ((c | 0x20) - 'a' + 10);
+        }
+        else
+        {
+            return fail("Invalid escape");
+        }
+    }
+    return true;
+}
+
+/**
+ * Parses the escape after a backslash and appends its chars to `ranges`. `single` is the escaped char, or -1
+ * for a class escape like `\d`.
+ */
+bool RegexCompiler::parseEscape(bool inClass, vector<CharRange> &ranges, int32_t &single)
+{
+    if (atEnd())
+    {
+        return fail("\\ at end of pattern");
+    }
+    const uint16_t c = pattern_[pos_++];
+    single = -1;
+    vector<CharRange> negated;
+    switch (c)
+    {
+    case 'd':
+        addDigits(ranges);
+        return true;
+    case 'w':
+        addWordChars(ranges);
+        return true;
+    case 's':
+        addSpaces(ranges);
+        return true;
+    case 'D':
+    case 'W':
+    case 'S':
+        if (c == 'D')
+        {
+            addDigits(negated);
+        }
+        else if (c == 'W')
+        {
+            addWordChars(negated);
+        }
+        else
+        {
+            addSpaces(negated);
+        }
+        complementRanges(negated);
+        ranges.insert(ranges.end(), negated.begin(), negated.end());
+        return true;
+    case 't':
+        single = '\t';
+        break;
+    case 'n':
+        single = '\n';
+        break;
+    case 'r':
+        single = '\r';
+        break;
+    case 'v':
+        single = '\v';
+        break;
+    case 'f':
+        single = '\f';
+        break;
+    case '0':
+        if (!atEnd() && peek() >= '0' && peek() <= '9')
+        {
+            return fail("Octal escapes are not supported");
+        }
+        single = 0;
+        break;
+    case 'x':
+        if (!parseHex(2, single))
+        {
+            return false;
+        }
+        break;
+    case 'u':
+        if (!parseHex(4, single))
+        {
+            return false;
+        }
+        break;
+    case 'c':
+        if (atEnd() || (peek() | 0x20) < 'a' || (peek() | 0x20) > 'z')
+        {
+            return fail("Invalid escape");
+        }
+        single = pattern_[pos_++] % 32;
+        break;
+    case 'b':
+        if (!inClass)
+        {
+            return fail("Word boundaries are not supported");
+        }
+        single = '\b';
+        break;
+    default:
+        if (c >= '1' && c <= '9')
+        {
+            return fail("Back references are not supported");
+        }
+        if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z')
+        {
+            return fail("Invalid escape");
+        }
+        single = c;
+        break;
+    }
+    ranges.push_back(CharRange(single, single));
+    return true;
+}
+
+bool RegexCompiler::addInst(uint8_t op, uint32_t out, uint32_t out1, uint32_t set, uint32_t &pc)
+{
+    vector<RegexSearch::Inst> &program = search_->program_;
+    if (program.size() >= REGEX_MAX_PROGRAM_SIZE)
+    {
+        return fail("Pattern too large");
+    }
+    RegexSearch::Inst inst;
+    inst.op = op;
+    inst.out = out;
+    inst.out1 = out1;
+    inst.set = set;
+    program.push_back(inst);
+    pc = program.size() - 1;
+    return true;
+}
+
+/**
+ * Emits `node` so that it continues at `next`, `entry` is where it starts. The program is built back to front.
+ */
+bool RegexCompiler::emit(size_t node, uint32_t next, uint32_t &entry)
+{
+    const RegexNode &n = nodes_[node];
+    switch (n.type)
+    {
+    case REGEX_NODE_EMPTY:
+        entry = next;
+        return true;
+    case REGEX_NODE_SET:
+        return addInst(REGEX_OP_SET, next, 0, n.set, entry);
+    case REGEX_NODE_LINE_START:
+        return addInst(REGEX_OP_LINE_START, next, 0, 0, entry);
+    case REGEX_NODE_LINE_END:
+        return addInst(REGEX_OP_LINE_END, next, 0, 0, entry);
+    case REGEX_NODE_CONCAT:
+        for (size_t i = n.children.size(); i-- > 0;)
+        {
+            if (!emit(n.children[i], next, next))
+            {
+                return false;
+            }
+        }
+        entry = next;
+        return true;
+    case REGEX_NODE_ALTERNATE:
+    {
+        if (!emit(n.children.back(), next, entry))
+        {
+            return false;
+        }
+        for (size_t i = n.children.size() - 1; i-- > 0;)
+        {
+            uint32_t child;
+            if (!emit(n.children[i], next, child) || !addInst(REGEX_OP_SPLIT, child, entry, 0, entry))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    case REGEX_NODE_REPEAT:
+    {
+        const size_t child = n.children[0];
+        const size_t min = n.min;
+        const size_t max = n.max;
+        uint32_t current = next;
+        if (max == REGEX_UNBOUNDED)
+        {
+            // a loop: the split goes into the child, which comes back to the split
+            uint32_t split, body;
+            if (!addInst(REGEX_OP_SPLIT, 0, next, 0, split) || !emit(child, split, body))
+            {
+                return false;
+            }
+            search_->program_[split].out = body;
+            current = split;
+        }
+        else
+        {
+            // nested optional copies, x{0,2} is (x(x)?)?
+            for (size_t i = min; i < max; i++)
+            {
+                uint32_t body;
+                if (!emit(child, current, body) || !addInst(REGEX_OP_SPLIT, body, next, 0, current))
+                {
+                    return false;
+                }
+            }
+        }
+        for (size_t i = 0; i < min; i++)
+        {
+            if (!emit(child, current, current))
+            {
+                return false;
+            }
+        }
+        entry = current;
+        return true;
+    }
+    }
+    assert(false);
+    return false;
+}
+
+/**
+ * Splits the chars into classes at the bounds of all char sets, with line feed and carriage return in classes
+ * of their own, and tabulates which classes each set contains.
+ */
+bool RegexCompiler::buildClasses()
+{
+    vector<uint32_t> bounds;
+    bounds.push_back(0);
+    bounds.push_back('\n');
+    bounds.push_back('\n' + 1);
+    bounds.push_back('\r');
+    bounds.push_back('\r' + 1);
+    for (size_t i = 0; i < sets_.size(); i++)
+    {
+        for (size_t j = 0; j < sets_[i].size(); j++)
+        {
+            bounds.push_back(sets_[i][j].first);
+            bounds.push_back((uint32_t)sets_[i][j].second + 1);
+        }
+    }
+    sort(bounds.begin(), bounds.end());
+    bounds.erase(unique(bounds.begin(), bounds.end()), bounds.end());
+    if (bounds.back() > 0xFFFF)
+    {
+        bounds.pop_back();
+    }
+
+    const size_t classesCount = bounds.size();
+    if (classesCount > REGEX_MAX_CLASSES || classesCount * sets_.size() > REGEX_MAX_SET_MEMBERS)
+    {
+        return fail("Pattern too large");
+    }
+    search_->classesCount_ = classesCount;
+    search_->eofClass_ = classesCount;
+    search_->classMap_.resize(0x10000);
+    for (size_t i = 0; i < classesCount; i++)
+    {
+        const uint32_t end = (i + 1 < classesCount ? bounds[i + 1] : 0x10000);
+        for (uint32_t c = bounds[i]; c < end; c++)
+        {
+            search_->classMap_[c] = i;
+        }
+    }
+    search_->lfClass_ = search_->classMap_['\n'];
+    search_->crClass_ = search_->classMap_['\r'];
+
+    search_->setMembers_.resize(sets_.size() * classesCount);
+    for (size_t i = 0; i < sets_.size(); i++)
+    {
+        for (size_t j = 0; j < classesCount; j++)
+        {
+            search_->setMembers_[i * classesCount + j] = containsChar(sets_[i], bounds[j]);
+        }
+    }
+    return true;
+}
+
+/**
+ * Whether every path from the start goes through `^` before it reads a char.
+ */
+bool RegexCompiler::isLineAnchored() const
+{
+    const vector<RegexSearch::Inst> &program = search_->program_;
+    vector<bool> visited(program.size());
+    vector<uint32_t> stack(1, search_->startPc_);
+    while (!stack.empty())
+    {
+        const uint32_t pc = stack.back();
+        stack.pop_back();
+        if (visited[pc])
+        {
+            continue;
+        }
+        visited[pc] = true;
+        if (program[pc].op == REGEX_OP_SPLIT)
+        {
+            stack.push_back(program[pc].out);
+            stack.push_back(program[pc].out1);
+        }
+        else if (program[pc].op != REGEX_OP_LINE_START)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Marks the classes that a match can start with, taking every `^ $` as satisfied. From a state without pcs, a
+ * char of another class leads to the state without pcs again, unless the pattern matches the empty string, then
+ * nothing is skipped.
+ */
+void RegexCompiler::buildStartClasses()
+{
+    const vector<RegexSearch::Inst> &program = search_->program_;
+    vector<uint8_t> &startClasses = search_->startClasses_;
+    startClasses.assign(search_->classesCount_ + 1, 0);
+    search_->skipStart_ = true;
+
+    vector<bool> visited(program.size());
+    vector<uint32_t> stack(1, search_->startPc_);
+    while (!stack.empty())
+    {
+        const uint32_t pc = stack.back();
+        stack.pop_back();
+        if (visited[pc])
+        {
+            continue;
+        }
+        visited[pc] = true;
+        const RegexSearch::Inst &inst = program[pc];
+        switch (inst.op)
+        {
+        case REGEX_OP_SET:
+            for (size_t charClass = 0; charClass < search_->classesCount_; charClass++)
+            {
+                startClasses[charClass] |= (search_->isMember(inst.set, charClass) ? 1 : 0);
+            }
+            break;
+        case REGEX_OP_SPLIT:
+            stack.push_back(inst.out);
+            stack.push_back(inst.out1);
+            break;
+        case REGEX_OP_LINE_START:
+        case REGEX_OP_LINE_END:
+            stack.push_back(inst.out);
+            break;
+        case REGEX_OP_MATCH:
+            search_->skipStart_ = false;
+            break;
+        }
+    }
+
+    // a single start char, or an ascii letter in either case, is looked for with `findLiteral`
+    vector<uint16_t> startChars;
+    for (size_t c = 0; c < 0x10000 && startChars.size() <= 2; c++)
+    {
+        if (startClasses[search_->classMap_[c]])
+        {
+            startChars.push_back((uint16_t)c);
+        }
+    }
+    search_->startChar_ = (startChars.empty() ? 0 : startChars.back());
+    search_->startCharIgnoreCase_ = (startChars.size() == 2 && startChars[0] >= 'A' && startChars[0] <= 'Z' && startChars[1] == startChars[0] + ('a' - 'A'));
+    search_->skipToStartChar_ = (search_->skipStart_ && (startChars.size() == 1 || search_->startCharIgnoreCase_));
+}
+
+bool RegexCompiler::compile(RegexSearch *search, string &error)
+{
+    search_ = search;
+    size_t root = 0;
+    bool ok = parseAlternate(root);
+    if (ok && !atEnd())
+    {
+        ok = fail("Unmatched ')'");
+    }
+
+    uint32_t match;
+    ok = ok && buildClasses() && addInst(REGEX_OP_MATCH, 0, 0, 0, match) && emit(root, match, search->startPc_);
+    if (!ok)
+    {
+        error = error_;
+        return false;
+    }
+    search->lineAnchored_ = isLineAnchored();
+    buildStartClasses();
+    search->marks_.resize(search->program_.size());
+    search->dfaMaxStates_ = max((size_t)16, REGEX_MAX_DFA_TABLE_SIZE / (search->classesCount_ + 1));
+    return true;
+}
+
+RegexSearch::RegexSearch() : startPc_(0), lineAnchored_(false), skipStart_(false), skipToStartChar_(false), startChar_(0), startCharIgnoreCase_(false), classesCount_(0), eofClass_(0), lfClass_(0), crClass_(0), dfaMaxStates_(0), generation_(0),
+      windowLeaf_(NULL), windowLeafStart_(0), windowStart_(0), isOneByteWindow_(false)
+{
+    fill(emptyDfaStates_, emptyDfaStates_ + 3, UINT32_MAX);
+}
+
+RegexSearch *RegexSearch::create(const BufferString *pattern, const SearchOptions &options, string &error)
+{
+    vector<uint16_t> chars(pattern->length());
+    pattern->write(chars.data(), 0, chars.size());
+
+    RegexSearch *result = new RegexSearch();
+    RegexCompiler compiler(chars, options.ignoreCase);
+    if (!compiler.compile(result, error))
+    {
+        delete result;
+        return NULL;
+    }
+    return result;
+}
+
+uint8_t RegexSearch::charKind(uint16_t charClass) const
+{
+    return (charClass == lfClass_ ? REGEX_KIND_LF : (charClass == crClass_ ? REGEX_KIND_CR : REGEX_KIND_OTHER));
+}
+
+/**
+ * Line starts and ends are those of the buffer: a \r\n pair is one line break.
+ */
+bool RegexSearch::isLineStart(uint8_t prevKind, uint16_t nextClass) const
+{
+    return (prevKind == REGEX_KIND_LF || (prevKind == REGEX_KIND_CR && nextClass != lfClass_));
+}
+
+bool RegexSearch::isLineEnd(uint8_t prevKind, uint16_t nextClass) const
+{
+    return (nextClass == crClass_ || nextClass == eofClass_ || (nextClass == lfClass_ && prevKind != REGEX_KIND_CR));
+}
+
+void RegexSearch::nextGeneration()
+{
+    if (++generation_ == 0)
+    {
+        fill(marks_.begin(), marks_.end(), 0);
+        generation_ = 1;
+    }
+}
+
+/**
+ * Follows the empty edges from `pcs` and from the start, at a position between a char of `prevKind` and a char
+ * of `nextClass`. Appends the reached sets to `result` and returns whether a match was reached.
+ */
+bool RegexSearch::closure(const uint32_t *pcs, size_t count, uint8_t prevKind, uint16_t nextClass, vector<uint32_t> &result)
+{
+    nextGeneration();
+    result.clear();
+    stack_.assign(pcs, pcs + count);
+    stack_.push_back(startPc_);
+    bool matched = false;
+    while (!stack_.empty())
+    {
+        const uint32_t pc = stack_.back();
+        stack_.pop_back();
+        if (marks_[pc] == generation_)
+        {
+            continue;
+        }
+        marks_[pc] = generation_;
+
+        const Inst &inst = program_[pc];
+        switch (inst.op)
+        {
+        case REGEX_OP_SET:
+            result.push_back(pc);
+            break;
+        case REGEX_OP_SPLIT:
+            stack_.push_back(inst.out1);
+            stack_.push_back(inst.out);
+            break;
+        case REGEX_OP_LINE_START:
+            if (isLineStart(prevKind, nextClass))
+            {
+                stack_.push_back(inst.out);
+            }
+            break;
+        case REGEX_OP_LINE_END:
+            if (isLineEnd(prevKind, nextClass))
+            {
+                stack_.push_back(inst.out);
+            }
+            break;
+        case REGEX_OP_MATCH:
+            matched = true;
+            break;
+        }
+    }
+    return matched;
+}
+
+/**
+ * The index of the state `key`, which is added if it is new. If the states are full they are all dropped first,
+ * and `flushed` is set: the indices the caller holds are no longer valid.
+ */
+uint32_t RegexSearch::dfaState(const vector<uint32_t> &key, bool &flushed)
+{
+    flushed = false;
+    map<vector<uint32_t>, uint32_t>::iterator found = dfaIndex_.find(key);
+    if (found != dfaIndex_.end())
+    {
+        return found->second;
+    }
+    if (dfaStates_.size() >= dfaMaxStates_)
+    {
+        dfaIndex_.clear();
+        dfaStates_.clear();
+        dfaTable_.clear();
+        fill(emptyDfaStates_, emptyDfaStates_ + 3, UINT32_MAX);
+        flushed = true;
+    }
+    const uint32_t state = dfaStates_.size();
+    dfaStates_.push_back(key);
+    dfaIndex_[key] = state;
+    dfaTable_.resize(dfaTable_.size() + classesCount_ + 1, -1);
+    return state;
+}
+
+/**
+ * The row of the state without pcs after a char of `prevKind`.
+ */
+uint32_t RegexSearch::emptyDfaState(uint8_t prevKind)
+{
+    if (emptyDfaStates_[prevKind] == UINT32_MAX)
+    {
+        bool flushed;
+        step_.assign(1, prevKind);
+        const uint32_t state = dfaState(step_, flushed);
+        emptyDfaStates_[prevKind] = state * (classesCount_ + 1);
+    }
+    return emptyDfaStates_[prevKind];
+}
+
+/**
+ * Computes and caches the transition from the state at `row` over `charClass`.
+ */
+int32_t RegexSearch::dfaTransition(uint32_t row, uint16_t charClass)
+{
+    const size_t stride = classesCount_ + 1;
+    // a copy, the state may be dropped below
+    const vector<uint32_t> key = dfaStates_[row / stride];
+    const bool matched = closure(key.data(), key.size() - 1, key.back(), charClass, closure_);
+
+    step_.clear();
+    if (charClass != eofClass_)
+    {
+        nextGeneration();
+        for (size_t i = 0; i < closure_.size(); i++)
+        {
+            const Inst &inst = program_[closure_[i]];
+            if (isMember(inst.set, charClass) && marks_[inst.out] != generation_)
+            {
+                marks_[inst.out] = generation_;
+                step_.push_back(inst.out);
+            }
+        }
+        sort(step_.begin(), step_.end());
+    }
+    const bool isEmpty = step_.empty();
+    step_.push_back(charKind(charClass));
+
+    bool flushed;
+    const uint32_t next = dfaState(step_, flushed);
+    const int32_t result = (int32_t)(((next * stride) << 2) | (isEmpty ? 2 : 0) | (matched ? 1 : 0));
+    if (!flushed)
+    {
+        dfaTable_[row + charClass] = result;
+    }
+    return result;
+}
+
+/**
+ * Runs the DFA over `chars`, the chars of `leaf` from `scanStart` to its end. Returns true when a match ends
+ * before a char. Sets `stop` when no match can start before `seedEnd` any more.
+ */
+template <typename T>
+bool RegexSearch::scanWindow(const T *chars, size_t length, const BufferPiece *leaf, size_t leafStart, size_t scanStart, size_t seedEnd, uint32_t &state, size_t &matchEnd, size_t &lastEmpty, bool &stop)
+{
+    const uint16_t *classMap = classMap_.data();
+    const int32_t *table = dfaTable_.data();
+    const bool lineAnchored = lineAnchored_;
+    const bool skipStart = skipStart_;
+    const uint8_t *startClasses = startClasses_.data();
+    // `startChar_` can't be in a one byte window if it is wider
+    const bool skipToStartChar = skipToStartChar_ && (sizeof(T) > 1 || startChar_ <= 0xFF);
+    const T startChar = (T)startChar_;
+    // past this index, no match starts before `seedEnd`
+    const size_t seedLength = (seedEnd > scanStart ? seedEnd - scanStart : 0);
+    uint32_t current = state;
+    size_t empty = lastEmpty;
+    // the first line start of `leaf` at or after `empty`, found by the first skip to a line start and then advanced
+    bool hasLineIndex = false;
+    size_t lineIndex = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        const uint16_t charClass = classMap[chars[i]];
+        int32_t transition = table[current + charClass];
+        if (transition < 0)
+        {
+            transition = dfaTransition(current, charClass);
+            table = dfaTable_.data();
+        }
+        if (transition & 1)
+        {
+            matchEnd = scanStart + i;
+            lastEmpty = empty;
+            return true;
+        }
+        current = (uint32_t)transition >> 2;
+        if ((transition & 2) == 0)
+        {
+            continue;
+        }
+
+        empty = scanStart + i + 1;
+        if (i + 1 >= seedLength)
+        {
+            lastEmpty = empty;
+            stop = true;
+            return false;
+        }
+        if (lineAnchored)
+        {
+            // nothing can match before the next line start
+            const size_t innerOffset = empty - leafStart;
+            const size_t lineStartsCount = leaf->newLineCount();
+            if (!hasLineIndex)
+            {
+                lineIndex = leaf->lineStartsUpTo(innerOffset - 1);
+                hasLineIndex = true;
+            }
+            while (lineIndex < lineStartsCount && leaf->lineStartFor(lineIndex) < innerOffset)
+            {
+                lineIndex++;
+            }
+            const size_t nextLineStart = (lineIndex < lineStartsCount ? leaf->lineStartFor(lineIndex) : leaf->length());
+            if (nextLineStart > innerOffset)
+            {
+                i = leafStart + nextLineStart - scanStart - 1;
+                current = emptyDfaState(charKind(classMap[chars[i]]));
+                table = dfaTable_.data();
+                empty = leafStart + nextLineStart;
+                if (i + 1 >= seedLength)
+                {
+                    lastEmpty = empty;
+                    stop = true;
+                    return false;
+                }
+            }
+        }
+        else if (skipStart)
+        {
+            // the chars that can't start a match keep the DFA without pcs
+            size_t next = i + 1;
+            if (skipToStartChar)
+            {
+                next += findLiteral(chars + next, length - next, &startChar, 1, startCharIgnoreCase_);
+            }
+            else if (skipToStartChar_)
+            {
+                next = length;
+            }
+            while (next < length && startClasses[classMap[chars[next]]] == 0)
+            {
+                next++;
+            }
+            if (next > i + 1)
+            {
+                i = next - 1;
+                current = emptyDfaState(charKind(classMap[chars[i]]));
+                table = dfaTable_.data();
+                empty = scanStart + next;
+                if (next >= seedLength)
+                {
+                    lastEmpty = empty;
+                    stop = true;
+                    return false;
+                }
+            }
+        }
+    }
+    state = current;
+    lastEmpty = empty;
+    return false;
+}
+
+/**
+ * Loads `leaf` from `from` to its end, unless the window already holds it.
+ */
+void RegexSearch::loadWindow(const BufferPiece *leaf, size_t leafStart, size_t from)
+{
+    if (leaf == windowLeaf_ && leafStart == windowLeafStart_ && from >= windowStart_)
+    {
+        return;
+    }
+    windowLeaf_ = leaf;
+    windowLeafStart_ = leafStart;
+    windowStart_ = from;
+    isOneByteWindow_ = leaf->isOneByte();
+    const size_t length = leafStart + leaf->length() - from;
+    if (isOneByteWindow_)
+    {
+        oneByteWindow_.resize(length);
+        leaf->writeOneByte(oneByteWindow_.data(), from - leafStart, length);
+    }
+    else
+    {
+        window_.resize(length);
+        leaf->write(window_.data(), from - leafStart, length);
+    }
+}
+
+uint16_t RegexSearch::windowClassAt(size_t offset) const
+{
+    const size_t i = offset - windowStart_;
+    return classMap_[isOneByteWindow_ ? oneByteWindow_[i] : window_[i]];
+}
+
+uint8_t RegexSearch::kindBefore(const BufferTree &tree, const BufferCursor &cursor) const
+{
+    if (cursor.offset == 0)
+    {
+        return REGEX_KIND_LF;
+    }
+    if (cursor.offset > cursor.leafStartOffset)
+    {
+        return charKind(classMap_[tree.leafAt(cursor.leafIndex)->charAt(cursor.offset - cursor.leafStartOffset - 1)]);
+    }
+    const BufferPiece *prevLeaf = tree.leafAt(cursor.leafIndex - 1);
+    return charKind(classMap_[prevLeaf->charAt(prevLeaf->length() - 1)]);
+}
+
+/**
+ * Streams the leafs through the DFA from `from` until a match ends. `lastEmpty` is the last position before
+ * that where no partial match was alive, the match starts at or after it.
+ */
+bool RegexSearch::scan(const BufferTree &tree, size_t from, size_t seedEnd, size_t &matchEnd, size_t &lastEmpty)
+{
+    BufferCursor cursor;
+    tree.findOffset(from, cursor);
+    uint32_t state = emptyDfaState(kindBefore(tree, cursor));
+    lastEmpty = from;
+
+    bool stop = false;
+    BufferLeafIterator it(tree, cursor.leafIndex);
+    while (true)
+    {
+        const BufferPiece *leaf = it.leaf();
+        const size_t leafStart = it.leafStartOffset();
+        const size_t scanStart = max(from, leafStart);
+        const size_t length = leafStart + leaf->length() - scanStart;
+        if (length > 0)
+        {
+            loadWindow(leaf, leafStart, scanStart);
+            const size_t skip = scanStart - windowStart_;
+            bool found;
+            if (isOneByteWindow_)
+            {
+                found = scanWindow(oneByteWindow_.data() + skip, length, leaf, leafStart, scanStart, seedEnd, state, matchEnd, lastEmpty, stop);
+            }
+            else
+            {
+                found = scanWindow(window_.data() + skip, length, leaf, leafStart, scanStart, seedEnd, state, matchEnd, lastEmpty, stop);
+            }
+            if (found || stop)
+            {
+                return found;
+            }
+        }
+        if (!it.next())
+        {
+            break;
+        }
+    }
+
+    int32_t transition = dfaTable_[state + eofClass_];
+    if (transition < 0)
+    {
+        transition = dfaTransition(state, eofClass_);
+    }
+    matchEnd = tree.length();
+    return (transition & 1);
+}
+
+/**
+ * Adds the threads reached from `pc` over empty edges to `list`. A pc that another thread reached first in this
+ * step is skipped, the threads are added by their start so the leftmost one keeps it.
+ */
+void RegexSearch::addThread(vector<Thread> &list, uint32_t pc, size_t start, uint8_t prevKind, uint16_t nextClass)
+{
+    stack_.assign(1, pc);
+    while (!stack_.empty())
+    {
+        const uint32_t current = stack_.back();
+        stack_.pop_back();
+        if (marks_[current] == generation_)
+        {
+            continue;
+        }
+        marks_[current] = generation_;
+
+        const Inst &inst = program_[current];
+        switch (inst.op)
+        {
+        case REGEX_OP_SET:
+        case REGEX_OP_MATCH:
+        {
+            Thread thread;
+            thread.pc = current;
+            thread.start = start;
+            list.push_back(thread);
+            break;
+        }
+        case REGEX_OP_SPLIT:
+            stack_.push_back(inst.out1);
+            stack_.push_back(inst.out);
+            break;
+        case REGEX_OP_LINE_START:
+            if (isLineStart(prevKind, nextClass))
+            {
+                stack_.push_back(inst.out);
+            }
+            break;
+        case REGEX_OP_LINE_END:
+            if (isLineEnd(prevKind, nextClass))
+            {
+                stack_.push_back(inst.out);
+            }
+            break;
+        }
+    }
+}
+
+/**
+ * Runs the Pike VM from `from` to find the leftmost-longest match that starts before `seedEnd`.
+ */
+bool RegexSearch::resolve(const BufferTree &tree, size_t from, size_t seedEnd, size_t &matchStart, size_t &matchEnd)
+{
+    const size_t length = tree.length();
+    BufferCursor cursor;
+    tree.findOffset(from, cursor);
+    uint8_t prevKind = kindBefore(tree, cursor);
+
+    BufferLeafIterator it(tree, cursor.leafIndex);
+    size_t windowEnd = from;
+    bool loaded = false;
+
+    bool found = false;
+    threads_.clear();
+    for (size_t offset = from;; offset++)
+    {
+        while (offset >= windowEnd && offset < length)
+        {
+            if (loaded && !it.next())
+            {
+                break;
+            }
+            loaded = true;
+            loadWindow(it.leaf(), it.leafStartOffset(), max(from, it.leafStartOffset()));
+            windowEnd = it.leafStartOffset() + it.leaf()->length();
+        }
+        const uint16_t nextClass = (offset < length ? windowClassAt(offset) : eofClass_);
+
+        nextGeneration();
+        closedThreads_.clear();
+        for (size_t i = 0; i < threads_.size(); i++)
+        {
+            addThread(closedThreads_, threads_[i].pc, threads_[i].start, prevKind, nextClass);
+        }
+        if (!found && offset < seedEnd)
+        {
+            addThread(closedThreads_, startPc_, offset, prevKind, nextClass);
+        }
+
+        threads_.clear();
+        for (size_t i = 0; i < closedThreads_.size(); i++)
+        {
+            const Thread &thread = closedThreads_[i];
+            const Inst &inst = program_[thread.pc];
+            if (found && thread.start > matchStart)
+            {
+                continue;
+            }
+            if (inst.op == REGEX_OP_MATCH)
+            {
+                if (!found || thread.start < matchStart || offset > matchEnd)
+                {
+                    found = true;
+                    matchStart = thread.start;
+                    matchEnd = offset;
+                }
+            }
+            else if (nextClass != eofClass_ && isMember(inst.set, nextClass))
+            {
+                Thread next = thread;
+                next.pc = inst.out;
+                threads_.push_back(next);
+            }
+        }
+        if (found)
+        {
+            // only a thread that started at or before the match can still replace it
+            size_t count = 0;
+            for (size_t i = 0; i < threads_.size(); i++)
+            {
+                if (threads_[i].start <= matchStart)
+                {
+                    threads_[count++] = threads_[i];
+                }
+            }
+            threads_.resize(count);
+        }
+
+        if (offset >= length || (threads_.empty() && (found || offset + 1 >= seedEnd)))
+        {
+            return found;
+        }
+        prevKind = charKind(nextClass);
+    }
+}
+
+bool RegexSearch::findMatch(const BufferTree &tree, size_t from, size_t seedEnd, size_t &matchStart, size_t &matchEnd)
+{
+    size_t lastEmpty;
+    if (from >= seedEnd || from > tree.length() || !scan(tree, from, seedEnd, matchEnd, lastEmpty))
+    {
+        return false;
+    }
+    return resolve(tree, lastEmpty, seedEnd, matchStart, matchEnd);
+}
+
+void RegexSearch::findAll(const BufferTree &tree, size_t start, size_t end, vector<size_t> &result)
+{
+    const size_t length = tree.length();
+    const size_t seedEnd = (end >= length ? length + 1 : end);
+    windowLeaf_ = NULL;
+    size_t matchStart, matchEnd;
+    for (size_t from = start; findMatch(tree, from, seedEnd, matchStart, matchEnd);)
+    {
+        result.push_back(matchStart);
+        result.push_back(matchEnd);
+        from = (matchEnd > matchStart ? matchEnd : matchEnd + 1);
+    }
+}
+
+bool RegexSearch::findNext(const BufferTree &tree, size_t from, size_t &matchStart, size_t &matchEnd)
+{
+    windowLeaf_ = NULL;
+    return findMatch(tree, from, tree.length() + 1, matchStart, matchEnd);
+}
+}
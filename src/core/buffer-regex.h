@@ -0,0 +1,155 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_BUFFER_REGEX_H_
+#define EDCORE_BUFFER_REGEX_H_
+
+#include "buffer-search.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// limits on what a pattern compiles to, a pattern beyond them is rejected
+#define REGEX_MAX_PROGRAM_SIZE 100000
+#define REGEX_MAX_CLASSES 4096
+#define REGEX_MAX_DEPTH 1000
+// the DFA states are dropped and built again once their transitions take more entries than this
+#define REGEX_MAX_DFA_TABLE_SIZE (4 * 1024 * 1024)
+
+namespace edcore
+{
+
+/**
+ * A regular expression search over the leafs of a tree, the text is never copied out as a whole.
+ *
+ * The syntax is the subset of JavaScript regular expressions without captures: literals and escapes, `.`,
+ * classes with `\d \w \s` and their negations, groups, `|`, the greedy quantifiers `* + ? {n,m}`, and `^ $`,
+ * which match at the line starts and ends of the buffer (as with the `m` flag). Lazy quantifiers, back
+ * references, lookarounds and `\b` are rejected. Matches are leftmost-longest, and chars are UTF-16 code units.
+ *
+ * A lazily built DFA streams over the leafs, its state is carried from one leaf to the next. It finds where
+ * the first match ends, and the last position before it where no partial match was alive, so the match
+ * starts after it. A Pike VM (an NFA simulation that keeps the start of each thread) then only runs over that
+ * stretch to find the bounds of the match. While no partial match is alive, a pattern that only matches at line
+ * starts skips to the next line start with the line starts of the leafs, other patterns skip the chars that can't
+ * start a match, with `findLiteral` when only one char (or an ascii letter in either case) can.
+ *
+ * The DFA is kept between calls, so a search is not thread-safe, use one per thread.
+ */
+class RegexSearch
+{
+  public:
+    /**
+     * Returns NULL and sets `error` if `pattern` is not valid.
+     */
+    static RegexSearch *create(const BufferString *pattern, const SearchOptions &options, string &error);
+
+    /**
+     * Appends the start and end offsets of the matches that start in `[start, end)` to `result`, left to right
+     * and not overlapping. A match can end after `end`. If `end` is the length of the tree, an empty match at
+     * the end is found as well. After an empty match the search goes on at the next offset.
+     */
+    void findAll(const BufferTree &tree, size_t start, size_t end, vector<size_t> &result);
+    /**
+     * The first match that starts at or after `from`.
+     */
+    bool findNext(const BufferTree &tree, size_t from, size_t &matchStart, size_t &matchEnd);
+
+  private:
+    struct Inst
+    {
+        uint8_t op;
+        uint32_t out;
+        // the other branch of a split
+        uint32_t out1;
+        // the char set of a set
+        uint32_t set;
+    };
+
+    struct Thread
+    {
+        uint32_t pc;
+        size_t start;
+    };
+
+    vector<Inst> program_;
+    uint32_t startPc_;
+    // whether the pattern only matches at line starts
+    bool lineAnchored_;
+    // whether the chars whose class is not in `startClasses_` can be skipped while no match is alive
+    bool skipStart_;
+    vector<uint8_t> startClasses_;
+    // whether `startChar_` is the only char in `startClasses_`, or with `startCharIgnoreCase_` its upper case is the other
+    bool skipToStartChar_;
+    uint16_t startChar_;
+    bool startCharIgnoreCase_;
+
+    // chars are mapped to classes that no char set tells apart, `eofClass_` stands for the end of the text
+    vector<uint16_t> classMap_;
+    size_t classesCount_;
+    uint16_t eofClass_;
+    uint16_t lfClass_;
+    uint16_t crClass_;
+    // `setMembers_[set * classesCount_ + class]`
+    vector<uint8_t> setMembers_;
+
+    // the DFA: a state is the sorted pcs after a step, followed by the kind of the char before it
+    map<vector<uint32_t>, uint32_t> dfaIndex_;
+    vector<vector<uint32_t>> dfaStates_;
+    // a row of `classesCount_ + 1` columns per state, states are referred to by the offset of their row; per class:
+    // the row of the next state << 2, whether it has no pcs << 1, and whether a match ends before the char, or -1
+    // until it is computed
+    vector<int32_t> dfaTable_;
+    size_t dfaMaxStates_;
+    // the rows of the states without pcs per kind of the char before, UINT32_MAX until they are added
+    uint32_t emptyDfaStates_[3];
+
+    // scratch space
+    vector<uint32_t> marks_;
+    uint32_t generation_;
+    vector<uint32_t> stack_;
+    vector<uint32_t> closure_;
+    vector<uint32_t> step_;
+    vector<Thread> threads_;
+    vector<Thread> closedThreads_;
+
+    // a leaf from `windowStart_` to its end, kept while the matches of a call are in it
+    const BufferPiece *windowLeaf_;
+    size_t windowLeafStart_;
+    size_t windowStart_;
+    bool isOneByteWindow_;
+    vector<uint16_t> window_;
+    vector<uint8_t> oneByteWindow_;
+
+    RegexSearch();
+
+    uint8_t charKind(uint16_t charClass) const;
+    bool isLineStart(uint8_t prevKind, uint16_t nextClass) const;
+    bool isLineEnd(uint8_t prevKind, uint16_t nextClass) const;
+    bool isMember(uint32_t set, uint16_t charClass) const { return setMembers_[set * classesCount_ + charClass] != 0; }
+    uint8_t kindBefore(const BufferTree &tree, const BufferCursor &cursor) const;
+    void nextGeneration();
+    void loadWindow(const BufferPiece *leaf, size_t leafStart, size_t from);
+    uint16_t windowClassAt(size_t offset) const;
+
+    bool closure(const uint32_t *pcs, size_t count, uint8_t prevKind, uint16_t nextClass, vector<uint32_t> &result);
+    uint32_t dfaState(const vector<uint32_t> &key, bool &flushed);
+    uint32_t emptyDfaState(uint8_t prevKind);
+    int32_t dfaTransition(uint32_t row, uint16_t charClass);
+    template <typename T>
+    bool scanWindow(const T *chars, size_t length, const BufferPiece *leaf, size_t leafStart, size_t scanStart, size_t seedEnd, uint32_t &state, size_t &matchEnd, size_t &lastEmpty, bool &stop);
+    bool scan(const BufferTree &tree, size_t from, size_t seedEnd, size_t &matchEnd, size_t &lastEmpty);
+    void addThread(vector<Thread> &list, uint32_t pc, size_t start, uint8_t prevKind, uint16_t nextClass);
+    bool resolve(const BufferTree &tree, size_t from, size_t seedEnd, size_t &matchStart, size_t &matchEnd);
+    bool findMatch(const BufferTree &tree, size_t from, size_t seedEnd, size_t &matchStart, size_t &matchEnd);
+
+    friend class RegexCompiler;
+};
+}
+
+#endif
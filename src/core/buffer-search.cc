@@ -0,0 +1,234 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "buffer-search.h"
+#include "simd.h"
+
+#include <algorithm>
+
+namespace edcore
+{
+
+static inline uint16_t foldAscii(uint16_t c)
+{
+    return (c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+LiteralSearch::LiteralSearch(const BufferString *needle, const SearchOptions &options)
+    : isOneByte_(true), ignoreCase_(options.ignoreCase), isOneByteWindow_(false)
+{
+    needle_.resize(needle->length());
+    if (!needle_.empty())
+    {
+        needle->write(needle_.data(), 0, needle_.size());
+    }
+    for (size_t i = 0; i < needle_.size(); i++)
+    {
+        if (ignoreCase_)
+        {
+            needle_[i] = foldAscii(needle_[i]);
+        }
+        isOneByte_ = isOneByte_ && needle_[i] <= 0xFF;
+    }
+    if (isOneByte_)
+    {
+        oneByteNeedle_.assign(needle_.begin(), needle_.end());
+    }
+}
+
+/**
+ * Loads `[start, start + length)` of `leaf` with the carry before it (`carryFirst`) or after it.
+ * Chars of the carry that can't be in a match of a one byte needle are left out of a one byte window,
+ * along with the chars beyond them.
+ */
+void LiteralSearch::loadWindow(const BufferPiece *leaf, size_t start, size_t length, bool carryFirst)
+{
+    isOneByteWindow_ = (isOneByte_ && leaf->isOneByte());
+    if (!isOneByteWindow_)
+    {
+        window_.resize(carry_.size() + length);
+        if (carryFirst)
+        {
+            copy(carry_.begin(), carry_.end(), window_.begin());
+            leaf->write(window_.data() + carry_.size(), start, length);
+        }
+        else
+        {
+            leaf->write(window_.data(), start, length);
+            copy(carry_.begin(), carry_.end(), window_.begin() + length);
+        }
+        return;
+    }
+
+    size_t carryStart = 0;
+    size_t carryEnd = carry_.size();
+    for (size_t i = 0; i < carry_.size(); i++)
+    {
+        if (carry_[i] > 0xFF)
+        {
+            if (carryFirst)
+            {
+                carryStart = i + 1;
+            }
+            else
+            {
+                carryEnd = i;
+                break;
+            }
+        }
+    }
+    const size_t carryLength = carryEnd - carryStart;
+    oneByteWindow_.resize(carryLength + length);
+    if (carryFirst)
+    {
+        copy(carry_.begin() + carryStart, carry_.begin() + carryEnd, oneByteWindow_.begin());
+        leaf->writeOneByte(oneByteWindow_.data() + carryLength, start, length);
+    }
+    else
+    {
+        leaf->writeOneByte(oneByteWindow_.data(), start, length);
+        copy(carry_.begin() + carryStart, carry_.begin() + carryEnd, oneByteWindow_.begin() + length);
+    }
+}
+
+void LiteralSearch::saveCarry(size_t start, size_t length)
+{
+    if (isOneByteWindow_)
+    {
+        carry_.assign(oneByteWindow_.begin() + start, oneByteWindow_.begin() + start + length);
+    }
+    else
+    {
+        carry_.assign(window_.begin() + start, window_.begin() + start + length);
+    }
+}
+
+/**
+ * The first match at or after `from` in the window, or `windowLength`.
+ */
+size_t LiteralSearch::find(size_t from, size_t windowLength) const
+{
+    if (from + needle_.size() > windowLength)
+    {
+        return windowLength;
+    }
+    if (isOneByteWindow_)
+    {
+        return from + findLiteral(oneByteWindow_.data() + from, windowLength - from, oneByteNeedle_.data(), oneByteNeedle_.size(), ignoreCase_);
+    }
+    return from + findLiteral(window_.data() + from, windowLength - from, needle_.data(), needle_.size(), ignoreCase_);
+}
+
+/**
+ * Searches `[start, end)` from the leaf at `leafIndex` on. Appends all matches to `all`, or stops at the first
+ * one and returns it in `first` if `all` is NULL.
+ */
+void LiteralSearch::forward(const BufferTree &tree, size_t leafIndex, size_t start, size_t end, vector<size_t> *all, size_t &first)
+{
+    const size_t needleLength = needle_.size();
+    carry_.clear();
+    // matches don't overlap, the next one starts here at the earliest
+    size_t searchFrom = start;
+
+    BufferLeafIterator it(tree, leafIndex);
+    while (true)
+    {
+        const BufferPiece *leaf = it.leaf();
+        const size_t leafStart = it.leafStartOffset();
+        const size_t chunkStart = max(start, leafStart);
+        const size_t chunkEnd = min(end, leafStart + leaf->length());
+        if (chunkStart < chunkEnd)
+        {
+            loadWindow(leaf, chunkStart - leafStart, chunkEnd - chunkStart, true);
+            const size_t windowLength = (isOneByteWindow_ ? oneByteWindow_.size() : window_.size());
+            const size_t windowStart = chunkEnd - windowLength;
+
+            size_t i = find(max(searchFrom, windowStart) - windowStart, windowLength);
+            while (i < windowLength)
+            {
+                if (all == NULL)
+                {
+                    first = windowStart + i;
+                    return;
+                }
+                all->push_back(windowStart + i);
+                searchFrom = windowStart + i + needleLength;
+                i = find(i + needleLength, windowLength);
+            }
+
+            // the carry never reaches back into a match
+            const size_t carryStart = max(windowLength - min(windowLength, needleLength - 1), min(windowLength, max(searchFrom, windowStart) - windowStart));
+            saveCarry(carryStart, windowLength - carryStart);
+            searchFrom = max(searchFrom, chunkEnd - carry_.size());
+        }
+        if (chunkEnd >= end || !it.next())
+        {
+            return;
+        }
+    }
+}
+
+void LiteralSearch::findAll(const BufferTree &tree, size_t start, size_t end, vector<size_t> &result)
+{
+    end = min(end, tree.length());
+    BufferCursor cursor;
+    if (needle_.empty() || start >= end || !tree.findOffset(start, cursor))
+    {
+        return;
+    }
+    size_t first;
+    forward(tree, cursor.leafIndex, start, end, &result, first);
+}
+
+bool LiteralSearch::findNext(const BufferTree &tree, const BufferCursor &from, size_t &result)
+{
+    if (needle_.empty() || from.offset >= tree.length())
+    {
+        return false;
+    }
+    result = tree.length();
+    forward(tree, from.leafIndex, from.offset, tree.length(), NULL, result);
+    return (result < tree.length());
+}
+
+bool LiteralSearch::findPrevious(const BufferTree &tree, const BufferCursor &from, size_t &result)
+{
+    const size_t needleLength = needle_.size();
+    if (needle_.empty() || from.offset < needleLength)
+    {
+        return false;
+    }
+    carry_.clear();
+
+    BufferLeafIterator it(tree, from.leafIndex);
+    while (true)
+    {
+        const BufferPiece *leaf = it.leaf();
+        const size_t leafStart = it.leafStartOffset();
+        const size_t chunkEnd = min(from.offset, leafStart + leaf->length());
+        if (leafStart < chunkEnd)
+        {
+            loadWindow(leaf, 0, chunkEnd - leafStart, false);
+            const size_t windowLength = (isOneByteWindow_ ? oneByteWindow_.size() : window_.size());
+
+            size_t last = windowLength;
+            for (size_t i = find(0, windowLength); i < windowLength; i = find(i + 1, windowLength))
+            {
+                last = i;
+            }
+            if (last < windowLength)
+            {
+                result = leafStart + last;
+                return true;
+            }
+            saveCarry(0, min(windowLength, needleLength - 1));
+        }
+        if (!it.prev())
+        {
+            return false;
+        }
+    }
+}
+}
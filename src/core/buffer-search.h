@@ -0,0 +1,71 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_BUFFER_SEARCH_H_
+#define EDCORE_BUFFER_SEARCH_H_
+
+#include "buffer-string.h"
+#include "buffer-tree.h"
+
+#include <vector>
+
+using namespace std;
+
+namespace edcore
+{
+
+struct SearchOptions
+{
+    // ascii letters match in either case
+    bool ignoreCase;
+};
+typedef struct SearchOptions SearchOptions;
+
+/**
+ * Finds a literal needle in the leafs of a tree. Each leaf is searched with `findLiteral`, in a window that starts
+ * with the last `needleLength - 1` chars before the leaf, so matches across leafs are found as well.
+ * The window is one byte when both the needle and the leaf are, two bytes otherwise.
+ * A search keeps its window between calls, use one per thread. An empty needle never matches.
+ */
+class LiteralSearch
+{
+  public:
+    LiteralSearch(const BufferString *needle, const SearchOptions &options);
+
+    size_t needleLength() const { return needle_.size(); }
+
+    /**
+     * Appends the offsets of the matches in `[start, end)` to `result`, left to right and not overlapping.
+     */
+    void findAll(const BufferTree &tree, size_t start, size_t end, vector<size_t> &result);
+    /**
+     * The first match that starts at or after `from`. Stops at the first leaf with a match.
+     */
+    bool findNext(const BufferTree &tree, const BufferCursor &from, size_t &result);
+    /**
+     * The last match that ends at or before `from`. Stops at the first leaf with a match.
+     */
+    bool findPrevious(const BufferTree &tree, const BufferCursor &from, size_t &result);
+
+  private:
+    vector<uint16_t> needle_;
+    vector<uint8_t> oneByteNeedle_;
+    bool isOneByte_;
+    bool ignoreCase_;
+
+    // the chars around the current leaf that a match can share with it
+    vector<uint16_t> carry_;
+    vector<uint16_t> window_;
+    vector<uint8_t> oneByteWindow_;
+    bool isOneByteWindow_;
+
+    void loadWindow(const BufferPiece *leaf, size_t start, size_t length, bool carryFirst);
+    void saveCarry(size_t start, size_t length);
+    size_t find(size_t from, size_t windowLength) const;
+    void forward(const BufferTree &tree, size_t leafIndex, size_t start, size_t end, vector<size_t> *all, size_t &first);
+};
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include <cstring>
 
 #include "buffer-string.h"
+#include "simd.h"
 
 namespace edcore
 {
@@ -52,6 +53,35 @@ BufferString *BufferString::substr(const BufferString *target, size_t start, siz
     return new SubString(target, start, length);
 }
 
+void OneByteArrayString::write(uint16_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= length_);
+    widenOneByte(data_ + start, length, buffer);
+}
+
+void OneByteArrayString::writeOneByte(uint8_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= length_);
+    memcpy(buffer, data_ + start, length);
+}
+
+void TwoByteArrayString::write(uint16_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= length_);
+    memcpy(buffer, data_ + start, sizeof(*buffer) * length);
+}
+
+void TwoByteArrayString::writeOneByte(uint8_t *buffer, size_t start, size_t length) const
+{
+    assert(start + length <= length_);
+    narrowToOneByte(data_ + start, length, buffer);
+}
+
+bool TwoByteArrayString::containsOnlyOneByte() const
+{
+    return edcore::containsOnlyOneByte(data_, length_);
+}
+
 void ConcatString::write(uint16_t *buffer, size_t start, size_t length) const
 {
     assert(start + length <= this->length());
@@ -122,6 +122,50 @@ class EmptyString : public BufferString
     bool containsOnlyOneByte() const { return true; }
 };
 
+/**
+ * A string over one byte chars owned by the caller, which must outlive the string.
+ */
+class OneByteArrayString : public BufferString
+{
+  public:
+    OneByteArrayString(const uint8_t *data, size_t length)
+    {
+        data_ = data;
+        length_ = length;
+    }
+    size_t length() const { return length_; }
+    void write(uint16_t *buffer, size_t start, size_t length) const;
+    void writeOneByte(uint8_t *buffer, size_t start, size_t length) const;
+    bool isOneByte() const { return true; }
+    bool containsOnlyOneByte() const { return true; }
+
+  private:
+    const uint8_t *data_;
+    size_t length_;
+};
+
+/**
+ * A string over 16-bit character codes owned by the caller, which must outlive the string.
+ */
+class TwoByteArrayString : public BufferString
+{
+  public:
+    TwoByteArrayString(const uint16_t *data, size_t length)
+    {
+        data_ = data;
+        length_ = length;
+    }
+    size_t length() const { return length_; }
+    void write(uint16_t *buffer, size_t start, size_t length) const;
+    void writeOneByte(uint8_t *buffer, size_t start, size_t length) const;
+    bool isOneByte() const { return false; }
+    bool containsOnlyOneByte() const;
+
+  private:
+    const uint16_t *data_;
+    size_t length_;
+};
+
 class ConcatString : public BufferString
 {
   public:
@@ -0,0 +1,1205 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "buffer-tree.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <iostream>
+#include <assert.h>
+#include <cstring>
+
+namespace edcore
+{
+
+BufferNode *createNode(bool isBottom)
+{
+    BufferNode *node = new BufferNode;
+    node->refCount = 1;
+    node->isBottom = isBottom;
+    node->childrenCount = 0;
+    node->length = 0;
+    node->newLineCount = 0;
+    node->leafsCount = 0;
+    node->pendingChildren = 0;
+    // the SIMD search reads all slots
+    memset(node->lengths, 0, sizeof(node->lengths));
+    memset(node->newLineCounts, 0, sizeof(node->newLineCounts));
+    memset(node->leafsCounts, 0, sizeof(node->leafsCounts));
+    node->wide = NULL;
+    return node;
+}
+
+void retainChildren(const BufferNode *node)
+{
+    for (size_t i = 0; i < node->childrenCount; i++)
+    {
+        if (node->isBottom)
+        {
+            static_cast<BufferPiece *>(node->children[i])->retain();
+        }
+        else
+        {
+            static_cast<BufferNode *>(node->children[i])->refCount++;
+        }
+    }
+}
+
+void releaseNode(BufferNode *node)
+{
+    if (--node->refCount > 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < node->childrenCount; i++)
+    {
+        if (node->isBottom)
+        {
+            static_cast<BufferPiece *>(node->children[i])->release();
+        }
+        else
+        {
+            releaseNode(static_cast<BufferNode *>(node->children[i]));
+        }
+    }
+    delete node;
+}
+
+BufferNode *cloneNode(const BufferNode *node)
+{
+    BufferNode *result = createNode(node->isBottom);
+    result->childrenCount = node->childrenCount;
+    result->length = node->length;
+    result->newLineCount = node->newLineCount;
+    result->leafsCount = node->leafsCount;
+    result->pendingChildren = node->pendingChildren;
+    memcpy(result->lengths, node->lengths, sizeof(node->lengths));
+    memcpy(result->newLineCounts, node->newLineCounts, sizeof(node->newLineCounts));
+    memcpy(result->leafsCounts, node->leafsCounts, sizeof(node->leafsCounts));
+    result->wide = (node->wide ? new BufferNodeWide(*node->wide) : NULL);
+    memcpy(result->children, node->children, sizeof(node->children));
+    retainChildren(result);
+    return result;
+}
+
+/**
+ * Make sure child `i` of `node` is not shared with another tree before it gets modified.
+ */
+BufferNode *ownChild(BufferNode *node, size_t i)
+{
+    BufferNode *child = static_cast<BufferNode *>(node->children[i]);
+    if (child->refCount > 1)
+    {
+        BufferNode *copy = cloneNode(child);
+        releaseNode(child);
+        node->children[i] = copy;
+        return copy;
+    }
+    return child;
+}
+
+/**
+ * Recompute the prefix sums and totals of `node` from its children.
+ */
+void refreshNode(BufferNode *node)
+{
+    size_t lengths[BUFFER_NODE_MAX_CHILDREN];
+    size_t newLineCounts[BUFFER_NODE_MAX_CHILDREN];
+    size_t leafsCounts[BUFFER_NODE_MAX_CHILDREN];
+
+    size_t length = 0;
+    size_t newLineCount = 0;
+    size_t leafsCount = 0;
+    uint32_t pendingChildren = 0;
+    for (size_t i = 0; i < node->childrenCount; i++)
+    {
+        if (node->isBottom)
+        {
+            BufferPiece *leaf = static_cast<BufferPiece *>(node->children[i]);
+            length += leaf->length();
+            leafsCount += 1;
+            // don't wait for the line starts, they are counted by a later refresh
+            if (leaf->hasLineStarts())
+            {
+                newLineCount += leaf->newLineCount();
+            }
+            else
+            {
+                pendingChildren |= (1u << i);
+            }
+        }
+        else
+        {
+            BufferNode *child = static_cast<BufferNode *>(node->children[i]);
+            length += child->length;
+            newLineCount += child->newLineCount;
+            leafsCount += child->leafsCount;
+            if (child->pendingChildren != 0)
+            {
+                pendingChildren |= (1u << i);
+            }
+        }
+        lengths[i] = length;
+        newLineCounts[i] = newLineCount;
+        leafsCounts[i] = leafsCount;
+    }
+    node->length = length;
+    node->newLineCount = newLineCount;
+    node->leafsCount = leafsCount;
+    node->pendingChildren = pendingChildren;
+
+    if (length > UINT32_MAX || newLineCount > UINT32_MAX || leafsCount > UINT32_MAX)
+    {
+        if (node->wide == NULL)
+        {
+            node->wide = new BufferNodeWide;
+        }
+        memcpy(node->wide->lengths, lengths, node->childrenCount * sizeof(lengths[0]));
+        memcpy(node->wide->newLineCounts, newLineCounts, node->childrenCount * sizeof(newLineCounts[0]));
+        memcpy(node->wide->leafsCounts, leafsCounts, node->childrenCount * sizeof(leafsCounts[0]));
+        return;
+    }
+
+    delete node->wide;
+    node->wide = NULL;
+    for (size_t i = 0; i < node->childrenCount; i++)
+    {
+        node->lengths[i] = lengths[i];
+        node->newLineCounts[i] = newLineCounts[i];
+        node->leafsCounts[i] = leafsCounts[i];
+    }
+}
+
+size_t childLength(const BufferNode *node, size_t i)
+{
+    return node->lengthsBefore(i + 1) - node->lengthsBefore(i);
+}
+
+size_t childNewLineCount(const BufferNode *node, size_t i)
+{
+    return node->newLineCountsBefore(i + 1) - node->newLineCountsBefore(i);
+}
+
+size_t childLeafsCount(const BufferNode *node, size_t i)
+{
+    return node->leafsCountsBefore(i + 1) - node->leafsCountsBefore(i);
+}
+
+/**
+ * Returns how many children of `node` have a prefix sum <= `x`, i.e. the index of the child containing `x`
+ * (or `childrenCount` if `x` is past the end).
+ */
+size_t countLessOrEqual(const BufferNode *node, const uint32_t *narrow, const size_t *wide, size_t x)
+{
+    if (wide != NULL)
+    {
+        size_t i = 0;
+        while (i < node->childrenCount && wide[i] <= x)
+        {
+            i++;
+        }
+        return i;
+    }
+    if (x > UINT32_MAX)
+    {
+        return node->childrenCount;
+    }
+    return countLessOrEqual16(narrow, node->childrenCount, (uint32_t)x);
+}
+
+size_t findChildByLength(const BufferNode *node, size_t length)
+{
+    return countLessOrEqual(node, node->lengths, (node->wide ? node->wide->lengths : NULL), length);
+}
+
+size_t findChildByNewLineCount(const BufferNode *node, size_t newLineCount)
+{
+    return countLessOrEqual(node, node->newLineCounts, (node->wide ? node->wide->newLineCounts : NULL), newLineCount);
+}
+
+size_t findChildByLeafsCount(const BufferNode *node, size_t leafsCount)
+{
+    return countLessOrEqual(node, node->leafsCounts, (node->wide ? node->wide->leafsCounts : NULL), leafsCount);
+}
+
+/**
+ * Move `count` children from `src` at `srcIndex` to `dest` at `destIndex`.
+ * `dest` must have room at `destIndex`, gaps are not closed. The nodes must be refreshed afterwards.
+ */
+void copyChildren(BufferNode *dest, size_t destIndex, const BufferNode *src, size_t srcIndex, size_t count)
+{
+    memmove(dest->children + destIndex, src->children + srcIndex, count * sizeof(dest->children[0]));
+}
+
+void insertChildNoSplit(BufferNode *node, size_t index, void *child)
+{
+    assert(node->childrenCount < BUFFER_NODE_MAX_CHILDREN);
+    assert(index <= node->childrenCount);
+
+    copyChildren(node, index + 1, node, index, node->childrenCount - index);
+    node->children[index] = child;
+    node->childrenCount++;
+    refreshNode(node);
+}
+
+void removeChild(BufferNode *node, size_t index)
+{
+    assert(index < node->childrenCount);
+
+    copyChildren(node, index, node, index + 1, node->childrenCount - index - 1);
+    node->childrenCount--;
+    refreshNode(node);
+}
+
+/**
+ * Insert `child` at `index` in `node`.
+ * If `node` is full, it is split in two halves and the new right half is returned.
+ */
+BufferNode *insertChild(BufferNode *node, size_t index, void *child)
+{
+    if (node->childrenCount < BUFFER_NODE_MAX_CHILDREN)
+    {
+        insertChildNoSplit(node, index, child);
+        return NULL;
+    }
+
+    const size_t leftCount = node->childrenCount / 2;
+    BufferNode *right = createNode(node->isBottom);
+    copyChildren(right, 0, node, leftCount, node->childrenCount - leftCount);
+    right->childrenCount = node->childrenCount - leftCount;
+    node->childrenCount = leftCount;
+
+    if (index <= leftCount)
+    {
+        insertChildNoSplit(node, index, child);
+        refreshNode(right);
+    }
+    else
+    {
+        insertChildNoSplit(right, index - leftCount, child);
+        refreshNode(node);
+    }
+    return right;
+}
+
+/**
+ * Find the child that contains leaf `leafIndex`, adjusting `leafIndex` to be relative to that child.
+ * With `inclusive`, `leafIndex` may point right after the last leaf of a child (used for inserting).
+ */
+size_t findChildByLeafIndex(const BufferNode *node, size_t &leafIndex, bool inclusive)
+{
+    size_t i;
+    if (inclusive)
+    {
+        i = (leafIndex == 0 ? 0 : findChildByLeafsCount(node, leafIndex - 1));
+    }
+    else
+    {
+        i = findChildByLeafsCount(node, leafIndex);
+    }
+    i = min(i, node->childrenCount - 1);
+    leafIndex -= node->leafsCountsBefore(i);
+    return i;
+}
+
+BufferNode *insertLeafInNode(BufferNode *node, size_t leafIndex, BufferPiece *leaf)
+{
+    if (node->isBottom)
+    {
+        return insertChild(node, leafIndex, leaf);
+    }
+
+    const size_t i = findChildByLeafIndex(node, leafIndex, true);
+    BufferNode *sibling = insertLeafInNode(ownChild(node, i), leafIndex, leaf);
+    if (sibling == NULL)
+    {
+        refreshNode(node);
+        return NULL;
+    }
+    return insertChild(node, i + 1, sibling);
+}
+
+void setLeafInNode(BufferNode *node, size_t leafIndex, BufferPiece *leaf)
+{
+    if (node->isBottom)
+    {
+        static_cast<BufferPiece *>(node->children[leafIndex])->release();
+        node->children[leafIndex] = leaf;
+    }
+    else
+    {
+        const size_t i = findChildByLeafIndex(node, leafIndex, false);
+        setLeafInNode(ownChild(node, i), leafIndex, leaf);
+    }
+    refreshNode(node);
+}
+
+/**
+ * Child `i` of `node` has too few children => borrow one from a sibling or merge with a sibling.
+ */
+void rebalanceChild(BufferNode *node, size_t i)
+{
+    assert(node->childrenCount >= 2);
+
+    const size_t leftIndex = (i > 0 ? i - 1 : i);
+    BufferNode *left = ownChild(node, leftIndex);
+    BufferNode *right = ownChild(node, leftIndex + 1);
+
+    if (left->childrenCount + right->childrenCount <= BUFFER_NODE_MAX_CHILDREN)
+    {
+        // merge `right` into `left`
+        copyChildren(left, left->childrenCount, right, 0, right->childrenCount);
+        left->childrenCount += right->childrenCount;
+        refreshNode(left);
+        delete right;
+
+        removeChild(node, leftIndex + 1);
+        return;
+    }
+
+    if (left->childrenCount < right->childrenCount)
+    {
+        // borrow the first child of `right`
+        copyChildren(left, left->childrenCount, right, 0, 1);
+        left->childrenCount++;
+        copyChildren(right, 0, right, 1, right->childrenCount - 1);
+        right->childrenCount--;
+    }
+    else
+    {
+        // borrow the last child of `left`
+        copyChildren(right, 1, right, 0, right->childrenCount);
+        copyChildren(right, 0, left, left->childrenCount - 1, 1);
+        right->childrenCount++;
+        left->childrenCount--;
+    }
+    refreshNode(left);
+    refreshNode(right);
+    refreshNode(node);
+}
+
+void removeLeafInNode(BufferNode *node, size_t leafIndex)
+{
+    if (node->isBottom)
+    {
+        static_cast<BufferPiece *>(node->children[leafIndex])->release();
+        removeChild(node, leafIndex);
+        return;
+    }
+
+    const size_t i = findChildByLeafIndex(node, leafIndex, false);
+    BufferNode *child = ownChild(node, i);
+    removeLeafInNode(child, leafIndex);
+    if (child->childrenCount < BUFFER_NODE_MIN_CHILDREN)
+    {
+        rebalanceChild(node, i);
+    }
+    else
+    {
+        refreshNode(node);
+    }
+}
+
+size_t nodeMemUsage(const BufferNode *node)
+{
+    size_t result = sizeof(BufferNode) + (node->wide ? sizeof(BufferNodeWide) : 0);
+    for (size_t i = 0; i < node->childrenCount; i++)
+    {
+        if (node->isBottom)
+        {
+            result += static_cast<BufferPiece *>(node->children[i])->memUsage();
+        }
+        else
+        {
+            result += nodeMemUsage(static_cast<BufferNode *>(node->children[i]));
+        }
+    }
+    return result;
+}
+
+/**
+ * Returns the depth of the subtree rooted at `node`.
+ */
+size_t assertNodeInvariants(const BufferNode *node, bool isRoot)
+{
+    assert(node->childrenCount <= BUFFER_NODE_MAX_CHILDREN);
+    if (!isRoot)
+    {
+        assert(node->childrenCount >= BUFFER_NODE_MIN_CHILDREN);
+    }
+
+    size_t length = 0;
+    size_t newLineCount = 0;
+    size_t leafsCount = 0;
+    size_t depth = 0;
+    for (size_t i = 0; i < node->childrenCount; i++)
+    {
+        if (node->isBottom)
+        {
+            const BufferPiece *leaf = static_cast<BufferPiece *>(node->children[i]);
+            assert(childLength(node, i) == leaf->length());
+            // a pending leaf can get its line starts at any time, until the next refresh it has no new lines
+            if (node->pendingChildren & (1u << i))
+            {
+                assert(childNewLineCount(node, i) == 0);
+            }
+            else
+            {
+                assert(leaf->hasLineStarts() && childNewLineCount(node, i) == leaf->newLineCount());
+            }
+            assert(childLeafsCount(node, i) == 1);
+        }
+        else
+        {
+            const BufferNode *child = static_cast<BufferNode *>(node->children[i]);
+            assert(childLength(node, i) == child->length);
+            assert(childNewLineCount(node, i) == child->newLineCount);
+            assert(childLeafsCount(node, i) == child->leafsCount);
+            assert(((node->pendingChildren & (1u << i)) != 0) == (child->pendingChildren != 0));
+
+            size_t childDepth = assertNodeInvariants(child, false);
+            assert(i == 0 || childDepth == depth);
+            depth = childDepth;
+        }
+        length += childLength(node, i);
+        newLineCount += childNewLineCount(node, i);
+        leafsCount += childLeafsCount(node, i);
+    }
+    assert(node->length == length);
+    assert(node->newLineCount == newLineCount);
+    assert(node->leafsCount == leafsCount);
+    assert((node->pendingChildren >> node->childrenCount) == 0);
+    assert((node->wide != NULL) == (length > UINT32_MAX || newLineCount > UINT32_MAX || leafsCount > UINT32_MAX));
+
+    return depth + 1;
+}
+
+/**
+ * Refresh the nodes that have pending leafs below them, so the leafs that got their line starts are counted.
+ */
+void refreshPendingNode(BufferNode *node)
+{
+    if (!node->isBottom)
+    {
+        for (size_t i = 0; i < node->childrenCount; i++)
+        {
+            if (node->pendingChildren & (1u << i))
+            {
+                refreshPendingNode(ownChild(node, i));
+            }
+        }
+    }
+    refreshNode(node);
+}
+
+BufferTree::BufferTree(vector<BufferPiece *> &pieces)
+{
+    // Build the tree bottom-up, spreading the children evenly so that every node is at least half full.
+    vector<void *> level(pieces.begin(), pieces.end());
+    bool isBottom = true;
+    do
+    {
+        const size_t count = level.size();
+        const size_t nodesCount = max((size_t)1, (count + BUFFER_NODE_MAX_CHILDREN - 1) / BUFFER_NODE_MAX_CHILDREN);
+
+        vector<void *> parents(nodesCount);
+        size_t childIndex = 0;
+        for (size_t i = 0; i < nodesCount; i++)
+        {
+            const size_t childrenCount = count / nodesCount + (i < count % nodesCount ? 1 : 0);
+
+            BufferNode *node = createNode(isBottom);
+            for (size_t j = 0; j < childrenCount; j++)
+            {
+                node->children[j] = level[childIndex++];
+            }
+            node->childrenCount = childrenCount;
+            refreshNode(node);
+            parents[i] = node;
+        }
+
+        level.swap(parents);
+        isBottom = false;
+    } while (level.size() > 1);
+
+    root_ = static_cast<BufferNode *>(level[0]);
+}
+
+BufferTree::BufferTree(const BufferTree &other)
+{
+    root_ = other.root_;
+    root_->refCount++;
+}
+
+BufferTree::~BufferTree()
+{
+    releaseNode(root_);
+}
+
+size_t BufferTree::memUsage() const
+{
+    return sizeof(BufferTree) + nodeMemUsage(root_);
+}
+
+size_t BufferTree::firstPendingLeafIndex() const
+{
+    assert(hasPendingLineStarts());
+
+    const BufferNode *node = root_;
+    size_t leafIndex = 0;
+    while (true)
+    {
+        size_t i = 0;
+        while (!(node->pendingChildren & (1u << i)))
+        {
+            i++;
+        }
+        leafIndex += node->leafsCountsBefore(i);
+
+        if (node->isBottom)
+        {
+            return leafIndex;
+        }
+        node = static_cast<BufferNode *>(node->children[i]);
+    }
+}
+
+void BufferTree::refreshLineStarts()
+{
+    if (!hasPendingLineStarts())
+    {
+        return;
+    }
+    ownRoot();
+    refreshPendingNode(root_);
+}
+
+bool BufferTree::ensureLineStarts(size_t lineNumber, size_t offset)
+{
+    if (!hasPendingLineStarts())
+    {
+        return false;
+    }
+
+    // the new lines before the first pending leaf are counted
+    BufferLeafIterator it(*this, firstPendingLeafIndex());
+    size_t newLineCount = it.newLinesBefore();
+    if (newLineCount >= lineNumber && it.leafStartOffset() > offset)
+    {
+        return false;
+    }
+    do
+    {
+        const BufferPiece *leaf = it.leaf();
+        newLineCount += leaf->newLineCount();
+        if (newLineCount >= lineNumber && it.leafStartOffset() + leaf->length() > offset)
+        {
+            break;
+        }
+    } while (it.next());
+
+    // also counts what the scanner did so far
+    refreshLineStarts();
+    return true;
+}
+
+void BufferTree::completeLineStarts()
+{
+    if (!hasPendingLineStarts())
+    {
+        return;
+    }
+
+    // walk backwards, to meet the scanner which goes forward
+    const size_t pendingLeafIndex = firstPendingLeafIndex();
+    BufferLeafIterator it(*this, leafsCount() - 1);
+    do
+    {
+        it.leaf()->ensureLineStarts();
+    } while (it.leafIndex() > pendingLeafIndex && it.prev());
+
+    refreshLineStarts();
+}
+
+BufferPiece *BufferTree::leafAt(size_t leafIndex) const
+{
+    assert(leafIndex < root_->leafsCount);
+
+    const BufferNode *node = root_;
+    while (!node->isBottom)
+    {
+        const size_t i = findChildByLeafIndex(node, leafIndex, false);
+        node = static_cast<BufferNode *>(node->children[i]);
+    }
+    return static_cast<BufferPiece *>(node->children[leafIndex]);
+}
+
+bool BufferTree::findOffset(size_t offset, BufferCursor &result) const
+{
+    size_t newLinesBefore;
+    return findOffset(offset, result, newLinesBefore);
+}
+
+bool BufferTree::findOffset(size_t offset, BufferCursor &result, size_t &newLinesBefore) const
+{
+    if (offset > root_->length)
+    {
+        return false;
+    }
+
+    const BufferNode *node = root_;
+    size_t searchOffset = offset;
+    size_t leafStartOffset = 0;
+    size_t leafIndex = 0;
+    newLinesBefore = 0;
+    while (true)
+    {
+        // go to the first child containing `searchOffset`, or to the last non-empty child if `searchOffset` is at the very end
+        size_t i = findChildByLength(node, searchOffset);
+        if (i == node->childrenCount)
+        {
+            i = (searchOffset == 0 ? 0 : findChildByLength(node, searchOffset - 1));
+        }
+        searchOffset -= node->lengthsBefore(i);
+        leafStartOffset += node->lengthsBefore(i);
+        leafIndex += node->leafsCountsBefore(i);
+        newLinesBefore += node->newLineCountsBefore(i);
+
+        if (node->isBottom)
+        {
+            break;
+        }
+        node = static_cast<BufferNode *>(node->children[i]);
+    }
+
+    result.offset = offset;
+    result.leafIndex = leafIndex;
+    result.leafStartOffset = leafStartOffset;
+
+    return true;
+}
+
+bool BufferTree::findLineStart(size_t &lineIndex, BufferCursor &result) const
+{
+    if (lineIndex > root_->newLineCount)
+    {
+        return false;
+    }
+
+    const BufferNode *node = root_;
+    size_t leafStartOffset = 0;
+    size_t leafIndex = 0;
+    const BufferPiece *leaf;
+    while (true)
+    {
+        // go to the first child containing the line break before `lineIndex`
+        size_t i = (lineIndex == 0 ? 0 : findChildByNewLineCount(node, lineIndex - 1));
+        i = min(i, node->childrenCount - 1);
+        lineIndex -= node->newLineCountsBefore(i);
+        leafStartOffset += node->lengthsBefore(i);
+        leafIndex += node->leafsCountsBefore(i);
+
+        if (node->isBottom)
+        {
+            leaf = static_cast<const BufferPiece *>(node->children[i]);
+            break;
+        }
+        node = static_cast<BufferNode *>(node->children[i]);
+    }
+
+    const LINE_START_T innerLineStartOffset = (lineIndex == 0 ? 0 : leaf->lineStartFor(lineIndex - 1));
+
+    result.offset = leafStartOffset + innerLineStartOffset;
+    result.leafIndex = leafIndex;
+    result.leafStartOffset = leafStartOffset;
+
+    return true;
+}
+
+bool BufferTree::findPosition(size_t offset, size_t &lineNumber, size_t &column) const
+{
+    BufferCursor cursor;
+    size_t newLinesBefore;
+    if (!findOffset(offset, cursor, newLinesBefore))
+    {
+        return false;
+    }
+
+    // count the line starts inside the leaf that are at or before `offset`
+    const BufferPiece *leaf = leafAt(cursor.leafIndex);
+    const size_t innerOffset = offset - cursor.leafStartOffset;
+    const size_t innerNewLines = leaf->lineStartsUpTo(innerOffset);
+
+    size_t lineIndex = newLinesBefore + innerNewLines;
+    size_t lineStartOffset;
+    if (innerNewLines > 0)
+    {
+        lineStartOffset = cursor.leafStartOffset + leaf->lineStartFor(innerNewLines - 1);
+    }
+    else
+    {
+        // the line starts in a previous leaf
+        BufferCursor lineStart;
+        size_t innerLineIndex = lineIndex;
+        findLineStart(innerLineIndex, lineStart);
+        lineStartOffset = lineStart.offset;
+    }
+
+    lineNumber = lineIndex + 1;
+    column = offset - lineStartOffset + 1;
+    return true;
+}
+
+bool BufferTree::findPositions(const size_t *offsets, size_t count, size_t *lineNumbers, size_t *columns) const
+{
+    if (count == 0)
+    {
+        return true;
+    }
+    if (offsets[count - 1] > root_->length)
+    {
+        return false;
+    }
+
+    BufferCursor cursor;
+    findOffset(offsets[0], cursor);
+    BufferLeafIterator it(*this, cursor.leafIndex);
+
+    // the start of the last line that begins before the current leaf, if known
+    bool hasLineStart = it.isFirst();
+    size_t lineStartOffset = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t offset = offsets[i];
+        assert(i == 0 || offsets[i - 1] <= offset);
+
+        size_t steps = 0;
+        while (!it.isLast() && offset >= it.leafStartOffset() + it.leaf()->length())
+        {
+            if (++steps > BUFFER_NODE_MAX_CHILDREN)
+            {
+                // far away, descend from the root instead of walking all the leafs in between
+                findOffset(offset, cursor);
+                it.seek(cursor.leafIndex);
+                hasLineStart = false;
+                break;
+            }
+
+            const BufferPiece *leaf = it.leaf();
+            if (leaf->newLineCount() > 0)
+            {
+                hasLineStart = true;
+                lineStartOffset = it.leafStartOffset() + leaf->lineStartFor(leaf->newLineCount() - 1);
+            }
+            it.next();
+        }
+
+        const BufferPiece *leaf = it.leaf();
+        const size_t innerOffset = offset - it.leafStartOffset();
+        const size_t innerNewLines = leaf->lineStartsUpTo(innerOffset);
+        const size_t lineIndex = it.newLinesBefore() + innerNewLines;
+
+        size_t currentLineStartOffset;
+        if (innerNewLines > 0)
+        {
+            currentLineStartOffset = it.leafStartOffset() + leaf->lineStartFor(innerNewLines - 1);
+        }
+        else
+        {
+            if (!hasLineStart)
+            {
+                BufferCursor lineStart;
+                size_t innerLineIndex = lineIndex;
+                findLineStart(innerLineIndex, lineStart);
+                hasLineStart = true;
+                lineStartOffset = lineStart.offset;
+            }
+            currentLineStartOffset = lineStartOffset;
+        }
+
+        lineNumbers[i] = lineIndex + 1;
+        columns[i] = offset - currentLineStartOffset + 1;
+    }
+    return true;
+}
+
+bool BufferTree::findOffsets(const size_t *lineNumbers, const size_t *columns, size_t count, size_t *offsets) const
+{
+    if (count == 0)
+    {
+        return true;
+    }
+    if (lineNumbers[0] == 0 || lineNumbers[count - 1] > root_->newLineCount + 1)
+    {
+        return false;
+    }
+
+    BufferCursor cursor;
+    size_t firstLineIndex = lineNumbers[0] - 1;
+    findLineStart(firstLineIndex, cursor);
+    BufferLeafIterator it(*this, cursor.leafIndex);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t lineIndex = lineNumbers[i] - 1;
+        assert(i == 0 || lineNumbers[i - 1] <= lineNumbers[i]);
+
+        // go to the first leaf that contains the start of the line, like `findLineStart`
+        size_t steps = 0;
+        while (!it.isLast() && lineIndex > it.newLinesBefore() + it.leaf()->newLineCount())
+        {
+            if (++steps > BUFFER_NODE_MAX_CHILDREN)
+            {
+                size_t innerLineIndex = lineIndex;
+                findLineStart(innerLineIndex, cursor);
+                it.seek(cursor.leafIndex);
+                break;
+            }
+            it.next();
+        }
+
+        const size_t innerLineIndex = lineIndex - it.newLinesBefore();
+        const size_t lineStartOffset = it.leafStartOffset() + (innerLineIndex == 0 ? 0 : it.leaf()->lineStartFor(innerLineIndex - 1));
+        offsets[i] = lineStartOffset + columns[i] - 1;
+    }
+    return true;
+}
+
+bool BufferTree::findLine(size_t lineNumber, BufferCursor &start, BufferCursor &end) const
+{
+    size_t innerLineIndex = lineNumber - 1;
+    if (!findLineStart(innerLineIndex, start))
+    {
+        return false;
+    }
+
+    findLineEnd(start.leafIndex, start.leafStartOffset, innerLineIndex, end);
+    return true;
+}
+
+void BufferTree::findLineEnd(size_t leafIndex, size_t leafStartOffset, size_t innerLineIndex, BufferCursor &result) const
+{
+    const size_t leafsCount = root_->leafsCount;
+    while (true)
+    {
+        BufferPiece *leaf = leafAt(leafIndex);
+
+        if (innerLineIndex < leaf->newLineCount())
+        {
+            LINE_START_T lineEndOffset = leaf->lineStartFor(innerLineIndex);
+
+            result.offset = leafStartOffset + lineEndOffset;
+            result.leafIndex = leafIndex;
+            result.leafStartOffset = leafStartOffset;
+            return;
+        }
+
+        leafIndex++;
+
+        if (leafIndex >= leafsCount)
+        {
+            result.offset = leafStartOffset + leaf->length();
+            result.leafIndex = leafIndex - 1;
+            result.leafStartOffset = leafStartOffset;
+            return;
+        }
+
+        leafStartOffset += leaf->length();
+        innerLineIndex = 0;
+    }
+}
+
+void BufferTree::extractString(BufferCursor start, size_t len, uint16_t *dest) const
+{
+    assert(start.offset + len <= root_->length);
+
+    size_t innerLeafOffset = start.offset - start.leafStartOffset;
+    size_t leafIndex = start.leafIndex;
+    size_t destOffset = 0;
+    while (len > 0)
+    {
+        BufferPiece *leaf = leafAt(leafIndex);
+        const size_t cnt = min(len, leaf->length() - innerLeafOffset);
+        leaf->write(dest + destOffset, innerLeafOffset, cnt);
+
+        len -= cnt;
+        destOffset += cnt;
+        innerLeafOffset = 0;
+
+        if (len == 0)
+        {
+            break;
+        }
+
+        leafIndex++;
+    }
+}
+
+void BufferTree::ownRoot()
+{
+    if (root_->refCount > 1)
+    {
+        BufferNode *copy = cloneNode(root_);
+        releaseNode(root_);
+        root_ = copy;
+    }
+}
+
+void BufferTree::setLeaf(size_t leafIndex, BufferPiece *leaf)
+{
+    ownRoot();
+    setLeafInNode(root_, leafIndex, leaf);
+}
+
+void BufferTree::insertLeaf(size_t leafIndex, BufferPiece *leaf)
+{
+    ownRoot();
+    BufferNode *sibling = insertLeafInNode(root_, leafIndex, leaf);
+    if (sibling != NULL)
+    {
+        BufferNode *newRoot = createNode(false);
+        insertChildNoSplit(newRoot, 0, root_);
+        insertChildNoSplit(newRoot, 1, sibling);
+        root_ = newRoot;
+    }
+}
+
+void BufferTree::removeLeaf(size_t leafIndex)
+{
+    ownRoot();
+    removeLeafInNode(root_, leafIndex);
+    if (!root_->isBottom && root_->childrenCount == 1)
+    {
+        BufferNode *oldRoot = root_;
+        root_ = static_cast<BufferNode *>(oldRoot->children[0]);
+        delete oldRoot;
+    }
+}
+
+void BufferTree::replaceLeafs(size_t leafIndex, size_t deleteCount, BufferPiece **leafs, size_t count)
+{
+    assert(leafIndex + deleteCount <= root_->leafsCount);
+
+    // overwrite in place as much as possible, this doesn't change the shape of the tree
+    const size_t setCount = min(deleteCount, count);
+    for (size_t i = 0; i < setCount; i++)
+    {
+        setLeaf(leafIndex + i, leafs[i]);
+    }
+    for (size_t i = setCount; i < count; i++)
+    {
+        insertLeaf(leafIndex + i, leafs[i]);
+    }
+    for (size_t i = setCount; i < deleteCount; i++)
+    {
+        removeLeaf(leafIndex + setCount);
+    }
+}
+
+void BufferTree::assertInvariants() const
+{
+    assertNodeInvariants(root_, true);
+}
+
+BufferLeafIterator::BufferLeafIterator(const BufferTree &tree, size_t leafIndex)
+{
+    root_ = tree.root_;
+    leafsCount_ = root_->leafsCount;
+    seek(leafIndex);
+}
+
+void BufferLeafIterator::seek(size_t leafIndex)
+{
+    assert(leafIndex < leafsCount_);
+
+    leafIndex_ = leafIndex;
+    leafStartOffset_ = 0;
+    newLinesBefore_ = 0;
+    depth_ = 0;
+
+    const BufferNode *node = root_;
+    while (true)
+    {
+        const size_t i = findChildByLeafIndex(node, leafIndex, false);
+        leafStartOffset_ += node->lengthsBefore(i);
+        newLinesBefore_ += node->newLineCountsBefore(i);
+
+        assert(depth_ < BUFFER_TREE_MAX_DEPTH);
+        nodes_[depth_] = node;
+        indices_[depth_] = i;
+        depth_++;
+
+        if (node->isBottom)
+        {
+            break;
+        }
+        node = static_cast<const BufferNode *>(node->children[i]);
+    }
+}
+
+bool BufferLeafIterator::next()
+{
+    if (isLast())
+    {
+        return false;
+    }
+
+    const BufferNode *bottom = nodes_[depth_ - 1];
+    const size_t bottomIndex = indices_[depth_ - 1];
+    leafStartOffset_ += childLength(bottom, bottomIndex);
+    newLinesBefore_ += childNewLineCount(bottom, bottomIndex);
+    leafIndex_++;
+
+    // go up until a node has a next child, then down to the first leaf of that child
+    size_t level = depth_ - 1;
+    while (indices_[level] + 1 >= nodes_[level]->childrenCount)
+    {
+        level--;
+    }
+    indices_[level]++;
+    for (; level + 1 < depth_; level++)
+    {
+        nodes_[level + 1] = static_cast<const BufferNode *>(nodes_[level]->children[indices_[level]]);
+        indices_[level + 1] = 0;
+    }
+    return true;
+}
+
+bool BufferLeafIterator::prev()
+{
+    if (isFirst())
+    {
+        return false;
+    }
+
+    // go up until a node has a previous child, then down to the last leaf of that child
+    size_t level = depth_ - 1;
+    while (indices_[level] == 0)
+    {
+        level--;
+    }
+    indices_[level]--;
+    for (; level + 1 < depth_; level++)
+    {
+        nodes_[level + 1] = static_cast<const BufferNode *>(nodes_[level]->children[indices_[level]]);
+        indices_[level + 1] = nodes_[level + 1]->childrenCount - 1;
+    }
+
+    const BufferNode *bottom = nodes_[depth_ - 1];
+    const size_t bottomIndex = indices_[depth_ - 1];
+    leafStartOffset_ -= childLength(bottom, bottomIndex);
+    newLinesBefore_ -= childNewLineCount(bottom, bottomIndex);
+    leafIndex_--;
+    return true;
+}
+
+BufferLineIterator::BufferLineIterator(const BufferTree &tree) : tree_(tree), start_(tree, 0), end_(tree, 0)
+{
+    lineCount_ = tree.newLineCount() + 1;
+    seek(1);
+}
+
+bool BufferLineIterator::seek(size_t lineNumber)
+{
+    if (lineNumber < 1 || lineNumber > lineCount_)
+    {
+        return false;
+    }
+
+    lineIndex_ = lineNumber - 1;
+
+    BufferCursor cursor;
+    size_t innerLineIndex = lineIndex_;
+    tree_.findLineStart(innerLineIndex, cursor);
+    start_.seek(cursor.leafIndex);
+    startOffset_ = cursor.offset;
+    findEnd();
+    return true;
+}
+
+void BufferLineIterator::findEnd()
+{
+    end_ = start_;
+    while (true)
+    {
+        const BufferPiece *leaf = end_.leaf();
+        const size_t innerLineIndex = lineIndex_ - end_.newLinesBefore();
+        if (innerLineIndex < leaf->newLineCount())
+        {
+            endOffset_ = end_.leafStartOffset() + leaf->lineStartFor(innerLineIndex);
+            return;
+        }
+        if (end_.isLast())
+        {
+            endOffset_ = end_.leafStartOffset() + leaf->length();
+            return;
+        }
+        end_.next();
+    }
+}
+
+bool BufferLineIterator::next()
+{
+    if (lineIndex_ + 1 >= lineCount_)
+    {
+        return false;
+    }
+
+    // the line starts right after the line terminator of the current line
+    lineIndex_++;
+    start_ = end_;
+    startOffset_ = endOffset_;
+    findEnd();
+    return true;
+}
+
+bool BufferLineIterator::prev()
+{
+    if (lineIndex_ == 0)
+    {
+        return false;
+    }
+
+    // the line ends where the current line starts
+    lineIndex_--;
+    end_ = start_;
+    endOffset_ = startOffset_;
+
+    while (!start_.isFirst() && lineIndex_ <= start_.newLinesBefore())
+    {
+        start_.prev();
+    }
+    const size_t innerLineIndex = lineIndex_ - start_.newLinesBefore();
+    startOffset_ = start_.leafStartOffset() + (innerLineIndex == 0 ? 0 : start_.leaf()->lineStartFor(innerLineIndex - 1));
+    return true;
+}
+
+void BufferLineIterator::refresh()
+{
+    start_ = BufferLeafIterator(tree_, 0);
+    lineCount_ = tree_.newLineCount() + 1;
+    seek(lineIndex_ + 1);
+}
+
+void BufferLineIterator::read(uint16_t *dest) const
+{
+    BufferLeafIterator it = start_;
+    size_t innerOffset = startOffset_ - it.leafStartOffset();
+    size_t len = endOffset_ - startOffset_;
+    while (len > 0)
+    {
+        const BufferPiece *leaf = it.leaf();
+        const size_t cnt = min(len, leaf->length() - innerOffset);
+        leaf->write(dest, innerOffset, cnt);
+
+        dest += cnt;
+        len -= cnt;
+        innerOffset = 0;
+        it.next();
+    }
+}
+}
@@ -0,0 +1,229 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_BUFFER_TREE_H_
+#define EDCORE_BUFFER_TREE_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "buffer-piece.h"
+
+using namespace std;
+
+/**
+ * 16 children keep each per-child array of a node within one cache line
+ * and let a SIMD compare scan a whole array at once.
+ */
+#define BUFFER_NODE_MAX_CHILDREN 16
+#define BUFFER_NODE_MIN_CHILDREN (BUFFER_NODE_MAX_CHILDREN / 2)
+// enough for 2^64 leafs with half full nodes
+#define BUFFER_TREE_MAX_DEPTH 24
+
+namespace edcore
+{
+
+struct BufferCursor
+{
+    size_t offset;
+    size_t leafIndex;
+    size_t leafStartOffset;
+};
+typedef struct BufferCursor BufferCursor;
+
+/**
+ * Per-child prefix sums of a node whose totals don't fit in 32 bits.
+ */
+struct BufferNodeWide
+{
+    size_t lengths[BUFFER_NODE_MAX_CHILDREN];
+    size_t newLineCounts[BUFFER_NODE_MAX_CHILDREN];
+    size_t leafsCounts[BUFFER_NODE_MAX_CHILDREN];
+};
+typedef struct BufferNodeWide BufferNodeWide;
+
+/**
+ * A node in the B+-tree of leafs.
+ * The aggregates of the children are kept in the parent, so a descent only touches one node per level.
+ * They are stored as inclusive prefix sums (`lengths[i]` is the length of children 0..i), in 32 bits
+ * unless the node is larger than 4G, in which case `wide` holds them instead.
+ * Bottom nodes have `BufferPiece *` children, all other nodes have `BufferNode *` children.
+ * Leafs whose line starts are still pending count as having no new lines. Bit i of `pendingChildren` is set
+ * if child i is such a leaf or has one below it, as of the last refresh of the node.
+ * Nodes are shared between trees (snapshots) and are copied before being modified if `refCount > 1`.
+ */
+struct BufferNode
+{
+    atomic<size_t> refCount;
+    bool isBottom;
+    size_t childrenCount;
+
+    size_t length;
+    size_t newLineCount;
+    size_t leafsCount;
+    uint32_t pendingChildren;
+
+    uint32_t lengths[BUFFER_NODE_MAX_CHILDREN];
+    uint32_t newLineCounts[BUFFER_NODE_MAX_CHILDREN];
+    uint32_t leafsCounts[BUFFER_NODE_MAX_CHILDREN];
+    BufferNodeWide *wide;
+    void *children[BUFFER_NODE_MAX_CHILDREN];
+
+    ~BufferNode() { delete wide; }
+
+    size_t lengthsBefore(size_t i) const { return (i == 0 ? 0 : (wide ? wide->lengths[i - 1] : lengths[i - 1])); }
+    size_t newLineCountsBefore(size_t i) const { return (i == 0 ? 0 : (wide ? wide->newLineCounts[i - 1] : newLineCounts[i - 1])); }
+    size_t leafsCountsBefore(size_t i) const { return (i == 0 ? 0 : (wide ? wide->leafsCounts[i - 1] : leafsCounts[i - 1])); }
+};
+typedef struct BufferNode BufferNode;
+
+class BufferTree
+{
+  public:
+    BufferTree(vector<BufferPiece *> &pieces);
+    /**
+     * O(1), the new tree shares all nodes and leafs with `other`.
+     */
+    BufferTree(const BufferTree &other);
+    ~BufferTree();
+
+    size_t length() const { return root_->length; }
+    size_t newLineCount() const { return root_->newLineCount; }
+    size_t leafsCount() const { return root_->leafsCount; }
+    size_t memUsage() const;
+
+    /**
+     * The line queries are exact for the leafs before the first one with pending line starts.
+     * `refreshLineStarts` counts the new lines of the pending leafs that got their line starts since the last call.
+     */
+    bool hasPendingLineStarts() const { return (root_->pendingChildren != 0); }
+    size_t firstPendingLeafIndex() const;
+    void refreshLineStarts();
+    /**
+     * Makes the line queries exact for line `lineNumber` and for `offset`: the leafs up to the one containing
+     * the `lineNumber`th new line and the one containing `offset` get their line starts and are counted.
+     * Returns true if the tree was refreshed, which invalidates its iterators.
+     */
+    bool ensureLineStarts(size_t lineNumber, size_t offset);
+    /**
+     * Waits for the line starts of all leafs.
+     */
+    void completeLineStarts();
+
+    BufferPiece *leafAt(size_t leafIndex) const;
+    bool findOffset(size_t offset, BufferCursor &result) const;
+    bool findLineStart(size_t &lineIndex, BufferCursor &result) const;
+    bool findLine(size_t lineNumber, BufferCursor &start, BufferCursor &end) const;
+    /**
+     * `lineNumber` and `column` are 1-based, like `findLine` and `EdBuffer.GetOffsetAt`.
+     */
+    bool findPosition(size_t offset, size_t &lineNumber, size_t &column) const;
+
+    /**
+     * Batch versions of `findPosition` and `findLine` + column, resolved in one left-to-right walk over the leafs.
+     * `offsets` and `lineNumbers` must be sorted ascending. Returns false if any of them is out of range.
+     */
+    bool findPositions(const size_t *offsets, size_t count, size_t *lineNumbers, size_t *columns) const;
+    bool findOffsets(const size_t *lineNumbers, const size_t *columns, size_t count, size_t *offsets) const;
+    void extractString(BufferCursor start, size_t len, uint16_t *dest) const;
+
+    /**
+     * Replace `deleteCount` leafs starting at `leafIndex` with `leafs`.
+     * The tree takes over the references of `leafs` and releases the removed leafs.
+     */
+    void replaceLeafs(size_t leafIndex, size_t deleteCount, BufferPiece **leafs, size_t count);
+
+    void assertInvariants() const;
+
+  private:
+    friend class BufferLeafIterator;
+
+    BufferNode *root_;
+
+    BufferTree &operator=(const BufferTree &other);
+
+    bool findOffset(size_t offset, BufferCursor &result, size_t &newLinesBefore) const;
+    void findLineEnd(size_t leafIndex, size_t leafStartOffset, size_t innerLineIndex, BufferCursor &result) const;
+    void ownRoot();
+    void setLeaf(size_t leafIndex, BufferPiece *leaf);
+    void insertLeaf(size_t leafIndex, BufferPiece *leaf);
+    void removeLeaf(size_t leafIndex);
+};
+
+/**
+ * Walks the leafs of a tree in order, in O(1) amortized time per step.
+ * The iterator is invalidated when the tree is modified.
+ */
+class BufferLeafIterator
+{
+  public:
+    BufferLeafIterator(const BufferTree &tree, size_t leafIndex);
+
+    BufferPiece *leaf() const { return static_cast<BufferPiece *>(nodes_[depth_ - 1]->children[indices_[depth_ - 1]]); }
+    size_t leafIndex() const { return leafIndex_; }
+    size_t leafStartOffset() const { return leafStartOffset_; }
+    size_t newLinesBefore() const { return newLinesBefore_; }
+    bool isFirst() const { return leafIndex_ == 0; }
+    bool isLast() const { return leafIndex_ + 1 == leafsCount_; }
+
+    void seek(size_t leafIndex);
+    bool next();
+    bool prev();
+
+  private:
+    const BufferNode *root_;
+    size_t leafsCount_;
+    size_t depth_;
+    const BufferNode *nodes_[BUFFER_TREE_MAX_DEPTH];
+    size_t indices_[BUFFER_TREE_MAX_DEPTH];
+
+    size_t leafIndex_;
+    size_t leafStartOffset_;
+    size_t newLinesBefore_;
+};
+
+/**
+ * Walks the lines of a tree forward or backward, in O(1) amortized time per line.
+ * The iterator is invalidated when the tree is modified.
+ */
+class BufferLineIterator
+{
+  public:
+    BufferLineIterator(const BufferTree &tree);
+
+    size_t lineNumber() const { return lineIndex_ + 1; }
+    size_t lineStartOffset() const { return startOffset_; }
+    size_t lineLength() const { return endOffset_ - startOffset_; }
+
+    bool seek(size_t lineNumber);
+    bool next();
+    bool prev();
+    /**
+     * Reads the tree again after `BufferTree::ensureLineStarts` refreshed it, staying on the current line.
+     */
+    void refresh();
+
+    /**
+     * Write the current line (including its line terminator) to `dest`, which must have room for `lineLength()` characters.
+     */
+    void read(uint16_t *dest) const;
+
+  private:
+    const BufferTree &tree_;
+    size_t lineCount_;
+    size_t lineIndex_;
+    // the leaf containing the start of the line, picked like `BufferTree::findLineStart` does
+    BufferLeafIterator start_;
+    size_t startOffset_;
+    // the leaf containing the end of the line, picked like `BufferTree::findLine` does
+    BufferLeafIterator end_;
+    size_t endOffset_;
+
+    void findEnd();
+};
+}
+
+#endif
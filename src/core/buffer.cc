@@ -9,442 +9,442 @@
 #include <assert.h>
 #include <cstring>
 
-#define PARENT(i) (i >> 1)
-#define LEFT_CHILD(i) (i << 1)
-#define RIGHT_CHILD(i) ((i << 1) + 1)
-#define IS_NODE(i) (i < nodesCount_)
-#define IS_LEAF(i) (i >= leafsStart_ && i < leafsEnd_)
-#define NODE_TO_LEAF_INDEX(i) (i - leafsStart_)
-#define LEAF_TO_NODE_INDEX(i) (i + leafsStart_)
-
 using namespace std;
 
 namespace edcore
 {
 
-size_t log2(size_t n)
+size_t Buffer::memUsage() const
 {
-    size_t v = 1;
-    for (size_t pow = 1;; pow++)
-    {
-        v = v << 1;
-        if (v >= n)
-        {
-            return pow;
-        }
-    }
-    return -1;
+    return (
+        sizeof(Buffer) - sizeof(BufferTree) +
+        tree_.memUsage() +
+        leafCache_->stats().memUsage +
+        (searchIndex_ != NULL ? searchIndex_->memUsage() : 0));
 }
 
-size_t Buffer::memUsage() const
+/**
+ * Runs on `Buffer::lineStartsScanner_`. The pieces are retained for it, pieces the buffer no longer uses
+ * are scanned all the same and go away here.
+ */
+static void scanPendingLineStarts(vector<BufferPiece *> pieces, const atomic<bool> *stop)
 {
-    const size_t leafsCount = leafs_.length();
-
-    size_t leafs = 0;
-    for (size_t i = 0; i < leafsCount; i++)
+    for (size_t i = 0, len = pieces.size(); i < len; i++)
     {
-        leafs += leafs_[i]->memUsage();
+        if (!stop->load(memory_order_relaxed))
+        {
+            pieces[i]->ensureLineStarts();
+        }
+        pieces[i]->release();
     }
-    return (
-        sizeof(Buffer) +
-        leafs_.memUsage() +
-        nodesCount_ * sizeof(BufferNode) +
-        leafs);
 }
 
-Buffer::Buffer(vector<BufferPiece *> &pieces, size_t minLeafLength, size_t maxLeafLength)
+Buffer::Buffer(BufferArena *arena, LeafCache *leafCache, vector<BufferPiece *> &pieces, size_t minLeafLength, size_t maxLeafLength, bool scanLineStartsInBackground) : arena_(arena), tree_(pieces), pieceTable_(false), addBuffer_(arena), leafCache_(leafCache), searchIndex_(NULL), stopLineStartsScanner_(false)
 {
-    assert(2 * minLeafLength >= maxLeafLength);
-
-    const size_t leafsCount = pieces.size();
-    BufferPiece **tmp = new BufferPiece *[leafsCount];
-    for (size_t i = 0; i < leafsCount; i++)
-    {
-        tmp[i] = pieces[i];
-    }
-    leafs_.assign(tmp, leafsCount);
+    arena_->retain();
+    leafCache_->retain();
+    lastEditAllocations_.allocations = 0;
+    lastEditAllocations_.heapAllocations = 0;
 
-    nodes_ = NULL;
-    _rebuildNodes();
+    assert(2 * minLeafLength >= maxLeafLength);
 
     minLeafLength_ = minLeafLength;
     maxLeafLength_ = maxLeafLength;
     idealLeafLength_ = (minLeafLength_ + maxLeafLength_) / 2;
 
+    vector<BufferPiece *> pendingPieces;
+    for (size_t i = 0, len = pieces.size(); i < len; i++)
+    {
+        // without the scanner, the line queries scan the pending pieces they need
+        if (scanLineStartsInBackground && !pieces[i]->hasLineStarts())
+        {
+            pieces[i]->retain();
+            pendingPieces.push_back(pieces[i]);
+        }
+    }
+    if (pendingPieces.size() > 0)
+    {
+        lineStartsScanner_ = thread(scanPendingLineStarts, pendingPieces, &stopLineStartsScanner_);
+    }
+
     // printf("mem usage: %lu B = %lf MB\n", memUsage(), ((double)memUsage()) / 1024 / 1024);
 }
 
-void Buffer::_rebuildNodes()
+Buffer::~Buffer()
 {
-    if (nodes_ != NULL)
+    if (lineStartsScanner_.joinable())
     {
-        delete[] nodes_;
+        stopLineStartsScanner_ = true;
+        lineStartsScanner_.join();
     }
+    delete searchIndex_;
+    // the pieces still hold the arena and the cache, they are freed once the tree and all snapshots are gone
+    leafCache_->release();
+    arena_->release();
+}
 
-    const size_t leafsCount = leafs_.length();
+void Buffer::extractString(BufferCursor start, size_t len, uint16_t *dest)
+{
+    tree_.extractString(start, len, dest);
+}
 
-    nodesCount_ = 1 << log2(leafsCount);
-    leafsStart_ = nodesCount_;
-    leafsEnd_ = leafsStart_ + leafsCount;
+bool Buffer::findOffset(size_t offset, BufferCursor &result)
+{
+    return tree_.findOffset(offset, result);
+}
 
-    nodes_ = new BufferNode[nodesCount_];
-    memset(nodes_, 0, nodesCount_ * sizeof(nodes_[0]));
-    for (size_t i = nodesCount_ - 1; i >= 1; i--)
+static bool findNextInTree(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, const BufferCursor &from, bool backward, size_t &result)
+{
+    if (needle->length() == 0)
     {
-        _updateSingleNode(i);
+        // never matches
+        return false;
     }
+    LiteralSearch search(needle, options);
+    return (backward ? search.findPrevious(tree, from, result) : search.findNext(tree, from, result));
 }
 
-void Buffer::_updateSingleNode(size_t nodeIndex)
+static void findAllInTree(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, vector<size_t> &result, size_t threadsCount)
 {
-    size_t left = LEFT_CHILD(nodeIndex);
-    size_t right = RIGHT_CHILD(nodeIndex);
-
-    size_t length = 0;
-    size_t newLineCount = 0;
-
-    if (IS_NODE(left))
+    if (needle->length() == 0)
     {
-        length += nodes_[left].length;
-        newLineCount += nodes_[left].newLineCount;
+        // never matches
+        return;
     }
-    else if (IS_LEAF(left))
+    if (threadsCount > 1)
     {
-        length += leafs_[NODE_TO_LEAF_INDEX(left)]->length();
-        newLineCount += leafs_[NODE_TO_LEAF_INDEX(left)]->newLineCount();
+        findAllParallel(tree, needle, options, threadsCount, result);
+        return;
     }
+    LiteralSearch(needle, options).findAll(tree, 0, tree.length(), result);
+}
 
-    if (IS_NODE(right))
+static bool findAllRegexInTree(const BufferTree &tree, const BufferString *pattern, const SearchOptions &options, vector<size_t> &result, string &error, size_t threadsCount)
+{
+    RegexSearch *search = RegexSearch::create(pattern, options, error);
+    if (search == NULL)
     {
-        length += nodes_[right].length;
-        newLineCount += nodes_[right].newLineCount;
+        return false;
     }
-    else if (IS_LEAF(right))
+    if (threadsCount > 1)
     {
-        length += leafs_[NODE_TO_LEAF_INDEX(right)]->length();
-        newLineCount += leafs_[NODE_TO_LEAF_INDEX(right)]->newLineCount();
+        findAllRegexParallel(tree, *search, threadsCount, result);
     }
-
-    nodes_[nodeIndex].length = length;
-    nodes_[nodeIndex].newLineCount = newLineCount;
+    else
+    {
+        search->findAll(tree, 0, tree.length(), result);
+    }
+    delete search;
+    return true;
 }
 
-Buffer::~Buffer()
+void Buffer::findAll(const BufferString *needle, const SearchOptions &options, vector<size_t> &result, size_t threadsCount)
 {
-    delete[] nodes_;
-    const size_t leafsCount = leafs_.length();
-    for (size_t i = 0; i < leafsCount; i++)
+    if (searchIndex_ != NULL && needle->length() > 0)
     {
-        delete leafs_[i];
+        searchIndex_->findAll(tree_, needle, options, result, threadsCount);
+        return;
     }
+    findAllInTree(tree_, needle, options, result, threadsCount);
 }
 
-void Buffer::extractString(BufferCursor start, size_t len, uint16_t *dest)
+bool Buffer::findNext(const BufferString *needle, const SearchOptions &options, const BufferCursor &from, bool backward, size_t &result)
 {
-    assert(start.offset + len <= nodes_[1].length);
-
-    size_t innerLeafOffset = start.offset - start.leafStartOffset;
-    size_t leafIndex = start.leafIndex;
-    size_t destOffset = 0;
-    while (len > 0)
-    {
-        BufferPiece *leaf = leafs_[leafIndex];
-        const size_t cnt = min(len, leaf->length() - innerLeafOffset);
-        leaf->write(dest + destOffset, innerLeafOffset, cnt);
+    return findNextInTree(tree_, needle, options, from, backward, result);
+}
 
-        len -= cnt;
-        destOffset += cnt;
-        innerLeafOffset = 0;
+bool Buffer::findAllRegex(const BufferString *pattern, const SearchOptions &options, vector<size_t> &result, string &error, size_t threadsCount)
+{
+    return findAllRegexInTree(tree_, pattern, options, result, error, threadsCount);
+}
 
-        if (len == 0)
-        {
-            break;
-        }
+size_t BufferSnapshot::lineCount()
+{
+    tree_.completeLineStarts();
+    return tree_.newLineCount() + 1;
+}
 
-        leafIndex++;
-    }
+bool BufferSnapshot::isLineCountPending()
+{
+    tree_.refreshLineStarts();
+    return tree_.hasPendingLineStarts();
 }
 
-#define GET_NODE_LENGTH(nodeIndex) (IS_NODE(nodeIndex) ? nodes_[nodeIndex].length : IS_LEAF(nodeIndex) ? leafs_[NODE_TO_LEAF_INDEX(nodeIndex)]->length() : 0)
+bool BufferSnapshot::findLine(size_t lineNumber, BufferCursor &start, BufferCursor &end)
+{
+    tree_.ensureLineStarts(lineNumber, 0);
+    return tree_.findLine(lineNumber, start, end);
+}
 
-bool Buffer::findOffset(size_t offset, BufferCursor &result)
+bool BufferSnapshot::findPosition(size_t offset, size_t &lineNumber, size_t &column)
 {
-    if (offset > nodes_[1].length)
-    {
-        return false;
-    }
+    tree_.ensureLineStarts(0, offset);
+    return tree_.findPosition(offset, lineNumber, column);
+}
 
-    size_t it = 1;
-    size_t searchOffset = offset;
-    size_t leafStartOffset = 0;
-    while (!IS_LEAF(it))
+bool BufferSnapshot::findPositions(const size_t *offsets, size_t count, size_t *lineNumbers, size_t *columns)
+{
+    if (count > 0)
     {
-        size_t left = LEFT_CHILD(it);
-        size_t right = RIGHT_CHILD(it);
-
-        size_t leftLength = GET_NODE_LENGTH(left);
-        size_t rightLength = GET_NODE_LENGTH(right);
-
-        if (searchOffset < leftLength || rightLength == 0)
-        {
-            // go left
-            it = left;
-        }
-        else
-        {
-            // go right
-            searchOffset -= leftLength;
-            leafStartOffset += leftLength;
-            it = right;
-        }
+        tree_.ensureLineStarts(0, offsets[count - 1]);
     }
-    it = NODE_TO_LEAF_INDEX(it);
-
-    result.offset = offset;
-    result.leafIndex = it;
-    result.leafStartOffset = leafStartOffset;
-
-    return true;
+    return tree_.findPositions(offsets, count, lineNumbers, columns);
 }
 
-bool Buffer::_findLineStart(size_t &lineIndex, BufferCursor &result)
+bool BufferSnapshot::findOffsets(const size_t *lineNumbers, const size_t *columns, size_t count, size_t *offsets)
 {
-    if (lineIndex > nodes_[1].newLineCount)
+    if (count > 0)
     {
-        return false;
+        tree_.ensureLineStarts(lineNumbers[count - 1], 0);
     }
+    return tree_.findOffsets(lineNumbers, columns, count, offsets);
+}
 
-    size_t it = 1;
-    size_t leafStartOffset = 0;
-    while (!IS_LEAF(it))
-    {
-        size_t left = LEFT_CHILD(it);
-        size_t right = RIGHT_CHILD(it);
+void BufferSnapshot::findAll(const BufferString *needle, const SearchOptions &options, vector<size_t> &result, size_t threadsCount) const
+{
+    findAllInTree(tree_, needle, options, result, threadsCount);
+}
 
-        size_t leftNewLineCount = 0;
-        size_t leftLength = 0;
-        if (IS_NODE(left))
-        {
-            leftNewLineCount = nodes_[left].newLineCount;
-            leftLength = nodes_[left].length;
-        }
-        else if (IS_LEAF(left))
-        {
-            leftNewLineCount = leafs_[NODE_TO_LEAF_INDEX(left)]->newLineCount();
-            leftLength = leafs_[NODE_TO_LEAF_INDEX(left)]->length();
-        }
+bool BufferSnapshot::findNext(const BufferString *needle, const SearchOptions &options, const BufferCursor &from, bool backward, size_t &result) const
+{
+    return findNextInTree(tree_, needle, options, from, backward, result);
+}
 
-        if (lineIndex <= leftNewLineCount)
-        {
-            // go left
-            it = left;
-            continue;
-        }
+bool BufferSnapshot::findAllRegex(const BufferString *pattern, const SearchOptions &options, vector<size_t> &result, string &error, size_t threadsCount) const
+{
+    return findAllRegexInTree(tree_, pattern, options, result, error, threadsCount);
+}
 
-        // go right
-        lineIndex -= leftNewLineCount;
-        leafStartOffset += leftLength;
-        it = right;
-    }
-    it = NODE_TO_LEAF_INDEX(it);
+size_t Buffer::lineCount()
+{
+    tree_.completeLineStarts();
+    return tree_.newLineCount() + 1;
+}
 
-    const LINE_START_T innerLineStartOffset = (lineIndex == 0 ? 0 : leafs_[it]->lineStartFor(lineIndex - 1));
+bool Buffer::isLineCountPending()
+{
+    tree_.refreshLineStarts();
+    return tree_.hasPendingLineStarts();
+}
 
-    result.offset = leafStartOffset + innerLineStartOffset;
-    result.leafIndex = it;
-    result.leafStartOffset = leafStartOffset;
+bool Buffer::findLine(size_t lineNumber, BufferCursor &start, BufferCursor &end)
+{
+    tree_.ensureLineStarts(lineNumber, 0);
+    return tree_.findLine(lineNumber, start, end);
+}
 
-    return true;
+bool Buffer::findPosition(size_t offset, size_t &lineNumber, size_t &column)
+{
+    tree_.ensureLineStarts(0, offset);
+    return tree_.findPosition(offset, lineNumber, column);
 }
 
-void Buffer::_findLineEnd(size_t leafIndex, size_t leafStartOffset, size_t innerLineIndex, BufferCursor &result)
+bool Buffer::findPositions(const size_t *offsets, size_t count, size_t *lineNumbers, size_t *columns)
 {
-    const size_t leafsCount = leafs_.length();
-    while (true)
+    if (count > 0)
     {
-        BufferPiece *leaf = leafs_[leafIndex];
-
-        if (innerLineIndex < leaf->newLineCount())
-        {
-            LINE_START_T lineEndOffset = leafs_[leafIndex]->lineStartFor(innerLineIndex);
-
-            result.offset = leafStartOffset + lineEndOffset;
-            result.leafIndex = leafIndex;
-            result.leafStartOffset = leafStartOffset;
-            return;
-        }
-
-        leafIndex++;
-
-        if (leafIndex >= leafsCount)
-        {
-            result.offset = leafStartOffset + leaf->length();
-            result.leafIndex = leafIndex - 1;
-            result.leafStartOffset = leafStartOffset;
-            return;
-        }
+        tree_.ensureLineStarts(0, offsets[count - 1]);
+    }
+    return tree_.findPositions(offsets, count, lineNumbers, columns);
+}
 
-        leafStartOffset += leaf->length();
-        innerLineIndex = 0;
+bool Buffer::findOffsets(const size_t *lineNumbers, const size_t *columns, size_t count, size_t *offsets)
+{
+    if (count > 0)
+    {
+        tree_.ensureLineStarts(lineNumbers[count - 1], 0);
     }
+    return tree_.findOffsets(lineNumbers, columns, count, offsets);
 }
 
-bool Buffer::findLine(size_t lineNumber, BufferCursor &start, BufferCursor &end)
+void Buffer::setSearchIndex(bool enabled)
 {
-    size_t innerLineIndex = lineNumber - 1;
-    if (!_findLineStart(innerLineIndex, start))
+    if (enabled == (searchIndex_ != NULL))
     {
-        return false;
+        return;
+    }
+    if (enabled)
+    {
+        searchIndex_ = new TrigramIndex();
+        searchIndex_->addAll(tree_);
+    }
+    else
+    {
+        delete searchIndex_;
+        searchIndex_ = NULL;
     }
+}
 
-    _findLineEnd(start.leafIndex, start.leafStartOffset, innerLineIndex, end);
-    return true;
+BufferSnapshot *Buffer::snapshot()
+{
+    return new BufferSnapshot(tree_);
 }
 
-void Buffer::resolveEdits(vector<OffsetLenEdit2> &_edits, vector<InternalOffsetLenEdit2> &edits, vector<BufferString *> &toDelete)
+size_t Buffer::compressColdLeafs()
 {
-    // Check if we must merge adjacent edits
-    size_t mergedCnt = 1;
-    for (size_t i = 1; i < _edits.size(); i++)
+    size_t compressedCount = 0;
+    for (size_t i = 0, len = tree_.leafsCount(); i < len; i++)
     {
-        OffsetLenEdit2 &prevEdit = _edits[i - 1];
-        OffsetLenEdit2 &edit = _edits[i];
-        if (prevEdit.offset + prevEdit.length == edit.offset)
+        // the flag of every leaf is cleared, so a leaf read after this call is not compressed by the next one
+        BufferPiece *leaf = tree_.leafAt(i);
+        if (leaf->takeAccessed() || leaf->isShared())
         {
             continue;
         }
-        mergedCnt++;
-    }
 
-    vector<OffsetLenEdit2> *actual;
-
-    vector<OffsetLenEdit2> _merged;
-    if (mergedCnt != _edits.size())
-    {
-        _merged.resize(mergedCnt);
-        size_t dest = 0;
-
-        OffsetLenEdit2 prev = _edits[0];
-        for (size_t i = 1; i < _edits.size(); i++)
+        BufferPiece *compressed = CompressedBufferPiece::create(leaf, leafCache_);
+        if (compressed != NULL)
         {
-            OffsetLenEdit2 curr = _edits[i];
-
-            if (prev.offset + prev.length == curr.offset)
-            {
-                // merge into `prev`
-                prev.length = prev.length + curr.length;
-                BufferString *newText = BufferString::concat(prev.text, curr.text);
-                toDelete.push_back(newText);
-                prev.text = newText;
-            }
-            else
+            if (searchIndex_ != NULL)
             {
-                _merged[dest++] = prev;
-                prev = curr;
+                searchIndex_->move(leaf, compressed);
             }
+            tree_.replaceLeafs(i, 1, &compressed, 1);
+            compressedCount++;
         }
-        _merged[dest++] = prev;
-
-        actual = &_merged;
     }
-    else
+    return compressedCount;
+}
+
+void Buffer::pushSpan(const BufferString *source, size_t start, size_t length)
+{
+    if (length > 0)
     {
-        actual = &_edits;
+        TextSpan span;
+        span.source = source;
+        span.start = start;
+        span.length = length;
+        spans_.push_back(span);
     }
+}
+
+void Buffer::resolveEdits(const vector<OffsetLenEdit2> &_edits)
+{
+    edits_.clear();
+    spans_.clear();
 
-    edits.resize(actual->size());
     BufferCursor tmp;
-    for (size_t i = 0; i < actual->size(); i++)
+    for (size_t i = 0, len = _edits.size(); i < len;)
     {
-        OffsetLenEdit2 &_edit = (*actual)[i];
-        InternalOffsetLenEdit2 &edit = edits[i];
-
-        edit.text = _edit.text;
+        const size_t offset = _edits[i].offset;
+        InternalOffsetLenEdit2 edit;
+        edit.spansStart = spans_.size();
 
-        findOffset(_edit.offset, tmp);
+        findOffset(offset, tmp);
         edit.startLeafIndex = tmp.leafIndex;
         edit.startInnerOffset = tmp.offset - tmp.leafStartOffset;
 
         if (edit.startInnerOffset > 0)
         {
-            BufferPiece *startLeaf = leafs_[edit.startLeafIndex];
+            BufferPiece *startLeaf = tree_.leafAt(edit.startLeafIndex);
             uint16_t charBefore = startLeaf->charAt(edit.startInnerOffset - 1);
             if (charBefore == '\r')
             {
                 // include the replacement of \r in the edit
-                BufferString *newText = BufferString::concat(BufferString::carriageReturn(), edit.text);
-                toDelete.push_back(newText);
-                edit.text = newText;
+                pushSpan(BufferString::carriageReturn(), 0, 1);
 
-                findOffset(_edit.offset - 1, tmp);
+                findOffset(offset - 1, tmp);
                 edit.startLeafIndex = tmp.leafIndex;
                 edit.startInnerOffset = tmp.offset - tmp.leafStartOffset;
             }
         }
 
-        findOffset(_edit.offset + _edit.length, tmp);
+        // adjacent edits are merged, their texts follow each other in the span list
+        size_t length = 0;
+        do
+        {
+            const OffsetLenEdit2 &_edit = _edits[i];
+            pushSpan(_edit.text, 0, _edit.text->length());
+            length += _edit.length;
+            i++;
+        } while (i < len && _edits[i - 1].offset + _edits[i - 1].length == _edits[i].offset);
+
+        findOffset(offset + length, tmp);
         edit.endLeafIndex = tmp.leafIndex;
         edit.endInnerOffset = tmp.offset - tmp.leafStartOffset;
 
-        BufferPiece *endLeaf = leafs_[edit.endLeafIndex];
+        BufferPiece *endLeaf = tree_.leafAt(edit.endLeafIndex);
         if (edit.endInnerOffset < endLeaf->length())
         {
             uint16_t charAfter = endLeaf->charAt(edit.endInnerOffset);
             if (charAfter == '\n')
             {
                 // include the replacement of \n in the edit
-                BufferString *newText = BufferString::concat(edit.text, BufferString::lineFeed());
-                toDelete.push_back(newText);
-                edit.text = newText;
+                pushSpan(BufferString::lineFeed(), 0, 1);
 
-                findOffset(_edit.offset + _edit.length + 1, tmp);
+                findOffset(offset + length + 1, tmp);
                 edit.endLeafIndex = tmp.leafIndex;
                 edit.endInnerOffset = tmp.offset - tmp.leafStartOffset;
             }
         }
+
+        edit.spansCount = spans_.size() - edit.spansStart;
+        edits_.push_back(edit);
     }
 }
 
-LeafReplacement &pushLeafReplacement(size_t startLeafIndex, size_t endLeafIndex, vector<LeafReplacement> &replacements)
+LeafReplacement &Buffer::pushLeafReplacement(size_t startLeafIndex, size_t endLeafIndex)
 {
     LeafReplacement tmp;
-    replacements.push_back(tmp);
-
-    LeafReplacement &res = replacements[replacements.size() - 1];
-    res.startLeafIndex = startLeafIndex;
-    res.endLeafIndex = endLeafIndex;
-    res.replacements = new vector<BufferPiece *>();
-    return res;
+    tmp.startLeafIndex = startLeafIndex;
+    tmp.endLeafIndex = endLeafIndex;
+    tmp.leafsStart = replacementLeafs_.size();
+    tmp.leafsCount = 0;
+    replacements_.push_back(tmp);
+    return replacements_.back();
 }
 
-void Buffer::flushLeafEdits(size_t accumulatedLeafIndex, vector<LeafOffsetLenEdit2> &accumulatedLeafEdits, vector<LeafReplacement> &replacements)
+void Buffer::flushLeafEdits(size_t accumulatedLeafIndex)
 {
-    if (accumulatedLeafEdits.size() > 0)
+    if (leafEdits_.size() > 0)
     {
-        LeafReplacement &rep = pushLeafReplacement(accumulatedLeafIndex, accumulatedLeafIndex, replacements);
-        BufferPiece::replaceOffsetLen(leafs_[accumulatedLeafIndex], accumulatedLeafEdits, idealLeafLength_, maxLeafLength_, rep.replacements);
+        LeafReplacement &rep = pushLeafReplacement(accumulatedLeafIndex, accumulatedLeafIndex);
+        if (pieceTable_)
+        {
+            BufferPiece::replaceSpans(tree_.leafAt(accumulatedLeafIndex), leafEdits_, spans_, addBuffer_, idealLeafLength_, maxLeafLength_, replacementLeafs_);
+        }
+        else
+        {
+            BufferPiece::replaceOffsetLen(tree_.leafAt(accumulatedLeafIndex), leafEdits_, spans_, idealLeafLength_, maxLeafLength_, replacementLeafs_);
+        }
+        rep.leafsCount = replacementLeafs_.size() - rep.leafsStart;
     }
 
-    accumulatedLeafEdits.clear();
+    leafEdits_.clear();
 }
 
-void pushLeafEdits(size_t start, size_t length, const BufferString *text, vector<LeafOffsetLenEdit2> &accumulatedLeafEdits)
+void Buffer::pushLeafEdit(size_t start, size_t length, size_t spansStart, size_t spansCount)
 {
-    if (length != 0 || text->length() != 0)
+    if (length != 0 || spansCount != 0)
     {
         LeafOffsetLenEdit2 tmp;
         tmp.start = start;
         tmp.length = length;
-        tmp.text = text;
-        accumulatedLeafEdits.push_back(tmp);
+        tmp.spansStart = spansStart;
+        tmp.spansCount = spansCount;
+        leafEdits_.push_back(tmp);
     }
 }
 
-void Buffer::appendLeaf(BufferPiece *leaf, vector<BufferPiece *> &leafs, BufferPiece *&prevLeaf)
+void Buffer::appendTreeLeaf(size_t leafIndex, BufferPiece *&prevLeaf)
+{
+    // the leaf may be shared with snapshots and it is also released by the tree once it is replaced
+    BufferPiece *leaf = tree_.leafAt(leafIndex);
+    leaf->retain();
+    appendLeaf(leaf, prevLeaf);
+}
+
+void Buffer::appendLeaf(BufferPiece *leaf, BufferPiece *&prevLeaf)
 {
+    if (pieceTable_)
+    {
+        appendSpanLeaf(leaf, prevLeaf);
+        return;
+    }
+
     if (prevLeaf == NULL)
     {
-        leafs.push_back(leaf);
+        leafs_.push_back(leaf);
         prevLeaf = leaf;
         return;
     }
@@ -452,16 +452,21 @@ void Buffer::appendLeaf(BufferPiece *leaf, vector<BufferPiece *> &leafs, BufferP
     size_t prevLeafLength = prevLeaf->length();
     size_t currLeafLength = leaf->length();
 
-    if ((prevLeafLength < minLeafLength_ || currLeafLength < minLeafLength_) && prevLeafLength + currLeafLength <= maxLeafLength_)
+    // joining a one byte leaf with a two byte one widens it, that is only worth it for a short one byte leaf
+    const bool prevIsOneByte = prevLeaf->isOneByte();
+    const bool joinWidens = (prevIsOneByte != leaf->isOneByte());
+    const size_t widenedLength = (prevIsOneByte ? prevLeafLength : currLeafLength);
+
+    if ((prevLeafLength < minLeafLength_ || currLeafLength < minLeafLength_) && prevLeafLength + currLeafLength <= maxLeafLength_ && (!joinWidens || widenedLength <= WIDE_RUN_MAX_GAP))
     {
         BufferPiece *modifiedPrevLeaf = BufferPiece::join2(prevLeaf, leaf);
-        delete prevLeaf;
+        prevLeaf->release();
 
-        leafs[leafs.size() - 1] = modifiedPrevLeaf;
+        leafs_[leafs_.size() - 1] = modifiedPrevLeaf;
         prevLeaf = modifiedPrevLeaf;
 
         // this leaf must be deleted
-        delete leaf;
+        leaf->release();
         return;
     }
 
@@ -472,166 +477,397 @@ void Buffer::appendLeaf(BufferPiece *leaf, vector<BufferPiece *> &leafs, BufferP
         (lastChar >= 0xd800 && lastChar <= 0xdbff) || (lastChar == '\r' && firstChar == '\n'))
     {
         BufferPiece *modifiedPrevLeaf = BufferPiece::deleteLastChar2(prevLeaf);
-        delete prevLeaf;
+        prevLeaf->release();
 
-        leafs[leafs.size() - 1] = modifiedPrevLeaf;
+        leafs_[leafs_.size() - 1] = modifiedPrevLeaf;
         prevLeaf = modifiedPrevLeaf;
 
         BufferPiece *modifiedLeaf = BufferPiece::insertFirstChar2(leaf, lastChar);
-        delete leaf;
+        leaf->release();
         leaf = modifiedLeaf;
     }
 
-    leafs.push_back(leaf);
+    leafs_.push_back(leaf);
     prevLeaf = leaf;
 }
 
-void Buffer::replaceOffsetLen(vector<OffsetLenEdit2> &_edits)
+void Buffer::replacePrevLeaf(BufferPiece *leaf, BufferPiece *&prevLeaf)
 {
-    struct timespec start;
+    prevLeaf->release();
+    leafs_[leafs_.size() - 1] = leaf;
+    prevLeaf = leaf;
+}
+
+void Buffer::appendSpanLeaf(BufferPiece *leaf, BufferPiece *&prevLeaf)
+{
+    if (prevLeaf == NULL)
+    {
+        leafs_.push_back(leaf);
+        prevLeaf = leaf;
+        return;
+    }
+
+    const size_t prevLeafLength = prevLeaf->length();
+    const size_t currLeafLength = leaf->length();
+
+    if (currLeafLength == 0)
+    {
+        leaf->release();
+        return;
+    }
+    if (prevLeafLength == 0)
+    {
+        replacePrevLeaf(leaf, prevLeaf);
+        return;
+    }
+
+    if (prevLeafLength + currLeafLength <= maxLeafLength_)
+    {
+        const BufferPiece *block = prevLeaf->block();
+        if (leaf->block() == block && prevLeaf->blockStart() + prevLeafLength == leaf->blockStart())
+        {
+            // the leafs are next to each other in their block, e.g. after typing
+            replacePrevLeaf(SpanBufferPiece::create(block, prevLeaf->blockStart(), prevLeafLength + currLeafLength), prevLeaf);
+            leaf->release();
+            return;
+        }
+
+        if (prevLeafLength + currLeafLength <= PIECE_TABLE_MAX_JOIN_LENGTH)
+        {
+            const TextSpan spans[2] = {{prevLeaf, 0, prevLeafLength}, {leaf, 0, currLeafLength}};
+            replacePrevLeaf(addBuffer_.append(spans, 2), prevLeaf);
+            leaf->release();
+            return;
+        }
+    }
+
+    uint16_t lastChar = prevLeaf->charAt(prevLeafLength - 1);
+    uint16_t firstChar = leaf->charAt(0);
+
+    if (
+        (lastChar >= 0xd800 && lastChar <= 0xdbff && firstChar >= 0xdc00 && firstChar <= 0xdfff) || (lastChar == '\r' && firstChar == '\n'))
+    {
+        // the pair gets a leaf of its own, so the leafs around it are only sliced.
+        // Unlike `appendLeaf`, a lone high surrogate stays, moving it could move the next one over too.
+        const TextSpan spans[2] = {{prevLeaf, prevLeafLength - 1, 1}, {leaf, 0, 1}};
+        BufferPiece *middleLeaf = addBuffer_.append(spans, 2);
+        BufferPiece *nextLeaf = (currLeafLength > 1 ? BufferPiece::slice(leaf, 1, currLeafLength - 1) : NULL);
+        leaf->release();
+
+        if (prevLeafLength > 1)
+        {
+            replacePrevLeaf(BufferPiece::slice(prevLeaf, 0, prevLeafLength - 1), prevLeaf);
+        }
+        else
+        {
+            leafs_.pop_back();
+            prevLeaf->release();
+            prevLeaf = (leafs_.size() > 0 ? leafs_[leafs_.size() - 1] : NULL);
+        }
+
+        appendSpanLeaf(middleLeaf, prevLeaf);
+        if (nextLeaf != NULL)
+        {
+            appendSpanLeaf(nextLeaf, prevLeaf);
+        }
+        return;
+    }
+
+    leafs_.push_back(leaf);
+    prevLeaf = leaf;
+}
+
+EditBatch::~EditBatch()
+{
+    for (size_t i = 0, len = edits_.size(); i < len; i++)
+    {
+        delete edits_[i].text;
+    }
+}
+
+void EditBatch::push(size_t offset, size_t length, PieceSliceString *text)
+{
+    OffsetLenEdit2 edit;
+    edit.initialIndex = edits_.size();
+    edit.offset = offset;
+    edit.length = length;
+    edit.text = text;
+    edits_.push_back(edit);
+    memUsage_ += sizeof(OffsetLenEdit2) + text->memUsage();
+}
+
+PieceSliceString *Buffer::slice(size_t offset, size_t length)
+{
+    vector<PieceSlice> slices;
+    if (length > 0)
+    {
+        BufferCursor cursor;
+        findOffset(offset, cursor);
+
+        size_t innerOffset = offset - cursor.leafStartOffset;
+        size_t leafIndex = cursor.leafIndex;
+        while (length > 0)
+        {
+            const BufferPiece *leaf = tree_.leafAt(leafIndex);
+            const size_t cnt = min(length, leaf->length() - innerOffset);
+            if (cnt > 0)
+            {
+                PieceSlice slice;
+                slice.piece = leaf;
+                slice.start = innerOffset;
+                slice.length = cnt;
+                slices.push_back(slice);
+            }
+
+            length -= cnt;
+            innerOffset = 0;
+            leafIndex++;
+        }
+    }
+    return new PieceSliceString(slices);
+}
+
+void Buffer::replaceOffsetLen(vector<OffsetLenEdit2> &_edits, EditBatch *inverse)
+{
+    if (_edits.size() == 0)
+    {
+        // nothing to do
+        return;
+    }
 
-    const size_t initialLeafLength = leafs_.length();
-    vector<BufferString *> toDelete;
+    const BufferArenaStats allocationsBefore = arena_->stats();
+
+    if (inverse != NULL)
+    {
+        // capture the removed text before any leaf is replaced
+        size_t delta = 0;
+        for (size_t i = 0, len = _edits.size(); i < len; i++)
+        {
+            const OffsetLenEdit2 &edit = _edits[i];
+            const size_t textLength = edit.text->length();
+            inverse->push(edit.offset + delta, textLength, slice(edit.offset, edit.length));
+            delta = delta + textLength - edit.length;
+        }
+    }
+
+    struct timespec start;
 
     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
-    vector<InternalOffsetLenEdit2> edits;
-    resolveEdits(_edits, edits, toDelete);
+    resolveEdits(_edits);
     // print_diff("    resolving edits", start);
 
     size_t accumulatedLeafIndex = 0;
-    vector<LeafOffsetLenEdit2> accumulatedLeafEdits;
-    vector<LeafReplacement> replacements;
+    leafEdits_.clear();
+    replacements_.clear();
+    replacementLeafs_.clear();
 
     clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
-    for (size_t i = 0, len = edits.size(); i < len; i++)
+    for (size_t i = 0, len = edits_.size(); i < len; i++)
     {
-        InternalOffsetLenEdit2 &edit = edits[i];
+        const InternalOffsetLenEdit2 &edit = edits_[i];
 
-        // printf("---> replace @ [%lu,%lu] -> [%lu,%lu] with [%lu]\n", edit.startLeafIndex, edit.startInnerOffset, edit.endLeafIndex, edit.endInnerOffset, edit.text->length());
+        // printf("---> replace @ [%lu,%lu] -> [%lu,%lu] with [%lu]\n", edit.startLeafIndex, edit.startInnerOffset, edit.endLeafIndex, edit.endInnerOffset, edit.spansCount);
 
         size_t startLeafIndex = edit.startLeafIndex;
         size_t endLeafIndex = edit.endLeafIndex;
 
         if (startLeafIndex != accumulatedLeafIndex)
         {
-            flushLeafEdits(accumulatedLeafIndex, accumulatedLeafEdits, replacements);
+            flushLeafEdits(accumulatedLeafIndex);
             accumulatedLeafIndex = startLeafIndex;
         }
 
         size_t leafEditStart = edit.startInnerOffset;
-        size_t leafEditEnd = (startLeafIndex == endLeafIndex ? edit.endInnerOffset : leafs_[startLeafIndex]->length());
-        pushLeafEdits(leafEditStart, leafEditEnd - leafEditStart, edit.text, accumulatedLeafEdits);
+        size_t leafEditEnd = (startLeafIndex == endLeafIndex ? edit.endInnerOffset : tree_.leafAt(startLeafIndex)->length());
+        pushLeafEdit(leafEditStart, leafEditEnd - leafEditStart, edit.spansStart, edit.spansCount);
 
         if (startLeafIndex < endLeafIndex)
         {
-            flushLeafEdits(accumulatedLeafIndex, accumulatedLeafEdits, replacements);
+            flushLeafEdits(accumulatedLeafIndex);
             accumulatedLeafIndex = endLeafIndex;
 
             // delete leafs in the middle
             if (startLeafIndex + 1 < endLeafIndex)
             {
-                pushLeafReplacement(startLeafIndex + 1, endLeafIndex - 1, replacements);
+                pushLeafReplacement(startLeafIndex + 1, endLeafIndex - 1);
             }
 
             // delete on last line
             size_t leafEditStart = 0;
             size_t leafEditEnd = edit.endInnerOffset;
-            pushLeafEdits(leafEditStart, leafEditEnd - leafEditStart, BufferString::empty(), accumulatedLeafEdits);
+            pushLeafEdit(leafEditStart, leafEditEnd - leafEditStart, 0, 0);
         }
     }
-    flushLeafEdits(accumulatedLeafIndex, accumulatedLeafEdits, replacements);
+    flushLeafEdits(accumulatedLeafIndex);
+    // print_diff("    applying edits", start);
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
 
-    for (size_t i = 0, len = toDelete.size(); i < len; i++)
+    // Replacements are applied in clusters, from right to left, so the leaf indices of the clusters to the left stay valid.
+    // A cluster contains replacements that are less than two leafs apart, because each cluster also recreates
+    // the leaf to the left and to the right of it and those must not be shared between clusters.
+    size_t clusterEnd = replacements_.size();
+    while (clusterEnd > 0)
     {
-        delete toDelete[i];
+        size_t clusterStart = clusterEnd - 1;
+        while (clusterStart > 0 && replacements_[clusterStart - 1].endLeafIndex + 2 >= replacements_[clusterStart].startLeafIndex)
+        {
+            clusterStart--;
+        }
+
+        applyLeafReplacements(clusterStart, clusterEnd);
+        clusterEnd = clusterStart;
     }
-    // print_diff("    applying edits", start);
+    // print_diff("    recreating leafs", start);
 
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+    const BufferArenaStats allocationsAfter = arena_->stats();
+    lastEditAllocations_.allocations = allocationsAfter.allocations - allocationsBefore.allocations;
+    lastEditAllocations_.heapAllocations = allocationsAfter.heapAllocations - allocationsBefore.heapAllocations;
+}
+
+size_t Buffer::replaceAll(const BufferString *needle, const SearchOptions &options, const BufferString *replacement, EditBatch *inverse)
+{
+    vector<size_t> starts;
+    findAll(needle, options, starts);
+    const size_t needleLength = needle->length();
+    vector<size_t> ranges(2 * starts.size());
+    for (size_t i = 0, len = starts.size(); i < len; i++)
+    {
+        ranges[2 * i] = starts[i];
+        ranges[2 * i + 1] = starts[i] + needleLength;
+    }
+    replaceRanges(ranges, replacement, inverse);
+    return starts.size();
+}
+
+bool Buffer::replaceAllRegex(const BufferString *pattern, const SearchOptions &options, const BufferString *replacement, size_t &count, string &error, EditBatch *inverse)
+{
+    vector<size_t> ranges;
+    if (!findAllRegex(pattern, options, ranges, error))
+    {
+        return false;
+    }
+    replaceRanges(ranges, replacement, inverse);
+    count = ranges.size() / 2;
+    return true;
+}
+
+/**
+ * Replaces each `[ranges[i], ranges[i + 1])` (sorted start and end pairs, not overlapping) with `replacement`.
+ */
+void Buffer::replaceRanges(const vector<size_t> &ranges, const BufferString *replacement, EditBatch *inverse)
+{
+    if (ranges.empty())
+    {
+        return;
+    }
+
+    // copied once, so the edits don't each read the replacement from its source
+    const size_t length = replacement->length();
+    vector<uint8_t> oneByteChars;
+    vector<uint16_t> chars;
+    if (length > 0 && replacement->isOneByte())
+    {
+        oneByteChars.resize(length);
+        replacement->writeOneByte(oneByteChars.data(), 0, length);
+    }
+    else if (length > 0)
+    {
+        chars.resize(length);
+        replacement->write(chars.data(), 0, length);
+    }
+    OneByteArrayString oneByteText(oneByteChars.data(), length);
+    TwoByteArrayString twoByteText(chars.data(), length);
+    // an empty vector has no storage, its strings are not used
+    const BufferString *text = BufferString::empty();
+    if (length > 0)
+    {
+        text = (replacement->isOneByte() ? (const BufferString *)&oneByteText : (const BufferString *)&twoByteText);
+    }
+
+    vector<OffsetLenEdit2> edits(ranges.size() / 2);
+    for (size_t i = 0, len = edits.size(); i < len; i++)
+    {
+        edits[i].initialIndex = i;
+        edits[i].offset = ranges[2 * i];
+        edits[i].length = ranges[2 * i + 1] - ranges[2 * i];
+        edits[i].text = text;
+    }
+    replaceOffsetLen(edits, inverse);
+}
+
+void Buffer::applyLeafReplacements(size_t fromIndex, size_t toIndex)
+{
+    const size_t leafsCount = tree_.leafsCount();
+
+    // Only the leafs touched by replacements and their direct neighbours are recreated.
+    // Neighbours are included because they can be joined or must give up a trailing \r or high surrogate.
+    const size_t firstReplacedLeafIndex = replacements_[fromIndex].startLeafIndex;
+    const size_t lastReplacedLeafIndex = replacements_[toIndex - 1].endLeafIndex;
+    const size_t regionStartLeafIndex = (firstReplacedLeafIndex > 0 ? firstReplacedLeafIndex - 1 : 0);
+    const size_t regionEndLeafIndex = (lastReplacedLeafIndex + 1 < leafsCount ? lastReplacedLeafIndex + 1 : leafsCount - 1);
 
-    vector<BufferPiece *> leafs;
-    size_t leafIndex = 0;
+    leafs_.clear();
+    size_t leafIndex = regionStartLeafIndex;
     BufferPiece *prevLeaf = NULL;
 
-    // BufferPiece *leaf = leafs_[leafIndex];
-    for (size_t i = 0, len = replacements.size(); i < len; i++)
+    for (size_t i = fromIndex; i < toIndex; i++)
     {
-        size_t replaceStartLeafIndex = replacements[i].startLeafIndex;
-        size_t replaceEndLeafIndex = replacements[i].endLeafIndex;
-        vector<BufferPiece *> innerLeafs = *(replacements[i].replacements);
+        const LeafReplacement &replacement = replacements_[i];
+        size_t replaceStartLeafIndex = replacement.startLeafIndex;
+        size_t replaceEndLeafIndex = replacement.endLeafIndex;
 
         // add leafs to the left of this replace op.
         while (leafIndex < replaceStartLeafIndex)
         {
-            appendLeaf(leafs_[leafIndex], leafs, prevLeaf);
-            // leafs.push_back(leafs_[leafIndex]);
+            appendTreeLeaf(leafIndex, prevLeaf);
             leafIndex++;
         }
 
-        // delete leafs that get replaced.
-        while (leafIndex <= replaceEndLeafIndex)
-        {
-            delete leafs_[leafIndex];
-            leafIndex++;
-        }
+        // skip leafs that get replaced, the tree releases them.
+        leafIndex = replaceEndLeafIndex + 1;
 
         // add new leafs.
-        for (size_t j = 0, lenJ = innerLeafs.size(); j < lenJ; j++)
+        for (size_t j = replacement.leafsStart, lenJ = replacement.leafsStart + replacement.leafsCount; j < lenJ; j++)
         {
-            appendLeaf(innerLeafs[j], leafs, prevLeaf);
-            // leafs.push_back(innerLeafs[j]);
+            appendLeaf(replacementLeafs_[j], prevLeaf);
         }
-
-        delete replacements[i].replacements;
     }
 
-    // add remaining leafs to the right of the last replacement.
-    while (leafIndex < initialLeafLength)
+    // add remaining leafs to the right of the last replacement, up to the end of the region.
+    while (leafIndex <= regionEndLeafIndex)
     {
-        appendLeaf(leafs_[leafIndex], leafs, prevLeaf);
-        // leafs.push_back(leafs_[leafIndex]);
+        appendTreeLeaf(leafIndex, prevLeaf);
         leafIndex++;
     }
-    // print_diff("    recreating leafs", start);
 
-    if (leafs.size() == 0)
+    const size_t regionLeafLength = regionEndLeafIndex - regionStartLeafIndex + 1;
+    if (leafs_.size() == 0 && regionLeafLength == leafsCount)
     {
-        // don't leave behind an empty leafs array
-        uint8_t *tmp = new uint8_t[0];
-        BufferPiece *tmp2 = new OneByteBufferPiece(tmp, 0);
-        leafs.push_back(tmp2);
+        // don't leave behind an empty tree
+        uint8_t *tmp = arena_->allocArray<uint8_t>(0);
+        BufferPiece *tmp2 = OneByteBufferPiece::create(arena_, tmp, 0);
+        leafs_.push_back(tmp2);
     }
 
-    leafs_.assign(leafs);
-
-    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
-    _rebuildNodes();
-    // print_diff("    rebuilding nodes", start);
-}
-
-void Buffer::_updateNodes(size_t fromNodeIndex, size_t toNodeIndex)
-{
-    while (fromNodeIndex != 0)
+    if (searchIndex_ != NULL)
     {
-        for (size_t nodeIndex = fromNodeIndex; nodeIndex <= toNodeIndex; nodeIndex++)
-        {
-            _updateSingleNode(nodeIndex);
-        }
-        fromNodeIndex /= 2;
-        toNodeIndex /= 2;
+        searchIndex_->replace(tree_, regionStartLeafIndex, regionLeafLength, (leafs_.size() > 0 ? &leafs_[0] : NULL), leafs_.size());
     }
+    tree_.replaceLeafs(regionStartLeafIndex, regionLeafLength, (leafs_.size() > 0 ? &leafs_[0] : NULL), leafs_.size());
 }
 
 void Buffer::assertInvariants()
 {
-    const size_t leafsCount = leafs_.length();
-    assert(leafsStart_ == nodesCount_);
-    assert(leafsEnd_ == leafsStart_ + leafsCount);
+    tree_.assertInvariants();
+    tree_.completeLineStarts();
+
+    const size_t leafsCount = tree_.leafsCount();
 
     BufferPiece *prevLeafWithContent = NULL;
     for (size_t i = 0; i < leafsCount; i++)
     {
-        BufferPiece *leaf = leafs_[i];
+        BufferPiece *leaf = tree_.leafAt(i);
         if (leaf->length() > 0 && prevLeafWithContent != NULL)
         {
             uint16_t lastChar = prevLeafWithContent->charAt(prevLeafWithContent->length() - 1);
@@ -652,49 +888,13 @@ void Buffer::assertInvariants()
             }
         }
         leaf->assertInvariants();
+        assert(searchIndex_ == NULL || searchIndex_->contains(leaf));
         if (leaf->length() > 0)
         {
             prevLeafWithContent = leaf;
         }
     }
 
-    for (size_t i = 1; i < nodesCount_; i++)
-    {
-        assertNodeInvariants(i);
-    }
-}
-
-void Buffer::assertNodeInvariants(size_t nodeIndex)
-{
-    size_t left = LEFT_CHILD(nodeIndex);
-    size_t right = RIGHT_CHILD(nodeIndex);
-
-    size_t length = 0;
-    size_t newLineCount = 0;
-
-    if (IS_NODE(left))
-    {
-        length += nodes_[left].length;
-        newLineCount += nodes_[left].newLineCount;
-    }
-    else if (IS_LEAF(left))
-    {
-        length += leafs_[NODE_TO_LEAF_INDEX(left)]->length();
-        newLineCount += leafs_[NODE_TO_LEAF_INDEX(left)]->newLineCount();
-    }
-
-    if (IS_NODE(right))
-    {
-        length += nodes_[right].length;
-        newLineCount += nodes_[right].newLineCount;
-    }
-    else if (IS_LEAF(right))
-    {
-        length += leafs_[NODE_TO_LEAF_INDEX(right)]->length();
-        newLineCount += leafs_[NODE_TO_LEAF_INDEX(right)]->newLineCount();
-    }
-
-    assert(nodes_[nodeIndex].length == length);
-    assert(nodes_[nodeIndex].newLineCount == newLineCount);
+    tree_.assertInvariants();
 }
 }
@@ -7,30 +7,23 @@
 #define EDCORE_BUFFER_H_
 
 #include "buffer-piece.h"
+#include "buffer-regex.h"
+#include "buffer-search.h"
 #include "buffer-string.h"
+#include "buffer-tree.h"
+#include "parallel-search.h"
+#include "trigram-index.h"
 
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <vector>
 
-namespace edcore
-{
-
-size_t log2(size_t n);
-
-struct BufferNode
-{
-    size_t length;
-    size_t newLineCount;
-};
-typedef struct BufferNode BufferNode;
+// in piece-table mode, neighbouring leafs up to this length are joined by copying them to the add buffer
+#define PIECE_TABLE_MAX_JOIN_LENGTH 256
 
-struct BufferCursor
+namespace edcore
 {
-    size_t offset;
-    size_t leafIndex;
-    size_t leafStartOffset;
-};
-typedef struct BufferCursor BufferCursor;
 
 struct OffsetLenEdit2
 {
@@ -41,63 +34,244 @@ struct OffsetLenEdit2
 };
 typedef struct OffsetLenEdit2 OffsetLenEdit2;
 
+/**
+ * An edit resolved to leaf positions. Its text is `spansCount` spans starting at `spansStart`.
+ */
 struct InternalOffsetLenEdit2
 {
     size_t startLeafIndex;
     size_t startInnerOffset;
     size_t endLeafIndex;
     size_t endInnerOffset;
-    const BufferString *text;
+    size_t spansStart;
+    size_t spansCount;
 };
 typedef struct InternalOffsetLenEdit2 InternalOffsetLenEdit2;
 
+/**
+ * Replaces leafs `[startLeafIndex, endLeafIndex]` with `leafsCount` leafs starting at `leafsStart` in `Buffer::replacementLeafs_`.
+ */
 struct LeafReplacement
 {
     size_t startLeafIndex;
     size_t endLeafIndex;
-    vector<BufferPiece *> *replacements;
+    size_t leafsStart;
+    size_t leafsCount;
 };
 typedef struct LeafReplacement LeafReplacement;
 
+/**
+ * A sorted batch of edits that owns its texts.
+ * Used to hold the inverse of applied edits, where the texts are slices of the removed pieces.
+ */
+class EditBatch
+{
+  public:
+    EditBatch() : memUsage_(sizeof(EditBatch)) {}
+    ~EditBatch();
+
+    vector<OffsetLenEdit2> &edits() { return edits_; }
+    size_t memUsage() const { return memUsage_; }
+
+    void push(size_t offset, size_t length, PieceSliceString *text);
+
+  private:
+    vector<OffsetLenEdit2> edits_;
+    size_t memUsage_;
+};
+
+/**
+ * A read-only view of a buffer at a point in time.
+ *
+ * It shares the leafs with pending line starts too, its line queries count them in its own nodes like the ones
+ * of `Buffer` do. So a snapshot is read from one thread at a time.
+ */
+class BufferSnapshot
+{
+  public:
+    BufferSnapshot(const BufferTree &tree) : tree_(tree) {}
+
+    size_t length() const { return tree_.length(); }
+    /**
+     * Waits for the line starts of all leafs, like `Buffer::lineCount`.
+     */
+    size_t lineCount();
+    bool isLineCountPending();
+    size_t memUsage() const { return sizeof(BufferSnapshot) - sizeof(BufferTree) + tree_.memUsage(); }
+
+    bool findOffset(size_t offset, BufferCursor &result) const { return tree_.findOffset(offset, result); }
+    bool findLine(size_t lineNumber, BufferCursor &start, BufferCursor &end);
+    bool findPosition(size_t offset, size_t &lineNumber, size_t &column);
+    bool findPositions(const size_t *offsets, size_t count, size_t *lineNumbers, size_t *columns);
+    bool findOffsets(const size_t *lineNumbers, const size_t *columns, size_t count, size_t *offsets);
+    /**
+     * For a `BufferLineIterator` of `tree()`: makes its line queries exact up to line `lineNumber`. Returns true
+     * if the tree was refreshed, the iterator must then `refresh`.
+     */
+    bool ensureLineStarts(size_t lineNumber) { return tree_.ensureLineStarts(lineNumber, 0); }
+    void extractString(BufferCursor start, size_t len, uint16_t *dest) const { tree_.extractString(start, len, dest); }
+    void findAll(const BufferString *needle, const SearchOptions &options, vector<size_t> &result, size_t threadsCount = 1) const;
+    bool findNext(const BufferString *needle, const SearchOptions &options, const BufferCursor &from, bool backward, size_t &result) const;
+    bool findAllRegex(const BufferString *pattern, const SearchOptions &options, vector<size_t> &result, string &error, size_t threadsCount = 1) const;
+
+    const BufferTree &tree() const { return tree_; }
+
+  private:
+    BufferTree tree_;
+};
+
 class Buffer
 {
   public:
-    Buffer(vector<BufferPiece *> &pieces, size_t minLeafLength, size_t maxLeafLength);
+    /**
+     * `pieces` must be allocated from `arena`, cached pieces must use `leafCache`. Pending line starts are
+     * scanned on a background thread if `scanLineStartsInBackground`, see `isLineCountPending`.
+     */
+    Buffer(BufferArena *arena, LeafCache *leafCache, vector<BufferPiece *> &pieces, size_t minLeafLength, size_t maxLeafLength, bool scanLineStartsInBackground = true);
     ~Buffer();
-    size_t length() const { return nodes_[1].length; }
-    size_t lineCount() const { return nodes_[1].newLineCount + 1; }
+    size_t length() const { return tree_.length(); }
+    /**
+     * Waits for the line starts of all leafs, see `isLineCountPending`.
+     */
+    size_t lineCount();
     size_t memUsage() const;
 
+    /**
+     * Pieces can be built with pending line starts (`BufferBuilder::fromFile`), a background thread scans them.
+     * Until it is done, offset queries and edits work as usual and line queries only scan the leafs up to
+     * the line or offset they ask for. Returns true while the line count is not known without waiting.
+     */
+    bool isLineCountPending();
+
     bool findOffset(size_t offset, BufferCursor &result);
     bool findLine(size_t lineNumber, BufferCursor &start, BufferCursor &end);
+    bool findPosition(size_t offset, size_t &lineNumber, size_t &column);
+    bool findPositions(const size_t *offsets, size_t count, size_t *lineNumbers, size_t *columns);
+    bool findOffsets(const size_t *lineNumbers, const size_t *columns, size_t count, size_t *offsets);
     void extractString(BufferCursor start, size_t len, uint16_t *dest);
 
-    void replaceOffsetLen(vector<OffsetLenEdit2> &edits);
+    /**
+     * The offsets of the matches of `needle`, left to right and not overlapping, see `LiteralSearch`.
+     * With `threadsCount` > 1 ranges of leafs are searched on that many threads, see `findAllParallel`.
+     * With the search index, only the leafs that can hold a match are searched, on `threadsCount` threads too.
+     */
+    void findAll(const BufferString *needle, const SearchOptions &options, vector<size_t> &result, size_t threadsCount = 1);
+    /**
+     * The first match that starts at or after `from`, or with `backward` the last match that ends at or before it.
+     * Only the leafs up to the match are searched.
+     */
+    bool findNext(const BufferString *needle, const SearchOptions &options, const BufferCursor &from, bool backward, size_t &result);
+    /**
+     * The start and end offsets of the matches of the regular expression `pattern`, see `RegexSearch`.
+     * Returns false and sets `error` if the pattern is not valid. `threadsCount` is as for `findAll`.
+     */
+    bool findAllRegex(const BufferString *pattern, const SearchOptions &options, vector<size_t> &result, string &error, size_t threadsCount = 1);
+
+    /**
+     * For iterators. Modifying the buffer invalidates them, use a snapshot to iterate while editing.
+     */
+    const BufferTree &tree() const { return tree_; }
+
+    /**
+     * `edits` must be sorted and not overlapping.
+     * If `inverse` is given, it receives the edits that undo this call.
+     */
+    void replaceOffsetLen(vector<OffsetLenEdit2> &edits, EditBatch *inverse = NULL);
+    /**
+     * Replaces the matches of `needle`, as `findAll` finds them, with `replacement` in one `replaceOffsetLen`: the
+     * replacement is copied once and shared by the edits, and each leaf is rewritten once however many matches
+     * it holds. Returns the number of replacements, `inverse` is as for `replaceOffsetLen`.
+     */
+    size_t replaceAll(const BufferString *needle, const SearchOptions &options, const BufferString *replacement, EditBatch *inverse = NULL);
+    /**
+     * Like `replaceAll`, for the matches of `findAllRegex`. The replacement is literal. Returns false and sets
+     * `error` if the pattern is not valid.
+     */
+    bool replaceAllRegex(const BufferString *pattern, const SearchOptions &options, const BufferString *replacement, size_t &count, string &error, EditBatch *inverse = NULL);
+
+    /**
+     * In piece-table mode edits don't copy the surviving text of a leaf. Leafs become spans over the pieces
+     * the buffer was built from and over an append-only add buffer that receives the inserted text.
+     * The mode can be changed at any time, it only affects later edits.
+     */
+    void setPieceTableMode(bool enabled) { pieceTable_ = enabled; }
+    bool pieceTableMode() const { return pieceTable_; }
+
+    /**
+     * Keeps a `TrigramIndex` of the leafs for `findAll`, off by default. Enabling it reads all leafs once,
+     * after that an edit indexes only the leafs it creates. Its memory is part of `memUsage`. Snapshots
+     * don't use it.
+     */
+    void setSearchIndex(bool enabled);
+    bool searchIndex() const { return (searchIndex_ != NULL); }
+
+    /**
+     * The arena allocations made by the last `replaceOffsetLen`.
+     */
+    const BufferArenaStats &lastEditAllocations() const { return lastEditAllocations_; }
+
+    /**
+     * For buffers that are rarely touched after they are loaded: compresses the leafs whose chars were not read
+     * or edited since the last call, so calling this on a timer compresses the leafs that went cold in between.
+     * Length and line queries never decompress. Reading a compressed leaf decompresses it into the leaf cache,
+     * editing it replaces it with uncompressed leafs. Leafs shared with snapshots or the undo history are
+     * skipped, compressing them would not free their chars. Returns the number of leafs compressed.
+     */
+    size_t compressColdLeafs();
+    /**
+     * The memory for decompressed and paged in leafs, `LEAF_CACHE_DEFAULT_BUDGET` by default. Snapshots share
+     * the cache. For a buffer of `BufferBuilder::fromFilePaged`, this is the cap on the memory for its text.
+     */
+    void setLeafCacheBudget(size_t budget) { leafCache_->setBudget(budget); }
+    LeafCacheStats leafCacheStats() const { return leafCache_->stats(); }
+
+    /**
+     * O(1). The snapshot shares all leafs with this buffer, later edits copy only the nodes and leafs they touch.
+     * The snapshot can be read from another thread while this buffer is edited.
+     * Pending line starts stay pending, the snapshot's line queries scan the leafs they need like this buffer's.
+     */
+    BufferSnapshot *snapshot();
 
     void assertInvariants();
-    void assertNodeInvariants(size_t nodeIndex);
 
   private:
-    BufferNode *nodes_;
-    size_t nodesCount_;
-
-    MyArray<BufferPiece *> leafs_;
-    size_t leafsStart_;
-    size_t leafsEnd_;
+    BufferArena *arena_;
+    BufferTree tree_;
+    BufferArenaStats lastEditAllocations_;
+    bool pieceTable_;
+    AddBuffer addBuffer_;
+    LeafCache *leafCache_;
+    // NULL while the search index is off
+    TrigramIndex *searchIndex_;
 
     size_t minLeafLength_;
     size_t maxLeafLength_;
     size_t idealLeafLength_;
 
-    bool _findLineStart(size_t &lineIndex, BufferCursor &result);
-    void _findLineEnd(size_t leafIndex, size_t leafStartOffset, size_t innerLineIndex, BufferCursor &result);
-    void _updateNodes(size_t fromNodeIndex, size_t toNodeIndex);
-    void _updateSingleNode(size_t nodeIndex);
-    void _rebuildNodes();
+    // scans the pieces built with pending line starts, in order
+    thread lineStartsScanner_;
+    atomic<bool> stopLineStartsScanner_;
+
+    // scratch space of `replaceOffsetLen`, kept between calls so small edits don't allocate
+    vector<InternalOffsetLenEdit2> edits_;
+    vector<TextSpan> spans_;
+    vector<LeafOffsetLenEdit2> leafEdits_;
+    vector<LeafReplacement> replacements_;
+    vector<BufferPiece *> replacementLeafs_;
+    vector<BufferPiece *> leafs_;
 
-    void resolveEdits(vector<OffsetLenEdit2> &_edits, vector<InternalOffsetLenEdit2> &edits, vector<BufferString *> &toDelete);
-    void flushLeafEdits(size_t accumulatedLeafIndex, vector<LeafOffsetLenEdit2> &accumulatedLeafEdits, vector<LeafReplacement> &replacements);
-    void appendLeaf(BufferPiece *leaf, vector<BufferPiece *> &leafs, BufferPiece *&prevLeaf);
+    PieceSliceString *slice(size_t offset, size_t length);
+    void replaceRanges(const vector<size_t> &ranges, const BufferString *replacement, EditBatch *inverse);
+    void resolveEdits(const vector<OffsetLenEdit2> &_edits);
+    void pushSpan(const BufferString *source, size_t start, size_t length);
+    void pushLeafEdit(size_t start, size_t length, size_t spansStart, size_t spansCount);
+    void flushLeafEdits(size_t accumulatedLeafIndex);
+    LeafReplacement &pushLeafReplacement(size_t startLeafIndex, size_t endLeafIndex);
+    void applyLeafReplacements(size_t fromIndex, size_t toIndex);
+    void appendTreeLeaf(size_t leafIndex, BufferPiece *&prevLeaf);
+    void appendLeaf(BufferPiece *leaf, BufferPiece *&prevLeaf);
+    void appendSpanLeaf(BufferPiece *leaf, BufferPiece *&prevLeaf);
+    void replacePrevLeaf(BufferPiece *leaf, BufferPiece *&prevLeaf);
 };
 }
 
@@ -0,0 +1,93 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "leaf-cache.h"
+#include "buffer-piece.h"
+
+namespace edcore
+{
+
+LeafCache::LeafCache(size_t budget) : refCount_(1)
+{
+    stats_.hits = 0;
+    stats_.misses = 0;
+    stats_.memUsage = 0;
+    stats_.budget = budget;
+}
+
+LeafCache::~LeafCache()
+{
+    // the pieces hold the cache, so it is empty by now
+    for (list<Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it)
+    {
+        delete[] it->chars;
+    }
+}
+
+const uint8_t *LeafCache::lock(const CachedBufferPiece *piece)
+{
+    mutex_.lock();
+
+    unordered_map<const CachedBufferPiece *, list<Entry>::iterator>::iterator found = index_.find(piece);
+    if (found != index_.end())
+    {
+        stats_.hits++;
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return found->second->chars;
+    }
+
+    stats_.misses++;
+    Entry entry;
+    entry.piece = piece;
+    entry.size = piece->loadedSize();
+    entry.chars = new uint8_t[entry.size];
+    piece->load(entry.chars);
+
+    evict(entry.size);
+    entries_.push_front(entry);
+    index_[piece] = entries_.begin();
+    stats_.memUsage += entry.size;
+    return entry.chars;
+}
+
+void LeafCache::evict(size_t size)
+{
+    while (!entries_.empty() && stats_.memUsage + size > stats_.budget)
+    {
+        Entry &last = entries_.back();
+        stats_.memUsage -= last.size;
+        index_.erase(last.piece);
+        delete[] last.chars;
+        entries_.pop_back();
+    }
+}
+
+void LeafCache::remove(const CachedBufferPiece *piece)
+{
+    lock_guard<mutex> guard(mutex_);
+
+    unordered_map<const CachedBufferPiece *, list<Entry>::iterator>::iterator found = index_.find(piece);
+    if (found != index_.end())
+    {
+        stats_.memUsage -= found->second->size;
+        delete[] found->second->chars;
+        entries_.erase(found->second);
+        index_.erase(found);
+    }
+}
+
+void LeafCache::setBudget(size_t budget)
+{
+    lock_guard<mutex> guard(mutex_);
+    stats_.budget = budget;
+    evict(0);
+}
+
+LeafCacheStats LeafCache::stats()
+{
+    lock_guard<mutex> guard(mutex_);
+    return stats_;
+}
+}
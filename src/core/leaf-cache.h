@@ -0,0 +1,96 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_LEAF_CACHE_H_
+#define EDCORE_LEAF_CACHE_H_
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+#define LEAF_CACHE_DEFAULT_BUDGET (16 * 1024 * 1024)
+
+namespace edcore
+{
+
+class CachedBufferPiece;
+
+struct LeafCacheStats
+{
+    // reads of cached leafs that found their chars in the cache
+    size_t hits;
+    // reads that had to load the chars, by decompressing them or paging them in
+    size_t misses;
+    // the loaded chars in the cache
+    size_t memUsage;
+    size_t budget;
+};
+typedef struct LeafCacheStats LeafCacheStats;
+
+/**
+ * The loaded chars of compressed and paged leafs, the least recently used are dropped once they take more than
+ * the budget. A leaf that is larger than the whole budget still gets loaded, as the only entry.
+ *
+ * The cache is shared by the leafs of a buffer and its snapshots, each leaf holds a reference to it.
+ * Snapshots can be read from other threads, so the cache is guarded by a mutex.
+ */
+class LeafCache
+{
+  public:
+    LeafCache(size_t budget);
+
+    void retain() { refCount_++; }
+    void release()
+    {
+        if (--refCount_ == 0)
+        {
+            delete this;
+        }
+    }
+
+    /**
+     * Returns the loaded chars of `piece`, see `CachedBufferPiece::load`. The cache stays locked until `unlock`, so they are not
+     * dropped while they are read.
+     */
+    const uint8_t *lock(const CachedBufferPiece *piece);
+    void unlock() { mutex_.unlock(); }
+
+    /**
+     * Drops the chars of a piece that is destroyed.
+     */
+    void remove(const CachedBufferPiece *piece);
+
+    void setBudget(size_t budget);
+    LeafCacheStats stats();
+
+  private:
+    struct Entry
+    {
+        const CachedBufferPiece *piece;
+        uint8_t *chars;
+        size_t size;
+    };
+
+    atomic<size_t> refCount_;
+    mutex mutex_;
+    // most recently used first
+    list<Entry> entries_;
+    unordered_map<const CachedBufferPiece *, list<Entry>::iterator> index_;
+    LeafCacheStats stats_;
+
+    ~LeafCache();
+    LeafCache(const LeafCache &other);
+    LeafCache &operator=(const LeafCache &other);
+
+    void evict(size_t size);
+};
+}
+
+#endif
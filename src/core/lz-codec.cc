@@ -0,0 +1,193 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "lz-codec.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+
+// matches are at least 4 bytes, the 4 bytes at each position are hashed into a table of 2^12 entries
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+// without a match for this many positions, the search skips ahead faster over incompressible bytes
+#define LZ_SKIP_TRIGGER 6
+
+namespace edcore
+{
+
+size_t lzCompressBound(size_t length)
+{
+    return length + length / 255 + 16;
+}
+
+static inline uint32_t read32(const uint8_t *src)
+{
+    uint32_t result;
+    memcpy(&result, src, sizeof(result));
+    return result;
+}
+
+static inline uint32_t hash32(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/**
+ * The lengths that don't fit in the 4 bits of the token continue in bytes of up to 255.
+ */
+static inline uint8_t *writeLength(uint8_t *dst, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        *dst++ = 255;
+    }
+    *dst++ = (uint8_t)length;
+    return dst;
+}
+
+static inline const uint8_t *readLength(const uint8_t *src, size_t &length)
+{
+    uint8_t byte;
+    do
+    {
+        byte = *src++;
+        length += byte;
+    } while (byte == 255);
+    return src;
+}
+
+static uint8_t *writeSequence(uint8_t *dst, const uint8_t *literals, size_t literalsLength, size_t offset, size_t matchLength)
+{
+    uint8_t *token = dst++;
+    *token = (uint8_t)(min(literalsLength, (size_t)15) << 4);
+    if (literalsLength >= 15)
+    {
+        dst = writeLength(dst, literalsLength - 15);
+    }
+    memcpy(dst, literals, literalsLength);
+    dst += literalsLength;
+
+    if (matchLength == 0)
+    {
+        // the last sequence has only literals
+        return dst;
+    }
+
+    *dst++ = (uint8_t)offset;
+    *dst++ = (uint8_t)(offset >> 8);
+    const size_t matchExtra = matchLength - LZ_MIN_MATCH;
+    *token |= (uint8_t)min(matchExtra, (size_t)15);
+    if (matchExtra >= 15)
+    {
+        dst = writeLength(dst, matchExtra - 15);
+    }
+    return dst;
+}
+
+size_t lzCompress(const uint8_t *src, size_t length, uint8_t *dst)
+{
+    // positions of the last 4 byte sequence with each hash, a stale or colliding entry is caught by comparing bytes
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint8_t *out = dst;
+    size_t anchor = 0;
+    size_t i = 1;
+    while (i + LZ_MIN_MATCH <= length)
+    {
+        const uint32_t sequence = read32(src + i);
+        const uint32_t hash = hash32(sequence);
+        const size_t candidate = table[hash];
+        table[hash] = (uint32_t)i;
+
+        if (i - candidate > LZ_MAX_OFFSET || read32(src + candidate) != sequence)
+        {
+            i += 1 + ((i - anchor) >> LZ_SKIP_TRIGGER);
+            continue;
+        }
+
+        size_t matchStart = i;
+        size_t matchCandidate = candidate;
+        while (matchStart > anchor && matchCandidate > 0 && src[matchStart - 1] == src[matchCandidate - 1])
+        {
+            // the match may start before the hashed position
+            matchStart--;
+            matchCandidate--;
+        }
+        size_t matchEnd = i + LZ_MIN_MATCH;
+        while (matchEnd < length && src[matchEnd] == src[candidate + (matchEnd - i)])
+        {
+            matchEnd++;
+        }
+
+        out = writeSequence(out, src + anchor, matchStart - anchor, matchStart - matchCandidate, matchEnd - matchStart);
+        anchor = matchEnd;
+        i = matchEnd;
+    }
+    return writeSequence(out, src + anchor, length - anchor, 0, 0) - dst;
+}
+
+void lzDecompress(const uint8_t *src, size_t compressedLength, uint8_t *dst, size_t length)
+{
+    const uint8_t *srcEnd = src + compressedLength;
+    uint8_t *out = dst;
+    uint8_t *outEnd = dst + length;
+    while (true)
+    {
+        const uint8_t token = *src++;
+        size_t literalsLength = token >> 4;
+        if (literalsLength == 15)
+        {
+            src = readLength(src, literalsLength);
+        }
+        if (literalsLength <= 16 && src + 16 <= srcEnd && out + 16 <= outEnd)
+        {
+            // short literals are copied with a fixed size, away from the ends there is room for the bytes after them
+            memcpy(out, src, 16);
+        }
+        else
+        {
+            memcpy(out, src, literalsLength);
+        }
+        out += literalsLength;
+        src += literalsLength;
+        if (src >= srcEnd)
+        {
+            break;
+        }
+
+        const size_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15)
+        {
+            src = readLength(src, matchLength);
+        }
+        matchLength += LZ_MIN_MATCH;
+
+        const uint8_t *match = out - offset;
+        if (offset >= 8 && out + matchLength + 8 <= outEnd)
+        {
+            // 8 bytes at a time, each of them is written before it is read again
+            for (size_t k = 0; k < matchLength; k += 8)
+            {
+                memcpy(out + k, match + k, 8);
+            }
+        }
+        else
+        {
+            // the match overlaps the bytes it produces, e.g. a run of spaces
+            for (size_t k = 0; k < matchLength; k++)
+            {
+                out[k] = match[k];
+            }
+        }
+        out += matchLength;
+    }
+    assert(out == outEnd);
+}
+}
@@ -0,0 +1,35 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_LZ_CODEC_H_
+#define EDCORE_LZ_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+namespace edcore
+{
+
+/**
+ * The most bytes `lzCompress` can write for `length` bytes of input.
+ */
+size_t lzCompressBound(size_t length);
+
+/**
+ * Compress `length` bytes of `src` into `dst`, which must have room for `lzCompressBound(length)` bytes.
+ * Returns the compressed length. Like in the LZ4 block format, each sequence is a token with the lengths of
+ * its literals and of its match, the literals, then the 16-bit offset of the match. It favours speed over ratio.
+ */
+size_t lzCompress(const uint8_t *src, size_t length, uint8_t *dst);
+
+/**
+ * Decompress `compressedLength` bytes written by `lzCompress` into `dst`, which receives exactly `length` bytes.
+ */
+void lzDecompress(const uint8_t *src, size_t compressedLength, uint8_t *dst, size_t length);
+}
+
+#endif
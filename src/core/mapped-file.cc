@@ -0,0 +1,212 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "mapped-file.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace edcore
+{
+
+MappedFile::MappedFile(const uint8_t *data, size_t length, intptr_t file) : refCount_(1)
+{
+    data_ = data;
+    length_ = length;
+    file_ = file;
+}
+
+#ifdef _WIN32
+
+MappedFile *MappedFile::open(const char *path, bool paged)
+{
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return NULL;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+    if (size.QuadPart == 0)
+    {
+        // empty files cannot be mapped
+        CloseHandle(file);
+        return new MappedFile(NULL, 0, -1);
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!paged)
+    {
+        CloseHandle(file);
+    }
+    if (mapping == NULL)
+    {
+        if (paged)
+        {
+            CloseHandle(file);
+        }
+        return NULL;
+    }
+
+    // the view keeps the mapping alive
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL)
+    {
+        if (paged)
+        {
+            CloseHandle(file);
+        }
+        return NULL;
+    }
+    return new MappedFile(static_cast<const uint8_t *>(data), (size_t)size.QuadPart, (paged ? (intptr_t)file : -1));
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != NULL)
+    {
+        UnmapViewOfFile(data_);
+    }
+    if (file_ != -1)
+    {
+        CloseHandle((HANDLE)file_);
+    }
+}
+
+void MappedFile::read(size_t start, size_t length, uint8_t *dest) const
+{
+    while (length > 0)
+    {
+        // the offset is passed with each read, so reads from several threads don't interfere
+        OVERLAPPED overlapped;
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)start;
+        overlapped.OffsetHigh = (DWORD)((uint64_t)start >> 32);
+        DWORD readLength = 0;
+        if (file_ == -1 || !ReadFile((HANDLE)file_, dest, (DWORD)min(length, (size_t)(1 << 30)), &readLength, &overlapped) || readLength == 0)
+        {
+            // the mapping has the same bytes
+            memcpy(dest, data_ + start, length);
+            return;
+        }
+        start += readLength;
+        length -= readLength;
+        dest += readLength;
+    }
+}
+
+void MappedFile::dropPages(size_t start, size_t length) const
+{
+    if (length == 0)
+    {
+        return;
+    }
+    // unlocking pages that are not locked removes them from the working set
+    VirtualUnlock(const_cast<uint8_t *>(data_) + start, length);
+}
+
+#else
+
+MappedFile *MappedFile::open(const char *path, bool paged)
+{
+    int fd = ::open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size == 0)
+    {
+        // empty files cannot be mapped
+        close(fd);
+        return new MappedFile(NULL, 0, -1);
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (!paged)
+    {
+        // the whole file is scanned right away, faulting it in with one call is cheaper than page by page
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void *data = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+    // the mapping stays valid after the file is closed
+    if (!paged || data == MAP_FAILED)
+    {
+        close(fd);
+    }
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+    return new MappedFile(static_cast<const uint8_t *>(data), st.st_size, (paged ? fd : -1));
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != NULL)
+    {
+        munmap(const_cast<uint8_t *>(data_), length_);
+    }
+    if (file_ != -1)
+    {
+        close((int)file_);
+    }
+}
+
+void MappedFile::read(size_t start, size_t length, uint8_t *dest) const
+{
+    while (length > 0)
+    {
+        const ssize_t readLength = (file_ != -1 ? pread((int)file_, dest, length, start) : -1);
+        if (readLength <= 0)
+        {
+            // the mapping has the same bytes
+            memcpy(dest, data_ + start, length);
+            return;
+        }
+        start += readLength;
+        length -= readLength;
+        dest += readLength;
+    }
+}
+
+void MappedFile::dropPages(size_t start, size_t length) const
+{
+    if (length == 0)
+    {
+        return;
+    }
+    const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+    const size_t pagesStart = start / pageSize * pageSize;
+    const size_t pagesEnd = min((start + length + pageSize - 1) / pageSize * pageSize, length_);
+    // the mapping is private and never written, so the pages are only dropped, not lost
+    madvise(const_cast<uint8_t *>(data_) + pagesStart, pagesEnd - pagesStart, MADV_DONTNEED);
+}
+
+#endif
+}
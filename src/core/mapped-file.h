@@ -0,0 +1,70 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_MAPPED_FILE_H_
+#define EDCORE_MAPPED_FILE_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+namespace edcore
+{
+
+/**
+ * A read-only memory mapping of a whole file.
+ * Pieces that point into the mapping hold a reference to it, the file is unmapped with the last reference.
+ * Like for any mapping, the file must not be truncated or written to by others while it is mapped.
+ */
+class MappedFile
+{
+  public:
+    /**
+     * Returns NULL if the file cannot be opened or mapped.
+     * The whole file is faulted in right away, it is read from start to end. With `paged` it is not, and the
+     * file stays open for `read`.
+     */
+    static MappedFile *open(const char *path, bool paged = false);
+
+    void retain() { refCount_++; }
+    void release()
+    {
+        if (--refCount_ == 0)
+        {
+            delete this;
+        }
+    }
+
+    const uint8_t *data() const { return data_; }
+    size_t length() const { return length_; }
+
+    /**
+     * Copies `[start, start + length)` of a paged file to `dest` without mapping its pages, so they don't
+     * add to the memory of the process. Can be called from any thread.
+     */
+    void read(size_t start, size_t length, uint8_t *dest) const;
+    /**
+     * Gives the pages of `[start, start + length)` back to the system, they are read from the file again when
+     * they are used. Pages that are shared with the ranges around it are dropped too.
+     */
+    void dropPages(size_t start, size_t length) const;
+
+  private:
+    atomic<size_t> refCount_;
+    const uint8_t *data_;
+    size_t length_;
+    // the open file of a paged file, -1 otherwise
+    intptr_t file_;
+
+    MappedFile(const uint8_t *data, size_t length, intptr_t file);
+    ~MappedFile();
+    MappedFile(const MappedFile &other);
+    MappedFile &operator=(const MappedFile &other);
+};
+}
+
+#endif
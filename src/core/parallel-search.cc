@@ -0,0 +1,234 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "parallel-search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace edcore
+{
+
+/**
+ * A range of offsets and the start and end pairs of the matches that start in it.
+ */
+struct SearchRange
+{
+    size_t start;
+    size_t end;
+    vector<size_t> matches;
+};
+typedef struct SearchRange SearchRange;
+
+/**
+ * `LiteralSearch` with the interface of `RegexSearch`: start and end pairs of the matches that start in a range.
+ */
+class LiteralRangeSearch
+{
+  public:
+    LiteralRangeSearch(const BufferString *needle, const SearchOptions &options) : search_(needle, options) {}
+
+    void findAll(const BufferTree &tree, size_t start, size_t end, vector<size_t> &result)
+    {
+        const size_t needleLength = search_.needleLength();
+        if (needleLength == 0)
+        {
+            return;
+        }
+        starts_.clear();
+        search_.findAll(tree, start, end + needleLength - 1, starts_);
+        for (size_t i = 0; i < starts_.size() && starts_[i] < end; i++)
+        {
+            result.push_back(starts_[i]);
+            result.push_back(starts_[i] + needleLength);
+        }
+    }
+
+    bool findNext(const BufferTree &tree, size_t from, size_t &matchStart, size_t &matchEnd)
+    {
+        BufferCursor cursor;
+        if (!tree.findOffset(from, cursor) || !search_.findNext(tree, cursor, matchStart))
+        {
+            return false;
+        }
+        matchEnd = matchStart + search_.needleLength();
+        return true;
+    }
+
+  private:
+    LiteralSearch search_;
+    vector<size_t> starts_;
+};
+
+/**
+ * Where the search goes on after a match, an empty match is not found again.
+ */
+static inline size_t searchFromAfter(size_t matchStart, size_t matchEnd)
+{
+    return (matchEnd > matchStart ? matchEnd : matchEnd + 1);
+}
+
+template <typename Search>
+static void searchRanges(Search search, const BufferTree *tree, vector<SearchRange> *ranges, atomic<size_t> *nextRange)
+{
+    const size_t rangesCount = ranges->size();
+    for (size_t i = (*nextRange)++; i < rangesCount; i = (*nextRange)++)
+    {
+        SearchRange &range = (*ranges)[i];
+        search.findAll(*tree, range.start, range.end, range.matches);
+    }
+}
+
+/**
+ * Appends the matches of `range` to `result` as a search over the whole tree would find them. `from` is where that
+ * search goes on, it is moved past the range.
+ */
+template <typename Search>
+static void mergeRange(Search &search, const BufferTree &tree, const SearchRange &range, size_t &from, vector<size_t> &result)
+{
+    const vector<size_t> &matches = range.matches;
+    size_t i = 0;
+    while (true)
+    {
+        while (i < matches.size() && matches[i] < from)
+        {
+            i += 2;
+        }
+        // where the search of the range went on to find match `i`
+        const size_t searchedFrom = (i == 0 ? range.start : searchFromAfter(matches[i - 2], matches[i - 1]));
+        if (searchedFrom <= from)
+        {
+            break;
+        }
+        // the search of the range skipped chars after `from` for a match that overlaps the ones before, the
+        // next match from `from` starts at or before match `i`
+        size_t matchStart, matchEnd;
+        if (!search.findNext(tree, from, matchStart, matchEnd) || matchStart >= range.end)
+        {
+            from = max(from, range.end);
+            return;
+        }
+        result.push_back(matchStart);
+        result.push_back(matchEnd);
+        from = searchFromAfter(matchStart, matchEnd);
+    }
+
+    if (i < matches.size())
+    {
+        result.insert(result.end(), matches.begin() + i, matches.end());
+        from = searchFromAfter(matches[matches.size() - 2], matches[matches.size() - 1]);
+    }
+    // no other match starts in the range
+    from = max(from, range.end);
+}
+
+/**
+ * Searches `ranges` on `threadsCount` threads and merges their matches. No match may start between two ranges.
+ */
+template <typename Search>
+static void findAllInRanges(const BufferTree &tree, Search &search, vector<SearchRange> &ranges, size_t threadsCount, vector<size_t> &result)
+{
+    const size_t rangesCount = ranges.size();
+    atomic<size_t> nextRange(0);
+    if (threadsCount <= 1 || rangesCount <= 1)
+    {
+        searchRanges(search, &tree, &ranges, &nextRange);
+    }
+    else
+    {
+        vector<thread> threads;
+        for (size_t i = 0, len = min(threadsCount, rangesCount); i < len; i++)
+        {
+            threads.push_back(thread(searchRanges<Search>, search, &tree, &ranges, &nextRange));
+        }
+        for (size_t i = 0, len = threads.size(); i < len; i++)
+        {
+            threads[i].join();
+        }
+    }
+
+    size_t from = 0;
+    for (size_t i = 0; i < rangesCount; i++)
+    {
+        // nothing starts before the range, so the search over the whole tree would go on from its start
+        from = max(from, ranges[i].start);
+        mergeRange(search, tree, ranges[i], from, result);
+    }
+}
+
+/**
+ * Splits the leafs into `threadsCount * PARALLEL_SEARCH_RANGES_PER_THREAD` contiguous ranges.
+ */
+static void splitLeafs(const BufferTree &tree, size_t threadsCount, vector<SearchRange> &ranges)
+{
+    const size_t leafsCount = tree.leafsCount();
+    const size_t rangesCount = max((size_t)1, min(leafsCount, threadsCount * PARALLEL_SEARCH_RANGES_PER_THREAD));
+    ranges.resize(rangesCount);
+    BufferLeafIterator it(tree, 0);
+    for (size_t i = 0; i < rangesCount; i++)
+    {
+        it.seek(i * leafsCount / rangesCount);
+        ranges[i].start = it.leafStartOffset();
+        if (i > 0)
+        {
+            ranges[i - 1].end = ranges[i].start;
+        }
+    }
+    // past the end, so the last range holds an empty match at the end
+    ranges[rangesCount - 1].end = tree.length() + 1;
+}
+
+void findAllParallel(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, size_t threadsCount, vector<size_t> &result)
+{
+    LiteralRangeSearch search(needle, options);
+    vector<SearchRange> ranges;
+    splitLeafs(tree, threadsCount, ranges);
+    vector<size_t> matches;
+    findAllInRanges(tree, search, ranges, threadsCount, matches);
+    for (size_t i = 0; i < matches.size(); i += 2)
+    {
+        result.push_back(matches[i]);
+    }
+}
+
+void findAllParallelInRanges(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, const vector<size_t> &ranges, size_t threadsCount, vector<size_t> &result)
+{
+    size_t totalLength = 0;
+    for (size_t i = 0; i < ranges.size(); i += 2)
+    {
+        totalLength += ranges[i + 1] - ranges[i];
+    }
+    // the ranges are cut into parts of about equal length, so the threads share a long one
+    const size_t partLength = max((size_t)1, totalLength / max((size_t)1, threadsCount * PARALLEL_SEARCH_RANGES_PER_THREAD));
+    vector<SearchRange> parts;
+    for (size_t i = 0; i < ranges.size(); i += 2)
+    {
+        for (size_t start = ranges[i]; start < ranges[i + 1]; start += partLength)
+        {
+            SearchRange part;
+            part.start = start;
+            part.end = min(ranges[i + 1], start + partLength);
+            parts.push_back(part);
+        }
+    }
+
+    LiteralRangeSearch search(needle, options);
+    vector<size_t> matches;
+    findAllInRanges(tree, search, parts, threadsCount, matches);
+    for (size_t i = 0; i < matches.size(); i += 2)
+    {
+        result.push_back(matches[i]);
+    }
+}
+
+void findAllRegexParallel(const BufferTree &tree, const RegexSearch &search, size_t threadsCount, vector<size_t> &result)
+{
+    RegexSearch copy(search);
+    vector<SearchRange> ranges;
+    splitLeafs(tree, threadsCount, ranges);
+    findAllInRanges(tree, copy, ranges, threadsCount, result);
+}
+}
@@ -0,0 +1,46 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_PARALLEL_SEARCH_H_
+#define EDCORE_PARALLEL_SEARCH_H_
+
+#include "buffer-regex.h"
+#include "buffer-search.h"
+
+#include <vector>
+
+using namespace std;
+
+// the leafs are split in this many ranges per thread, so a thread that is done early takes another range
+#define PARALLEL_SEARCH_RANGES_PER_THREAD 4
+
+namespace edcore
+{
+
+/**
+ * `LiteralSearch::findAll` over the whole tree on `threadsCount` threads.
+ *
+ * The leafs are split into contiguous ranges, each thread searches one range at a time for the matches that start
+ * in it, reading on past its end for the matches that cross it. The ranges are merged in order: where the last
+ * match of a range reaches into the next one, the matches of the next range that overlap it are dropped and the
+ * search is run again from its end until it meets the matches of the range, so each match is found once and the
+ * result is the same as with one thread. The tree is only read, it must not change during the call (search a
+ * snapshot to edit the buffer meanwhile).
+ */
+void findAllParallel(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, size_t threadsCount, vector<size_t> &result);
+/**
+ * `findAllParallel` for the matches that start in the ranges `[ranges[i], ranges[i + 1])` (sorted start and end
+ * pairs, apart), which must hold all matches of the tree, see `TrigramIndex::findAll`. Long ranges are cut into
+ * parts, so the threads share them.
+ */
+void findAllParallelInRanges(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, const vector<size_t> &ranges, size_t threadsCount, vector<size_t> &result);
+/**
+ * `RegexSearch::findAll` over the whole tree on `threadsCount` threads, like `findAllParallel`. Each thread
+ * searches with its own copy of `search`.
+ */
+void findAllRegexParallel(const BufferTree &tree, const RegexSearch &search, size_t threadsCount, vector<size_t> &result);
+}
+
+#endif
@@ -0,0 +1,1016 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "simd.h"
+
+#include <assert.h>
+#include <cstring>
+
+#ifdef EDCORE_SIMD_X64
+#include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace edcore
+{
+
+static inline size_t popCount(uint32_t v)
+{
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+static inline size_t countTrailingZeros(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return index;
+#else
+    size_t result = 0;
+    while ((v & 1) == 0)
+    {
+        v >>= 1;
+        result++;
+    }
+    return result;
+#endif
+}
+
+#ifdef EDCORE_SIMD_AVX2
+static bool supportsAVX2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+// ---- countLessOrEqual16
+
+#ifndef EDCORE_SIMD_X64
+
+static size_t countLessOrEqual16Scalar(const uint32_t *values, size_t count, uint32_t x)
+{
+    size_t result = 0;
+    while (result < count && values[result] <= x)
+    {
+        result++;
+    }
+    return result;
+}
+
+#endif
+
+#ifdef EDCORE_SIMD_X64
+
+// SSE2 only has signed compares, flipping the sign bit turns them into unsigned compares.
+#define SIGN_BIT ((int)0x80000000)
+
+static size_t countLessOrEqual16SSE2(const uint32_t *values, size_t count, uint32_t x)
+{
+    const __m128i bias = _mm_set1_epi32(SIGN_BIT);
+    const __m128i needle = _mm_xor_si128(_mm_set1_epi32((int)x), bias);
+
+    uint32_t greater = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(values + 4 * i)), bias);
+        greater |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(block, needle))) << (4 * i);
+    }
+    return popCount(~greater & ((1u << count) - 1));
+}
+
+#endif
+
+#ifdef EDCORE_SIMD_AVX2
+
+__attribute__((target("avx2"))) static size_t countLessOrEqual16AVX2(const uint32_t *values, size_t count, uint32_t x)
+{
+    const __m256i bias = _mm256_set1_epi32(SIGN_BIT);
+    const __m256i needle = _mm256_xor_si256(_mm256_set1_epi32((int)x), bias);
+
+    __m256i low = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)values), bias);
+    __m256i high = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(values + 8)), bias);
+    uint32_t greater = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(low, needle)));
+    greater |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(high, needle))) << 8;
+    return popCount(~greater & ((1u << count) - 1));
+}
+
+#endif
+
+typedef size_t (*CountLessOrEqual16Fn)(const uint32_t *values, size_t count, uint32_t x);
+
+static CountLessOrEqual16Fn selectCountLessOrEqual16()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return countLessOrEqual16AVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return countLessOrEqual16SSE2;
+#else
+    return countLessOrEqual16Scalar;
+#endif
+}
+
+static const CountLessOrEqual16Fn countLessOrEqual16Impl = selectCountLessOrEqual16();
+
+size_t countLessOrEqual16(const uint32_t *values, size_t count, uint32_t x)
+{
+    return countLessOrEqual16Impl(values, count, x);
+}
+
+// ---- createLineStarts
+
+/**
+ * The vector paths look at 64 characters at a time and get one bit per character for \r and one for \n.
+ */
+#define LINE_BLOCK_LENGTH 64
+
+template <typename T>
+static void createLineStartsScalar(const T *data, size_t start, size_t length, vector<uint32_t> &lineStarts)
+{
+    for (size_t i = start; i < length; i++)
+    {
+        uint16_t chr = data[i];
+
+        if (chr == '\r')
+        {
+            if (i + 1 < length && data[i + 1] == '\n')
+            {
+                // \r\n... case
+                lineStarts.push_back(i + 2);
+                i++; // skip \n
+            }
+            else
+            {
+                // \r... case
+                lineStarts.push_back(i + 1);
+            }
+        }
+        else if (chr == '\n')
+        {
+            lineStarts.push_back(i + 1);
+        }
+    }
+}
+
+/**
+ * A \n always ends a line, a \r only if it is not followed by \n.
+ * `nextIsLineFeed` tells whether the character after the block is \n, for a \r\n pair that straddles two blocks.
+ */
+static inline void appendLineStarts(size_t blockStart, uint64_t cr, uint64_t lf, bool nextIsLineFeed, vector<uint32_t> &lineStarts)
+{
+    const uint64_t lfAfter = (lf >> 1) | ((uint64_t)nextIsLineFeed << (LINE_BLOCK_LENGTH - 1));
+    uint64_t ends = lf | (cr & ~lfAfter);
+    while (ends != 0)
+    {
+        lineStarts.push_back(blockStart + countTrailingZeros(ends) + 1);
+        ends &= ends - 1;
+    }
+}
+
+template <typename T, void (*LineBreakMasks)(const T *, uint64_t &, uint64_t &)>
+static void createLineStartsBlocks(const T *data, size_t length, vector<uint32_t> &lineStarts)
+{
+    size_t i = 0;
+    for (; i + LINE_BLOCK_LENGTH <= length; i += LINE_BLOCK_LENGTH)
+    {
+        uint64_t cr, lf;
+        LineBreakMasks(data + i, cr, lf);
+        if ((cr | lf) != 0)
+        {
+            const bool nextIsLineFeed = (i + LINE_BLOCK_LENGTH < length && data[i + LINE_BLOCK_LENGTH] == '\n');
+            appendLineStarts(i, cr, lf, nextIsLineFeed, lineStarts);
+        }
+    }
+    // a \r at the end of the last block has already been handled
+    createLineStartsScalar(data, i, length, lineStarts);
+}
+
+#ifdef EDCORE_SIMD_X64
+
+static void lineBreakMasksSSE2(const uint8_t *data, uint64_t &cr, uint64_t &lf)
+{
+    const __m128i crs = _mm_set1_epi8('\r');
+    const __m128i lfs = _mm_set1_epi8('\n');
+    cr = 0;
+    lf = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(data + 16 * i));
+        cr |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, crs)) << (16 * i);
+        lf |= (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(block, lfs)) << (16 * i);
+    }
+}
+
+static void lineBreakMasksSSE2(const uint16_t *data, uint64_t &cr, uint64_t &lf)
+{
+    const __m128i crs = _mm_set1_epi16('\r');
+    const __m128i lfs = _mm_set1_epi16('\n');
+    cr = 0;
+    lf = 0;
+    for (size_t i = 0; i < 4; i++)
+    {
+        // pack the 16-bit compare results of 16 characters into bytes
+        __m128i low = _mm_loadu_si128((const __m128i *)(data + 16 * i));
+        __m128i high = _mm_loadu_si128((const __m128i *)(data + 16 * i + 8));
+        __m128i crBytes = _mm_packs_epi16(_mm_cmpeq_epi16(low, crs), _mm_cmpeq_epi16(high, crs));
+        __m128i lfBytes = _mm_packs_epi16(_mm_cmpeq_epi16(low, lfs), _mm_cmpeq_epi16(high, lfs));
+        cr |= (uint64_t)(uint32_t)_mm_movemask_epi8(crBytes) << (16 * i);
+        lf |= (uint64_t)(uint32_t)_mm_movemask_epi8(lfBytes) << (16 * i);
+    }
+}
+
+#endif
+
+#ifdef EDCORE_SIMD_AVX2
+
+__attribute__((target("avx2"))) static void lineBreakMasksAVX2(const uint8_t *data, uint64_t &cr, uint64_t &lf)
+{
+    const __m256i crs = _mm256_set1_epi8('\r');
+    const __m256i lfs = _mm256_set1_epi8('\n');
+    __m256i low = _mm256_loadu_si256((const __m256i *)data);
+    __m256i high = _mm256_loadu_si256((const __m256i *)(data + 32));
+    cr = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, crs)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, crs)) << 32);
+    lf = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, lfs)) | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, lfs)) << 32);
+}
+
+__attribute__((target("avx2"))) static void lineBreakMasksAVX2(const uint16_t *data, uint64_t &cr, uint64_t &lf)
+{
+    const __m256i crs = _mm256_set1_epi16('\r');
+    const __m256i lfs = _mm256_set1_epi16('\n');
+    cr = 0;
+    lf = 0;
+    for (size_t i = 0; i < 2; i++)
+    {
+        // packs works within 128-bit lanes, the permute puts the 32 bytes back in character order
+        __m256i low = _mm256_loadu_si256((const __m256i *)(data + 32 * i));
+        __m256i high = _mm256_loadu_si256((const __m256i *)(data + 32 * i + 16));
+        __m256i crBytes = _mm256_permute4x64_epi64(_mm256_packs_epi16(_mm256_cmpeq_epi16(low, crs), _mm256_cmpeq_epi16(high, crs)), 0xD8);
+        __m256i lfBytes = _mm256_permute4x64_epi64(_mm256_packs_epi16(_mm256_cmpeq_epi16(low, lfs), _mm256_cmpeq_epi16(high, lfs)), 0xD8);
+        cr |= (uint64_t)(uint32_t)_mm256_movemask_epi8(crBytes) << (32 * i);
+        lf |= (uint64_t)(uint32_t)_mm256_movemask_epi8(lfBytes) << (32 * i);
+    }
+}
+
+#endif
+
+typedef void (*CreateLineStarts8Fn)(const uint8_t *data, size_t length, vector<uint32_t> &lineStarts);
+typedef void (*CreateLineStarts16Fn)(const uint16_t *data, size_t length, vector<uint32_t> &lineStarts);
+
+#ifndef EDCORE_SIMD_X64
+
+static void createLineStarts8Scalar(const uint8_t *data, size_t length, vector<uint32_t> &lineStarts)
+{
+    createLineStartsScalar(data, 0, length, lineStarts);
+}
+
+static void createLineStarts16Scalar(const uint16_t *data, size_t length, vector<uint32_t> &lineStarts)
+{
+    createLineStartsScalar(data, 0, length, lineStarts);
+}
+
+#endif
+
+static CreateLineStarts8Fn selectCreateLineStarts8()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return createLineStartsBlocks<uint8_t, lineBreakMasksAVX2>;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return createLineStartsBlocks<uint8_t, lineBreakMasksSSE2>;
+#else
+    return createLineStarts8Scalar;
+#endif
+}
+
+static CreateLineStarts16Fn selectCreateLineStarts16()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return createLineStartsBlocks<uint16_t, lineBreakMasksAVX2>;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return createLineStartsBlocks<uint16_t, lineBreakMasksSSE2>;
+#else
+    return createLineStarts16Scalar;
+#endif
+}
+
+static const CreateLineStarts8Fn createLineStarts8Impl = selectCreateLineStarts8();
+static const CreateLineStarts16Fn createLineStarts16Impl = selectCreateLineStarts16();
+
+void createLineStarts(const uint8_t *data, size_t length, vector<uint32_t> &lineStarts)
+{
+    createLineStarts8Impl(data, length, lineStarts);
+}
+
+void createLineStarts(const uint16_t *data, size_t length, vector<uint32_t> &lineStarts)
+{
+    createLineStarts16Impl(data, length, lineStarts);
+}
+
+// ---- transcoding
+
+static inline void widenOneByteScalar(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        dst[i] = src[i];
+    }
+}
+
+static inline void narrowToOneByteScalar(const uint16_t *src, size_t length, uint8_t *dst)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        dst[i] = (uint8_t)src[i];
+    }
+}
+
+static inline bool containsOnlyOneByteScalar(const uint16_t *data, size_t length)
+{
+    uint16_t bits = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        bits |= data[i];
+    }
+    return (bits < 256);
+}
+
+/**
+ * The one byte check ORs blocks of this many characters together before looking at the high bytes.
+ */
+#define ONE_BYTE_CHECK_LENGTH 256
+
+#ifdef EDCORE_SIMD_X64
+
+static void widenOneByteSSE2(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(block, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(block, zero));
+    }
+    widenOneByteScalar(src + i, length - i, dst + i);
+}
+
+static void narrowToOneByteSSE2(const uint16_t *src, size_t length, uint8_t *dst)
+{
+    // packus saturates, clearing the high bytes first makes it truncate like the scalar loop
+    const __m128i lowBytes = _mm_set1_epi16(0xFF);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16)
+    {
+        __m128i low = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + i)), lowBytes);
+        __m128i high = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + i + 8)), lowBytes);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(low, high));
+    }
+    narrowToOneByteScalar(src + i, length - i, dst + i);
+}
+
+static bool containsOnlyOneByteSSE2(const uint16_t *data, size_t length)
+{
+    const __m128i highBytes = _mm_set1_epi16((short)0xFF00);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    while (i + 8 <= length)
+    {
+        const size_t end = min(i + ONE_BYTE_CHECK_LENGTH, length - length % 8);
+        __m128i bits = zero;
+        for (; i < end; i += 8)
+        {
+            bits = _mm_or_si128(bits, _mm_loadu_si128((const __m128i *)(data + i)));
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(bits, highBytes), zero)) != 0xFFFF)
+        {
+            return false;
+        }
+    }
+    return containsOnlyOneByteScalar(data + i, length - i);
+}
+
+#endif
+
+#ifdef EDCORE_SIMD_AVX2
+
+__attribute__((target("avx2"))) static void widenOneByteAVX2(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i low = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i)));
+        __m256i high = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(src + i + 16)));
+        _mm256_storeu_si256((__m256i *)(dst + i), low);
+        _mm256_storeu_si256((__m256i *)(dst + i + 16), high);
+    }
+    widenOneByteScalar(src + i, length - i, dst + i);
+}
+
+__attribute__((target("avx2"))) static void narrowToOneByteAVX2(const uint16_t *src, size_t length, uint8_t *dst)
+{
+    const __m256i lowBytes = _mm256_set1_epi16(0xFF);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        // packus works within 128-bit lanes, the permute puts the 32 bytes back in character order
+        __m256i low = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src + i)), lowBytes);
+        __m256i high = _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(src + i + 16)), lowBytes);
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0xD8));
+    }
+    narrowToOneByteScalar(src + i, length - i, dst + i);
+}
+
+__attribute__((target("avx2"))) static bool containsOnlyOneByteAVX2(const uint16_t *data, size_t length)
+{
+    const __m256i highBytes = _mm256_set1_epi16((short)0xFF00);
+    size_t i = 0;
+    while (i + 16 <= length)
+    {
+        const size_t end = min(i + ONE_BYTE_CHECK_LENGTH, length - length % 16);
+        __m256i bits = _mm256_setzero_si256();
+        for (; i < end; i += 16)
+        {
+            bits = _mm256_or_si256(bits, _mm256_loadu_si256((const __m256i *)(data + i)));
+        }
+        if (!_mm256_testz_si256(bits, highBytes))
+        {
+            return false;
+        }
+    }
+    return containsOnlyOneByteScalar(data + i, length - i);
+}
+
+#endif
+
+typedef void (*WidenOneByteFn)(const uint8_t *src, size_t length, uint16_t *dst);
+typedef void (*NarrowToOneByteFn)(const uint16_t *src, size_t length, uint8_t *dst);
+typedef bool (*ContainsOnlyOneByteFn)(const uint16_t *data, size_t length);
+
+static WidenOneByteFn selectWidenOneByte()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return widenOneByteAVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return widenOneByteSSE2;
+#else
+    return widenOneByteScalar;
+#endif
+}
+
+static NarrowToOneByteFn selectNarrowToOneByte()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return narrowToOneByteAVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return narrowToOneByteSSE2;
+#else
+    return narrowToOneByteScalar;
+#endif
+}
+
+static ContainsOnlyOneByteFn selectContainsOnlyOneByte()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return containsOnlyOneByteAVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return containsOnlyOneByteSSE2;
+#else
+    return containsOnlyOneByteScalar;
+#endif
+}
+
+static const WidenOneByteFn widenOneByteImpl = selectWidenOneByte();
+static const NarrowToOneByteFn narrowToOneByteImpl = selectNarrowToOneByte();
+static const ContainsOnlyOneByteFn containsOnlyOneByteImpl = selectContainsOnlyOneByte();
+
+void widenOneByte(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    widenOneByteImpl(src, length, dst);
+}
+
+void narrowToOneByte(const uint16_t *src, size_t length, uint8_t *dst)
+{
+    narrowToOneByteImpl(src, length, dst);
+}
+
+bool containsOnlyOneByte(const uint16_t *data, size_t length)
+{
+    return containsOnlyOneByteImpl(data, length);
+}
+
+// ---- UTF-8
+
+static inline bool containsOnlyAsciiScalar(const uint8_t *data, size_t length)
+{
+    uint8_t bits = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        bits |= data[i];
+    }
+    return (bits < 128);
+}
+
+#ifdef EDCORE_SIMD_X64
+
+static bool containsOnlyAsciiSSE2(const uint8_t *data, size_t length)
+{
+    size_t i = 0;
+    while (i + 16 <= length)
+    {
+        const size_t end = min(i + ONE_BYTE_CHECK_LENGTH, length - length % 16);
+        __m128i bits = _mm_setzero_si128();
+        for (; i < end; i += 16)
+        {
+            bits = _mm_or_si128(bits, _mm_loadu_si128((const __m128i *)(data + i)));
+        }
+        if (_mm_movemask_epi8(bits) != 0)
+        {
+            return false;
+        }
+    }
+    return containsOnlyAsciiScalar(data + i, length - i);
+}
+
+#endif
+
+#ifdef EDCORE_SIMD_AVX2
+
+__attribute__((target("avx2"))) static bool containsOnlyAsciiAVX2(const uint8_t *data, size_t length)
+{
+    size_t i = 0;
+    while (i + 32 <= length)
+    {
+        const size_t end = min(i + ONE_BYTE_CHECK_LENGTH, length - length % 32);
+        __m256i bits = _mm256_setzero_si256();
+        for (; i < end; i += 32)
+        {
+            bits = _mm256_or_si256(bits, _mm256_loadu_si256((const __m256i *)(data + i)));
+        }
+        if (_mm256_movemask_epi8(bits) != 0)
+        {
+            return false;
+        }
+    }
+    return containsOnlyAsciiScalar(data + i, length - i);
+}
+
+#endif
+
+typedef bool (*ContainsOnlyAsciiFn)(const uint8_t *data, size_t length);
+
+static ContainsOnlyAsciiFn selectContainsOnlyAscii()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return containsOnlyAsciiAVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return containsOnlyAsciiSSE2;
+#else
+    return containsOnlyAsciiScalar;
+#endif
+}
+
+static const ContainsOnlyAsciiFn containsOnlyAsciiImpl = selectContainsOnlyAscii();
+
+bool containsOnlyAscii(const uint8_t *data, size_t length)
+{
+    return containsOnlyAsciiImpl(data, length);
+}
+
+#define UTF8_REPLACEMENT_CHARACTER 0xFFFD
+
+/**
+ * Decode the sequence starting with the non-ascii byte `src[i]`, advance `i` past it and return the number of
+ * 16-bit character codes written to `dst` (1 or 2).
+ */
+static inline size_t decodeUtf8Sequence(const uint8_t *src, size_t length, size_t &i, uint16_t *dst)
+{
+    const uint8_t lead = src[i++];
+
+    size_t needed;
+    uint32_t codePoint;
+    // the valid range of the second byte, which excludes overlong forms, surrogates and code points > U+10FFFF
+    uint8_t lower = 0x80;
+    uint8_t upper = 0xBF;
+    if (lead >= 0xC2 && lead <= 0xDF)
+    {
+        needed = 1;
+        codePoint = lead & 0x1F;
+    }
+    else if (lead >= 0xE0 && lead <= 0xEF)
+    {
+        needed = 2;
+        codePoint = lead & 0x0F;
+        lower = (lead == 0xE0 ? 0xA0 : 0x80);
+        upper = (lead == 0xED ? 0x9F : 0xBF);
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4)
+    {
+        needed = 3;
+        codePoint = lead & 0x07;
+        lower = (lead == 0xF0 ? 0x90 : 0x80);
+        upper = (lead == 0xF4 ? 0x8F : 0xBF);
+    }
+    else
+    {
+        dst[0] = UTF8_REPLACEMENT_CHARACTER;
+        return 1;
+    }
+
+    for (size_t k = 0; k < needed; k++)
+    {
+        if (i >= length || src[i] < lower || src[i] > upper)
+        {
+            // the byte that does not fit is decoded again on its own
+            dst[0] = UTF8_REPLACEMENT_CHARACTER;
+            return 1;
+        }
+        codePoint = (codePoint << 6) | (src[i++] & 0x3F);
+        lower = 0x80;
+        upper = 0xBF;
+    }
+
+    if (codePoint < 0x10000)
+    {
+        dst[0] = (uint16_t)codePoint;
+        return 1;
+    }
+    codePoint -= 0x10000;
+    dst[0] = (uint16_t)(0xD800 + (codePoint >> 10));
+    dst[1] = (uint16_t)(0xDC00 + (codePoint & 0x3FF));
+    return 2;
+}
+
+static inline size_t decodeUtf8Scalar(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    uint16_t *const dstStart = dst;
+    size_t i = 0;
+    while (i < length)
+    {
+        if (src[i] < 0x80)
+        {
+            *(dst++) = src[i++];
+            continue;
+        }
+        dst += decodeUtf8Sequence(src, length, i, dst);
+    }
+    return dst - dstStart;
+}
+
+/*
+ * The vector decoders widen a whole block and keep the chars up to its first non-ascii byte. From there
+ * sequences are decoded one by one until the next ascii byte. Writing the whole block is safe: a prefix of
+ * the input never decodes to more chars than it has bytes.
+ */
+
+#ifdef EDCORE_SIMD_X64
+
+static size_t decodeUtf8SSE2(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint16_t *const dstStart = dst;
+    size_t i = 0;
+    while (i + 16 <= length)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)dst, _mm_unpacklo_epi8(block, zero));
+        _mm_storeu_si128((__m128i *)(dst + 8), _mm_unpackhi_epi8(block, zero));
+
+        const uint32_t nonAscii = _mm_movemask_epi8(block);
+        if (nonAscii == 0)
+        {
+            i += 16;
+            dst += 16;
+            continue;
+        }
+        const size_t asciiLength = countTrailingZeros(nonAscii);
+        i += asciiLength;
+        dst += asciiLength;
+        do
+        {
+            dst += decodeUtf8Sequence(src, length, i, dst);
+        } while (i < length && src[i] >= 0x80);
+    }
+    return (dst - dstStart) + decodeUtf8Scalar(src + i, length - i, dst);
+}
+
+#endif
+
+#ifdef EDCORE_SIMD_AVX2
+
+__attribute__((target("avx2"))) static size_t decodeUtf8AVX2(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    uint16_t *const dstStart = dst;
+    size_t i = 0;
+    while (i + 32 <= length)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)dst, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(block)));
+        _mm256_storeu_si256((__m256i *)(dst + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(block, 1)));
+
+        const uint32_t nonAscii = _mm256_movemask_epi8(block);
+        if (nonAscii == 0)
+        {
+            i += 32;
+            dst += 32;
+            continue;
+        }
+        const size_t asciiLength = countTrailingZeros(nonAscii);
+        i += asciiLength;
+        dst += asciiLength;
+        do
+        {
+            dst += decodeUtf8Sequence(src, length, i, dst);
+        } while (i < length && src[i] >= 0x80);
+    }
+    return (dst - dstStart) + decodeUtf8Scalar(src + i, length - i, dst);
+}
+
+#endif
+
+typedef size_t (*DecodeUtf8Fn)(const uint8_t *src, size_t length, uint16_t *dst);
+
+static DecodeUtf8Fn selectDecodeUtf8()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return decodeUtf8AVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return decodeUtf8SSE2;
+#else
+    return decodeUtf8Scalar;
+#endif
+}
+
+static const DecodeUtf8Fn decodeUtf8Impl = selectDecodeUtf8();
+
+size_t decodeUtf8(const uint8_t *src, size_t length, uint16_t *dst)
+{
+    return decodeUtf8Impl(src, length, dst);
+}
+
+// ---- literal search
+
+static inline uint16_t foldAscii(uint16_t c)
+{
+    return (c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+/**
+ * The bit that is ORed into the text before comparing it to the lower case letter `c`, so both cases match.
+ * Text chars that are not letters never become a letter that way.
+ */
+static inline uint16_t caseBit(uint16_t c, bool ignoreCase)
+{
+    return (ignoreCase && c >= 'a' && c <= 'z' ? 0x20 : 0);
+}
+
+template <typename T>
+static inline bool matchesAt(const T *data, const T *needle, size_t needleLength, bool ignoreCase)
+{
+    if (!ignoreCase)
+    {
+        return (memcmp(data, needle, needleLength * sizeof(T)) == 0);
+    }
+    for (size_t i = 0; i < needleLength; i++)
+    {
+        if (foldAscii(data[i]) != needle[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+static size_t findLiteralScalar(const T *data, size_t start, size_t length, const T *needle, size_t needleLength, bool ignoreCase)
+{
+    const uint16_t first = needle[0];
+    const uint16_t firstCase = caseBit(first, ignoreCase);
+    for (size_t i = start; i + needleLength <= length; i++)
+    {
+        if ((data[i] | firstCase) == first && matchesAt(data + i, needle, needleLength, ignoreCase))
+        {
+            return i;
+        }
+    }
+    return length;
+}
+
+/*
+ * The vector searches compare a block of positions against the first and against the last char of the needle
+ * at once, and only compare the whole needle at the positions where both match.
+ */
+
+#ifdef EDCORE_SIMD_X64
+
+static size_t findLiteralSSE2(const uint8_t *data, size_t length, const uint8_t *needle, size_t needleLength, bool ignoreCase)
+{
+    const size_t lastIndex = needleLength - 1;
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[lastIndex]);
+    const __m128i firstCase = _mm_set1_epi8((char)caseBit(needle[0], ignoreCase));
+    const __m128i lastCase = _mm_set1_epi8((char)caseBit(needle[lastIndex], ignoreCase));
+    size_t i = 0;
+    for (; i + lastIndex + 16 <= length; i += 16)
+    {
+        const __m128i blockFirst = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i)), firstCase);
+        const __m128i blockLast = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i + lastIndex)), lastCase);
+        uint32_t candidates = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last)));
+        while (candidates != 0)
+        {
+            const size_t candidate = i + countTrailingZeros(candidates);
+            if (matchesAt(data + candidate, needle, needleLength, ignoreCase))
+            {
+                return candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return findLiteralScalar(data, i, length, needle, needleLength, ignoreCase);
+}
+
+static size_t findLiteralSSE2(const uint16_t *data, size_t length, const uint16_t *needle, size_t needleLength, bool ignoreCase)
+{
+    const size_t lastIndex = needleLength - 1;
+    const __m128i first = _mm_set1_epi16((short)needle[0]);
+    const __m128i last = _mm_set1_epi16((short)needle[lastIndex]);
+    const __m128i firstCase = _mm_set1_epi16((short)caseBit(needle[0], ignoreCase));
+    const __m128i lastCase = _mm_set1_epi16((short)caseBit(needle[lastIndex], ignoreCase));
+    size_t i = 0;
+    for (; i + lastIndex + 8 <= length; i += 8)
+    {
+        const __m128i blockFirst = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i)), firstCase);
+        const __m128i blockLast = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i + lastIndex)), lastCase);
+        // two mask bits per char, only the low one is kept
+        uint32_t candidates = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi16(blockFirst, first), _mm_cmpeq_epi16(blockLast, last))) & 0x5555;
+        while (candidates != 0)
+        {
+            const size_t candidate = i + countTrailingZeros(candidates) / 2;
+            if (matchesAt(data + candidate, needle, needleLength, ignoreCase))
+            {
+                return candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return findLiteralScalar(data, i, length, needle, needleLength, ignoreCase);
+}
+
+#endif
+
+#ifdef EDCORE_SIMD_AVX2
+
+__attribute__((target("avx2"))) static size_t findLiteralAVX2(const uint8_t *data, size_t length, const uint8_t *needle, size_t needleLength, bool ignoreCase)
+{
+    const size_t lastIndex = needleLength - 1;
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[lastIndex]);
+    const __m256i firstCase = _mm256_set1_epi8((char)caseBit(needle[0], ignoreCase));
+    const __m256i lastCase = _mm256_set1_epi8((char)caseBit(needle[lastIndex], ignoreCase));
+    size_t i = 0;
+    for (; i + lastIndex + 32 <= length; i += 32)
+    {
+        const __m256i blockFirst = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + i)), firstCase);
+        const __m256i blockLast = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + i + lastIndex)), lastCase);
+        uint32_t candidates = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last)));
+        while (candidates != 0)
+        {
+            const size_t candidate = i + countTrailingZeros(candidates);
+            if (matchesAt(data + candidate, needle, needleLength, ignoreCase))
+            {
+                return candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return findLiteralScalar(data, i, length, needle, needleLength, ignoreCase);
+}
+
+__attribute__((target("avx2"))) static size_t findLiteralAVX2(const uint16_t *data, size_t length, const uint16_t *needle, size_t needleLength, bool ignoreCase)
+{
+    const size_t lastIndex = needleLength - 1;
+    const __m256i first = _mm256_set1_epi16((short)needle[0]);
+    const __m256i last = _mm256_set1_epi16((short)needle[lastIndex]);
+    const __m256i firstCase = _mm256_set1_epi16((short)caseBit(needle[0], ignoreCase));
+    const __m256i lastCase = _mm256_set1_epi16((short)caseBit(needle[lastIndex], ignoreCase));
+    size_t i = 0;
+    for (; i + lastIndex + 16 <= length; i += 16)
+    {
+        const __m256i blockFirst = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + i)), firstCase);
+        const __m256i blockLast = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + i + lastIndex)), lastCase);
+        uint32_t candidates = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi16(blockFirst, first), _mm256_cmpeq_epi16(blockLast, last))) & 0x55555555;
+        while (candidates != 0)
+        {
+            const size_t candidate = i + countTrailingZeros(candidates) / 2;
+            if (matchesAt(data + candidate, needle, needleLength, ignoreCase))
+            {
+                return candidate;
+            }
+            candidates &= candidates - 1;
+        }
+    }
+    return findLiteralScalar(data, i, length, needle, needleLength, ignoreCase);
+}
+
+#endif
+
+#ifndef EDCORE_SIMD_X64
+
+static size_t findLiteral8Scalar(const uint8_t *data, size_t length, const uint8_t *needle, size_t needleLength, bool ignoreCase)
+{
+    return findLiteralScalar(data, 0, length, needle, needleLength, ignoreCase);
+}
+
+static size_t findLiteral16Scalar(const uint16_t *data, size_t length, const uint16_t *needle, size_t needleLength, bool ignoreCase)
+{
+    return findLiteralScalar(data, 0, length, needle, needleLength, ignoreCase);
+}
+
+#endif
+
+typedef size_t (*FindLiteral8Fn)(const uint8_t *data, size_t length, const uint8_t *needle, size_t needleLength, bool ignoreCase);
+typedef size_t (*FindLiteral16Fn)(const uint16_t *data, size_t length, const uint16_t *needle, size_t needleLength, bool ignoreCase);
+
+static FindLiteral8Fn selectFindLiteral8()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return findLiteralAVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return findLiteralSSE2;
+#else
+    return findLiteral8Scalar;
+#endif
+}
+
+static FindLiteral16Fn selectFindLiteral16()
+{
+#ifdef EDCORE_SIMD_AVX2
+    if (supportsAVX2())
+    {
+        return findLiteralAVX2;
+    }
+#endif
+#ifdef EDCORE_SIMD_X64
+    return findLiteralSSE2;
+#else
+    return findLiteral16Scalar;
+#endif
+}
+
+static const FindLiteral8Fn findLiteral8Impl = selectFindLiteral8();
+static const FindLiteral16Fn findLiteral16Impl = selectFindLiteral16();
+
+size_t findLiteral(const uint8_t *data, size_t length, const uint8_t *needle, size_t needleLength, bool ignoreCase)
+{
+    assert(needleLength > 0);
+    return findLiteral8Impl(data, length, needle, needleLength, ignoreCase);
+}
+
+size_t findLiteral(const uint16_t *data, size_t length, const uint16_t *needle, size_t needleLength, bool ignoreCase)
+{
+    assert(needleLength > 0);
+    return findLiteral16Impl(data, length, needle, needleLength, ignoreCase);
+}
+}
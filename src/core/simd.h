@@ -0,0 +1,73 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_SIMD_H_
+#define EDCORE_SIMD_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define EDCORE_SIMD_X64 1
+#endif
+
+// AVX2 kernels are compiled with per-function target attributes and picked at runtime.
+#if defined(EDCORE_SIMD_X64) && defined(__GNUC__)
+#define EDCORE_SIMD_AVX2 1
+#endif
+
+namespace edcore
+{
+
+/**
+ * Returns how many of `values[0..count)` are <= `x`, for sorted `values`.
+ * `values` must be readable for 16 elements, `count` <= 16.
+ */
+size_t countLessOrEqual16(const uint32_t *values, size_t count, uint32_t x);
+
+/**
+ * Append the offset after each line terminator (\r\n, \r or \n) in `data` to `lineStarts`.
+ */
+void createLineStarts(const uint8_t *data, size_t length, vector<uint32_t> &lineStarts);
+void createLineStarts(const uint16_t *data, size_t length, vector<uint32_t> &lineStarts);
+
+/**
+ * Copy `length` one byte characters from `src` to `dst` as 16-bit character codes.
+ */
+void widenOneByte(const uint8_t *src, size_t length, uint16_t *dst);
+
+/**
+ * Copy `length` 16-bit character codes from `src` to `dst`, keeping the low byte of each.
+ */
+void narrowToOneByte(const uint16_t *src, size_t length, uint8_t *dst);
+
+/**
+ * Returns whether all of `data[0..length)` are < 256.
+ */
+bool containsOnlyOneByte(const uint16_t *data, size_t length);
+
+/**
+ * Returns whether all of `data[0..length)` are < 128.
+ */
+bool containsOnlyAscii(const uint8_t *data, size_t length);
+
+/**
+ * Decode `length` bytes of UTF-8 into `dst` and return the number of 16-bit character codes written, at most `length`.
+ * Invalid or truncated sequences become U+FFFD, one per maximal subpart like the WHATWG decoder (and node's `Buffer.toString`).
+ */
+size_t decodeUtf8(const uint8_t *src, size_t length, uint16_t *dst);
+
+/**
+ * Returns the first position of `needle` in `data[0..length)`, or `length` if there is none. `needle` is not empty.
+ * With `ignoreCase`, ascii letters match in either case and the letters of `needle` must be lower case.
+ */
+size_t findLiteral(const uint8_t *data, size_t length, const uint8_t *needle, size_t needleLength, bool ignoreCase);
+size_t findLiteral(const uint16_t *data, size_t length, const uint16_t *needle, size_t needleLength, bool ignoreCase);
+}
+
+#endif
@@ -0,0 +1,389 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "trigram-index.h"
+#include "parallel-search.h"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace edcore
+{
+
+static inline uint16_t foldAscii(uint16_t c)
+{
+    return (c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+static inline uint64_t trigramKey(uint16_t a, uint16_t b, uint16_t c)
+{
+    return (((uint64_t)a << 32) | ((uint64_t)b << 16) | c);
+}
+
+/**
+ * The top bits are the well mixed ones, a bitmap of `2^k` bits takes the top `k`.
+ */
+static inline uint64_t trigramHash(uint64_t key)
+{
+    return key * 0x9E3779B97F4A7C15ULL;
+}
+
+template <typename T>
+static void addTrigrams(const T *chars, size_t length, uint32_t shift, uint64_t *bits)
+{
+    if (length < 3)
+    {
+        return;
+    }
+    uint16_t a = foldAscii(chars[0]);
+    uint16_t b = foldAscii(chars[1]);
+    for (size_t i = 2; i < length; i++)
+    {
+        const uint16_t c = foldAscii(chars[i]);
+        const uint64_t bit = trigramHash(trigramKey(a, b, c)) >> shift;
+        bits[bit >> 6] |= ((uint64_t)1 << (bit & 63));
+        a = b;
+        b = c;
+    }
+}
+
+/**
+ * The first two and the last two chars, folded. They overlap in a leaf shorter than four chars.
+ */
+template <typename T>
+static void setEdges(const T *chars, size_t length, uint16_t *first, uint16_t *last)
+{
+    const size_t edgeLength = min(length, (size_t)2);
+    for (size_t i = 0; i < 2; i++)
+    {
+        first[i] = (i < edgeLength ? foldAscii(chars[i]) : 0);
+        last[i] = (i < edgeLength ? foldAscii(chars[length - edgeLength + i]) : 0);
+    }
+}
+
+/**
+ * With its node and bucket in the map.
+ */
+size_t TrigramIndex::entryMemUsage(const LeafTrigrams *entry)
+{
+    return (sizeof(LeafTrigrams) + entry->bits.size() * sizeof(uint64_t) + sizeof(pair<const BufferPiece *, LeafTrigrams *>) + 2 * sizeof(void *));
+}
+
+TrigramIndex::TrigramIndex() : memUsage_(sizeof(TrigramIndex))
+{
+}
+
+TrigramIndex::~TrigramIndex()
+{
+    for (unordered_map<const BufferPiece *, LeafTrigrams *>::iterator it = leafs_.begin(); it != leafs_.end(); ++it)
+    {
+        delete it->second;
+    }
+}
+
+TrigramIndex::LeafTrigrams *TrigramIndex::build(const BufferPiece *leaf)
+{
+    LeafTrigrams *entry = new LeafTrigrams();
+    const size_t length = leaf->length();
+    size_t bitsCount = TRIGRAM_INDEX_MIN_BITS;
+    while (bitsCount < TRIGRAM_INDEX_MAX_BITS && bitsCount * TRIGRAM_INDEX_CHARS_PER_BIT < length)
+    {
+        bitsCount *= 2;
+    }
+    uint32_t shift = 64;
+    for (size_t i = bitsCount; i > 1; i >>= 1)
+    {
+        shift--;
+    }
+    entry->bits.assign(bitsCount / 64, 0);
+    entry->shift = shift;
+    entry->length = length;
+    entry->uses = 0;
+
+    if (length == 0)
+    {
+        // the leaf of an empty buffer, the scratch vectors may have no storage to copy it to
+        setEdges((const uint16_t *)NULL, 0, entry->first, entry->last);
+        return entry;
+    }
+    if (leaf->isOneByte())
+    {
+        oneByteChars_.resize(length);
+        leaf->writeOneByte(oneByteChars_.data(), 0, length);
+        addTrigrams(oneByteChars_.data(), length, shift, entry->bits.data());
+        setEdges(oneByteChars_.data(), length, entry->first, entry->last);
+    }
+    else
+    {
+        chars_.resize(length);
+        leaf->write(chars_.data(), 0, length);
+        addTrigrams(chars_.data(), length, shift, entry->bits.data());
+        setEdges(chars_.data(), length, entry->first, entry->last);
+    }
+    return entry;
+}
+
+void TrigramIndex::add(const BufferPiece *leaf)
+{
+    unordered_map<const BufferPiece *, LeafTrigrams *>::iterator found = leafs_.find(leaf);
+    if (found != leafs_.end())
+    {
+        found->second->uses++;
+        return;
+    }
+    LeafTrigrams *entry = build(leaf);
+    entry->uses = 1;
+    leafs_[leaf] = entry;
+    memUsage_ += entryMemUsage(entry);
+}
+
+void TrigramIndex::remove(const BufferPiece *leaf)
+{
+    unordered_map<const BufferPiece *, LeafTrigrams *>::iterator found = leafs_.find(leaf);
+    assert(found != leafs_.end());
+    if (found == leafs_.end() || --found->second->uses > 0)
+    {
+        return;
+    }
+    memUsage_ -= entryMemUsage(found->second);
+    delete found->second;
+    leafs_.erase(found);
+}
+
+void TrigramIndex::addAll(const BufferTree &tree)
+{
+    BufferLeafIterator it(tree, 0);
+    for (size_t i = 0, len = tree.leafsCount(); i < len; i++)
+    {
+        add(it.leaf());
+        if (i + 1 < len)
+        {
+            it.next();
+        }
+    }
+}
+
+void TrigramIndex::replace(const BufferTree &tree, size_t leafIndex, size_t removedCount, BufferPiece *const *added, size_t addedCount)
+{
+    // added first, so the leafs that stay in the tree are never dropped and indexed again
+    for (size_t i = 0; i < addedCount; i++)
+    {
+        add(added[i]);
+    }
+    if (removedCount == 0)
+    {
+        return;
+    }
+    BufferLeafIterator it(tree, leafIndex);
+    for (size_t i = 0; i < removedCount; i++)
+    {
+        remove(it.leaf());
+        if (i + 1 < removedCount)
+        {
+            it.next();
+        }
+    }
+}
+
+void TrigramIndex::move(const BufferPiece *from, const BufferPiece *to)
+{
+    unordered_map<const BufferPiece *, LeafTrigrams *>::iterator found = leafs_.find(from);
+    if (found == leafs_.end())
+    {
+        return;
+    }
+    LeafTrigrams *entry = found->second;
+    leafs_.erase(found);
+    leafs_[to] = entry;
+}
+
+/**
+ * The trigrams of the needle that are `(a, b, c)`.
+ */
+uint64_t TrigramIndex::edgeMask(uint16_t a, uint16_t b, uint16_t c) const
+{
+    const uint64_t key = trigramKey(a, b, c);
+    uint64_t mask = 0;
+    for (size_t q = 0, len = needleTrigrams_.size(); q < len; q++)
+    {
+        if (needleTrigrams_[q] == key)
+        {
+            mask |= ((uint64_t)1 << q);
+        }
+    }
+    return mask;
+}
+
+/**
+ * Sets `candidates_[i]` for the leafs `i` in which a match of `needle` (at least 3 chars) can start: every trigram
+ * of the needle is in the leaf, in a leaf after it that the match can reach, or across an edge between them.
+ * Returns false if a leaf is not indexed.
+ */
+bool TrigramIndex::findCandidates(const BufferTree &tree, const vector<uint16_t> &needle)
+{
+    needleTrigrams_.clear();
+    needleHashes_.clear();
+    for (size_t i = 2; i < needle.size() && needleTrigrams_.size() < TRIGRAM_INDEX_MAX_NEEDLE_TRIGRAMS; i++)
+    {
+        const uint64_t key = trigramKey(foldAscii(needle[i - 2]), foldAscii(needle[i - 1]), foldAscii(needle[i]));
+        if (find(needleTrigrams_.begin(), needleTrigrams_.end(), key) == needleTrigrams_.end())
+        {
+            needleTrigrams_.push_back(key);
+            needleHashes_.push_back(trigramHash(key));
+        }
+    }
+    const size_t trigramsCount = needleTrigrams_.size();
+    const uint64_t allTrigrams = (trigramsCount == 64 ? ~(uint64_t)0 : ((uint64_t)1 << trigramsCount) - 1);
+
+    const size_t leafsCount = tree.leafsCount();
+    presentMasks_.resize(leafsCount);
+    edgeMasks_.resize(leafsCount);
+    lengths_.resize(leafsCount);
+    candidates_.resize(leafsCount);
+
+    // the last two chars before the current leaf
+    uint16_t before[2] = {0, 0};
+    size_t beforeCount = 0;
+    BufferLeafIterator it(tree, 0);
+    for (size_t i = 0; i < leafsCount; i++)
+    {
+        unordered_map<const BufferPiece *, LeafTrigrams *>::const_iterator found = leafs_.find(it.leaf());
+        if (found == leafs_.end())
+        {
+            return false;
+        }
+        const LeafTrigrams *entry = found->second;
+
+        uint64_t present = 0;
+        for (size_t q = 0; q < trigramsCount; q++)
+        {
+            const uint64_t bit = needleHashes_[q] >> entry->shift;
+            present |= ((entry->bits[bit >> 6] >> (bit & 63)) & 1) << q;
+        }
+
+        // the trigrams that end in the first two chars of the leaf and start before it
+        uint64_t edge = 0;
+        const size_t length = entry->length;
+        if (length > 0)
+        {
+            if (beforeCount == 2)
+            {
+                edge |= edgeMask(before[0], before[1], entry->first[0]);
+            }
+            if (beforeCount > 0 && length > 1)
+            {
+                edge |= edgeMask(before[1], entry->first[0], entry->first[1]);
+            }
+            if (length > 1)
+            {
+                before[0] = entry->last[0];
+                before[1] = entry->last[1];
+                beforeCount = 2;
+            }
+            else
+            {
+                before[0] = before[1];
+                before[1] = entry->first[0];
+                beforeCount = min(beforeCount + 1, (size_t)2);
+            }
+        }
+
+        presentMasks_[i] = present;
+        edgeMasks_[i] = edge;
+        lengths_[i] = length;
+        if (i + 1 < leafsCount)
+        {
+            it.next();
+        }
+    }
+
+    // a match starting in leaf `i` reaches the leafs after it up to `needle.size() - 1` chars past its end
+    for (size_t i = 0; i < leafsCount; i++)
+    {
+        uint64_t found = presentMasks_[i];
+        size_t between = 0;
+        for (size_t j = i + 1; j < leafsCount && between < needle.size() - 1 && found != allTrigrams; j++)
+        {
+            found |= edgeMasks_[j] | presentMasks_[j];
+            between += lengths_[j];
+        }
+        candidates_[i] = (found == allTrigrams && lengths_[i] > 0);
+    }
+    return true;
+}
+
+void TrigramIndex::findAll(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, vector<size_t> &result, size_t threadsCount)
+{
+    const size_t needleLength = needle->length();
+    if (needleLength == 0)
+    {
+        // never matches
+        return;
+    }
+    LiteralSearch search(needle, options);
+    vector<uint16_t> chars(needleLength);
+    needle->write(chars.data(), 0, needleLength);
+    if (needleLength < 3 || !findCandidates(tree, chars))
+    {
+        if (threadsCount > 1)
+        {
+            findAllParallel(tree, needle, options, threadsCount, result);
+            return;
+        }
+        search.findAll(tree, 0, tree.length(), result);
+        return;
+    }
+
+    // each run of candidate leafs is searched on to where a match starting in it can end, the search goes on
+    // from the end of the last match, as the search of the whole tree does
+    const size_t leafsCount = tree.leafsCount();
+    BufferLeafIterator it(tree, 0);
+    size_t from = 0;
+    size_t runStart = 0;
+    bool inRun = false;
+    // with threads, the runs are collected as start and end pairs and searched at the end
+    vector<size_t> runs;
+    for (size_t i = 0; i <= leafsCount; i++)
+    {
+        const bool isCandidate = (i < leafsCount && candidates_[i] != 0);
+        const size_t leafStart = (i < leafsCount ? it.leafStartOffset() : tree.length());
+        if (isCandidate && !inRun)
+        {
+            runStart = leafStart;
+            inRun = true;
+        }
+        else if (!isCandidate && inRun)
+        {
+            if (threadsCount > 1)
+            {
+                runs.push_back(runStart);
+                runs.push_back(leafStart);
+            }
+            else
+            {
+                const size_t start = max(from, runStart);
+                if (start < leafStart)
+                {
+                    const size_t matchesBefore = result.size();
+                    search.findAll(tree, start, min(tree.length(), leafStart + needleLength - 1), result);
+                    if (result.size() > matchesBefore)
+                    {
+                        from = result.back() + needleLength;
+                    }
+                }
+            }
+            inRun = false;
+        }
+        if (i + 1 < leafsCount)
+        {
+            it.next();
+        }
+    }
+    if (!runs.empty())
+    {
+        findAllParallelInRanges(tree, needle, options, runs, threadsCount, result);
+    }
+}
+}
@@ -0,0 +1,103 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef EDCORE_TRIGRAM_INDEX_H_
+#define EDCORE_TRIGRAM_INDEX_H_
+
+#include "buffer-search.h"
+
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// the bitmap of a leaf has a bit per this many chars, rounded up to a power of two within the bounds below
+#define TRIGRAM_INDEX_CHARS_PER_BIT 2
+#define TRIGRAM_INDEX_MIN_BITS 512
+#define TRIGRAM_INDEX_MAX_BITS 32768
+// at most this many trigrams of a needle are looked up
+#define TRIGRAM_INDEX_MAX_NEEDLE_TRIGRAMS 64
+
+namespace edcore
+{
+
+/**
+ * Bitmaps of the hashed trigrams of the leafs of a buffer, so a search only reads the leafs that can have a match.
+ *
+ * Each leaf has a bitmap of the trigrams that lie in it, and its first and last two chars, from which the trigrams
+ * across the edges between leafs are found at query time. An entry depends on the chars of its leaf only, leafs
+ * are immutable, so an edit only indexes the leafs it creates and drops the ones it removes. The trigrams are
+ * of chars with ascii letters in lower case, so one index serves searches with and without `ignoreCase`.
+ *
+ * Entries are keyed by leaf, the owner must drop a leaf before it leaves its tree, as another piece can be
+ * created at its address once it is freed.
+ */
+class TrigramIndex
+{
+  public:
+    TrigramIndex();
+    ~TrigramIndex();
+
+    size_t memUsage() const { return memUsage_; }
+    bool contains(const BufferPiece *leaf) const { return (leafs_.find(leaf) != leafs_.end()); }
+
+    /**
+     * Indexes all leafs of `tree`.
+     */
+    void addAll(const BufferTree &tree);
+    /**
+     * For `BufferTree::replaceLeafs`, before the leafs are replaced: indexes the leafs of `added` that are not
+     * indexed yet and drops the leafs of `[leafIndex, leafIndex + removedCount)` of `tree` that are not in `added`.
+     */
+    void replace(const BufferTree &tree, size_t leafIndex, size_t removedCount, BufferPiece *const *added, size_t addedCount);
+    /**
+     * `to` has the chars of `from` and takes over its entry.
+     */
+    void move(const BufferPiece *from, const BufferPiece *to);
+
+    /**
+     * `LiteralSearch::findAll` over all of `tree`, which must be indexed, reading only the runs of leafs in
+     * which a match can start. With `threadsCount` > 1 the runs are searched on that many threads, see
+     * `findAllParallelInRanges`.
+     */
+    void findAll(const BufferTree &tree, const BufferString *needle, const SearchOptions &options, vector<size_t> &result, size_t threadsCount = 1);
+
+  private:
+    struct LeafTrigrams
+    {
+        // a bit per hashed trigram, the bit index is the top `64 - shift` bits of the hash
+        vector<uint64_t> bits;
+        uint32_t shift;
+        size_t length;
+        // folded, as far as the leaf is long
+        uint16_t first[2];
+        uint16_t last[2];
+        // the number of times the leaf is in the tree
+        size_t uses;
+    };
+
+    unordered_map<const BufferPiece *, LeafTrigrams *> leafs_;
+    size_t memUsage_;
+
+    // scratch space
+    vector<uint16_t> chars_;
+    vector<uint8_t> oneByteChars_;
+    vector<uint64_t> needleTrigrams_;
+    vector<uint64_t> needleHashes_;
+    vector<uint64_t> presentMasks_;
+    vector<uint64_t> edgeMasks_;
+    vector<size_t> lengths_;
+    vector<uint8_t> candidates_;
+
+    void add(const BufferPiece *leaf);
+    void remove(const BufferPiece *leaf);
+    LeafTrigrams *build(const BufferPiece *leaf);
+    static size_t entryMemUsage(const LeafTrigrams *entry);
+    uint64_t edgeMask(uint16_t a, uint16_t b, uint16_t c) const;
+    bool findCandidates(const BufferTree &tree, const vector<uint16_t> &needle);
+};
+}
+
+#endif
@@ -42,6 +42,24 @@ void EdBufferBuilder::AcceptChunk(const v8::FunctionCallbackInfo<v8::Value> &arg
     delete str;
 }
 
+void EdBufferBuilder::AcceptUtf8Chunk(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferBuilder *obj = ObjectWrap::Unwrap<EdBufferBuilder>(args.Holder());
+
+    // a node Buffer is an Uint8Array
+    if (!args[0]->IsUint8Array())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be an Uint8Array")));
+        return;
+    }
+
+    v8::Local<v8::Uint8Array> chunk = v8::Local<v8::Uint8Array>::Cast(args[0]);
+    const uint8_t *data = static_cast<const uint8_t *>(chunk->Buffer()->GetContents().Data()) + chunk->ByteOffset();
+    obj->actual_->acceptUtf8Chunk(data, chunk->ByteLength());
+}
+
 void EdBufferBuilder::Finish(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
     EdBufferBuilder *obj = ObjectWrap::Unwrap<EdBufferBuilder>(args.Holder());
@@ -54,6 +72,67 @@ void EdBufferBuilder::Build(const v8::FunctionCallbackInfo<v8::Value> &args)
     args.GetReturnValue().Set(result);
 }
 
+void EdBufferBuilder::SetScanLineStartsInBackground(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferBuilder *obj = ObjectWrap::Unwrap<EdBufferBuilder>(args.Holder());
+
+    if (!args[0]->IsBoolean())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a boolean")));
+        return;
+    }
+
+    obj->actual_->setScanLineStartsInBackground(args[0]->BooleanValue());
+}
+
+void EdBufferBuilder::FromFile(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    LoadFile(args, false);
+}
+
+void EdBufferBuilder::FromFilePaged(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    LoadFile(args, true);
+}
+
+void EdBufferBuilder::LoadFile(const v8::FunctionCallbackInfo<v8::Value> &args, bool paged)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+
+    if (!args[0]->IsString())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a string")));
+        return;
+    }
+
+    size_t threadsCount = 1;
+    if (args[1]->IsNumber())
+    {
+        threadsCount = (size_t)max(1.0, args[1]->NumberValue());
+    }
+
+    v8::String::Utf8Value path(args[0]);
+    edcore::BufferBuilder *builder = (paged ? edcore::BufferBuilder::fromFilePaged(*path, threadsCount) : edcore::BufferBuilder::fromFile(*path, threadsCount));
+    if (builder == NULL)
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Cannot read file")));
+        return;
+    }
+
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+    v8::Local<v8::Function> cons = v8::Local<v8::Function>::New(isolate, constructor);
+    v8::Local<v8::Object> result = cons->NewInstance(context, 0, NULL).ToLocalChecked();
+
+    EdBufferBuilder *obj = ObjectWrap::Unwrap<EdBufferBuilder>(result);
+    delete obj->actual_;
+    obj->actual_ = builder;
+    args.GetReturnValue().Set(result);
+}
+
 void EdBufferBuilder::New(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
     v8::Isolate *isolate = args.GetIsolate();
@@ -89,8 +168,12 @@ void EdBufferBuilder::Init(v8::Local<v8::Object> exports)
 
     // Prototype
     NODE_SET_PROTOTYPE_METHOD(tpl, "AcceptChunk", AcceptChunk);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "AcceptUtf8Chunk", AcceptUtf8Chunk);
     NODE_SET_PROTOTYPE_METHOD(tpl, "Finish", Finish);
     NODE_SET_PROTOTYPE_METHOD(tpl, "Build", Build);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "SetScanLineStartsInBackground", SetScanLineStartsInBackground);
+    NODE_SET_METHOD(tpl, "FromFile", FromFile);
+    NODE_SET_METHOD(tpl, "FromFilePaged", FromFilePaged);
 
     constructor.Reset(isolate, tpl->GetFunction());
     exports->Set(v8::String::NewFromUtf8(isolate, "EdBufferBuilder"),
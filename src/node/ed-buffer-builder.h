@@ -26,8 +26,13 @@ class EdBufferBuilder : public node::ObjectWrap
     static v8::Persistent<v8::Function> constructor;
     static void New(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void AcceptChunk(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void AcceptUtf8Chunk(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void Finish(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void Build(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void SetScanLineStartsInBackground(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void FromFile(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void FromFilePaged(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void LoadFile(const v8::FunctionCallbackInfo<v8::Value> &args, bool paged);
 };
 
 #endif
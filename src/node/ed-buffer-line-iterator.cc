@@ -0,0 +1,150 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "ed-buffer-line-iterator.h"
+
+EdBufferLineIterator::EdBufferLineIterator(edcore::BufferSnapshot *snapshot) : snapshot_(snapshot), actual_(snapshot->tree())
+{
+}
+
+EdBufferLineIterator::~EdBufferLineIterator()
+{
+    delete this->snapshot_;
+}
+
+void EdBufferLineIterator::GetLineNumber(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferLineIterator *obj = ObjectWrap::Unwrap<EdBufferLineIterator>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Number::New(isolate, obj->actual_.lineNumber()));
+}
+
+void EdBufferLineIterator::GetLineLength(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferLineIterator *obj = ObjectWrap::Unwrap<EdBufferLineIterator>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Number::New(isolate, obj->actual_.lineLength()));
+}
+
+void EdBufferLineIterator::Seek(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferLineIterator *obj = ObjectWrap::Unwrap<EdBufferLineIterator>(args.Holder());
+
+    if (!args[0]->IsNumber())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a number")));
+        return;
+    }
+
+    size_t lineNumber = args[0]->NumberValue();
+    if (obj->snapshot_->ensureLineStarts(lineNumber))
+    {
+        obj->actual_.refresh();
+    }
+    args.GetReturnValue().Set(v8::Boolean::New(isolate, obj->actual_.seek(lineNumber)));
+}
+
+void EdBufferLineIterator::Next(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferLineIterator *obj = ObjectWrap::Unwrap<EdBufferLineIterator>(args.Holder());
+
+    // the next line ends at the new line after it
+    if (obj->snapshot_->ensureLineStarts(obj->actual_.lineNumber() + 1))
+    {
+        obj->actual_.refresh();
+    }
+    args.GetReturnValue().Set(v8::Boolean::New(isolate, obj->actual_.next()));
+}
+
+void EdBufferLineIterator::Prev(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferLineIterator *obj = ObjectWrap::Unwrap<EdBufferLineIterator>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Boolean::New(isolate, obj->actual_.prev()));
+}
+
+void EdBufferLineIterator::Read(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferLineIterator *obj = ObjectWrap::Unwrap<EdBufferLineIterator>(args.Holder());
+
+    if (!args[0]->IsUint16Array())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a Uint16Array")));
+        return;
+    }
+
+    // the line is written only if it fits, the caller can grow the array and read again
+    v8::Local<v8::Uint16Array> target = v8::Local<v8::Uint16Array>::Cast(args[0]);
+    const size_t len = obj->actual_.lineLength();
+    if (len <= target->Length())
+    {
+        uint8_t *data = static_cast<uint8_t *>(target->Buffer()->GetContents().Data());
+        obj->actual_.read(reinterpret_cast<uint16_t *>(data + target->ByteOffset()));
+    }
+    args.GetReturnValue().Set(v8::Number::New(isolate, len));
+}
+
+v8::Local<v8::Object> EdBufferLineIterator::Create(v8::Isolate *isolate, edcore::BufferSnapshot *snapshot, size_t lineNumber)
+{
+    // only the lines up to `lineNumber` are scanned, the iterator scans more as it moves on
+    snapshot->ensureLineStarts(lineNumber);
+
+    const int argc = 1;
+    v8::Local<v8::Value> argv[argc] = {v8::External::New(isolate, snapshot)};
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    v8::Local<v8::Function> cons = v8::Local<v8::Function>::New(isolate, EdBufferLineIterator::constructor);
+    v8::Local<v8::Object> result =
+        cons->NewInstance(context, argc, argv).ToLocalChecked();
+    ObjectWrap::Unwrap<EdBufferLineIterator>(result)->actual_.seek(lineNumber);
+    return result;
+}
+
+void EdBufferLineIterator::New(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+
+    if (!args.IsConstructCall() || !args[0]->IsExternal())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Use EdBuffer.CreateLineIterator()")));
+        return;
+    }
+
+    edcore::BufferSnapshot *snapshot = static_cast<edcore::BufferSnapshot *>(v8::Local<v8::External>::Cast(args[0])->Value());
+    EdBufferLineIterator *obj = new EdBufferLineIterator(snapshot);
+    obj->Wrap(args.This());
+    args.GetReturnValue().Set(args.This());
+}
+
+void EdBufferLineIterator::Init(v8::Local<v8::Object> exports)
+{
+    v8::Isolate *isolate = exports->GetIsolate();
+
+    // Prepare constructor template
+    v8::Local<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New(isolate, New);
+    tpl->SetClassName(v8::String::NewFromUtf8(isolate, "EdBufferLineIterator"));
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    // Prototype
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetLineNumber", GetLineNumber);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetLineLength", GetLineLength);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "Seek", Seek);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "Next", Next);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "Prev", Prev);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "Read", Read);
+
+    constructor.Reset(isolate, tpl->GetFunction());
+    exports->Set(v8::String::NewFromUtf8(isolate, "EdBufferLineIterator"),
+                 tpl->GetFunction());
+}
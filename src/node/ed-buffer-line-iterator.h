@@ -0,0 +1,40 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef SRC_ED_BUFFER_LINE_ITERATOR_H_
+#define SRC_ED_BUFFER_LINE_ITERATOR_H_
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include "../core/buffer.h"
+
+/**
+ * Iterates over the lines of a snapshot, so edits to the buffer do not invalidate it.
+ */
+class EdBufferLineIterator : public node::ObjectWrap
+{
+  public:
+    static void Init(v8::Local<v8::Object> exports);
+    static v8::Local<v8::Object> Create(v8::Isolate *isolate, edcore::BufferSnapshot *snapshot, size_t lineNumber);
+
+  private:
+    edcore::BufferSnapshot *snapshot_;
+    edcore::BufferLineIterator actual_;
+
+    explicit EdBufferLineIterator(edcore::BufferSnapshot *snapshot);
+    ~EdBufferLineIterator();
+
+    static v8::Persistent<v8::Function> constructor;
+    static void New(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetLineNumber(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetLineLength(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void Seek(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void Next(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void Prev(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void Read(const v8::FunctionCallbackInfo<v8::Value> &args);
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#include "ed-buffer-snapshot.h"
+#include "ed-buffer-string.h"
+
+EdBufferSnapshot::EdBufferSnapshot(edcore::BufferSnapshot *snapshot)
+{
+    this->actual_ = snapshot;
+}
+
+EdBufferSnapshot::~EdBufferSnapshot()
+{
+    delete this->actual_;
+}
+
+void EdBufferSnapshot::GetLength(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferSnapshot *obj = ObjectWrap::Unwrap<EdBufferSnapshot>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Number::New(isolate, obj->actual_->length()));
+}
+
+void EdBufferSnapshot::GetLineCount(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferSnapshot *obj = ObjectWrap::Unwrap<EdBufferSnapshot>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Number::New(isolate, obj->actual_->lineCount()));
+}
+
+void EdBufferSnapshot::GetLineContent(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBufferSnapshot *obj = ObjectWrap::Unwrap<EdBufferSnapshot>(args.Holder());
+
+    if (!args[0]->IsNumber())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a number")));
+        return;
+    }
+
+    size_t lineNumber = args[0]->NumberValue();
+
+    edcore::BufferCursor start, end;
+    if (!obj->actual_->findLine(lineNumber, start, end))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Line not found")));
+        return;
+    }
+
+    size_t len = end.offset - start.offset;
+    uint16_t *data = new uint16_t[len];
+    obj->actual_->extractString(start, len, data);
+    v8::MaybeLocal<v8::String> res = v8::String::NewExternalTwoByte(isolate, new MyString(data, len));
+    args.GetReturnValue().Set(res.ToLocalChecked() /*TODO*/);
+}
+
+v8::Local<v8::Object> EdBufferSnapshot::Create(v8::Isolate *isolate, edcore::BufferSnapshot *snapshot)
+{
+    const int argc = 1;
+    v8::Local<v8::Value> argv[argc] = {v8::External::New(isolate, snapshot)};
+    v8::Local<v8::Context> context = isolate->GetCurrentContext();
+
+    v8::Local<v8::Function> cons = v8::Local<v8::Function>::New(isolate, EdBufferSnapshot::constructor);
+    v8::Local<v8::Object> result =
+        cons->NewInstance(context, argc, argv).ToLocalChecked();
+    return result;
+}
+
+void EdBufferSnapshot::New(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+
+    if (!args.IsConstructCall() || !args[0]->IsExternal())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Use EdBuffer.CreateSnapshot()")));
+        return;
+    }
+
+    edcore::BufferSnapshot *snapshot = static_cast<edcore::BufferSnapshot *>(v8::Local<v8::External>::Cast(args[0])->Value());
+    EdBufferSnapshot *obj = new EdBufferSnapshot(snapshot);
+    obj->Wrap(args.This());
+    args.GetReturnValue().Set(args.This());
+}
+
+void EdBufferSnapshot::Init(v8::Local<v8::Object> exports)
+{
+    v8::Isolate *isolate = exports->GetIsolate();
+
+    // Prepare constructor template
+    v8::Local<v8::FunctionTemplate> tpl = v8::FunctionTemplate::New(isolate, New);
+    tpl->SetClassName(v8::String::NewFromUtf8(isolate, "EdBufferSnapshot"));
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    // Prototype
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetLength", GetLength);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetLineCount", GetLineCount);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetLineContent", GetLineContent);
+
+    constructor.Reset(isolate, tpl->GetFunction());
+    exports->Set(v8::String::NewFromUtf8(isolate, "EdBufferSnapshot"),
+                 tpl->GetFunction());
+}
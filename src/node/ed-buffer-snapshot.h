@@ -0,0 +1,33 @@
+/*---------------------------------------------------------------------------------------------
+ *  Copyright (c) Microsoft Corporation. All rights reserved.
+ *  Licensed under the MIT License. See License.txt in the project root for license information.
+ *--------------------------------------------------------------------------------------------*/
+
+#ifndef SRC_ED_BUFFER_SNAPSHOT_H_
+#define SRC_ED_BUFFER_SNAPSHOT_H_
+
+#include <node.h>
+#include <node_object_wrap.h>
+
+#include "../core/buffer.h"
+
+class EdBufferSnapshot : public node::ObjectWrap
+{
+  public:
+    static void Init(v8::Local<v8::Object> exports);
+    static v8::Local<v8::Object> Create(v8::Isolate *isolate, edcore::BufferSnapshot *snapshot);
+
+  private:
+    edcore::BufferSnapshot *actual_;
+
+    explicit EdBufferSnapshot(edcore::BufferSnapshot *snapshot);
+    ~EdBufferSnapshot();
+
+    static v8::Persistent<v8::Function> constructor;
+    static void New(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetLength(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetLineCount(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetLineContent(const v8::FunctionCallbackInfo<v8::Value> &args);
+};
+
+#endif
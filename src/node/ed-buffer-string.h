@@ -45,4 +45,17 @@ class v8StringAsBufferString : public edcore::BufferString
     }
 };
 
+class MyString : public v8::String::ExternalStringResource
+{
+  public:
+    MyString(const uint16_t *data, size_t length) : data_(data), length_(length) {}
+    ~MyString() { delete[] data_; }
+    virtual const uint16_t *data() const { return data_; }
+    virtual size_t length() const { return length_; }
+
+  private:
+    const uint16_t *data_;
+    size_t length_;
+};
+
 #endif
@@ -6,31 +6,22 @@
 #include <iostream>
 #include <algorithm>
 #include "ed-buffer.h"
+#include "ed-buffer-snapshot.h"
+#include "ed-buffer-line-iterator.h"
 #include "ed-buffer-string.h"
 #include "../core/buffer-string.h"
 
 using namespace std;
 
-class MyString : public v8::String::ExternalStringResource
-{
-  public:
-    MyString(const uint16_t *data, size_t length) : data_(data), length_(length) {}
-    ~MyString() { delete[] data_; }
-    virtual const uint16_t *data() const { return data_; }
-    virtual size_t length() const { return length_; }
-
-  private:
-    const uint16_t *data_;
-    size_t length_;
-};
-
 EdBuffer::EdBuffer(EdBufferBuilder *builder)
 {
     this->actual_ = builder->BuildBuffer();
+    this->journal_ = new edcore::BufferJournal(this->actual_, 0);
 }
 
 EdBuffer::~EdBuffer()
 {
+    delete this->journal_;
     delete this->actual_;
 }
 
@@ -50,6 +41,14 @@ void EdBuffer::GetLineCount(const v8::FunctionCallbackInfo<v8::Value> &args)
     args.GetReturnValue().Set(v8::Number::New(isolate, obj->actual_->lineCount()));
 }
 
+void EdBuffer::IsLineCountPending(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Boolean::New(isolate, obj->actual_->isLineCountPending()));
+}
+
 void EdBuffer::GetOffsetAt(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
     v8::Isolate *isolate = args.GetIsolate();
@@ -78,6 +77,184 @@ void EdBuffer::GetOffsetAt(const v8::FunctionCallbackInfo<v8::Value> &args)
     args.GetReturnValue().Set(res.ToLocalChecked() /*TODO*/);
 }
 
+void EdBuffer::GetPositionAt(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsNumber())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a number")));
+        return;
+    }
+
+    size_t offset = args[0]->NumberValue();
+
+    size_t lineNumber, column;
+    if (!obj->actual_->findPosition(offset, lineNumber, column))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Invalid position")));
+        return;
+    }
+
+    v8::Local<v8::Object> result = v8::Object::New(isolate);
+    result->Set(ctx, v8::String::NewFromUtf8(isolate, "lineNumber"), v8::Number::New(isolate, lineNumber)).FromJust();
+    result->Set(ctx, v8::String::NewFromUtf8(isolate, "column"), v8::Number::New(isolate, column)).FromJust();
+    args.GetReturnValue().Set(result);
+}
+
+static uint32_t *uint32ArrayData(v8::Local<v8::Uint32Array> arr)
+{
+    uint8_t *data = static_cast<uint8_t *>(arr->Buffer()->GetContents().Data());
+    return reinterpret_cast<uint32_t *>(data + arr->ByteOffset());
+}
+
+static double *float64ArrayData(v8::Local<v8::Float64Array> arr)
+{
+    uint8_t *data = static_cast<uint8_t *>(arr->Buffer()->GetContents().Data());
+    return reinterpret_cast<double *>(data + arr->ByteOffset());
+}
+
+static bool checkSorted(const vector<size_t> &values)
+{
+    for (size_t i = 1, len = values.size(); i < len; i++)
+    {
+        if (values[i - 1] > values[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void EdBuffer::GetPositionsAt(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsFloat64Array() || !args[1]->IsUint32Array() || !args[2]->IsUint32Array())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Arguments must be a Float64Array and two Uint32Arrays")));
+        return;
+    }
+
+    v8::Local<v8::Float64Array> _offsets = v8::Local<v8::Float64Array>::Cast(args[0]);
+    v8::Local<v8::Uint32Array> _lineNumbers = v8::Local<v8::Uint32Array>::Cast(args[1]);
+    v8::Local<v8::Uint32Array> _columns = v8::Local<v8::Uint32Array>::Cast(args[2]);
+    const size_t count = _offsets->Length();
+    if (_lineNumbers->Length() < count || _columns->Length() < count)
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Result arrays are too short")));
+        return;
+    }
+
+    // doubles hold the offsets of buffers larger than 4G
+    const double *offsetsData = float64ArrayData(_offsets);
+    vector<size_t> offsets(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!(offsetsData[i] >= 0))
+        {
+            isolate->ThrowException(v8::Exception::Error(
+                v8::String::NewFromUtf8(isolate, "Invalid position")));
+            return;
+        }
+        offsets[i] = offsetsData[i];
+    }
+    if (!checkSorted(offsets))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Offsets must be sorted")));
+        return;
+    }
+
+    vector<size_t> lineNumbers(count), columns(count);
+    if (!obj->actual_->findPositions(offsets.data(), count, lineNumbers.data(), columns.data()))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Invalid position")));
+        return;
+    }
+    // sorted offsets, so the last position has the largest line number
+    if (count > 0 && lineNumbers[count - 1] > UINT32_MAX)
+    {
+        isolate->ThrowException(v8::Exception::RangeError(
+            v8::String::NewFromUtf8(isolate, "Line number does not fit a Uint32Array")));
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (columns[i] > UINT32_MAX)
+        {
+            isolate->ThrowException(v8::Exception::RangeError(
+                v8::String::NewFromUtf8(isolate, "Column does not fit a Uint32Array")));
+            return;
+        }
+    }
+
+    uint32_t *lineNumbersData = uint32ArrayData(_lineNumbers);
+    uint32_t *columnsData = uint32ArrayData(_columns);
+    for (size_t i = 0; i < count; i++)
+    {
+        lineNumbersData[i] = lineNumbers[i];
+        columnsData[i] = columns[i];
+    }
+}
+
+void EdBuffer::GetOffsetsAt(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsUint32Array() || !args[1]->IsUint32Array() || !args[2]->IsFloat64Array())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Arguments must be two Uint32Arrays and a Float64Array")));
+        return;
+    }
+
+    v8::Local<v8::Uint32Array> _lineNumbers = v8::Local<v8::Uint32Array>::Cast(args[0]);
+    v8::Local<v8::Uint32Array> _columns = v8::Local<v8::Uint32Array>::Cast(args[1]);
+    v8::Local<v8::Float64Array> _offsets = v8::Local<v8::Float64Array>::Cast(args[2]);
+    const size_t count = _lineNumbers->Length();
+    if (_columns->Length() != count || _offsets->Length() < count)
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Arrays have different lengths")));
+        return;
+    }
+
+    const uint32_t *lineNumbersData = uint32ArrayData(_lineNumbers);
+    const uint32_t *columnsData = uint32ArrayData(_columns);
+    vector<size_t> lineNumbers(lineNumbersData, lineNumbersData + count);
+    vector<size_t> columns(columnsData, columnsData + count);
+    if (!checkSorted(lineNumbers))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Line numbers must be sorted")));
+        return;
+    }
+
+    vector<size_t> offsets(count);
+    if (!obj->actual_->findOffsets(lineNumbers.data(), columns.data(), count, offsets.data()))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Line not found")));
+        return;
+    }
+
+    double *offsetsData = float64ArrayData(_offsets);
+    for (size_t i = 0; i < count; i++)
+    {
+        offsetsData[i] = offsets[i];
+    }
+}
+
 void EdBuffer::GetLineContent(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
     v8::Isolate *isolate = args.GetIsolate();
@@ -107,6 +284,107 @@ void EdBuffer::GetLineContent(const v8::FunctionCallbackInfo<v8::Value> &args)
     args.GetReturnValue().Set(res.ToLocalChecked() /*TODO*/);
 }
 
+static v8::Local<v8::Float64Array> offsetsAsFloat64Array(v8::Isolate *isolate, const vector<size_t> &offsets)
+{
+    // doubles hold the offsets of buffers larger than 4G
+    v8::Local<v8::ArrayBuffer> buffer = v8::ArrayBuffer::New(isolate, offsets.size() * sizeof(double));
+    double *data = static_cast<double *>(buffer->GetContents().Data());
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+        data[i] = offsets[i];
+    }
+    return v8::Float64Array::New(buffer, 0, offsets.size());
+}
+
+void EdBuffer::FindAll(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsString())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a string")));
+        return;
+    }
+
+    v8::Local<v8::String> _needle = v8::Local<v8::String>::Cast(args[0]);
+    v8StringAsBufferString needle(_needle);
+    edcore::SearchOptions options;
+    options.ignoreCase = args[1]->BooleanValue();
+    size_t threadsCount = 1;
+    if (args[2]->IsNumber())
+    {
+        threadsCount = (size_t)max(1.0, args[2]->NumberValue());
+    }
+
+    vector<size_t> offsets;
+    obj->actual_->findAll(&needle, options, offsets, threadsCount);
+    args.GetReturnValue().Set(offsetsAsFloat64Array(isolate, offsets));
+}
+
+void EdBuffer::FindNext(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsString() || !args[1]->IsNumber())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Arguments must be a string and a number")));
+        return;
+    }
+
+    v8::Local<v8::String> _needle = v8::Local<v8::String>::Cast(args[0]);
+    v8StringAsBufferString needle(_needle);
+    const size_t offset = args[1]->NumberValue();
+    const bool backward = args[2]->BooleanValue();
+    edcore::SearchOptions options;
+    options.ignoreCase = args[3]->BooleanValue();
+
+    edcore::BufferCursor from;
+    size_t result;
+    if (!obj->actual_->findOffset(offset, from) || !obj->actual_->findNext(&needle, options, from, backward, result))
+    {
+        args.GetReturnValue().Set(v8::Number::New(isolate, -1));
+        return;
+    }
+    args.GetReturnValue().Set(v8::Number::New(isolate, result));
+}
+
+void EdBuffer::FindAllRegex(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsString())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a string")));
+        return;
+    }
+
+    v8::Local<v8::String> _pattern = v8::Local<v8::String>::Cast(args[0]);
+    v8StringAsBufferString pattern(_pattern);
+    edcore::SearchOptions options;
+    options.ignoreCase = args[1]->BooleanValue();
+    size_t threadsCount = 1;
+    if (args[2]->IsNumber())
+    {
+        threadsCount = (size_t)max(1.0, args[2]->NumberValue());
+    }
+
+    vector<size_t> offsets;
+    string error;
+    if (!obj->actual_->findAllRegex(&pattern, options, offsets, error, threadsCount))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, error.c_str())));
+        return;
+    }
+    args.GetReturnValue().Set(offsetsAsFloat64Array(isolate, offsets));
+}
+
 bool compareEdits(edcore::OffsetLenEdit2 &a, edcore::OffsetLenEdit2 &b)
 {
     if (a.offset == b.offset)
@@ -246,7 +524,7 @@ void EdBuffer::ReplaceOffsetLen(const v8::FunctionCallbackInfo<v8::Value> &args)
 
     // printf("mem usage before edit: %lu B = %lf KB\n", obj->actual_->memUsage(), ((double)obj->actual_->memUsage()) / 1024);
 
-    obj->actual_->replaceOffsetLen(edits);
+    obj->journal_->replaceOffsetLen(edits);
 
     // printf("mem usage after edit: %lu B = %lf KB\n", obj->actual_->memUsage(), ((double)obj->actual_->memUsage()) / 1024);
 
@@ -260,6 +538,200 @@ void EdBuffer::ReplaceOffsetLen(const v8::FunctionCallbackInfo<v8::Value> &args)
     // delete []allData;
 }
 
+void EdBuffer::ReplaceAll(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsString() || !args[1]->IsString())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Arguments must be two strings")));
+        return;
+    }
+
+    v8::Local<v8::String> _needle = v8::Local<v8::String>::Cast(args[0]);
+    v8StringAsBufferString needle(_needle);
+    v8::Local<v8::String> _replacement = v8::Local<v8::String>::Cast(args[1]);
+    v8StringAsBufferString replacement(_replacement);
+    edcore::SearchOptions options;
+    options.ignoreCase = args[2]->BooleanValue();
+
+    const size_t count = obj->journal_->replaceAll(&needle, options, &replacement);
+    args.GetReturnValue().Set(v8::Number::New(isolate, count));
+}
+
+void EdBuffer::ReplaceAllRegex(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsString() || !args[1]->IsString())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Arguments must be two strings")));
+        return;
+    }
+
+    v8::Local<v8::String> _pattern = v8::Local<v8::String>::Cast(args[0]);
+    v8StringAsBufferString pattern(_pattern);
+    v8::Local<v8::String> _replacement = v8::Local<v8::String>::Cast(args[1]);
+    v8StringAsBufferString replacement(_replacement);
+    edcore::SearchOptions options;
+    options.ignoreCase = args[2]->BooleanValue();
+
+    size_t count;
+    string error;
+    if (!obj->journal_->replaceAllRegex(&pattern, options, &replacement, count, error))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, error.c_str())));
+        return;
+    }
+    args.GetReturnValue().Set(v8::Number::New(isolate, count));
+}
+
+void EdBuffer::SetUndoMemoryCap(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsNumber())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a number")));
+        return;
+    }
+
+    obj->journal_->setMemoryCap(args[0]->NumberValue());
+}
+
+void EdBuffer::Undo(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Boolean::New(isolate, obj->journal_->undo()));
+}
+
+void EdBuffer::Redo(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Boolean::New(isolate, obj->journal_->redo()));
+}
+
+void EdBuffer::SetPieceTableMode(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsBoolean())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a boolean")));
+        return;
+    }
+
+    obj->actual_->setPieceTableMode(args[0]->BooleanValue());
+}
+
+void EdBuffer::SetSearchIndex(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsBoolean())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a boolean")));
+        return;
+    }
+
+    obj->actual_->setSearchIndex(args[0]->BooleanValue());
+}
+
+void EdBuffer::GetMemUsage(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Number::New(isolate, obj->actual_->memUsage()));
+}
+
+void EdBuffer::CompressColdLeafs(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    args.GetReturnValue().Set(v8::Number::New(isolate, obj->actual_->compressColdLeafs()));
+}
+
+void EdBuffer::SetLeafCacheBudget(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsNumber())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a number")));
+        return;
+    }
+
+    obj->actual_->setLeafCacheBudget(args[0]->NumberValue());
+}
+
+void EdBuffer::GetLeafCacheStats(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    const edcore::LeafCacheStats stats = obj->actual_->leafCacheStats();
+    v8::Local<v8::Object> result = v8::Object::New(isolate);
+    result->Set(ctx, v8::String::NewFromUtf8(isolate, "hits"), v8::Number::New(isolate, stats.hits)).FromJust();
+    result->Set(ctx, v8::String::NewFromUtf8(isolate, "misses"), v8::Number::New(isolate, stats.misses)).FromJust();
+    result->Set(ctx, v8::String::NewFromUtf8(isolate, "memUsage"), v8::Number::New(isolate, stats.memUsage)).FromJust();
+    result->Set(ctx, v8::String::NewFromUtf8(isolate, "budget"), v8::Number::New(isolate, stats.budget)).FromJust();
+    args.GetReturnValue().Set(result);
+}
+
+void EdBuffer::CreateSnapshot(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    v8::Local<v8::Object> result = EdBufferSnapshot::Create(args.GetIsolate(), obj->actual_->snapshot());
+    args.GetReturnValue().Set(result);
+}
+
+void EdBuffer::CreateLineIterator(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+    v8::Isolate *isolate = args.GetIsolate();
+    EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
+
+    if (!args[0]->IsNumber())
+    {
+        isolate->ThrowException(v8::Exception::TypeError(
+            v8::String::NewFromUtf8(isolate, "Argument must be a number")));
+        return;
+    }
+
+    // doesn't wait for the line count of a buffer that is still being scanned
+    size_t lineNumber = args[0]->NumberValue();
+    edcore::BufferCursor start, end;
+    if (lineNumber < 1 || !obj->actual_->findLine(lineNumber, start, end))
+    {
+        isolate->ThrowException(v8::Exception::Error(
+            v8::String::NewFromUtf8(isolate, "Line not found")));
+        return;
+    }
+
+    v8::Local<v8::Object> result = EdBufferLineIterator::Create(isolate, obj->actual_->snapshot(), lineNumber);
+    args.GetReturnValue().Set(result);
+}
+
 void EdBuffer::AssertInvariants(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
     EdBuffer *obj = ObjectWrap::Unwrap<EdBuffer>(args.Holder());
@@ -315,9 +787,29 @@ void EdBuffer::Init(v8::Local<v8::Object> exports)
     // Prototype
     NODE_SET_PROTOTYPE_METHOD(tpl, "GetLength", GetLength);
     NODE_SET_PROTOTYPE_METHOD(tpl, "GetLineCount", GetLineCount);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "IsLineCountPending", IsLineCountPending);
     NODE_SET_PROTOTYPE_METHOD(tpl, "GetOffsetAt", GetOffsetAt);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetPositionAt", GetPositionAt);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetPositionsAt", GetPositionsAt);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetOffsetsAt", GetOffsetsAt);
     NODE_SET_PROTOTYPE_METHOD(tpl, "GetLineContent", GetLineContent);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "FindAll", FindAll);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "FindNext", FindNext);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "FindAllRegex", FindAllRegex);
     NODE_SET_PROTOTYPE_METHOD(tpl, "ReplaceOffsetLen", ReplaceOffsetLen);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "ReplaceAll", ReplaceAll);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "ReplaceAllRegex", ReplaceAllRegex);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "SetUndoMemoryCap", SetUndoMemoryCap);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "Undo", Undo);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "Redo", Redo);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "SetPieceTableMode", SetPieceTableMode);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "SetSearchIndex", SetSearchIndex);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetMemUsage", GetMemUsage);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "CompressColdLeafs", CompressColdLeafs);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "SetLeafCacheBudget", SetLeafCacheBudget);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "GetLeafCacheStats", GetLeafCacheStats);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "CreateSnapshot", CreateSnapshot);
+    NODE_SET_PROTOTYPE_METHOD(tpl, "CreateLineIterator", CreateLineIterator);
     NODE_SET_PROTOTYPE_METHOD(tpl, "AssertInvariants", AssertInvariants);
 
     constructor.Reset(isolate, tpl->GetFunction());
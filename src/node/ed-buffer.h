@@ -10,6 +10,7 @@
 #include <node_object_wrap.h>
 
 #include "../core/buffer.h"
+#include "../core/buffer-journal.h"
 #include "ed-buffer-builder.h"
 
 class EdBuffer : public node::ObjectWrap
@@ -20,6 +21,7 @@ class EdBuffer : public node::ObjectWrap
 
   private:
     edcore::Buffer *actual_;
+    edcore::BufferJournal *journal_;
 
     explicit EdBuffer(EdBufferBuilder *builder);
     ~EdBuffer();
@@ -28,9 +30,29 @@ class EdBuffer : public node::ObjectWrap
     static void New(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void GetLength(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void GetLineCount(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void IsLineCountPending(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void GetOffsetAt(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetPositionAt(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetPositionsAt(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetOffsetsAt(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void GetLineContent(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void FindAll(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void FindNext(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void FindAllRegex(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void ReplaceOffsetLen(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void ReplaceAll(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void ReplaceAllRegex(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void SetUndoMemoryCap(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void Undo(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void Redo(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void SetPieceTableMode(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void SetSearchIndex(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetMemUsage(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void CompressColdLeafs(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void SetLeafCacheBudget(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void GetLeafCacheStats(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void CreateSnapshot(const v8::FunctionCallbackInfo<v8::Value> &args);
+    static void CreateLineIterator(const v8::FunctionCallbackInfo<v8::Value> &args);
     static void AssertInvariants(const v8::FunctionCallbackInfo<v8::Value> &args);
 };
 